@@ -15,24 +15,26 @@
 #include <iostream>
 #include <fstream>
 #include <complex>
+#include <vector>
 
 #include "lime/LimeSuite.h"
 #include "liquid/liquid.h"
 #include "util/log.h"
 #include "util/ws_spectrogram.h"
-#include "util/write_csv_file.h"
+#include "util/IQRecorder.h"
 
 #include <nlohmann/json.hpp>
 #include <cxxopts.hpp>
 
 #include "phy/RadioThread.h"
+#include "phy/IQBus.h"
 #include "phy/LimeRadioThread.h"
 #include "phy/PhyThread.h"
+#include "phy/PhyChannelizerBank.h"
+#include "phy/PhyDSPKernels.h"
 
 #define PORT 8085
 
-#define SPECon true
-
 using json = nlohmann::json;
 
 int main(int argc, const char* argv[])
@@ -52,6 +54,9 @@ int main(int argc, const char* argv[])
                     ("s", "websocket for spectrogram")
                     ("p", "phy testing")
                     ("l", "gpio test")
+                    ("r,record", "record RX IQ to <file>_<n>.sigmf-data", cxxopts::value<std::string>())
+                    ("t,trace", "record frame sync trace events to file", cxxopts::value<std::string>())
+                    ("trace-decode", "decode a frame sync trace file to csv and exit", cxxopts::value<std::string>())
             ;
 
     auto result = options.parse(argc, argv);
@@ -61,6 +66,15 @@ int main(int argc, const char* argv[])
         exit(0);
     }
 
+    if(result.count("trace-decode")) {
+        long n = PhyTrace::decode(result["trace-decode"].as<std::string>(), std::cout);
+        if(n < 0) {
+            std::cerr << "not a frame sync trace file: " << result["trace-decode"].as<std::string>() << std::endl;
+            exit(1);
+        }
+        exit(0);
+    }
+
     LOG_APP_INFO("*                       RPX-100 Backend started                              *");
     LOG_APP_INFO("******************************************************************************");
 
@@ -70,27 +84,156 @@ int main(int argc, const char* argv[])
     json SystemConfig = json::parse(SystemConfigFile);
     SystemConfigFile.close();
 
+    // optional sections - a config without one (e.g. only "Info" and "Radio") gets the defaults of its values
+    auto cf_section = [&SystemConfig](const char *name) { return SystemConfig.value(name, json::object()); };
+
     float_t cf_samp_rate = SystemConfig["Radio"]["SAMPLING_RATE"];
     size_t cf_oversampling = SystemConfig["Radio"]["OVERSAMPLING"];
     float_t cf_center_freq = SystemConfig["Radio"]["CENTER_FREQ"];
+    std::string cf_iq_queue = SystemConfig["Radio"].value("IQ_QUEUE", "ring");
+    size_t cf_iq_pool_blocks = SystemConfig["Radio"].value("IQ_POOL_BLOCKS", DEFAULT_IQBLOCKPOOL_BLOCKS);
+    IQStreamFormat cf_stream_format = iqStreamFormatFromString(SystemConfig["Radio"].value("STREAM_FORMAT", "F32"));
+    size_t cf_rx_channels = SystemConfig["Radio"].value("RX_CHANNELS", DEFAULT_RX_CHANNELS);
+    std::string cf_calibration_cache = SystemConfig["Radio"].value("CALIBRATION_CACHE_FILE", "");
+    unsigned int cf_iq_bus_slots = SystemConfig["Radio"].value("IQ_BUS_SLOTS", IQBUS_DEFAULT_SLOTS);
+    const json cf_phy = cf_section("Phy");
+    std::string cf_sts_detector = cf_phy.value("STS_DETECTOR", "fft");
+    unsigned int cf_tx_lead_frames = cf_phy.value("TX_LEAD_FRAMES", PHY_TX_LEAD_FRAMES);
+    bool cf_diversity_mrc = cf_phy.value("DIVERSITY_MRC", false);
+    const json cf_metrics = cf_section("Metrics");
+    unsigned int cf_metrics_period = cf_metrics.value("PERIOD_MS", METRICS_DEFAULT_PERIOD_MS);
+    std::string cf_metrics_file = cf_metrics.value("PROMETHEUS_FILE", "");
+    bool cf_cpe_pipeline = cf_phy.value("CPE_PIPELINE", true);
+    unsigned int cf_pipeline_depth = cf_phy.value("PIPELINE_QUEUE_DEPTH", PHY_PIPELINE_QUEUE_DEPTH);
+    const json cf_recorder = cf_section("Recorder");
+    std::string cf_rec_format = cf_recorder.value("FORMAT", "cf32");
+    uint64_t cf_rec_rotate_mb = cf_recorder.value("ROTATE_MB", 1024);
+    unsigned int cf_rec_rotate_sec = cf_recorder.value("ROTATE_SEC", 0);
+    bool cf_rec_direct = cf_recorder.value("O_DIRECT", true);
+    const json cf_channelizer_section = cf_section("Channelizer");
+    unsigned int cf_channelizer_channels = cf_channelizer_section.value("CHANNELS", 1);
+    unsigned int cf_channelizer_spectrum = cf_channelizer_section.value("SPECTRUM_CHANNEL", 0);
+    std::vector<unsigned int> cf_channelizer_phys = cf_channelizer_section.value("PHY_CHANNELS", std::vector<unsigned int>());
+    bool cf_sensing = SystemConfig.contains("Sensing") && SystemConfig["Sensing"].value("ENABLED", false);
+    PhySensingConfig cf_sensing_config;
+    if(cf_sensing)
+        cf_sensing_config = SystemConfig["Sensing"].get<PhySensingConfig>();
+    const json cf_spectrum_section = cf_section("Spectrum");
+    unsigned int cf_spectrum_fps = cf_spectrum_section.value("FPS", SPECTRUM_DEFAULT_FPS);
+    SpectrumConfig cf_spectrum;
+    cf_spectrum.nfft = cf_spectrum_section.value("NFFT", SPECTRUM_DEFAULT_NFFT);
+    cf_spectrum.average_ms = cf_spectrum_section.value("AVERAGE_MS", SPECTRUM_DEFAULT_AVERAGE_MS);
+    const json cf_auth = cf_section("Auth");
+    unsigned int cf_auth_workers = cf_auth.value("WORKERS", AUTH_DEFAULT_WORKERS);
+    size_t cf_auth_max_pending = cf_auth.value("MAX_PENDING", AUTH_DEFAULT_MAX_PENDING);
+    uint32_t cf_auth_token_lifetime = cf_auth.value("TOKEN_LIFETIME_S", SESSION_TOKEN_DEFAULT_LIFETIME);
+
+    // cpu affinity / SCHED_FIFO priority of the worker threads
+    auto cf_thread_sched = [&SystemConfig](const char *name) {
+        ThreadSched sched;
+        if(SystemConfig.contains("Threads") && SystemConfig["Threads"].contains(name)) {
+            sched.cpu = SystemConfig["Threads"][name].value("CPU", -1);
+            sched.fifo_priority = SystemConfig["Threads"][name].value("FIFO_PRIORITY", 0);
+        }
+        return sched;
+    };
+    // RX block size / LMS stream tuning per use ("PHY", "CAPTURE") - the profile gives the defaults, single values
+    // override them
+    bool cf_stream_tuning = SystemConfig.contains("Stream");
+    auto cf_stream = [&SystemConfig](const char *use, const char *profile) {
+        RadioStreamConfig config = RadioStreamConfig::profile(profile);
+        if(!SystemConfig.contains("Stream"))
+            return config;
+        const json& stream = SystemConfig["Stream"];
+        const json section = stream.contains(use) ? stream[use] : json::object();
+        config = RadioStreamConfig::profile(section.value("PROFILE", std::string(profile)));
+        config.adaptive = section.value("ADAPTIVE", stream.value("ADAPTIVE", false));
+        config.latency_budget_ms = section.value("LATENCY_BUDGET_MS", config.latency_budget_ms);
+        config.block_samples = section.value("BLOCK_SAMPLES", config.block_samples);
+        config.min_block_samples = section.value("MIN_BLOCK_SAMPLES", config.min_block_samples);
+        config.max_block_samples = section.value("MAX_BLOCK_SAMPLES", config.max_block_samples);
+        config.fifo_size = section.value("FIFO_SIZE", config.fifo_size);
+        config.throughput_vs_latency = section.value("THROUGHPUT_VS_LATENCY", config.throughput_vs_latency);
+        config.min_throughput_vs_latency = section.value("MIN_THROUGHPUT_VS_LATENCY", config.min_throughput_vs_latency);
+        config.max_throughput_vs_latency = section.value("MAX_THROUGHPUT_VS_LATENCY", config.max_throughput_vs_latency);
+        return config;
+    };
+    std::string cf_fft_planner = cf_phy.value("FFT_PLANNER", "estimate");
+    std::string cf_fft_wisdom = cf_phy.value("FFT_WISDOM_FILE", PHY_FFT_WISDOM_FILE);
+    std::string cf_dsp_kernels = cf_phy.value("DSP_KERNELS", "auto");
+
+    // async logging and the runtime levels of the subsystems - the loggers of Log::Init() are replaced before the
+    // worker threads start
+    LogConfig cf_log;
+    if(SystemConfig.contains("Log"))
+        cf_log = SystemConfig["Log"].get<LogConfig>();
+    Log::Configure(cf_log);
+
+    if(result.count("trace"))
+        PhyTrace::start(result["trace"].as<std::string>());
+
+    // FFT plans are shared process wide - load the wisdom of the last run before any plan gets created
+    PhyFFTPlanCache::instance().setPlanner(cf_fft_planner);
+    PhyFFTPlanCache::instance().importWisdom(cf_fft_wisdom);
+
+    // SIMD kernels of the PHY loops - the frame sync / gen keep the set of their construction
+    PhyDSPKernels::select(cf_dsp_kernels);
 
     // create SDR object
     RadioThread *sdr;
 
     // create RX and TX queues to communicate with the SDR object
-    RadioThreadIQDataQueuePtr iqpipe_rx = std::make_shared<RadioThreadIQDataQueue>();
-    iqpipe_rx->set_max_items(2000);
+    // RX goes to the IQ bus - phy, spectrum, channelizer and recorder each subscribe with an own cursor
+    // TX: "ring" is the lock-free SPSC queue, "spinlock" the SpinMutex/std::deque fallback
+    // the max lag of the subscribers stays below the pool of the radio - a stalled subscriber cannot drain it
+    IQBusPtr iqbus_rx = IQBus::create(cf_iq_bus_slots, (unsigned int)cf_iq_pool_blocks);
+    ThreadIQDataQueueBasePtr iqpipe_tx = createRadioThreadIQDataQueue(cf_iq_queue, 2000);
 
-    RadioThreadIQDataQueuePtr iqpipe_tx = std::make_shared<RadioThreadIQDataQueue>();
-    iqpipe_tx->set_max_items(2000);
+    // queue depths are sampled when the metrics are published
+    Metrics::instance().gauge("radio_iqpipe_rx_depth", "IQ blocks referenced by the RX bus").setCallback([iqbus_rx]() { return (int64_t)iqbus_rx->size(); });
+    Metrics::instance().gauge("radio_iqpipe_tx_depth", "IQ blocks in the TX queue").setCallback([iqpipe_tx]() { return (int64_t)iqpipe_tx->size(); });
+    Metrics::instance().start(cf_metrics_period, cf_metrics_file);
 
     // init SDR
     // sdr = new LimeRadioThread();  // default is defined via DEFAULT_SAMPLEBUFFERCNT
     sdr = new LimeRadioThread(3200);  // set to a specifc sampleCnt (# samples RX , # samples TX max)
-    sdr->setRXQueue(iqpipe_rx);
+    // the blocks of the pool bound the block size of the stream tuner
+    RadioStreamConfig cf_stream_capture = cf_stream("CAPTURE", "throughput");
+    sdr->setBlockPool(IQBlockPool::create(cf_iq_pool_blocks, std::max(3200u, cf_stream_capture.max_block_samples)));
+    sdr->setRXQueue(iqbus_rx);
     sdr->setTXQueue(iqpipe_tx);
     sdr->setFrequency(cf_center_freq);
-    sdr->setSamplingRate(cf_samp_rate, cf_oversampling);
+    // with the channelizer (-s) the capture covers all sub-channels
+    const bool channelized = result.count("s") && cf_channelizer_channels > 1;
+    sdr->setSamplingRate(PhyChannelizerBank::captureRate(channelized ? cf_channelizer_channels : 1, cf_samp_rate), cf_oversampling);
+    sdr->setStreamFormat(cf_stream_format);
+    sdr->setRXChannels(cf_rx_channels);     // blocks of channel 1 go to setRXQueue(1, ...) if set
+    if (cf_stream_tuning)
+        sdr->setStreamConfig(cf_stream_capture);   // small blocks for the phy, large ones for spectrum / recorder
+    // restores (or calibrates once) the setting above - later retunes to a cached setting take milliseconds
+    if (!cf_calibration_cache.empty())
+        sdr->setCalibrationCache(cf_calibration_cache);
+    // the settings of the sensing sweep are calibrated before the radio thread streams - a quiet period only
+    // restores them
+    if (cf_sensing) {
+        std::vector<double> frequencies = cf_sensing_config.channels;
+        frequencies.push_back(cf_center_freq);
+        sdr->precalibrate(frequencies);
+    }
+
+    // RX IQ recorder - subscriber of the RX bus, a slow disk only costs the recorder blocks
+    IQRecorder *recorder = nullptr;
+    std::thread *t_recorder = nullptr;
+    if(result.count("record")) {
+        ThreadIQDataQueueBasePtr iqpipe_rec = iqbus_rx->subscribe("recorder", IQBUS_DROP_OLDEST, IQRECORDER_QUEUE_DEPTH);
+        recorder = new IQRecorder(result["record"].as<std::string>());
+        recorder->setFormat(IQRecorder::formatFromString(cf_rec_format));
+        recorder->setRotate(cf_rec_rotate_mb * 1024 * 1024, cf_rec_rotate_sec);
+        recorder->setDirectIO(cf_rec_direct);
+        recorder->setQueue(iqpipe_rec);
+        Metrics::instance().gauge("recorder_queue_depth", "IQ blocks waiting for the recorder").setCallback([iqpipe_rec]() { return (int64_t)iqpipe_rec->size(); });
+        t_recorder = new std::thread(&IQRecorder::threadMain, recorder);
+    }
 
 
     // create SDR Thread
@@ -99,27 +242,58 @@ int main(int argc, const char* argv[])
     //Start RadioThread this is also starting the RX and TX streams
     t_sdr = new std::thread(&RadioThread::threadMain, sdr);
 
+    // polyphase channelizer - the wide capture is split into sub-channels of cf_samp_rate, the spectrum shows one of
+    // them and a CPE PhyThread runs the frame sync on each of PHY_CHANNELS
+    PhyChannelizerBank *channelizer = nullptr;
+    ThreadIQDataQueueBasePtr iqpipe_spectrum;
+
+    if(channelized) {
+        channelizer = new PhyChannelizerBank(cf_channelizer_channels, cf_samp_rate, cf_center_freq, sdr->getBlockPool()->block_capacity());
+        iqpipe_spectrum = channelizer->start(iqbus_rx->subscribe("channelizer", IQBUS_DROP_OLDEST, 0), cf_channelizer_spectrum,
+                                             cf_channelizer_phys, cf_iq_queue, cf_oversampling, [&](PhyThread *subPhy) {
+            subPhy->setSTSDetector(cf_sts_detector == "schmidl-cox" ? PhyFrameSync::STS_DETECTOR_SCHMIDL_COX : PhyFrameSync::STS_DETECTOR_FFT);
+            subPhy->setPipeline(cf_cpe_pipeline, cf_pipeline_depth);
+        });
+    } else if(result.count("s")) {
+        // the spectrum only needs the newest blocks
+        iqpipe_spectrum = iqbus_rx->subscribe("spectrum", IQBUS_LATEST, WS_SPECTROGRAM_QUEUE_DEPTH);
+    }
+
+    std::thread *t_wsspec = nullptr;
+    wsSpectrogram *wsspec = nullptr;
+
     if(result.count("s")) {
         // Start websocket server with IQ stream
-        wsSpectrogram *wsspec;
         wsspec = new wsSpectrogram(PORT);
+        wsspec->setSpectrum(cf_spectrum_fps, cf_spectrum);
+        wsspec->setAuth(cf_auth_workers, cf_auth_max_pending, cf_auth_token_lifetime);
         LOG_APP_INFO("Started WebSocketServer on Port 8085");
-        wsspec->setQueue(iqpipe_rx);
-        std::thread *t_wsspec = nullptr;
+        wsspec->setQueue(iqpipe_spectrum);
         t_wsspec = new std::thread(&wsSpectrogram::threadMain, wsspec);
-        while(SPECon) {
-            //LOG_APP_INFO("Running");
-        }
     }
 
     if(result.count("p")) {
         PhyThread *phy;
-        phy = new PhyThread(PhyThread::PhyMode::TEST);
+        phy = new PhyThread(PhyThread::PhyMode::TEST, cf_samp_rate, cf_oversampling, cf_center_freq);
+        phy->setSTSDetector(cf_sts_detector == "schmidl-cox" ? PhyFrameSync::STS_DETECTOR_SCHMIDL_COX : PhyFrameSync::STS_DETECTOR_FFT);
+        phy->setTxLeadFrames(cf_tx_lead_frames);
+        phy->setRXChannels(cf_rx_channels);
+        phy->setDiversity(cf_diversity_mrc);
+        phy->setPipeline(cf_cpe_pipeline, cf_pipeline_depth);
+        phy->setThreadSched(PhyThread::STAGE_RX, cf_thread_sched("PHY_RX"));
+        phy->setThreadSched(PhyThread::STAGE_SYNC, cf_thread_sched("PHY_SYNC"));
+        phy->setThreadSched(PhyThread::STAGE_DEBUG, cf_thread_sched("PHY_DEBUG"));
+        // the phy gets the samples of sdr from the bus - the sensing engine retunes sdr (precalibrated above)
+        if (cf_sensing)
+            phy->setSensing(cf_sensing_config, sdr);
         LOG_APP_INFO("PHY Layer running");
-        phy->setRXQueue(iqpipe_rx);
+        phy->setRXQueue(iqbus_rx->subscribe("phy", IQBUS_DROP_OLDEST, 0));
         LOG_APP_INFO("RXQueue");
         phy->run(); // this is blocking for testing at the moment
 
+    } else if(t_wsspec != nullptr) {
+        // the spectrum server runs until the process is stopped
+        t_wsspec->join();
     }
 
 
@@ -152,10 +326,35 @@ int main(int argc, const char* argv[])
         LOG_APP_INFO("GPIO testing completed");
     }
 
-    iqpipe_rx->flush();
-    iqpipe_tx->flush();
+    // all threads which log are joined before Log::Shutdown()
+    if(t_wsspec != nullptr) {
+        wsspec->terminate();
+        if(t_wsspec->joinable())
+            t_wsspec->join();
+        delete(t_wsspec);
+    }
+
+    // the TX queue is flushed by the radio thread - it is its only consumer
+    iqbus_rx->flush();
     sdr->terminate();
+    t_sdr->join();
+    delete(t_sdr);
+    if(channelizer != nullptr) {
+        channelizer->stop();
+        delete(channelizer);
+    }
+    if(recorder != nullptr) {
+        recorder->terminate();
+        t_recorder->join();
+        delete(t_recorder);
+        delete(recorder);
+    }
     delete(sdr);
 
+    PhyFFTPlanCache::instance().exportWisdom(cf_fft_wisdom);
+    Metrics::instance().stop();
+    PhyTrace::stop();
+    Log::Shutdown();
+
     return 0;
 }
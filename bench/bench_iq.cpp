@@ -0,0 +1,197 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstring>
+
+#include "liquid/liquid.h"
+
+#include "phy/RadioThread.h"
+#include "phy/IQBlock.h"
+#include "phy/IQConvert.h"
+
+#include "util/SpectrumEngine.h"
+
+
+// producer thread pushes blocks as fast as the queue takes them, the benchmark thread is the consumer
+static void queue_push_pop(benchmark::State& state, const std::string& type) {
+
+    ThreadIQDataQueueBasePtr queue = createRadioThreadIQDataQueue(type, 2000);
+    RadioThreadIQDataPtr block = std::make_shared<RadioThreadIQData>();
+
+    std::atomic_bool stop(false);
+    std::thread producer([&]() {
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (!queue->push(block))
+                std::this_thread::yield();
+        }
+    });
+
+    RadioThreadIQDataPtr item;
+    for (auto _ : state) {
+        while (!queue->pop(item))
+            std::this_thread::yield();
+        benchmark::DoNotOptimize(item);
+    }
+
+    stop.store(true);
+    producer.join();
+    queue->flush();
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+static void BM_RadioThreadIQDataRingQueue_push_pop(benchmark::State& state) { queue_push_pop(state, "ring"); }
+BENCHMARK(BM_RadioThreadIQDataRingQueue_push_pop)->UseRealTime();
+
+static void BM_RadioThreadIQDataQueue_push_pop(benchmark::State& state) { queue_push_pop(state, "spinlock"); }
+BENCHMARK(BM_RadioThreadIQDataQueue_push_pop)->UseRealTime();
+
+
+// producer paced by the block rate of the radio, the consumer sleeps in wait_pop() - wake-up latency per block
+static void BM_RadioThreadIQDataRingQueue_wait_pop(benchmark::State& state) {
+
+    ThreadIQDataQueueBasePtr queue = createRadioThreadIQDataQueue("ring", 2000);
+    RadioThreadIQDataPtr block = std::make_shared<RadioThreadIQData>();
+
+    std::atomic_bool stop(false);
+    std::thread producer([&]() {
+        while (!stop.load(std::memory_order_relaxed)) {
+            queue->push(block);
+            std::this_thread::sleep_for(std::chrono::microseconds(state.range(0)));
+        }
+    });
+
+    RadioThreadIQDataPtr item;
+    for (auto _ : state) {
+        while (!queue->wait_pop(item, IQQUEUE_WAIT_FOREVER));
+        benchmark::DoNotOptimize(item);
+    }
+
+    stop.store(true);
+    producer.join();
+    queue->flush();
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RadioThreadIQDataRingQueue_wait_pop)->Arg(0)->Arg(500)->UseRealTime();
+
+
+static void BM_IQBlockPool_acquire_release(benchmark::State& state) {
+
+    IQBlockPoolPtr pool = IQBlockPool::create(DEFAULT_IQBLOCKPOOL_BLOCKS, 4080);
+
+    for (auto _ : state) {
+        IQBlockPtr b = pool->acquire();
+        benchmark::DoNotOptimize(b);
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_IQBlockPool_acquire_release);
+
+
+// F32 interleave copy of a received block (LMS_RecvStream buffer -> IQ block)
+static void BM_IQ_copy_f32(benchmark::State& state) {
+
+    const size_t n = state.range(0);
+    IQSampleBuffer in(n), out(n);
+    in.resize(n);
+    out.resize(n);
+    std::fill(in.begin(), in.end(), liquid_float_complex(0.25f, -0.25f));
+
+    for (auto _ : state) {
+        std::memcpy(out.data(), in.data(), n * sizeof(liquid_float_complex));
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * n);
+    state.SetBytesProcessed(state.iterations() * n * sizeof(liquid_float_complex));
+}
+BENCHMARK(BM_IQ_copy_f32)->Arg(1300)->Arg(4080);
+
+
+static void BM_IQ_convert_i16_to_cf(benchmark::State& state) {
+
+    const size_t n = state.range(0);
+    std::vector<int16_t> in(2 * n, 1234);
+    IQSampleBuffer out(n);
+    out.resize(n);
+    const float scale = 1.0f / iqStreamFormatFullScale(IQStreamFormat::I16);
+
+    for (auto _ : state) {
+        iq_convert_i16_to_cf(in.data(), out.data(), n, scale);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_IQ_convert_i16_to_cf)->Arg(1300)->Arg(4080);
+
+
+static void BM_IQ_convert_cf_to_i16(benchmark::State& state) {
+
+    const size_t n = state.range(0);
+    IQSampleBuffer in(n);
+    in.resize(n);
+    std::fill(in.begin(), in.end(), liquid_float_complex(0.25f, -0.25f));
+    std::vector<int16_t> out(2 * n);
+    const float scale = iqStreamFormatFullScale(IQStreamFormat::I16) - 1;
+
+    for (auto _ : state) {
+        iq_convert_cf_to_i16(in.data(), out.data(), n, scale, scale);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_IQ_convert_cf_to_i16)->Arg(1300)->Arg(4080);
+
+
+// what wsSpectrogram::run() did per block before the SpectrumEngine: spgramcf object per block, write, get_psd, destroy
+static void BM_wsSpectrogram_spgramcf_psd(benchmark::State& state) {
+
+    const unsigned int nfft = state.range(0);
+    const size_t n = 4080;
+    IQSampleBuffer x(n);
+    x.resize(n);
+    std::fill(x.begin(), x.end(), liquid_float_complex(0.25f, -0.25f));
+    std::vector<float> psd(nfft);
+
+    for (auto _ : state) {
+        spgramcf q = spgramcf_create_default(nfft);
+        spgramcf_write(q, x.data(), n);
+        spgramcf_get_psd(q, psd.data());
+        spgramcf_destroy(q);
+        benchmark::DoNotOptimize(psd.data());
+    }
+
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_wsSpectrogram_spgramcf_psd)->Arg(512)->Arg(2048);
+
+
+// the same blocks through the SpectrumEngine - one persistent spgram, PSD once per frame (25 fps)
+static void BM_SpectrumEngine_push(benchmark::State& state) {
+
+    SpectrumConfig config;
+    config.nfft = state.range(0);
+
+    SpectrumEngine engine(SPECTRUM_DEFAULT_FPS);
+    engine.addConsumer(config);
+    engine.setCallback([](const SpectrumConfig&, const float *psd, uint64_t) { benchmark::DoNotOptimize(psd); });
+
+    const size_t n = 4080;
+    RadioThreadIQDataPtr block = std::make_shared<RadioThreadIQData>(n);
+    block->data.resize(n);
+    std::fill(block->data.begin(), block->data.end(), liquid_float_complex(0.25f, -0.25f));
+
+    for (auto _ : state) {
+        engine.push(block);
+        block->timestampFirstSample += n;
+    }
+
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_SpectrumEngine_push)->Arg(512)->Arg(2048);
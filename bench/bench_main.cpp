@@ -0,0 +1,27 @@
+#include <benchmark/benchmark.h>
+
+#include "util/log.h"
+
+
+#ifndef RPX100_BENCH_PROCESSOR
+#define RPX100_BENCH_PROCESSOR     "unknown"
+#endif
+
+
+// rpx100_bench --benchmark_format=json (or --benchmark_out=<file> --benchmark_out_format=json) for regression
+// tracking; the build and host context (cpu, caches, scaling) is part of the json output
+int main(int argc, char** argv) {
+
+    // only errors - the frame sync logs on every detection otherwise
+    Log::Init(4, "rpx100_bench.log");
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    benchmark::AddCustomContext("rpx100_processor", RPX100_BENCH_PROCESSOR);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    return 0;
+}
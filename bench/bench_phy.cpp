@@ -0,0 +1,275 @@
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "liquid/liquid.h"
+
+#include "phy/DefaultRadioConfig.h"
+#include "phy/PhyDefinitions.h"
+#include "phy/PhyFrameSync.h"
+#include "phy/PhyFrameGen.h"
+#include "phy/PhyOFDMDemod.h"
+#include "phy/PhyOFDMKernels.h"
+#include "phy/PhyDSPKernels.h"
+#include "phy/PhySensing.h"
+#include "phy/PhyIQDebug.h"
+#include "phy/IQBlock.h"
+
+
+// access to the private kernels of PhyFrameSync / PhyFrameGen
+struct PhyFrameSyncBench {
+    static int estimate_gain_STS(PhyFrameSync& q, liquid_float_complex *rc) { return q.estimate_gain_STS(rc, q.m_gain_STSa); }
+    static int STS_metrics(PhyFrameSync& q, liquid_float_complex& s) { return q.STS_metrics(q.m_gain_STSa, s); }
+};
+
+struct PhyFrameGenBench {
+    static int genSymbol(PhyFrameGen& q, liquid_float_complex *buffer) { return q.genSymbol(buffer); }
+};
+
+
+// frames of random QPSK symbols behind the STS preamble with some noise in between - the frame sync sees
+// detection, sync and payload states like on air
+static const IQSampleBuffer& test_signal() {
+
+    static IQSampleBuffer signal;
+
+    if (signal.empty()) {
+        PhyFrameGen gen(PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN);
+
+        const unsigned int num_symbols = 16;
+        const unsigned int frames = 8;
+
+        std::mt19937 rng(1);
+        std::normal_distribution<float> noise(0.0f, 0.01f);
+        std::uniform_int_distribution<int> bit(0, 1);
+
+        std::vector<liquid_float_complex> symbols(num_symbols * PHY_SUBCARRIERS__M);
+        auto block = std::make_shared<IQBlock>();
+
+        for (unsigned int f = 0; f < frames; f++) {
+            for (auto& s : symbols)
+                s = liquid_float_complex(bit(rng) ? M_SQRT1_2 : -M_SQRT1_2, bit(rng) ? M_SQRT1_2 : -M_SQRT1_2);
+
+            gen.create_frame(block, symbols.data(), num_symbols);
+
+            for (size_t i = 0; i < PHY_FRAME_PERIOD_SAMPLES; i++) {
+                liquid_float_complex n(noise(rng), noise(rng));
+                signal.push_back(i < block->data.size() ? block->data[i] + n : n);
+            }
+        }
+    }
+
+    return signal;
+}
+
+
+static void BM_PhyFrameSync_execute_sample(benchmark::State& state) {
+
+    const IQSampleBuffer& x = test_signal();
+    PhyFrameSync sync(PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN);
+    sync.setIQDebug(std::make_shared<PhyIQDebug>());
+
+    size_t i = 0;
+    for (auto _ : state) {
+        sync.m_currentSampleTimestamp = i;
+        sync.execute(x[i % x.size()]);
+        i++;
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PhyFrameSync_execute_sample);
+
+
+static void BM_PhyFrameSync_execute_block(benchmark::State& state) {
+
+    const IQSampleBuffer& x = test_signal();
+    const size_t n = state.range(0);
+    PhyFrameSync sync(PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN);
+    sync.setIQDebug(std::make_shared<PhyIQDebug>());
+
+    uint64_t ts = 0;
+    size_t pos = 0;
+    for (auto _ : state) {
+        if (pos + n > x.size())
+            pos = 0;
+        sync.m_currentSampleTimestamp = ts;
+        sync.execute(x.data() + pos, n);
+        pos += n;
+        ts += n;
+    }
+
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_PhyFrameSync_execute_block)->Arg(1300)->Arg(4080)->Arg(PHY_FRAME_PERIOD_SAMPLES);
+
+
+static void BM_PhyFrameSync_estimate_gain_STS_metrics(benchmark::State& state) {
+
+    PhyFrameGen gen(PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN);
+    PhyFrameSync sync(PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN);
+
+    IQSampleBuffer rc(PHY_SUBCARRIERS__M);
+    rc.resize(PHY_SUBCARRIERS__M);
+    std::copy_n(gen.getSTSTemplate().data() + PHY_CP_STS_LTS, PHY_SUBCARRIERS__M, rc.data());
+
+    liquid_float_complex s_hat;
+    for (auto _ : state) {
+        PhyFrameSyncBench::estimate_gain_STS(sync, rc.data());
+        PhyFrameSyncBench::STS_metrics(sync, s_hat);
+        benchmark::DoNotOptimize(s_hat);
+    }
+
+    state.SetItemsProcessed(state.iterations() * PHY_SUBCARRIERS__M);
+}
+BENCHMARK(BM_PhyFrameSync_estimate_gain_STS_metrics);
+
+
+static void BM_PhyFrameGen_genSymbol(benchmark::State& state) {
+
+    PhyFrameGen gen(PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN);
+    IQSampleBuffer y(gen.getSymbolLength());
+
+    for (auto _ : state) {
+        PhyFrameGenBench::genSymbol(gen, y.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * gen.getSymbolLength());
+}
+BENCHMARK(BM_PhyFrameGen_genSymbol);
+
+
+static void BM_PhyFrameGen_create_STS_symbol(benchmark::State& state) {
+
+    PhyFrameGen gen(PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN);
+    auto tx = std::make_shared<IQBlock>(gen.getSymbolLength());
+    gen.setTXBuffer(tx);
+
+    for (auto _ : state) {
+        gen.create_STS_symbol();
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * gen.getSymbolLength());
+}
+BENCHMARK(BM_PhyFrameGen_create_STS_symbol);
+
+
+static void BM_PhyFrameGen_create_frame(benchmark::State& state) {
+
+    const unsigned int num_symbols = state.range(0);
+    PhyFrameGen gen(PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN);
+    auto block = std::make_shared<IQBlock>(gen.getFrameLength(num_symbols));
+    std::vector<liquid_float_complex> symbols(num_symbols * PHY_SUBCARRIERS__M, liquid_float_complex(M_SQRT1_2, M_SQRT1_2));
+
+    for (auto _ : state) {
+        gen.create_frame(block, symbols.data(), num_symbols);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * gen.getFrameLength(num_symbols));
+}
+BENCHMARK(BM_PhyFrameGen_create_frame)->Arg(1)->Arg(16);
+
+
+// payload symbols per second of the batched demodulation (FFT, equalizer, pilot tracking, soft bits)
+static void BM_PhyOFDMDemod_push(benchmark::State& state) {
+
+    PhyOFDMDemod demod(PHY_SUBCARRIERS__M, PHY_CP_DATA, state.range(0));
+    demod.setModulation(PhyOFDMDemod::MOD_QAM16);
+
+    std::vector<liquid_float_complex> G(PHY_SUBCARRIERS__M, liquid_float_complex(1.0f, 0.0f));
+    demod.start(G.data(), 0);
+
+    const IQSampleBuffer& x = test_signal();
+    const size_t n = (size_t)state.range(0) * (PHY_SUBCARRIERS__M + PHY_CP_DATA);
+    size_t symbols = 0;
+
+    for (auto _ : state) {
+        symbols += demod.push(x.data(), std::min(n, x.size()));
+        benchmark::DoNotOptimize(demod.getSoftBits());
+    }
+
+    state.SetItemsProcessed(symbols);
+}
+BENCHMARK(BM_PhyOFDMDemod_push)->Arg(1)->Arg(PHY_DEMOD_BATCH_SYMBOLS);
+
+
+// sync decision point kernels (STS gain, STS metric, CFO) - range(0) 1: compile-time profile, 0: runtime sized
+static void BM_PhyOFDMKernels_sts(benchmark::State& state) {
+
+    std::unique_ptr<PhyOFDMKernels> kernels;
+    if (state.range(0))
+        kernels = PhyOFDMKernels::create(PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN);
+    else
+        kernels.reset(new PhyOFDMKernelsT<0, 0, 0>(PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN));
+
+    const IQSampleBuffer& x = test_signal();
+    liquid_float_complex *G = kernels->buffer(PhyOFDMKernels::BUF_GAIN_STSA);
+    const liquid_float_complex *S = kernels->buffer(PhyOFDMKernels::BUF_STS);
+
+    for (auto _ : state) {
+        kernels->sts_gain(x.data(), S, G, 0.055f);
+        benchmark::DoNotOptimize(kernels->sts_metrics(G));
+        benchmark::DoNotOptimize(kernels->cfo_correlation(x.data(), S));
+        benchmark::DoNotOptimize(kernels->energy(x.data()));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PhyOFDMKernels_sts)->Arg(0)->Arg(1);
+
+
+// vector kernels of one OFDM symbol per instruction set - range(0) 0: scalar, 1: avx2, 2: neon
+static void BM_PhyDSPKernels(benchmark::State& state) {
+
+    static const char *names[] = {"scalar", "avx2", "neon"};
+    const PhyDSPKernels *dsp = PhyDSPKernels::find(names[state.range(0)]);
+    if (dsp == nullptr) {
+        state.SkipWithError("kernels not supported by this CPU");
+        return;
+    }
+    state.SetLabel(dsp->name);
+
+    const size_t M = PHY_SUBCARRIERS__M;
+    const IQSampleBuffer& x = test_signal();
+    std::vector<liquid_float_complex> y(M);
+    std::vector<float> w(M, 0.5f), psd(M, 0.0f);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(dsp->energy(x.data(), M));
+        dsp->mul_conj(x.data(), &x[M], y.data(), M, 0.055f);
+        benchmark::DoNotOptimize(dsp->dot_conj(&y[4], &y[0], M - 4));
+        dsp->rotate(x.data(), y.data(), M, 0.1f, -0.001f);
+        dsp->window(y.data(), w.data(), y.data(), M);
+        dsp->mag2_acc(y.data(), psd.data(), M);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * M);
+}
+BENCHMARK(BM_PhyDSPKernels)->Arg(0)->Arg(1)->Arg(2);
+
+
+// energy and feature detection of one sensing dwell
+static void BM_PhySensing_detect(benchmark::State& state) {
+
+    PhySensingConfig config;
+    config.channels = { DEFAULT_CENTER_FREQ };
+    config.dwell_samples = state.range(0);
+    PhySensingEngine engine([](double) { return true; }, DEFAULT_CENTER_FREQ, DEFAULT_SAMPLE_RATE, config);
+
+    const IQSampleBuffer& x = test_signal();
+    PhySensingChannel entry;
+
+    for (auto _ : state) {
+        engine.detect(x.data(), config.dwell_samples, entry);
+        benchmark::DoNotOptimize(entry.feature_db);
+    }
+
+    state.SetItemsProcessed(state.iterations() * config.dwell_samples);
+}
+BENCHMARK(BM_PhySensing_detect)->Arg(PHY_SENSING_DWELL_SAMPLES)->Arg(4 * PHY_SENSING_DWELL_SAMPLES);
@@ -15,4 +15,11 @@
 // 0.45 sind laut GUI 33db
 #define DEFAULT_NOM_RX_GAIN 0.45
 
-#define DEFAULT_SAMPLEBUFFERCNT 5000
\ No newline at end of file
+#define DEFAULT_SAMPLEBUFFERCNT 5000
+
+// number of IQ sample blocks preallocated in the IQBlockPool of a radio
+#define DEFAULT_IQBLOCKPOOL_BLOCKS 256
+
+// RX channels streamed at once - the LimeSDR has two RX paths (channel 0 for sync/data, channel 1 e.g. for sensing)
+#define DEFAULT_RX_CHANNELS 1
+#define RADIO_MAX_RX_CHANNELS 2
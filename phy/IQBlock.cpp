@@ -0,0 +1,135 @@
+#include "phy/IQBlock.h"
+#include <algorithm>
+#include <thread>
+
+
+IQBlockPoolPtr IQBlockPool::create(size_t num_blocks, size_t block_capacity) {
+    // constructor is private so that the pool is always owned by a shared_ptr (needed by shared_from_this())
+    return IQBlockPoolPtr(new IQBlockPool(num_blocks, block_capacity));
+}
+
+
+IQBlockPool::IQBlockPool(size_t num_blocks, size_t block_capacity)
+    : m_num_blocks{num_blocks}, m_block_capacity{block_capacity} {
+
+    LOG_RADIO_DEBUG("IQBlockPool() constructor - {} blocks with {} samples", num_blocks, block_capacity);
+
+    // free list size must be a power of two
+    size_t cells = 2;
+    while (cells < m_num_blocks)
+        cells <<= 1;
+
+    m_cell_mask = cells - 1;
+    m_cells = new Cell[cells];
+    for (size_t i = 0; i < cells; i++) {
+        m_cells[i].seq.store(i, std::memory_order_relaxed);
+        m_cells[i].slot = nullptr;
+    }
+
+    m_slots = new Slot[m_num_blocks];
+    for (size_t i = 0; i < m_num_blocks; i++) {
+        m_slots[i].block.data.reserve(m_block_capacity);
+
+        // touch the memory once so that the pages are mapped before streaming starts
+        // (pools with capacity 0 only hand out views, see IQSampleBuffer::attach())
+        if (m_block_capacity > 0) {
+            m_slots[i].block.data.resize(m_block_capacity);
+            std::fill_n(m_slots[i].block.data.data(), m_block_capacity, liquid_float_complex(0.0f, 0.0f));
+            m_slots[i].block.data.clear();
+        }
+
+        push_free(&m_slots[i]);
+    }
+}
+
+
+IQBlockPool::~IQBlockPool() {
+
+    LOG_RADIO_DEBUG("IQBlockPool() de-constructor - {} heap misses", miss_count());
+
+    // all blocks hold a reference to the pool, i.e. when we get here every slot is back in the free list
+    delete[] m_slots;
+    delete[] m_cells;
+}
+
+
+IQBlockPtr IQBlockPool::acquire() {
+
+    Slot *slot = nullptr;
+
+    if (pop_free(slot)) {
+        return IQBlockPtr(&slot->block, SlotDeleter(), SlotAllocator<IQBlock>(slot, shared_from_this()));
+    }
+
+    // pool is exhausted - keep streaming but allocate from the heap
+    if (m_miss_count.fetch_add(1, std::memory_order_relaxed) == 0) {
+        LOG_RADIO_WARN("IQBlockPool::acquire() pool with {} blocks exhausted - allocating from heap", m_num_blocks);
+    }
+
+    return std::make_shared<IQBlock>(m_block_capacity);
+}
+
+
+void IQBlockPool::release(Slot *slot) {
+    // cannot fail as there are never more slots than cells
+    push_free(slot);
+}
+
+
+bool IQBlockPool::push_free(Slot *slot) {
+
+    Cell *cell;
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+
+    for (;;) {
+        cell = &m_cells[pos & m_cell_mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+        if (dif == 0) {
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            // full
+            return false;
+        } else {
+            pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->slot = slot;
+    cell->seq.store(pos + 1, std::memory_order_release);
+
+    return true;
+}
+
+
+bool IQBlockPool::pop_free(Slot *&slot) {
+
+    Cell *cell;
+    size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+
+    for (;;) {
+        cell = &m_cells[pos & m_cell_mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (dif == 0) {
+            if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (dif < 0) {
+            // empty - unless a release() has already claimed this cell and is about to publish it
+            if (m_enqueue_pos.load(std::memory_order_relaxed) == pos)
+                return false;
+            std::this_thread::yield();
+            pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        } else {
+            pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot = cell->slot;
+    cell->seq.store(pos + m_cell_mask + 1, std::memory_order_release);
+
+    return true;
+}
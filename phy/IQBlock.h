@@ -0,0 +1,306 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <complex>
+
+#include "liquid/liquid.h"
+#include "phy/DefaultRadioConfig.h"
+
+#include "util/log.h"
+
+
+// alignment of the IQ sample storage - covers 32 byte AVX and 64 byte cache lines
+#define IQBLOCK_ALIGNMENT           64
+
+// storage reserved per pool slot for the shared_ptr control block
+#define IQBLOCKPOOL_CTRL_SIZE       128
+
+
+/**
+ * IQSampleBuffer class
+ *
+ * @note contiguous, IQBLOCK_ALIGNMENT aligned buffer of liquid_float_complex samples; the storage is allocated
+ *       once with the capacity and only reallocated if a push_back()/resize() goes beyond it
+ * @note liquid_float_complex is layout compatible to interleaved F32 IQ data (IQIQIQ...) so data() can be handed
+ *       to LMS_RecvStream / LMS_SendStream or to liquid functions directly
+ * @note attach() turns the buffer into a non-owning view of external samples (e.g. a memory mapped capture); a
+ *       view is turned into an own copy as soon as it has to grow
+ *
+ */
+class IQSampleBuffer {
+public:
+
+    typedef liquid_float_complex value_type;
+    typedef liquid_float_complex* iterator;
+    typedef const liquid_float_complex* const_iterator;
+
+    IQSampleBuffer() = default;
+
+    explicit IQSampleBuffer(size_t capacity) { reserve(capacity); }
+
+    IQSampleBuffer(const IQSampleBuffer&) = delete;
+
+    IQSampleBuffer& operator=(const IQSampleBuffer&) = delete;
+
+    ~IQSampleBuffer() { if (m_owned) std::free(m_data); }
+
+    /**
+     * @brief make sure the buffer can hold at least capacity samples; existing samples are kept
+     *
+     * @param capacity number of complex samples
+     */
+    void reserve(size_t capacity) {
+
+        if (capacity <= m_capacity)
+            return;
+
+        // aligned_alloc requires the size to be a multiple of the alignment
+        size_t bytes = capacity * sizeof(liquid_float_complex);
+        bytes = (bytes + IQBLOCK_ALIGNMENT - 1) & ~((size_t)IQBLOCK_ALIGNMENT - 1);
+
+        auto *data = static_cast<liquid_float_complex *>(std::aligned_alloc(IQBLOCK_ALIGNMENT, bytes));
+        if (data == nullptr) {
+            throw std::bad_alloc();
+        }
+
+        if (m_data != nullptr) {
+            std::memcpy(data, m_data, m_size * sizeof(liquid_float_complex));
+            if (m_owned)
+                std::free(m_data);
+        }
+
+        m_data = data;
+        m_capacity = bytes / sizeof(liquid_float_complex);
+        m_owned = true;
+    }
+
+    /**
+     * @brief use size samples at data as content of the buffer without copying - data has to stay valid as long as
+     *        the buffer refers to it; own storage is released
+     *
+     * @param data external samples
+     * @param size number of complex samples
+     */
+    void attach(liquid_float_complex *data, size_t size) {
+        if (m_owned)
+            std::free(m_data);
+        m_data = data;
+        m_size = m_capacity = size;
+        m_owned = false;
+    }
+
+    /**
+     * @brief drop a view set by attach(); an owning buffer is only cleared
+     */
+    void detach() {
+        if (m_owned) {
+            m_size = 0;
+            return;
+        }
+        m_data = nullptr;
+        m_size = m_capacity = 0;
+        m_owned = true;
+    }
+
+    bool owned() const { return m_owned; }
+
+    void resize(size_t size) {
+        if (size > m_capacity) {
+            reserve(size);
+        }
+        m_size = size;
+    }
+
+    void clear() { m_size = 0; }
+
+    void push_back(const liquid_float_complex& sample) {
+        if (m_size == m_capacity) {
+            reserve(m_capacity ? 2 * m_capacity : IQBLOCK_ALIGNMENT);
+        }
+        m_data[m_size++] = sample;
+    }
+
+    liquid_float_complex* data() { return m_data; }
+    const liquid_float_complex* data() const { return m_data; }
+
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_capacity; }
+    bool empty() const { return m_size == 0; }
+
+    liquid_float_complex& operator[](size_t i) { return m_data[i]; }
+    const liquid_float_complex& operator[](size_t i) const { return m_data[i]; }
+
+    liquid_float_complex& front() { return m_data[0]; }
+    liquid_float_complex& back() { return m_data[m_size - 1]; }
+
+    iterator begin() { return m_data; }
+    iterator end() { return m_data + m_size; }
+    const_iterator begin() const { return m_data; }
+    const_iterator end() const { return m_data + m_size; }
+
+private:
+
+    liquid_float_complex *m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_capacity = 0;
+    bool m_owned = true;
+
+};
+
+
+/**
+ * IQBlock class
+ *
+ * @note one block of IQ data with timestamp of first sample of block; data is stored contiguous in
+ *       liquid_float_complex; RadioThreadIQData and RadioIQData are both an IQBlock
+ *
+ */
+class IQBlock {
+public:
+    long long frequency;
+    long long sampleRate;
+
+    uint64_t timestampFirstSample;
+
+    // RX channel of the radio the block was received on; blocks of the channels of one radio with the same
+    // timestampFirstSample cover the same samples in time
+    uint8_t channel;
+
+    IQSampleBuffer data;
+
+    IQBlock() :
+            frequency(DEFAULT_CENTER_FREQ), sampleRate(DEFAULT_SAMPLE_RATE), timestampFirstSample(0), channel(0) {
+    }
+
+    explicit IQBlock(size_t capacity) :
+            frequency(DEFAULT_CENTER_FREQ), sampleRate(DEFAULT_SAMPLE_RATE), timestampFirstSample(0), channel(0),
+            data(capacity) {
+    }
+
+    virtual ~IQBlock() = default;
+};
+
+typedef std::shared_ptr<IQBlock> IQBlockPtr;
+
+
+class IQBlockPool;
+typedef std::shared_ptr<IQBlockPool> IQBlockPoolPtr;
+
+/**
+ * IQBlockPool class
+ *
+ * @note preallocates num_blocks IQBlocks of block_capacity samples at startup and hands them out as IQBlockPtr;
+ *       when the last reference to a block is dropped it goes back to the lock-free free list of the pool
+ * @note the shared_ptr control block of each block lives in the pool slot as well, i.e. acquire() and the release
+ *       of a block do not allocate; only when the pool is exhausted acquire() falls back to the heap (miss_count())
+ * @note acquire() and the release of blocks can be done from any thread
+ *
+ */
+class IQBlockPool : public std::enable_shared_from_this<IQBlockPool> {
+public:
+
+    static IQBlockPoolPtr create(size_t num_blocks, size_t block_capacity);
+
+    ~IQBlockPool();
+
+    IQBlockPool(const IQBlockPool&) = delete;
+
+    IQBlockPool& operator=(const IQBlockPool&) = delete;
+
+    /**
+     * @brief get an empty block (size 0) with at least block_capacity() samples of storage
+     *
+     * @return IQBlockPtr
+     */
+    IQBlockPtr acquire();
+
+    size_t num_blocks() const { return m_num_blocks; }
+    size_t block_capacity() const { return m_block_capacity; }
+
+    /**
+     * @brief number of acquire() calls which had to allocate from the heap as the pool was empty
+     *
+     * @return uint64_t
+     */
+    uint64_t miss_count() const { return m_miss_count.load(std::memory_order_relaxed); }
+
+private:
+
+    IQBlockPool(size_t num_blocks, size_t block_capacity);
+
+    struct Slot {
+        IQBlock block;
+        alignas(std::max_align_t) unsigned char ctrl[IQBLOCKPOOL_CTRL_SIZE];
+    };
+
+    // the control block of the shared_ptr is placed in Slot::ctrl; when the control block is deallocated (i.e.
+    // the block is no longer referenced) the slot is handed back to the free list
+    template<class T>
+    struct SlotAllocator {
+        typedef T value_type;
+
+        Slot *slot;
+        IQBlockPoolPtr pool;
+
+        SlotAllocator(Slot *s, IQBlockPoolPtr p) : slot(s), pool(std::move(p)) {}
+
+        template<class U>
+        SlotAllocator(const SlotAllocator<U>& other) : slot(other.slot), pool(other.pool) {}
+
+        T* allocate(size_t n) {
+            static_assert(sizeof(T) <= IQBLOCKPOOL_CTRL_SIZE, "IQBLOCKPOOL_CTRL_SIZE too small for control block");
+            static_assert(alignof(T) <= alignof(std::max_align_t), "control block alignment not supported");
+            assert(n == 1);
+            return reinterpret_cast<T*>(slot->ctrl);
+        }
+
+        void deallocate(T*, size_t) {
+            pool->release(slot);
+        }
+
+        template<class U>
+        bool operator==(const SlotAllocator<U>& other) const { return slot == other.slot; }
+
+        template<class U>
+        bool operator!=(const SlotAllocator<U>& other) const { return slot != other.slot; }
+    };
+
+    struct SlotDeleter {
+        void operator()(IQBlock *block) const {
+            block->data.detach();
+            block->timestampFirstSample = 0;
+            block->channel = 0;
+        }
+    };
+
+    // bounded lock-free MPMC queue (D. Vyukov) used as free list
+    struct Cell {
+        std::atomic<size_t> seq;
+        Slot *slot;
+    };
+
+    bool push_free(Slot *slot);
+    bool pop_free(Slot *&slot);
+
+    void release(Slot *slot);
+
+    const size_t m_num_blocks;
+    const size_t m_block_capacity;
+
+    Slot *m_slots = nullptr;
+
+    Cell *m_cells = nullptr;
+    size_t m_cell_mask = 0;
+
+    alignas(IQBLOCK_ALIGNMENT) std::atomic<size_t> m_enqueue_pos{0};
+    alignas(IQBLOCK_ALIGNMENT) std::atomic<size_t> m_dequeue_pos{0};
+
+    alignas(IQBLOCK_ALIGNMENT) std::atomic<uint64_t> m_miss_count{0};
+
+};
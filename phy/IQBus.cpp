@@ -0,0 +1,242 @@
+#include "phy/IQBus.h"
+
+#include <algorithm>
+
+
+IQBus::IQBus(unsigned int slots, unsigned int pool_blocks) {
+
+    m_num_slots = 2;
+    while (m_num_slots < slots)
+        m_num_slots <<= 1;
+    m_mask = m_num_slots - 1;
+
+    // one slot is left to the producer - the block at the max lag cannot be overwritten while it is read
+    m_max_lag_limit = (unsigned int)m_num_slots - 1;
+    if (pool_blocks > 0) {
+        const unsigned int pool_limit = pool_blocks > 2 * IQBUS_POOL_HEADROOM ? pool_blocks - IQBUS_POOL_HEADROOM : std::max(pool_blocks / 2, 1u);
+        m_max_lag_limit = std::min(m_max_lag_limit, pool_limit);
+    }
+
+    m_slots.reset(new Slot[m_num_slots]);
+
+    LOG_RADIO_DEBUG("IQBus() constructor - {} slots, max lag {} blocks", m_num_slots, m_max_lag_limit);
+}
+
+
+IQBusPtr IQBus::create(unsigned int slots, unsigned int pool_blocks) {
+    return IQBusPtr(new IQBus(slots, pool_blocks));
+}
+
+
+IQBus::~IQBus() {
+    LOG_RADIO_DEBUG("IQBus() de-constructor - {} blocks published", m_write_seq.load());
+}
+
+
+IQBusSubscriberPtr IQBus::subscribe(const std::string& name, IQBusPolicy policy, unsigned int max_lag) {
+
+    std::lock_guard<std::mutex> lock(m_subscribers_mutex);
+
+    // the producer adds the subscriber to the release with the next push - it starts behind the last block
+    IQBusSubscriberPtr subscriber(new IQBusSubscriber(shared_from_this(), name, policy, max_lag, m_write_seq.load(std::memory_order_acquire)));
+    m_subscribers.push_back(subscriber.get());
+
+    LOG_RADIO_INFO("IQBus::subscribe() {} - {} policy, max lag {} blocks, {} subscribers", name,
+                   policy == IQBUS_LATEST ? "latest" : "drop oldest", subscriber->m_max_lag.load(), m_subscribers.size());
+
+    return subscriber;
+}
+
+
+size_t IQBus::subscribers() {
+    std::lock_guard<std::mutex> lock(m_subscribers_mutex);
+    return m_subscribers.size();
+}
+
+
+void IQBus::detach(IQBusSubscriber *subscriber) {
+
+    std::lock_guard<std::mutex> lock(m_subscribers_mutex);
+
+    m_subscribers.erase(std::remove(m_subscribers.begin(), m_subscribers.end(), subscriber), m_subscribers.end());
+
+    LOG_RADIO_INFO("IQBus unsubscribe {} - {} blocks skipped, {} subscribers", subscriber->name(), subscriber->overflow_count(), m_subscribers.size());
+}
+
+
+void IQBus::set_max_items(unsigned int max_items) {
+    // the ring is sized in create() - the producer side has no limit
+    LOG_RADIO_DEBUG("IQBus::set_max_items() {} ignored - {} slots", max_items, m_num_slots);
+}
+
+
+bool IQBus::push(const value_type& item) {
+
+    const uint64_t seq = m_write_seq.load(std::memory_order_relaxed);
+
+    {
+        Slot& slot = m_slots[seq & m_mask];
+        std::lock_guard<SpinMutex> lock(slot.mutex);
+        slot.block = item;
+        slot.seq = seq;
+    }
+
+    m_write_seq.store(seq + 1, std::memory_order_release);
+    m_metric_blocks.add();
+
+    std::lock_guard<std::mutex> lock(m_subscribers_mutex);
+
+    for (IQBusSubscriber *subscriber : m_subscribers)
+        subscriber->published();
+
+    release(release_bound(seq + 1));
+
+    return true;
+}
+
+
+uint64_t IQBus::release_bound(uint64_t written) {
+
+    // a subscriber more than its max lag behind skips to written - max lag (or further) with the next pop()
+    uint64_t upto = written;
+    for (IQBusSubscriber *subscriber : m_subscribers) {
+        const uint64_t read = subscriber->m_read_seq.load(std::memory_order_acquire);
+        const uint64_t max_lag = subscriber->m_max_lag.load(std::memory_order_relaxed);
+        const uint64_t first = written > max_lag ? std::max(read, written - max_lag) : read;
+        upto = std::min(upto, first);
+    }
+    return upto;
+}
+
+
+void IQBus::release(uint64_t upto) {
+
+    // slots further back are overwritten already
+    uint64_t released = m_released.load(std::memory_order_relaxed);
+    const uint64_t written = m_write_seq.load(std::memory_order_relaxed);
+    if (written > m_num_slots)
+        released = std::max(released, written - m_num_slots);
+
+    for (; released < upto; released++) {
+        Slot& slot = m_slots[released & m_mask];
+        std::lock_guard<SpinMutex> lock(slot.mutex);
+        if (slot.seq == released)
+            slot.block.reset();
+    }
+
+    m_released.store(released, std::memory_order_release);
+}
+
+
+bool IQBus::read(uint64_t seq, value_type& item) {
+
+    Slot& slot = m_slots[seq & m_mask];
+    std::lock_guard<SpinMutex> lock(slot.mutex);
+
+    if (slot.seq != seq || slot.block == nullptr)
+        return false;
+
+    item = slot.block;
+    return true;
+}
+
+
+bool IQBus::pop(value_type& item) {
+    // consumers read through their IQBusSubscriber
+    return false;
+}
+
+
+void IQBus::flush() {
+
+    std::lock_guard<std::mutex> lock(m_subscribers_mutex);
+
+    const uint64_t written = m_write_seq.load(std::memory_order_acquire);
+    for (IQBusSubscriber *subscriber : m_subscribers)
+        subscriber->m_read_seq.store(written, std::memory_order_release);
+
+    release(written);
+}
+
+
+IQBus::size_type IQBus::size() const {
+    const uint64_t written = m_write_seq.load(std::memory_order_acquire);
+    const uint64_t released = m_released.load(std::memory_order_acquire);
+    return (size_type)std::min<uint64_t>(written - std::min(released, written), m_num_slots);
+}
+
+
+void IQBus::print_size() {
+    LOG_RADIO_DEBUG("IQBus() {} blocks referenced, {} subscribers", size(), subscribers());
+}
+
+
+
+IQBusSubscriber::IQBusSubscriber(const IQBusPtr& bus, const std::string& name, IQBusPolicy policy, unsigned int max_lag, uint64_t start)
+        : m_bus(bus), m_name(name), m_policy(policy), m_max_lag(0), m_read_seq(start) {
+    set_max_items(max_lag);
+}
+
+
+IQBusSubscriber::~IQBusSubscriber() {
+    m_bus->detach(this);
+}
+
+
+void IQBusSubscriber::set_max_items(unsigned int max_items) {
+    // below the ring size and the pool of the producer
+    const unsigned int limit = m_bus->max_lag_limit();
+    m_max_lag.store(max_items == 0 || max_items > limit ? limit : max_items);
+}
+
+
+bool IQBusSubscriber::push(const value_type& item) {
+    LOG_RADIO_ERROR("IQBusSubscriber::push() {} - the producer pushes to the IQBus", m_name);
+    return false;
+}
+
+
+bool IQBusSubscriber::pop(value_type& item) {
+
+    uint64_t seq = m_read_seq.load(std::memory_order_relaxed);
+
+    for (;;) {
+        const uint64_t written = m_bus->m_write_seq.load(std::memory_order_acquire);
+        if (seq >= written)
+            return false;
+
+        // too far behind - skip according to the policy
+        const unsigned int max_lag = m_max_lag.load(std::memory_order_relaxed);
+        if (written - seq > max_lag) {
+            const uint64_t next = m_policy == IQBUS_LATEST ? written - 1 : written - max_lag;
+            m_overflow_count.fetch_add(next - seq, std::memory_order_relaxed);
+            m_bus->m_metric_dropped.add(next - seq);
+            seq = next;
+        }
+
+        if (m_bus->read(seq, item)) {
+            m_read_seq.store(seq + 1, std::memory_order_release);
+            return true;
+        }
+
+        // overwritten while the lag was checked - the next pass skips it
+        seq++;
+    }
+}
+
+
+void IQBusSubscriber::flush() {
+    m_read_seq.store(m_bus->m_write_seq.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+
+IQBusSubscriber::size_type IQBusSubscriber::size() const {
+    const uint64_t written = m_bus->m_write_seq.load(std::memory_order_acquire);
+    const uint64_t seq = m_read_seq.load(std::memory_order_acquire);
+    return seq >= written ? 0 : (size_type)std::min<uint64_t>(written - seq, m_max_lag.load(std::memory_order_relaxed));
+}
+
+
+void IQBusSubscriber::print_size() {
+    LOG_RADIO_DEBUG("IQBusSubscriber() {} size {} skipped {}", m_name, size(), overflow_count());
+}
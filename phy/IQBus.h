@@ -0,0 +1,185 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "phy/RadioThread.h"
+
+#include "util/log.h"
+#include "util/Metrics.h"
+
+
+#define IQBUS_DEFAULT_SLOTS         1024        // blocks of the shared ring (~1.4 s of 3200 sample blocks at 2.28 MSps)
+#define IQBUS_POOL_HEADROOM         32          // IQBlockPool blocks the ring never references (radio, blocks in use)
+
+
+class IQBus;
+class IQBusSubscriber;
+
+typedef std::shared_ptr<IQBus> IQBusPtr;
+typedef std::shared_ptr<IQBusSubscriber> IQBusSubscriberPtr;
+
+
+/**
+ * @brief what a subscriber loses when it falls behind by more than its max lag
+ */
+typedef enum {
+    IQBUS_DROP_OLDEST=0,        // continue max lag blocks behind the producer - gap, stream continues (phy, recorder)
+    IQBUS_LATEST                // continue with the newest block - only fresh data matters (spectrum)
+} IQBusPolicy;
+
+
+/**
+ * IQBus class
+ *
+ * @note single producer / multi consumer broadcast of IQ blocks: the producer (e.g. the radio thread, set as its RX
+ *       queue) pushes each block once into a shared ring of block references, every subscriber reads the ring with
+ *       an own cursor - the blocks are shared, not copied
+ * @note the producer never waits: push() always succeeds, a subscriber which is more than its max lag behind
+ *       skips blocks according to its policy (counted in its overflow_count())
+ * @note subscribe() / unsubscribe at runtime (the subscriber detaches in its destructor) - a new subscriber starts
+ *       with the next pushed block
+ * @note the ring only keeps the references a subscriber may still read - not older than its read cursor and not
+ *       more than its max lag behind the producer - i.e. blocks go back to the IQBlockPool as soon as all
+ *       subscribers are through; a stalled subscriber holds at most its max lag
+ * @note with the pool size given to create() the max lag of all subscribers stays IQBUS_POOL_HEADROOM blocks below
+ *       it, i.e. a stalled subscriber cannot drain the pool of the radio
+ * @note the bus itself has no consumer: pop() returns false and size() is the number of blocks referenced by the ring
+ *
+ */
+class IQBus : public ThreadIQDataQueueBase, public std::enable_shared_from_this<IQBus> {
+public:
+
+    /**
+     * @param slots ring size - rounded up to a power of two; the max lag of a subscriber is below it
+     * @param pool_blocks blocks of the IQBlockPool of the producer - bounds the max lag as well (0: no pool bound)
+     */
+    static IQBusPtr create(unsigned int slots = IQBUS_DEFAULT_SLOTS, unsigned int pool_blocks = 0);
+
+    ~IQBus() override;
+
+    /**
+     * @brief new subscriber - a ThreadIQDataQueueBase for the consumer side (pop(), wait_pop(), pop_n(), size())
+     *
+     * @param name for logging
+     * @param policy
+     * @param max_lag blocks the subscriber may fall behind before it skips (0 or too large: slots - 1)
+     * @return IQBusSubscriberPtr
+     */
+    IQBusSubscriberPtr subscribe(const std::string& name, IQBusPolicy policy, unsigned int max_lag);
+
+    unsigned int slots() const { return (unsigned int)m_num_slots; }
+
+    /**
+     * @brief upper bound of the max lag of a subscriber
+     */
+    unsigned int max_lag_limit() const { return m_max_lag_limit; }
+
+    size_t subscribers();
+
+    // ThreadIQDataQueueBase - producer side
+    void set_max_items(unsigned int max_items) override;
+
+    bool push(const value_type& item) override;
+
+    bool pop(value_type& item) override;
+
+    /**
+     * @brief moves all subscribers to the newest block and drops the references of the ring
+     */
+    void flush() override;
+
+    size_type size() const override;
+
+    void print_size() override;
+
+private:
+
+    friend class IQBusSubscriber;
+
+    IQBus(unsigned int slots, unsigned int pool_blocks);
+
+    struct Slot {
+        SpinMutex mutex;
+        uint64_t seq = UINT64_MAX;
+        RadioThreadIQDataPtr block;
+    };
+
+    // copy of the block with sequence number seq - false if the slot was overwritten meanwhile
+    bool read(uint64_t seq, value_type& item);
+
+    void detach(IQBusSubscriber *subscriber);
+
+    // drops the references of the blocks below upto - called with m_subscribers_mutex
+    void release(uint64_t upto);
+
+    // first block a subscriber may still read - m_subscribers_mutex
+    uint64_t release_bound(uint64_t written);
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_num_slots;
+    uint64_t m_mask;
+    unsigned int m_max_lag_limit;
+
+    alignas(IQQUEUE_CACHE_LINE_SIZE) std::atomic<uint64_t> m_write_seq{0};
+    std::atomic<uint64_t> m_released{0};    // slots below are released - written with m_subscribers_mutex
+
+    std::mutex m_subscribers_mutex;
+    std::vector<IQBusSubscriber *> m_subscribers;
+
+    MetricCounter& m_metric_blocks = Metrics::instance().counter("iqbus_blocks_total", "IQ blocks published on the IQ bus");
+    MetricCounter& m_metric_dropped = Metrics::instance().counter("iqbus_subscriber_dropped_total", "IQ blocks skipped by slow IQ bus subscribers");
+
+};
+
+
+/**
+ * IQBusSubscriber class
+ *
+ * @note read cursor of one consumer on an IQBus - used like any other IQ queue by one consumer thread; keeps the
+ *       bus alive
+ * @note set_max_items() changes the max lag, flush() moves the cursor to the newest block
+ *
+ */
+class IQBusSubscriber : public ThreadIQDataQueueBase {
+public:
+
+    ~IQBusSubscriber() override;
+
+    const std::string& name() const { return m_name; }
+
+    IQBusPolicy policy() const { return m_policy; }
+
+    void set_max_items(unsigned int max_items) override;
+
+    bool push(const value_type& item) override;
+
+    bool pop(value_type& item) override;
+
+    void flush() override;
+
+    size_type size() const override;
+
+    void print_size() override;
+
+private:
+
+    friend class IQBus;
+
+    IQBusSubscriber(const IQBusPtr& bus, const std::string& name, IQBusPolicy policy, unsigned int max_lag, uint64_t start);
+
+    void published() { notify(); }
+
+    const IQBusPtr m_bus;
+    const std::string m_name;
+    const IQBusPolicy m_policy;
+    std::atomic<unsigned int> m_max_lag;
+
+    // next block to read - written by the consumer, read by the producer for the release of the ring slots
+    alignas(IQQUEUE_CACHE_LINE_SIZE) std::atomic<uint64_t> m_read_seq;
+
+};
@@ -0,0 +1,131 @@
+#include "phy/IQConvert.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+
+IQStreamFormat iqStreamFormatFromString(const std::string& name) {
+    if (name == "I12" || name == "i12")
+        return IQStreamFormat::I12;
+    if (name == "I16" || name == "i16")
+        return IQStreamFormat::I16;
+    return IQStreamFormat::F32;
+}
+
+const char* iqStreamFormatName(IQStreamFormat format) {
+    switch (format) {
+    case IQStreamFormat::I12: return "I12";
+    case IQStreamFormat::I16: return "I16";
+    default: return "F32";
+    }
+}
+
+float iqStreamFormatFullScale(IQStreamFormat format) {
+    switch (format) {
+    case IQStreamFormat::I12: return 2048.0f;
+    case IQStreamFormat::I16: return 32768.0f;
+    default: return 1.0f;
+    }
+}
+
+
+void iq_convert_i16_to_cf(const int16_t *in, liquid_float_complex *out, size_t n, float scale) {
+
+    float *pout = reinterpret_cast<float *>(out);
+    const size_t values = 2 * n;     // I and Q
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256 vscale = _mm256_set1_ps(scale);
+    for (; i + 16 <= values; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i + 8));
+        __m256 fa = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(a)), vscale);
+        __m256 fb = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(b)), vscale);
+        _mm256_storeu_ps(pout + i, fa);
+        _mm256_storeu_ps(pout + i + 8, fb);
+    }
+#elif defined(__SSE2__)
+    const __m128 vscale = _mm_set1_ps(scale);
+    for (; i + 8 <= values; i += 8) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+        // sign extend int16 -> int32 by placing the value in the upper half and shifting back
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16);
+        _mm_storeu_ps(pout + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), vscale));
+        _mm_storeu_ps(pout + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), vscale));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 8 <= values; i += 8) {
+        int16x8_t a = vld1q_s16(in + i);
+        float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(a)));
+        float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(a)));
+        vst1q_f32(pout + i, vmulq_n_f32(lo, scale));
+        vst1q_f32(pout + i + 4, vmulq_n_f32(hi, scale));
+    }
+#endif
+
+    for (; i < values; i++) {
+        pout[i] = (float)in[i] * scale;
+    }
+}
+
+
+void iq_convert_cf_to_i16(const liquid_float_complex *in, int16_t *out, size_t n, float scale, float limit) {
+
+    const float *pin = reinterpret_cast<const float *>(in);
+    const size_t values = 2 * n;     // I and Q
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256 vscale = _mm256_set1_ps(scale);
+    const __m256 vmax = _mm256_set1_ps(limit);
+    const __m256 vmin = _mm256_set1_ps(-limit);
+    for (; i + 16 <= values; i += 16) {
+        __m256 fa = _mm256_mul_ps(_mm256_loadu_ps(pin + i), vscale);
+        __m256 fb = _mm256_mul_ps(_mm256_loadu_ps(pin + i + 8), vscale);
+        fa = _mm256_min_ps(_mm256_max_ps(fa, vmin), vmax);
+        fb = _mm256_min_ps(_mm256_max_ps(fb, vmin), vmax);
+        // packs works per 128 bit lane - restore the sample order afterwards
+        __m256i p = _mm256_packs_epi32(_mm256_cvtps_epi32(fa), _mm256_cvtps_epi32(fb));
+        p = _mm256_permute4x64_epi64(p, 0xD8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), p);
+    }
+#elif defined(__SSE2__)
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128 vmax = _mm_set1_ps(limit);
+    const __m128 vmin = _mm_set1_ps(-limit);
+    for (; i + 8 <= values; i += 8) {
+        __m128 fa = _mm_mul_ps(_mm_loadu_ps(pin + i), vscale);
+        __m128 fb = _mm_mul_ps(_mm_loadu_ps(pin + i + 4), vscale);
+        fa = _mm_min_ps(_mm_max_ps(fa, vmin), vmax);
+        fb = _mm_min_ps(_mm_max_ps(fb, vmin), vmax);
+        __m128i p = _mm_packs_epi32(_mm_cvtps_epi32(fa), _mm_cvtps_epi32(fb));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), p);
+    }
+#elif defined(__aarch64__)
+    const float32x4_t vmax = vdupq_n_f32(limit);
+    const float32x4_t vmin = vdupq_n_f32(-limit);
+    for (; i + 8 <= values; i += 8) {
+        float32x4_t fa = vmulq_n_f32(vld1q_f32(pin + i), scale);
+        float32x4_t fb = vmulq_n_f32(vld1q_f32(pin + i + 4), scale);
+        fa = vminq_f32(vmaxq_f32(fa, vmin), vmax);
+        fb = vminq_f32(vmaxq_f32(fb, vmin), vmax);
+        int16x8_t p = vcombine_s16(vqmovn_s32(vcvtnq_s32_f32(fa)), vqmovn_s32(vcvtnq_s32_f32(fb)));
+        vst1q_s16(out + i, p);
+    }
+#endif
+
+    for (; i < values; i++) {
+        float v = std::min(std::max(pin[i] * scale, -limit), limit);
+        out[i] = (int16_t)std::lrintf(v);
+    }
+}
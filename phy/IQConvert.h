@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include "liquid/liquid.h"
+
+
+/**
+ * IQStreamFormat
+ *
+ * @note host side sample format of the LMS stream; I12 and I16 are both delivered as interleaved int16_t, i.e. half
+ *       the host buffer of F32 and no float conversion in LimeSuite
+ * @note the USB link carries 12 bit samples for F32 and I12 (LMS_LINK_FMT_I12) and 16 bit samples for I16 - the
+ *       host format does not reduce the link bandwidth below the I12 packing
+ *
+ */
+enum class IQStreamFormat {
+    F32,
+    I16,
+    I12
+};
+
+
+/**
+ * @brief parse "F32", "I16" or "I12" (e.g. SystemConfig Radio/STREAM_FORMAT); unknown strings fall back to F32
+ *
+ * @param name
+ * @return IQStreamFormat
+ */
+IQStreamFormat iqStreamFormatFromString(const std::string& name);
+
+const char* iqStreamFormatName(IQStreamFormat format);
+
+/**
+ * @brief full scale of the integer formats - 2048 for I12, 32768 for I16 and 1 for F32
+ *
+ * @param format
+ * @return float
+ */
+float iqStreamFormatFullScale(IQStreamFormat format);
+
+
+/**
+ * @brief convert n interleaved int16 IQ samples (2*n int16_t) to liquid_float_complex, out = in * scale
+ *
+ * @note SSE2/AVX2 on x86 and NEON on ARM, otherwise scalar; out has to hold n complex samples
+ *
+ * @param in interleaved IQIQIQ... int16_t
+ * @param out
+ * @param n number of complex samples
+ * @param scale e.g. 1.0f / iqStreamFormatFullScale(format)
+ */
+void iq_convert_i16_to_cf(const int16_t *in, liquid_float_complex *out, size_t n, float scale);
+
+/**
+ * @brief convert n liquid_float_complex samples to interleaved int16 IQ, out = round(in * scale) saturated to
+ *        [-limit, limit]
+ *
+ * @param in
+ * @param out interleaved IQIQIQ... int16_t, has to hold 2*n values
+ * @param n number of complex samples
+ * @param scale e.g. iqStreamFormatFullScale(format) - 1
+ * @param limit e.g. iqStreamFormatFullScale(format) - 1
+ */
+void iq_convert_cf_to_i16(const liquid_float_complex *in, int16_t *out, size_t n, float scale, float limit);
@@ -0,0 +1,260 @@
+#include "phy/LimeCalibrationCache.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <nlohmann/json.hpp>
+
+
+// LMS7002M register map (see LMS7002M datasheet / LMS7002M_parameters.h)
+#define LMS7_REG_MAC            0x0020      // bits 1:0 select channel A (1) / B (2) for the per channel registers
+#define LMS7_REG_SX_VCO_CMP     0x0123      // bit 13 VCO_CMPHO, bit 12 VCO_CMPLO
+#define LMS7_MAC_A              1
+#define LMS7_MAC_B              2
+
+// per SX (MAC A = SXR, MAC B = SXT): PLL config, FRAC_SDM, INT_SDM, dividers, VCO bias, CSW_VCO / SEL_VCO, ...
+static const uint16_t s_sx_registers[] = {0x011C, 0x011D, 0x011E, 0x011F, 0x0120, 0x0121, 0x0122, 0x0123, 0x0124};
+
+// per channel: TxTSP GCORRQ, GCORRI, IQCORR, DCCORRI/Q; RxTSP GCORRQ, GCORRI, IQCORR; RFE DCOFFI/Q
+static const uint16_t s_channel_registers[] = {0x0201, 0x0202, 0x0203, 0x0204, 0x0401, 0x0402, 0x0403, 0x010E};
+
+// DC calibration values DC_TXAI .. DC_RXBQ - not banked by MAC
+static const uint16_t s_global_registers[] = {0x05C3, 0x05C4, 0x05C5, 0x05C6, 0x05C7, 0x05C8, 0x05C9, 0x05CA};
+
+
+LimeCalibrationCache::LimeCalibrationCache(const std::string& file) : m_file(file) {
+
+    load();
+}
+
+
+LimeCalibrationCache::Key LimeCalibrationCache::makeKey(lms_device_t *device, double frequency, size_t rx_channels) {
+
+    float_type rate = 0, rf_rate = 0, rx_gain = 0, tx_gain = 0;
+    LMS_GetSampleRate(device, LMS_CH_RX, 0, &rate, &rf_rate);
+    LMS_GetNormalizedGain(device, LMS_CH_RX, 0, &rx_gain);
+    LMS_GetNormalizedGain(device, LMS_CH_TX, 0, &tx_gain);
+
+    return Key((uint64_t)std::llround(frequency), (uint64_t)std::llround(rate),
+               (int)std::lround(rx_gain * LIME_CALIBRATION_GAIN_STEPS), (int)std::lround(tx_gain * LIME_CALIBRATION_GAIN_STEPS),
+               (int)rx_channels);
+}
+
+
+bool LimeCalibrationCache::restore(lms_device_t *device, const Key& key) {
+
+    std::vector<Register> regs;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(key);
+        if (it == m_entries.end()) {
+            m_metric_misses.add();
+            return false;
+        }
+        regs = it->second;
+    }
+
+    if (!write_registers(device, regs)) {
+        LOG_RADIO_ERROR("LimeCalibrationCache::restore() register write failed");
+        m_metric_misses.add();
+        return false;
+    }
+
+    if (!lo_locked(device)) {
+        LOG_RADIO_WARN("LimeCalibrationCache::restore() LO did not lock with the cached setting for {} Hz - recalibrating", std::get<0>(key));
+        m_metric_unlocked.add();
+        m_metric_misses.add();
+        return false;
+    }
+
+    m_metric_hits.add();
+    return true;
+}
+
+
+bool LimeCalibrationCache::capture(lms_device_t *device, const Key& key) {
+
+    std::vector<Register> regs;
+    if (!read_registers(device, regs)) {
+        LOG_RADIO_ERROR("LimeCalibrationCache::capture() register read failed - {} Hz not cached", std::get<0>(key));
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries[key] = std::move(regs);
+    }
+
+    return save();
+}
+
+
+size_t LimeCalibrationCache::size() {
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+
+bool LimeCalibrationCache::read_registers(lms_device_t *device, std::vector<Register>& regs) {
+
+    uint16_t mac = 0;
+    if (LMS_ReadLMSReg(device, LMS7_REG_MAC, &mac) != 0)
+        return false;
+
+    regs.clear();
+    bool ok = true;
+    for (uint16_t ch : {LMS7_MAC_A, LMS7_MAC_B}) {
+        ok &= LMS_WriteLMSReg(device, LMS7_REG_MAC, (mac & ~0x3) | ch) == 0;
+        for (uint16_t address : s_sx_registers) {
+            uint16_t value = 0;
+            ok &= LMS_ReadLMSReg(device, address, &value) == 0;
+            regs.push_back({ch, address, value});
+        }
+        for (uint16_t address : s_channel_registers) {
+            uint16_t value = 0;
+            ok &= LMS_ReadLMSReg(device, address, &value) == 0;
+            regs.push_back({ch, address, value});
+        }
+    }
+    LMS_WriteLMSReg(device, LMS7_REG_MAC, mac);
+
+    for (uint16_t address : s_global_registers) {
+        uint16_t value = 0;
+        ok &= LMS_ReadLMSReg(device, address, &value) == 0;
+        regs.push_back({0, address, value});
+    }
+
+    return ok;
+}
+
+
+bool LimeCalibrationCache::write_registers(lms_device_t *device, const std::vector<Register>& regs) {
+
+    uint16_t mac = 0;
+    if (LMS_ReadLMSReg(device, LMS7_REG_MAC, &mac) != 0)
+        return false;
+
+    // registers are stored grouped by MAC - MAC 0 entries are not banked
+    bool ok = true;
+    uint16_t selected = mac & 0x3;
+    for (const Register& r : regs) {
+        if (r.mac != 0 && r.mac != selected) {
+            ok &= LMS_WriteLMSReg(device, LMS7_REG_MAC, (mac & ~0x3) | r.mac) == 0;
+            selected = r.mac;
+        }
+        ok &= LMS_WriteLMSReg(device, r.address, r.value) == 0;
+    }
+    LMS_WriteLMSReg(device, LMS7_REG_MAC, mac);
+
+    return ok;
+}
+
+
+bool LimeCalibrationCache::lo_locked(lms_device_t *device) {
+
+    uint16_t mac = 0;
+    if (LMS_ReadLMSReg(device, LMS7_REG_MAC, &mac) != 0)
+        return false;
+
+    // locked: VCO_CMPHO = 1, VCO_CMPLO = 0 for SXR and SXT
+    bool locked = true;
+    for (uint16_t ch : {LMS7_MAC_A, LMS7_MAC_B}) {
+        uint16_t value = 0;
+        LMS_WriteLMSReg(device, LMS7_REG_MAC, (mac & ~0x3) | ch);
+        locked &= LMS_ReadLMSReg(device, LMS7_REG_SX_VCO_CMP, &value) == 0 && ((value >> 12) & 0x3) == 0x2;
+    }
+    LMS_WriteLMSReg(device, LMS7_REG_MAC, mac);
+
+    return locked;
+}
+
+
+bool LimeCalibrationCache::load() {
+
+    std::ifstream f(m_file);
+    if (!f.is_open()) {
+        LOG_RADIO_INFO("LimeCalibrationCache::load() no calibration cache {} - starting empty", m_file);
+        return false;
+    }
+
+    nlohmann::json j;
+    try {
+        j = nlohmann::json::parse(f);
+    } catch (std::exception& exception) {
+        LOG_RADIO_ERROR("LimeCalibrationCache::load() calibration cache {} is not parsable: {}", m_file, exception.what());
+        return false;
+    }
+
+    if (!j.is_object() || j.value("version", 0) != LIME_CALIBRATION_CACHE_VERSION || !j["entries"].is_array()) {
+        LOG_RADIO_WARN("LimeCalibrationCache::load() calibration cache {} has an unknown format - ignored", m_file);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& entry : j["entries"]) {
+        try {
+            Key key(entry.at("frequency").get<uint64_t>(), entry.at("rate").get<uint64_t>(),
+                    entry.at("rx_gain").get<int>(), entry.at("tx_gain").get<int>(), entry.value("rx_channels", 1));
+            std::vector<Register> regs;
+            for (auto& r : entry.at("registers"))
+                regs.push_back({r.at(0).get<uint16_t>(), r.at(1).get<uint16_t>(), r.at(2).get<uint16_t>()});
+            m_entries[key] = std::move(regs);
+        } catch (std::exception& exception) {
+            LOG_RADIO_WARN("LimeCalibrationCache::load() invalid entry in {}: {}", m_file, exception.what());
+        }
+    }
+
+    LOG_RADIO_INFO("LimeCalibrationCache::load() {} calibrations from {}", m_entries.size(), m_file);
+    return true;
+}
+
+
+bool LimeCalibrationCache::save() {
+
+    nlohmann::json j;
+    j["version"] = LIME_CALIBRATION_CACHE_VERSION;
+    j["entries"] = nlohmann::json::array();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& e : m_entries) {
+            nlohmann::json regs = nlohmann::json::array();
+            for (const Register& r : e.second)
+                regs.push_back({r.mac, r.address, r.value});
+            j["entries"].push_back({
+                {"frequency", std::get<0>(e.first)},
+                {"rate", std::get<1>(e.first)},
+                {"rx_gain", std::get<2>(e.first)},
+                {"tx_gain", std::get<3>(e.first)},
+                {"rx_channels", std::get<4>(e.first)},
+                {"registers", regs}
+            });
+        }
+    }
+
+    // write and rename so that an interrupted write does not destroy the cache
+    const std::string tmp = m_file + ".tmp";
+    std::FILE *f = std::fopen(tmp.c_str(), "w");
+    if (f == nullptr) {
+        LOG_RADIO_ERROR("LimeCalibrationCache::save() cannot open {}: {}", tmp, std::strerror(errno));
+        return false;
+    }
+    const std::string text = j.dump(1);
+    const bool written = std::fwrite(text.data(), 1, text.size(), f) == text.size();
+    // fclose() flushes - a full disk may only show up here
+    if (std::fclose(f) != 0 || !written) {
+        LOG_RADIO_ERROR("LimeCalibrationCache::save() write to {} failed: {}", tmp, std::strerror(errno));
+        std::remove(tmp.c_str());
+        return false;
+    }
+    if (std::rename(tmp.c_str(), m_file.c_str()) != 0) {
+        LOG_RADIO_ERROR("LimeCalibrationCache::save() cannot rename {} to {}: {}", tmp, m_file, std::strerror(errno));
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "lime/LimeSuite.h"
+
+#include "util/log.h"
+#include "util/Metrics.h"
+
+
+#define LIME_CALIBRATION_CACHE_FILE     "lime_calibration.json"
+#define LIME_CALIBRATION_CACHE_VERSION  1
+#define LIME_CALIBRATION_GAIN_STEPS     1000        // normalized gains are keyed in steps of 1/1000
+
+
+/**
+ * LimeCalibrationCache class
+ *
+ * @note LMS_Calibrate takes seconds per direction - the cache keeps the LMS7002M registers the calibration and the
+ *       LO tuning leave behind per (frequency, sample rate, RX gain, TX gain) and writes them back on a retune, which
+ *       takes a few register writes over USB instead of a calibration and a VCO search
+ * @note registers per SX (MAC A = SXR, MAC B = SXT): PLL and VCO setting of the LO (0x011C - 0x0124); per channel
+ *       (MAC A / B): TxTSP and RxTSP gain/phase/DC correctors and the RFE DC offset; global: the DC calibration
+ *       values (0x05C3 - 0x05CA)
+ * @note a restored LO is checked for lock (VCO comparators); without lock the caller has to tune and calibrate,
+ *       i.e. a drifted entry is replaced by a fresh calibration
+ * @note entries are stored as JSON; the file is rewritten on each new entry (write and rename)
+ *
+ */
+class LimeCalibrationCache {
+public:
+
+    // frequency (Hz), sample rate (Hz), normalized RX / TX gain in LIME_CALIBRATION_GAIN_STEPS, RX channels
+    typedef std::tuple<uint64_t, uint64_t, int, int, int> Key;
+
+    // MAC, register address, value
+    struct Register {
+        uint16_t mac;
+        uint16_t address;
+        uint16_t value;
+    };
+
+    explicit LimeCalibrationCache(const std::string& file = LIME_CALIBRATION_CACHE_FILE);
+
+    LimeCalibrationCache(const LimeCalibrationCache&) = delete;
+
+    LimeCalibrationCache& operator=(const LimeCalibrationCache&) = delete;
+
+    /**
+     * @brief key of the device state with the LO at frequency and rx_channels calibrated RX channels (gains and
+     *        sample rate are read from the device)
+     */
+    static Key makeKey(lms_device_t *device, double frequency, size_t rx_channels);
+
+    /**
+     * @brief write the registers of key back to the device
+     *
+     * @return true if the key is cached and the LO locked with the restored setting
+     */
+    bool restore(lms_device_t *device, const Key& key);
+
+    /**
+     * @brief read the registers of a freshly tuned and calibrated device and store them for key
+     *
+     * @return false if the registers could not be read or the file could not be written (a file error keeps the
+     *         entry for this run)
+     */
+    bool capture(lms_device_t *device, const Key& key);
+
+    size_t size();
+
+    const std::string& getFile() const { return m_file; }
+
+private:
+
+    bool load();
+    bool save();
+
+    static bool read_registers(lms_device_t *device, std::vector<Register>& regs);
+    static bool write_registers(lms_device_t *device, const std::vector<Register>& regs);
+    static bool lo_locked(lms_device_t *device);
+
+    const std::string m_file;
+
+    std::mutex m_mutex;
+    std::map<Key, std::vector<Register>> m_entries;
+
+    MetricCounter& m_metric_hits = Metrics::instance().counter("radio_calibration_cache_hits_total", "retunes restored from the calibration cache");
+    MetricCounter& m_metric_misses = Metrics::instance().counter("radio_calibration_cache_misses_total", "retunes which needed a calibration");
+    MetricCounter& m_metric_unlocked = Metrics::instance().counter("radio_calibration_cache_unlocked_total", "cached LO settings which did not lock");
+
+};
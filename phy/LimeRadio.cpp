@@ -2,6 +2,7 @@
 #include "LimeRadio.h"
 #include "lime/LimeSuite.h"
 #include "liquid/liquid.h"
+#include <algorithm>
 #include <memory>
 #include <chrono>
 #include <complex>
@@ -10,6 +11,25 @@
 //////////////////////////
 /// LimeRadio stuff
 
+// dataFmt of lms_stream_t is an anonymous enum
+typedef decltype(lms_stream_t::dataFmt) lms_data_fmt_t;
+
+static lms_data_fmt_t lmsDataFmt(IQStreamFormat format) {
+    switch (format) {
+    case IQStreamFormat::I12: return lms_stream_t::LMS_FMT_I12;
+    case IQStreamFormat::I16: return lms_stream_t::LMS_FMT_I16;
+    default: return lms_stream_t::LMS_FMT_F32;
+    }
+}
+
+typedef decltype(lms_stream_t::linkFmt) lms_link_fmt_t;
+
+// wire format on the USB link - I16 host samples keep their 16 bit, F32 and I12 are packed to 12 bit (the LimeSuite
+// default, set explicitly)
+static lms_link_fmt_t lmsLinkFmt(IQStreamFormat format) {
+    return format == IQStreamFormat::I16 ? lms_stream_t::LMS_LINK_FMT_I16 : lms_stream_t::LMS_LINK_FMT_I12;
+}
+
 LimeRadio::LimeRadio() 
     : Radio(), m_rxSampleCnt{Radio::m_sampleBufferCnt}, m_txSampleCnt{Radio::m_sampleBufferCnt}  {
 
@@ -20,6 +40,12 @@ LimeRadio::LimeRadio()
     initLimeGPIO();
     set_HW_RX();
 
+    // stream values of the phy - small FIFO, max throughput
+    RadioStreamConfig config;
+    config.fifo_size = 1024 * 100;
+    config.throughput_vs_latency = 1;
+    m_tuner.configure(config, m_sampleBufferCnt, blockCapacity());
+
     initStreaming();
 }
 
@@ -33,6 +59,12 @@ LimeRadio::LimeRadio(int sampleBufferCnt)
     initLimeGPIO();
     set_HW_RX();
 
+    // stream values of the phy - small FIFO, max throughput
+    RadioStreamConfig config;
+    config.fifo_size = 1024 * 100;
+    config.throughput_vs_latency = 1;
+    m_tuner.configure(config, m_sampleBufferCnt, blockCapacity());
+
     initStreaming();
 
 
@@ -54,7 +86,6 @@ int LimeRadio::receive_IQ_data() {
     // LOG_RADIO_INFO("LimeRadio::receive_IQ_data(): receive IQ data from current SDR");
 
     m_isRxTxRunning.store(true);
-    m_IQdataRXBuffer = Radio::getRXBuffer();
 
     // std::cout << m_IQdataRXBuffer << std::endl;
 
@@ -70,55 +101,90 @@ int LimeRadio::receive_IQ_data() {
     // printRadioConfig();
 
  
-    if(m_isRX) {
+    // RX streams independent of the frontend state - the TX side (PhyTxScheduler / RadioTRSwitch) only switches the
+    // frontend for the air time of its bursts, RX keeps its timeline
+    {
 
 
         auto t1 = std::chrono::steady_clock::now();
 
 
-        // clear out RX buffer from potential old stuff
-        m_IQdataRXBuffer->data.clear();
+        // receive directly into a fresh block of the pool per RX channel; liquid_float_complex matches the
+        // interleaved F32 layout (IQIQIQ...) of the LMS stream - the previous block stays valid as long as the
+        // consumer holds it
+        const IQBlockPoolPtr pool = getBlockPool();
+        for(size_t ch = 0; ch < m_rxChannels; ch++) {
+            RadioIQDataPtr& block = m_IQdataRXBuffer[ch];
+            block = pool->acquire();
+            block->data.resize(m_rxSampleCnt);
+            block->channel = ch;
+
+            // Receive samples
+            // @todo - check flag when there is a buffer overflow on the Lime .. i.e. we are getting samples too slow
+            int samplesRead;
+            if(m_streamFormat == IQStreamFormat::F32) {
+                samplesRead = LMS_RecvStream(&m_rx_streamId[ch], block->data.data(), m_rxSampleCnt, &m_rx_metadata[ch], 100);     // timeout 500->100
+            } else {
+                samplesRead = LMS_RecvStream(&m_rx_streamId[ch], m_rxIQbufferI16.data(), m_rxSampleCnt, &m_rx_metadata[ch], 100);
+                if(samplesRead > 0)
+                    iq_convert_i16_to_cf(m_rxIQbufferI16.data(), block->data.data(), samplesRead, 1.0f / iqStreamFormatFullScale(m_streamFormat));
+            }
 
-        // Receive samples
-        // @todo - check flag when there is a buffer overflow on the Lime .. i.e. we are getting samples too slow
-        int samplesRead = LMS_RecvStream(&m_rx_streamId, m_rxIQbuffer, m_rxSampleCnt, &m_rx_metadata, 100);     // timeout 500->100
+            block->timestampFirstSample = m_rx_metadata[ch].timestamp;
+            block->sampleRate = (long long)m_sampleRate;
+            block->frequency = (long long)m_frequency;
 
-        auto t2 = std::chrono::steady_clock::now();
+            if(samplesRead > 0)
+            {
+                block->data.resize(samplesRead);
+                m_metrics.rx_samples.add(samplesRead);
+            } else {
+                block->data.clear();
+                LOG_RADIO_DEBUG("no samples received on channel {}!!", ch);
+            }
+        }
 
-        LMS_GetStreamStatus(&m_rx_streamId, &m_rx_status);
+        auto t2 = std::chrono::steady_clock::now();
 
-        auto t21 = std::chrono::steady_clock::now();
+        // m_rx_status is the status of the first channel (sync/data); the counts of the status reads of
+        // get_rx_timestamp() come with the next read here
+        m_rx_stream_status[0].read(&m_rx_streamId[0], m_rx_status, m_rx_status_cursor[0]);
+        m_metrics.update_rx(m_rx_status);
+        for(size_t ch = 1; ch < m_rxChannels; ch++) {
+            lms_stream_status_t status;
+            if(m_rx_stream_status[ch].read(&m_rx_streamId[ch], status, m_rx_status_cursor[ch]))
+                m_metrics.update_rx(status);
+        }
+        m_metrics.rx_recv_time.record(t2 - t1);
 
-        //I and Q samples are interleaved in buffer: IQIQIQ...
-        float *pp = (float *)m_rxIQbuffer;
-        liquid_float_complex s;
+        // block size of the next call; a new throughputVsLatency needs new RX streams
+        m_tuner.record(t2 - t1);
+        const bool restartRX = m_tuner.update(m_rx_status);
+        m_rxSampleCnt = m_tuner.blockSamples();
 
-        m_IQdataRXBuffer->timestampFirstSample = m_rx_metadata.timestamp;
+        auto t21 = std::chrono::steady_clock::now();
 
-        if(samplesRead > 0)
-        {
+        // the channels are handed over with the same timestamps - on the streams the blocks were read from
+        m_rxAlign.align(m_rx_streamId, m_IQdataRXBuffer, m_rxChannels);
 
-            for (int i = 0; i < samplesRead; i++) {
-                s.real(pp[2 * i]);
-                s.imag(pp[2 * i + 1]);
+        // hand the blocks over to the consumer (getRXBuffer())
+        Radio::setRXBuffer(m_IQdataRXBuffer[0]);
+        for(size_t ch = 1; ch < m_rxChannels; ch++)
+            Radio::setRXBuffer(ch, m_IQdataRXBuffer[ch]);
 
-                m_IQdataRXBuffer->data.push_back(s);
-            }
-        } else {
-            LOG_RADIO_DEBUG("no samples received!!");
-        }
+        // new streams only after the blocks of the old ones are aligned and handed over (like LimeRadioThread)
+        if(restartRX)
+            restartRXStreaming();
 
 
         auto t3 = std::chrono::steady_clock::now();
 
-        std::cout << "ts read : ";
-        std::cout << std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() << " : ";
-        std::cout << std::chrono::duration_cast<std::chrono::microseconds>(t21 - t1).count() << " : ";
-        std::cout << std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count() << std::endl;
+        LOG_RADIO_TRACE("LimeRadio::receive_IQ_data() ts read : {} : {} : {}",
+                        std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count(),
+                        std::chrono::duration_cast<std::chrono::microseconds>(t21 - t1).count(),
+                        std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count());
 
 
-    } else {
-        LOG_RADIO_ERROR("receive_IQ_data(): m_isRX is false -- are we set to transmit ????");
     }
 
     m_isRxTxRunning.store(false);
@@ -132,8 +198,7 @@ int LimeRadio::send_IQ_data() {
 
 //    LOG_RADIO_INFO("send IQ data from current buffer.");
 
-    m_isRxTxRunning.store(true);
-
+    // called from the TX thread while the RX thread receives - m_isRxTxRunning belongs to the RX side
     m_IQdataTXBuffer = Radio::getTXBuffer();
 
 //    LOG_RADIO_DEBUG("run() tx stream handle {}", m_tx_streamId.handle);
@@ -141,34 +206,35 @@ int LimeRadio::send_IQ_data() {
 
 //    printRadioConfig();
 
-    if(!m_isRX) {
+    // the TX stream runs all the time - the block goes to the air at its timestamp (waitForTimestamp)
+    {
 
         auto samplesWrite = m_IQdataTXBuffer->data.size();
 
-        if(samplesWrite > m_txSampleCnt) {
-            LOG_RADIO_DEBUG("transmit buffer {} too small for {} number of samples!!", m_txSampleCnt, samplesWrite);
-            return -1;
-        }
-
-        //I and Q samples are interleaved in buffer: IQIQIQ...
-        float *pp = (float *)m_txIQbuffer;          // @todo check if malloc should not be done in this function (if yes it is maybe slow)
-        liquid_float_complex s;
-
         if(samplesWrite > 0)
         {
 
-            for (int i = 0; i < samplesWrite; i++) {
-
-                s = m_IQdataTXBuffer->data.front();
-                pp[2 * i] = s.real();
-                pp[2 * i + 1] = s.imag();
-
-                m_IQdataTXBuffer->data.pop_front();
-            }
-
             //Send samples with delay from RX (waitForTimestamp is enabled)
-            m_tx_metadata.timestamp = m_IQdataTXBuffer->timestampFirstSample;
-            LMS_SendStream(&m_tx_streamId, m_txIQbuffer, samplesWrite, &m_tx_metadata, 500);    // @todo error handling on send error
+            //the block data is already interleaved IQIQIQ... F32 - no staging copy needed
+            //a block larger than the stream buffer (m_txSampleCnt) is sent in parts with consecutive timestamps
+            if(samplesWrite > (size_t)m_txSampleCnt)
+                LOG_RADIO_DEBUG("transmit buffer {} too small for {} number of samples - block split", m_txSampleCnt, samplesWrite);
+
+            const float fullScale = iqStreamFormatFullScale(m_streamFormat) - 1;
+            auto t1 = std::chrono::steady_clock::now();
+            for(size_t offset = 0; offset < samplesWrite; offset += m_txSampleCnt) {
+                const size_t n = std::min(samplesWrite - offset, (size_t)m_txSampleCnt);
+                m_tx_metadata.timestamp = m_IQdataTXBuffer->timestampFirstSample + offset;
+                if(m_streamFormat == IQStreamFormat::F32) {
+                    LMS_SendStream(&m_tx_streamId, m_IQdataTXBuffer->data.data() + offset, n, &m_tx_metadata, 500);    // @todo error handling on send error
+                } else {
+                    // m_txIQbufferI16 holds m_txSampleCnt samples (initStreaming())
+                    iq_convert_cf_to_i16(m_IQdataTXBuffer->data.data() + offset, m_txIQbufferI16.data(), n, fullScale, fullScale);
+                    LMS_SendStream(&m_tx_streamId, m_txIQbufferI16.data(), n, &m_tx_metadata, 500);
+                }
+            }
+            m_metrics.tx_send_time.record(std::chrono::steady_clock::now() - t1);
+            m_metrics.tx_samples.add(samplesWrite);
         //    std::cout << m_tx_metadata.timestamp << std::endl;
 
             // for testing send without metadata
@@ -181,12 +247,8 @@ int LimeRadio::send_IQ_data() {
             LOG_RADIO_DEBUG("no samples sent!!");
         }
 
-    } else {
-        LOG_RADIO_ERROR("send_IQ_data(): m_isRX is true -- are we set to receive ????");
     }
 
-    m_isRxTxRunning.store(false);
-
     return 0;
 
 }
@@ -196,9 +258,7 @@ int LimeRadio::send_IQ_data() {
 
 int LimeRadio::send_Tone() {
 
-    m_isRxTxRunning.store(true);
-
-    if(!m_isRX) {
+    {
 
         int samplesWrite = 1280;
 
@@ -230,12 +290,8 @@ int LimeRadio::send_Tone() {
 //        m_tx_metadata.timestamp = m_IQdataTXBuffer->timestampFirstSample;
         LMS_SendStream(&m_tx_streamId, tx_buffer, samplesWrite, nullptr, 100);    // @todo error handling on send error
 
-    } else {
-        LOG_RADIO_ERROR("send_IQ_data(): m_isRX is true -- are we set to receive ????");
     }
 
-    m_isRxTxRunning.store(false);
-
     return 0;
 
 }
@@ -269,8 +325,19 @@ uint64_t LimeRadio::get_rx_timestamp() {
     // lms_stream_status_t rx_status;
     // lms_stream_status_t tx_status;
 
-    LMS_GetStreamStatus(&m_rx_streamId, &m_rx_status);
-    LMS_GetStreamStatus(&m_tx_streamId, &m_tx_status);
+    // called from the TX side (PhyTxScheduler) while the RX thread reads the RX status - only the timestamp is
+    // used here, the overrun counts of this read go to the next status read of the RX thread (tuner, metrics)
+    lms_stream_status_t rx_status;
+    rx_status.timestamp = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_rx_stream_mutex);
+        LimeStreamStatus::Cursor cursor;
+        m_rx_stream_status[0].read(&m_rx_streamId[0], rx_status, cursor);
+    }
+    // the counts of each TX status read go to the metrics once, whichever thread reads
+    lms_stream_status_t tx_status;
+    if (m_tx_stream_status.read(&m_tx_streamId, tx_status))
+        m_metrics.update_tx(tx_status);
 
 
 
@@ -279,7 +346,7 @@ uint64_t LimeRadio::get_rx_timestamp() {
 
     //m_isRxTxRunning.store(false);
 
-    return m_rx_status.timestamp;
+    return rx_status.timestamp;
 //    return m_rx_metadata.timestamp;
 
 }
@@ -287,6 +354,11 @@ uint64_t LimeRadio::get_rx_timestamp() {
 
 
 
+uint64_t LimeRadio::get_tx_underruns() {
+    return m_tx_stream_status.totals().underrun;
+}
+
+
 int LimeRadio::error()
 {
     LOG_RADIO_ERROR("LimeRadio::error() called");
@@ -360,8 +432,6 @@ int LimeRadio::initLimeSDR() {
     if(LMS_SetNormalizedGain(m_lms_device, LMS_CH_RX, LMS_Channel, DEFAULT_NOM_RX_GAIN) != 0)
         error();
 
-    LMS_Calibrate(m_lms_device, LMS_CH_RX, LMS_Channel, DEFAULT_SAMPLE_RATE, 0 );
-
 
 
     // set TX Antennna, Gain and calibrate
@@ -371,7 +441,8 @@ int LimeRadio::initLimeSDR() {
     if(LMS_SetNormalizedGain(m_lms_device, LMS_CH_TX, LMS_Channel, DEFAULT_NOM_TX_GAIN) != 0)
         error();
 
-    LMS_Calibrate(m_lms_device, LMS_CH_TX, LMS_Channel, DEFAULT_SAMPLE_RATE, 0 ); 
+    // calibrate RX and TX - a calibration cache is only used once set with setCalibrationCache()
+    runCalibration(m_frequency);
 
 
 
@@ -388,63 +459,71 @@ void LimeRadio::closeLimeSDR() {
 }
 
 
-void LimeRadio::initStreaming() {
+void LimeRadio::setupRXStreaming() {
 
     //RX Streaming Setup
     LOG_RADIO_INFO("Init RX Streaming");
 
-    //Initialize stream
-    m_rx_streamId.channel = LMS_Channel;                 // channel number
-    m_rx_streamId.fifoSize = 1024 * 100;                 // fifo size in samples
-    m_rx_streamId.throughputVsLatency = 1;             // throughput vs speed -- 0.5 middle - 1.0 fastest
-    m_rx_streamId.isTx = false;                          // RX channel
-    m_rx_streamId.dataFmt = lms_stream_t::LMS_FMT_F32;   // F32 not optimal but easier with liquid @todo check for 12bit
-    if (LMS_SetupStream(m_lms_device, &m_rx_streamId) != 0)
-        error();
-
-    //allocate memory for IQ Buffer used by LMS_Receive
-    if (m_rxIQbuffer != nullptr) {
-            ::free(m_rxIQbuffer);
+    //Initialize one stream per RX channel - all streams are set up before they are started, so the channels
+    //start on the same timestamp
+    for(size_t ch = 0; ch < m_rxChannels; ch++) {
+        m_rx_streamId[ch].channel = lmsRXChannel(ch);            // channel number
+        m_rx_streamId[ch].fifoSize = m_tuner.fifoSize();         // fifo size in samples
+        m_rx_streamId[ch].throughputVsLatency = m_tuner.throughputVsLatency();   // throughput vs speed -- 0.5 middle - 1.0 fastest
+        m_rx_streamId[ch].isTx = false;                          // RX channel
+        m_rx_streamId[ch].dataFmt = lmsDataFmt(m_streamFormat);  // host buffer - int16 halves it compared to F32
+        m_rx_streamId[ch].linkFmt = lmsLinkFmt(m_streamFormat);
+        if (LMS_SetupStream(m_lms_device, &m_rx_streamId[ch]) != 0)
+            error();
     }
-    m_rxIQbuffer = std::malloc(m_rxSampleCnt * 4 * sizeof(float));
 
-    LOG_RADIO_TRACE("initStreaming() rxSampleCnt {}", m_rxSampleCnt);    
-    LOG_RADIO_TRACE("initStreaming() m_rxIQbuffer {}",m_rxIQbuffer);
-    LOG_RADIO_TRACE("initStreaming() size m_rxIQbuffer {}", m_rxSampleCnt * 4 * sizeof(int16_t));
+    // F32 samples are received directly into the blocks of the IQBlockPool (see receive_IQ_data()); the integer
+    // formats need an int16 buffer which is then converted into the block - sized for the largest block of the tuner
+    m_rxSampleCnt = m_tuner.blockSamples();
+    if(m_streamFormat != IQStreamFormat::F32)
+        m_rxIQbufferI16.assign(2 * m_tuner.maxBlockSamples(), 0);
+    else
+        m_rxIQbufferI16.clear();
+
+    LOG_RADIO_TRACE("setupRXStreaming() rxSampleCnt {} format {} rx channels {}", m_rxSampleCnt, iqStreamFormatName(m_streamFormat), m_rxChannels);
 
     //Start streaming
-    if(LMS_StartStream(&m_rx_streamId) != 0)
-        LOG_RADIO_ERROR("RX StartStream Error");
+    for(size_t ch = 0; ch < m_rxChannels; ch++) {
+        if(LMS_StartStream(&m_rx_streamId[ch]) != 0)
+            LOG_RADIO_ERROR("RX StartStream Error (channel {})", ch);
+
+        //Streaming Metadata
+        m_rx_metadata[ch].flushPartialPacket = false; //currently has no effect in RX
+        m_rx_metadata[ch].waitForTimestamp = false; //currently has no effect in RX
+    }
 
-    LOG_RADIO_TRACE("initStreaming() rx stream handle {}", m_rx_streamId.handle);
+    LOG_RADIO_TRACE("setupRXStreaming() rx stream handle {}", m_rx_streamId[0].handle);
+}
 
-    //Streaming Metadata
-    m_rx_metadata.flushPartialPacket = false; //currently has no effect in RX
-    m_rx_metadata.waitForTimestamp = false; //currently has no effect in RX
+void LimeRadio::initStreaming() {
 
+    setupRXStreaming();
 
     //TX Streaming Setup
     LOG_RADIO_INFO("Init TX Streaming");
 
     //Initialize TX stream
     m_tx_streamId.channel = LMS_Channel;                 //channel number
-    m_tx_streamId.fifoSize = 1024 * 100;                //fifo size in samples
-    m_tx_streamId.throughputVsLatency = 1;             //optimize for max throughput
+    m_tx_streamId.fifoSize = m_tuner.fifoSize();        //fifo size in samples
+    m_tx_streamId.throughputVsLatency = m_tuner.config().throughput_vs_latency;    //optimize for max throughput
     m_tx_streamId.isTx = true;                          //RX channel
-    m_tx_streamId.dataFmt = lms_stream_t::LMS_FMT_F32;   //F32 not optimal but easier with liquid @todo check for 12bit
+    m_tx_streamId.dataFmt = lmsDataFmt(m_streamFormat);
+    m_tx_streamId.linkFmt = lmsLinkFmt(m_streamFormat);
     if (LMS_SetupStream(m_lms_device, &m_tx_streamId) != 0)
         error();
 
-    //allocate memory for IQ Buffer used by LMS_Receive
-    if (m_txIQbuffer != nullptr) {
-            ::free(m_txIQbuffer);
-    }
-    m_txIQbuffer = std::malloc(m_txSampleCnt * 4 * sizeof(float));
+    // F32 samples are sent directly from the TX block (see send_IQ_data())
+    if(m_streamFormat != IQStreamFormat::F32)
+        m_txIQbufferI16.assign(2 * m_txSampleCnt, 0);
+    else
+        m_txIQbufferI16.clear();
 
-    
-    LOG_RADIO_TRACE("initStreaming() txSampleCnt {}", m_txSampleCnt);    
-    LOG_RADIO_TRACE("initStreaming() m_txIQbuffer {}",m_txIQbuffer);
-    LOG_RADIO_TRACE("initStreaming() size m_txIQbuffer {}", m_txSampleCnt * 4 * sizeof(int16_t));
+    LOG_RADIO_TRACE("initStreaming() txSampleCnt {} format {}", m_txSampleCnt, iqStreamFormatName(m_streamFormat));    
 
     //Start streaming
     if(LMS_StartStream(&m_tx_streamId) != 0)
@@ -464,12 +543,10 @@ void LimeRadio::stopStreaming() {
     //Stop streaming
     LOG_RADIO_INFO("Stop Streaming");
 
-    std::free(m_rxIQbuffer);
-
-    LMS_StopStream(&m_rx_streamId); //stream is stopped but can be started again with LMS_StartStream()
-    LMS_DestroyStream(m_lms_device, &m_rx_streamId); //stream is deallocated and can no longer be used
-
-    std::free(m_txIQbuffer);
+    for(size_t ch = 0; ch < m_rxChannels; ch++) {
+        LMS_StopStream(&m_rx_streamId[ch]); //stream is stopped but can be started again with LMS_StartStream()
+        LMS_DestroyStream(m_lms_device, &m_rx_streamId[ch]); //stream is deallocated and can no longer be used
+    }
 
     LMS_StopStream(&m_tx_streamId); //stream is stopped but can be started again with LMS_StartStream()
     LMS_DestroyStream(m_lms_device, &m_tx_streamId); //stream is deallocated and can no longer be used
@@ -477,14 +554,100 @@ void LimeRadio::stopStreaming() {
 
 }
 
+void LimeRadio::restartRXStreaming() {
+
+    std::lock_guard<std::mutex> lock(m_rx_stream_mutex);
+
+    for(size_t ch = 0; ch < m_rxChannels; ch++) {
+        LMS_StopStream(&m_rx_streamId[ch]);
+        LMS_DestroyStream(m_lms_device, &m_rx_streamId[ch]);
+    }
+
+    setupRXStreaming();
+}
+
+void LimeRadio::setStreamConfig(const RadioStreamConfig& config)
+{
+    LOG_RADIO_TRACE("setStreamConfig() block {} fifo {} throughputVsLatency {}", config.block_samples, config.fifo_size, config.throughput_vs_latency);
+
+    if(m_isRxTxRunning.load()) {
+        LOG_RADIO_ERROR("setStreamConfig() stream config cannot be changed while receiving");
+        return;
+    }
+
+    // fifo size and throughputVsLatency can only be set on stream setup - destroy and setup the streams again
+    stopStreaming();
+    m_tuner.configure(config, m_sampleBufferCnt, blockCapacity());
+    initStreaming();
+
+    LOG_APP_INFO("Set StreamConfig: {} block {} samples, fifo {}, throughputVsLatency {}", config.adaptive ? "adaptive" : "fixed",
+                 m_tuner.blockSamples(), m_tuner.fifoSize(), m_tuner.throughputVsLatency());
+}
+
+void LimeRadio::setStreamFormat(IQStreamFormat format)
+{
+    LOG_RADIO_TRACE("setStreamFormat() set stream format to {}", iqStreamFormatName(format));
+
+    if(format == m_streamFormat)
+        return;
+
+    // the data format can only be set on stream setup - destroy and setup the streams again
+    stopStreaming();
+    m_streamFormat = format;
+    initStreaming();
+
+    LOG_APP_INFO("Set StreamFormat: {}", iqStreamFormatName(format));
+}
+
+void LimeRadio::setRXChannels(size_t channels)
+{
+    LOG_RADIO_TRACE("setRXChannels() set {} RX channels", channels);
+
+    if(channels < 1 || channels > RADIO_MAX_RX_CHANNELS) {
+        LOG_RADIO_ERROR("setRXChannels() {} RX channels are not supported (1 .. {})", channels, RADIO_MAX_RX_CHANNELS);
+        return;
+    }
+
+    if(channels == m_rxChannels)
+        return;
+
+    // streams are set up per channel - destroy and setup the streams again; the RX LO of the LMS7002M is shared by
+    // both RX channels, gain is set per channel like for the first one in initLimeSDR(); the calibration of the
+    // channel set comes from the cache (the key covers the RX channels)
+    stopStreaming();
+    for(size_t ch = 1; ch < RADIO_MAX_RX_CHANNELS; ch++) {
+        const bool enable = ch < channels;
+        if (LMS_EnableChannel(m_lms_device, LMS_CH_RX, lmsRXChannel(ch), enable) != 0)
+            error();
+        if(!enable)
+            continue;
+        if(LMS_SetNormalizedGain(m_lms_device, LMS_CH_RX, lmsRXChannel(ch), DEFAULT_NOM_RX_GAIN) != 0)
+            error();
+    }
+    for(size_t ch = channels; ch < RADIO_MAX_RX_CHANNELS; ch++)
+        Radio::setRXBuffer(ch, nullptr);
+    m_rxChannels = channels;
+    if (m_calibrationCache == nullptr || !restoreCalibration(m_frequency))
+        runCalibration(m_frequency);
+    initStreaming();
+
+    LOG_APP_INFO("Set RX Channels: {}", channels);
+}
+
 void LimeRadio::setFrequency(float_t frequency)
 {
     LOG_RADIO_TRACE("setFrequency() set freq to {} MHZ", frequency);
 
-    LMS_StopStream(&m_rx_streamId);
-    LMS_StopStream(&m_tx_streamId);
+    auto t0 = std::chrono::steady_clock::now();
+    m_frequency = frequency;
 
+    // cached setting - LO and correctors are written back, the streams keep running
+    if (m_calibrationCache != nullptr && restoreCalibration(frequency)) {
+        m_metric_retune.record(std::chrono::steady_clock::now() - t0);
+        return;
+    }
 
+    // the LO is tuned while the streams keep running - the sample clock (CGEN) is not touched
     //Set center frequency to freq
     if (LMS_SetLOFrequency(m_lms_device, LMS_CH_RX, 0, frequency) != 0)
         error();
@@ -493,30 +656,152 @@ void LimeRadio::setFrequency(float_t frequency)
     if (LMS_SetLOFrequency(m_lms_device, LMS_CH_TX, 0, frequency) != 0)
         error();
 
-    if(LMS_StartStream(&m_rx_streamId) != 0)
-        LOG_RADIO_ERROR("RX StartStream Error");
-    if(LMS_StartStream(&m_tx_streamId) != 0)
-        LOG_RADIO_ERROR("TX StartStream Error");
+    // new setting - calibrated once, the next retune to it comes from the cache
+    if (m_calibrationCache != nullptr) {
+        pauseStreaming();
+        runCalibration(frequency);
+        resumeStreaming();
+    }
+
+    m_metric_retune.record(std::chrono::steady_clock::now() - t0);
+}
+
+bool LimeRadio::tryFrequency(float_t frequency)
+{
+    LOG_RADIO_TRACE("tryFrequency() {} Hz", frequency);
+
+    // without a cache setFrequency() does not calibrate either
+    if (m_calibrationCache == nullptr) {
+        setFrequency(frequency);
+        return true;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    if (!restoreCalibration(frequency)) {
+        // a failed restore may have written part of the setting - back to the current one
+        if (!restoreCalibration(m_frequency))
+            LOG_RADIO_ERROR("tryFrequency() {} Hz could not be restored", m_frequency);
+        return false;
+    }
+
+    m_frequency = frequency;
+    m_metric_retune.record(std::chrono::steady_clock::now() - t0);
+    return true;
+}
 
+void LimeRadio::precalibrate(const std::vector<double>& frequencies)
+{
+    if (m_calibrationCache == nullptr)
+        return;
+
+    const double current = m_frequency;
+    size_t calibrated = 0;
+
+    for (double frequency : frequencies) {
+        if (restoreCalibration(frequency))
+            continue;
+
+        if (LMS_SetLOFrequency(m_lms_device, LMS_CH_RX, 0, frequency) != 0)
+            error();
+        if (LMS_SetLOFrequency(m_lms_device, LMS_CH_TX, 0, frequency) != 0)
+            error();
+
+        pauseStreaming();
+        runCalibration(frequency);
+        resumeStreaming();
+        calibrated++;
+    }
+
+    setFrequency(current);
 
+    LOG_RADIO_INFO("precalibrate() {} of {} settings calibrated, {} Hz", calibrated, frequencies.size(), current);
 }
 
 void LimeRadio::setSamplingRate(float_t sampling_rate, size_t oversampling)
 {
     LOG_RADIO_TRACE("setFrequency() set sampling_rate {} and oversampling {}", sampling_rate, oversampling);
 
-    LMS_StopStream(&m_rx_streamId);
-    LMS_StopStream(&m_tx_streamId);
+    // the sample rate changes CGEN and the interface clock - the streams have to be stopped
+    pauseStreaming();
 
     if (LMS_SetSampleRate(m_lms_device, sampling_rate, oversampling) != 0)
         error();
 
-    if(LMS_StartStream(&m_rx_streamId) != 0)
-        LOG_RADIO_ERROR("RX StartStream Error");
+    // the rate the device runs at (the CGEN steps) goes with the RX blocks
+    float_type rate, rf_rate;
+    m_sampleRate = LMS_GetSampleRate(m_lms_device, LMS_CH_RX, 0, &rate, &rf_rate) == 0 ? rate : sampling_rate;
+
+    // the calibration depends on the sample rate (filter bandwidth)
+    if (m_calibrationCache != nullptr && !restoreCalibration(m_frequency))
+        runCalibration(m_frequency);
+
+    resumeStreaming();
+}
+
+void LimeRadio::setCalibrationCache(const std::string& file)
+{
+    LOG_RADIO_TRACE("setCalibrationCache() {}", file);
+
+    m_calibrationCache.reset(new LimeCalibrationCache(file));
+    if (!restoreCalibration(m_frequency)) {
+        pauseStreaming();
+        runCalibration(m_frequency);
+        resumeStreaming();
+    }
+}
+
+void LimeRadio::pauseStreaming()
+{
+    for(size_t ch = 0; ch < m_rxChannels; ch++)
+        LMS_StopStream(&m_rx_streamId[ch]);
+    LMS_StopStream(&m_tx_streamId);
+}
+
+void LimeRadio::resumeStreaming()
+{
+    for(size_t ch = 0; ch < m_rxChannels; ch++)
+        if(LMS_StartStream(&m_rx_streamId[ch]) != 0)
+            LOG_RADIO_ERROR("RX StartStream Error (channel {})", ch);
     if(LMS_StartStream(&m_tx_streamId) != 0)
         LOG_RADIO_ERROR("TX StartStream Error");
 }
 
+bool LimeRadio::restoreCalibration(double frequency)
+{
+    auto key = LimeCalibrationCache::makeKey(m_lms_device, frequency, m_rxChannels);
+    if (!m_calibrationCache->restore(m_lms_device, key))
+        return false;
+
+    LOG_RADIO_DEBUG("restoreCalibration() {} Hz restored from {}", frequency, m_calibrationCache->getFile());
+    return true;
+}
+
+void LimeRadio::runCalibration(double frequency)
+{
+    auto t0 = std::chrono::steady_clock::now();
+
+    float_type rate, rf_rate;
+    LMS_GetSampleRate(m_lms_device, LMS_CH_RX, 0, &rate, &rf_rate);
+
+    for(size_t ch = 0; ch < m_rxChannels; ch++) {
+        if (LMS_Calibrate(m_lms_device, LMS_CH_RX, lmsRXChannel(ch), rate, 0) != 0) {
+            LOG_RADIO_ERROR("runCalibration() RX calibration failed (channel {}) - {} Hz not cached", ch, frequency);
+            return;
+        }
+    }
+    if (LMS_Calibrate(m_lms_device, LMS_CH_TX, LMS_Channel, rate, 0) != 0) {
+        LOG_RADIO_ERROR("runCalibration() TX calibration failed - {} Hz not cached", frequency);
+        return;
+    }
+
+    // without a cache (setCalibrationCache()) the calibration is done on each call
+    if (m_calibrationCache != nullptr && !m_calibrationCache->capture(m_lms_device, LimeCalibrationCache::makeKey(m_lms_device, frequency, m_rxChannels)))
+        LOG_RADIO_WARN("runCalibration() {} Hz not stored in {}", frequency, m_calibrationCache->getFile());
+
+    LOG_RADIO_INFO("runCalibration() {} Hz @ {} Sps calibrated in {} ms", frequency, rate,
+                   std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count());
+}
+
 void LimeRadio::printRadioConfig()
 {
     float_type rate, rf_rate;
@@ -17,13 +17,18 @@
 #include "liquid/liquid.h"
 
 #include "phy/Radio.h"
+#include "phy/RadioMetrics.h"
+#include "phy/LimeRxAlign.h"
+#include "phy/LimeStreamStatus.h"
+#include "phy/LimeCalibrationCache.h"
+#include "phy/RadioStreamTuner.h"
 
 #include "util/log.h"
 
 class LimeRadio : public Radio {
 public:
 
-    size_t LMS_Channel = 0;
+    size_t LMS_Channel = 0;     // TX channel and first RX channel
     
     LimeRadio();
     LimeRadio(int sampleBufferCnt);
@@ -35,9 +40,16 @@ public:
     int send_Tone() override;
 
     uint64_t get_rx_timestamp() override;
+    uint64_t get_tx_underruns() override;
 
     void setFrequency(float_t frequency) override;
+    bool tryFrequency(float_t frequency) override;
+    void precalibrate(const std::vector<double>& frequencies) override;
     void setSamplingRate(float_t sampling_rate, size_t oversampling) override;
+    void setStreamFormat(IQStreamFormat format) override;
+    void setRXChannels(size_t channels) override;
+    void setCalibrationCache(const std::string& file) override;
+    void setStreamConfig(const RadioStreamConfig& config) override;
 
     void set_HW_SDR_ON();
     void set_HW_SDR_OFF();
@@ -47,29 +59,68 @@ public:
 private:
 
     lms_device_t* m_lms_device = NULL;
-    lms_stream_t m_rx_streamId;         // RX stream structure
+    lms_stream_t m_rx_streamId[RADIO_MAX_RX_CHANNELS];      // RX stream structure per RX channel
     lms_stream_t m_tx_streamId;         // TX stream structure
-    lms_stream_meta_t m_rx_metadata;    // Use metadata for additional control over sample receive function behavior
+    lms_stream_meta_t m_rx_metadata[RADIO_MAX_RX_CHANNELS]; // Use metadata for additional control over sample receive function behavior
     lms_stream_meta_t m_tx_metadata;    // Use metadata for additional control over sample receive function behavior
 
     //data buffers for RX
-    const int m_rxSampleCnt; //complex samples per buffer is set via constructor
-    void *m_rxIQbuffer  { nullptr };
+    int m_rxSampleCnt; //complex samples per buffer - set via constructor, adjusted by m_tuner
+    std::vector<int16_t> m_rxIQbufferI16;   // LMS_RecvStream buffer for the I12/I16 formats, converted into the block
+
+    RadioStreamTuner m_tuner;       // RX block size, FIFO size and throughputVsLatency
+    std::mutex m_rx_stream_mutex;   // RX stream re-setup of the tuner vs. the status read of get_rx_timestamp()
+
+    // every status read of a stream goes through its LimeStreamStatus - the reads of the RX thread (tuner, metrics)
+    // and of get_rx_timestamp() (TX side) share the overrun / underrun counts
+    LimeStreamStatus m_rx_stream_status[RADIO_MAX_RX_CHANNELS];
+    LimeStreamStatus::Cursor m_rx_status_cursor[RADIO_MAX_RX_CHANNELS];    // RX thread
+    LimeStreamStatus m_tx_stream_status;
+
+    RadioIQDataPtr m_IQdataRXBuffer[RADIO_MAX_RX_CHANNELS];
+
+    LimeRxAlign m_rxAlign;  // keeps the blocks of the RX channels on the same timestamps
 
-    RadioIQDataPtr m_IQdataRXBuffer;
-    
     //data buffers for TX
     const int m_txSampleCnt; //complex samples per buffer is set via constructor
-    void *m_txIQbuffer  { nullptr };
+    std::vector<int16_t> m_txIQbufferI16;   // LMS_SendStream buffer for the I12/I16 formats
 
     RadioIQDataPtr m_IQdataTXBuffer;
 
+    RadioStreamMetrics m_metrics;
+
+    // LO and calibration per setting (setCalibrationCache()) - without cache initLimeSDR() and setRXChannels() calibrate
+    std::unique_ptr<LimeCalibrationCache> m_calibrationCache;
+    double m_frequency = DEFAULT_CENTER_FREQ;      // last requested center frequency (key of the cache)
+    double m_sampleRate = DEFAULT_SAMPLE_RATE;     // host sample rate of setSamplingRate() - stamped on the RX blocks
+
+    MetricHistogram& m_metric_retune = Metrics::instance().histogram("radio_retune_seconds", "time of a center frequency change");
+
     int initLimeSDR();
     void closeLimeSDR();
+
+    // LMS channel of the RX channel ch (0 is LMS_Channel)
+    size_t lmsRXChannel(size_t ch) const { return (LMS_Channel + ch) % RADIO_MAX_RX_CHANNELS; }
     
     void initStreaming();
     void stopStreaming();
 
+    // setup and start the RX streams with the values of m_tuner
+    void setupRXStreaming();
+
+    // RX streams destroyed and set up again (new throughputVsLatency of m_tuner) - TX keeps streaming
+    void restartRXStreaming();
+
+    // stop / restart the set up streams (e.g. around a calibration) without destroying them
+    void pauseStreaming();
+    void resumeStreaming();
+
+    // restore the setting at frequency from the calibration cache - false if it is not cached (or did not lock)
+    bool restoreCalibration(double frequency);
+
+    // calibrate RX and TX at the current setting and add it to the cache - the streams have to be paused
+    void runCalibration(double frequency);
+
     void printRadioConfig();
 
     int initLimeGPIO();
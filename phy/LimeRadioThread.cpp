@@ -3,6 +3,7 @@
 #include "LimeRadioThread.h"
 #include "lime/LimeSuite.h"
 #include "liquid/liquid.h"
+#include <algorithm>
 #include <memory>
 #include <chrono>
 #include <complex>
@@ -10,6 +11,31 @@
 //////////////////////////
 /// LimeRadioThread stuff
 
+// dataFmt of lms_stream_t is an anonymous enum
+typedef decltype(lms_stream_t::dataFmt) lms_data_fmt_t;
+
+static lms_data_fmt_t lmsDataFmt(IQStreamFormat format)
+{
+    switch (format)
+    {
+    case IQStreamFormat::I12:
+        return lms_stream_t::LMS_FMT_I12;
+    case IQStreamFormat::I16:
+        return lms_stream_t::LMS_FMT_I16;
+    default:
+        return lms_stream_t::LMS_FMT_F32;
+    }
+}
+
+typedef decltype(lms_stream_t::linkFmt) lms_link_fmt_t;
+
+// wire format on the USB link - I16 host samples keep their 16 bit, F32 and I12 are packed to 12 bit (the LimeSuite
+// default, set explicitly)
+static lms_link_fmt_t lmsLinkFmt(IQStreamFormat format)
+{
+    return format == IQStreamFormat::I16 ? lms_stream_t::LMS_LINK_FMT_I16 : lms_stream_t::LMS_LINK_FMT_I12;
+}
+
 LimeRadioThread::LimeRadioThread()
         : RadioThread(), m_rxSampleCnt{RadioThread::m_sampleBufferCnt}, m_txSampleCnt{RadioThread::m_sampleBufferCnt}
 {
@@ -22,6 +48,12 @@ LimeRadioThread::LimeRadioThread()
     set_HW_RX();
     set_HW_SDR_ON();
 
+    // stream values of the IQ capture - large FIFO, balanced throughput
+    RadioStreamConfig config;
+    config.fifo_size = 1024 * 1024;
+    config.throughput_vs_latency = 0.5;
+    m_tuner.configure(config, m_sampleBufferCnt, blockCapacity());
+
     initStreaming();
 }
 
@@ -37,6 +69,12 @@ LimeRadioThread::LimeRadioThread(int sampleBufferCnt)
     set_HW_RX();
     set_HW_SDR_ON();
 
+    // stream values of the IQ capture - large FIFO, balanced throughput
+    RadioStreamConfig config;
+    config.fifo_size = 1024 * 1024;
+    config.throughput_vs_latency = 0.5;
+    m_tuner.configure(config, m_sampleBufferCnt, blockCapacity());
+
     initStreaming();
 }
 
@@ -50,9 +88,10 @@ LimeRadioThread::~LimeRadioThread()
 }
 
 /**
- * @brief run() is receiving and sending the data via the Lime - a quick hack for the start
+ * @brief run() is receiving the data via the Lime while tx_main() sends the blocks of the TX queue on an own thread
  *
- * @todo move RX/TX stuff to own function ; thread either runs as RX or TX
+ * @note RX and TX stream at the same time (full duplex) - the RF frontend is switched to TX only for the air time
+ *       of the TX blocks (see RadioTRSwitch), RX keeps its timeline in between
  *
  */
 void LimeRadioThread::run()
@@ -62,123 +101,226 @@ void LimeRadioThread::run()
 
     m_isRxTxRunning.store(true);
 
-    m_IQdataRXQueue = std::static_pointer_cast<RadioThreadIQDataQueue>(RadioThread::getRXQueue());
-    m_IQdataTXQueue = std::static_pointer_cast<RadioThreadIQDataQueue>(RadioThread::getTXQueue());
+    for (size_t ch = 0; ch < m_rxChannels; ch++)
+        m_IQdataRXQueue[ch] = RadioThread::getRXQueue(ch);
+    m_IQdataTXQueue = RadioThread::getTXQueue();
+    m_blockPool = RadioThread::getBlockPool();
 
-    LOG_RADIO_DEBUG("run() rx stream handle {}", m_rx_streamId.handle);
-    LOG_RADIO_DEBUG("run() m_rxIQbuffer {}", m_rxIQbuffer);
-    LOG_RADIO_DEBUG("run() m_IQdataRXQueue {}", m_IQdataRXQueue.use_count());
+    LOG_RADIO_DEBUG("run() rx stream handle {} rx channels {}", m_rx_streamId[0].handle, m_rxChannels);
+    LOG_RADIO_DEBUG("run() m_IQdataRXQueue {}", m_IQdataRXQueue[0].use_count());
     LOG_RADIO_DEBUG("run() tx stream handle {}", m_tx_streamId.handle);
-    LOG_RADIO_DEBUG("run() m_txIQbuffer {}", m_txIQbuffer);
     LOG_RADIO_DEBUG("run() m_IQdataTXQueue {}", m_IQdataTXQueue.use_count());
 
     printRadioConfig();
 
+    float_type rate, rf_rate;
+    LMS_GetSampleRate(m_lms_device, LMS_CH_RX, 0, &rate, &rf_rate);
+
+    // the frontend follows the timestamps of the TX blocks; the sample clock is anchored by the RX stream status
+    RadioTRSwitch trSwitch([this](bool tx) { switch_HW_TR(tx); }, rate);
+    LMS_GetStreamStatus(&m_rx_streamId[0], &m_rx_status);
+    trSwitch.anchor(m_rx_status.timestamp);
+
+    std::thread t_tx(&LimeRadioThread::tx_main, this, std::ref(trSwitch));
+
     double samplesTotalRX = 0;
-    double samplesTotalTX = 0;
+    uint64_t rxBlocks = 0;
+
+    // stream format can only be changed while the thread is not running
+    const float rxScale = 1.0f / iqStreamFormatFullScale(m_streamFormat);
 
     // run until thread gets terminated, or stopped (stopping -> true)
     while (!stopping)
     {
-        if (m_isRX)
+        bool restartRX = false;
+
+        // retunes and calibrations of other threads (setFrequency(), tryFrequency(), ...) stop and start the streams
+        // under m_stream_mutex - they are applied between the receives, a waiting one goes first
+        while (m_stream_waiters.load() > 0)
+            std::this_thread::yield();
+        std::unique_lock<std::mutex> streamLock(m_stream_mutex);
+
+        // Receive samples of each RX channel directly into a block - liquid_float_complex matches the interleaved
+        // F32 layout IQIQIQ... of the channel stream; the integer formats are received into m_rxIQbufferI16 and
+        // converted into the block
+        auto t1 = std::chrono::steady_clock::now();
+        for (size_t ch = 0; ch < m_rxChannels; ch++)
         {
+            // block comes preallocated from the pool - no heap allocation per block
+            RadioThreadIQDataPtr& block = m_rxIQdataOut[ch];
+            block = m_blockPool->acquire();
+            block->data.resize(m_rxSampleCnt);
+            block->channel = ch;
+
+            int samplesRead;
+            if (m_streamFormat == IQStreamFormat::F32)
+            {
+                samplesRead = LMS_RecvStream(&m_rx_streamId[ch], block->data.data(), m_rxSampleCnt, &m_rx_metadata[ch], 500);
+            }
+            else
+            {
+                samplesRead = LMS_RecvStream(&m_rx_streamId[ch], m_rxIQbufferI16.data(), m_rxSampleCnt, &m_rx_metadata[ch], 500);
+                if (samplesRead > 0)
+                    iq_convert_i16_to_cf(m_rxIQbufferI16.data(), block->data.data(), samplesRead, rxScale);
+            }
 
-            // Receive samples
-            int samplesRead = LMS_RecvStream(&m_rx_streamId, m_rxIQbuffer, m_rxSampleCnt, &m_rx_metadata, 500);
+            // a retune restarts the streams under the lock - the samples of this receive are at m_frequency
+            block->timestampFirstSample = m_rx_metadata[ch].timestamp;
+            block->sampleRate = (long long)m_sampleRate.load();
+            block->frequency = (long long)m_frequency.load();
+            block->data.resize(samplesRead > 0 ? samplesRead : 0);
 
-            // I and Q samples are interleaved in buffer: IQIQIQ...
-            float *pp = (float *)m_rxIQbuffer;
-            liquid_float_complex s;
+            if (samplesRead > 0)
+                m_metrics.rx_samples.add(samplesRead);
+        }
 
-            // @tcheck  suboptimal ??
-            m_rxIQdataOut = std::make_shared<RadioThreadIQData>();
+        // the channels are delivered with the same timestamps
+        m_rxAlign.align(m_rx_streamId, m_rxIQdataOut, m_rxChannels);
 
-            m_rxIQdataOut->timestampFirstSample = m_rx_metadata.timestamp;
+        const auto recv_time = std::chrono::steady_clock::now() - t1;
+        m_metrics.rx_recv_time.record(recv_time);
+        m_tuner.record(recv_time);
 
-            if (samplesRead > 0)
+        // FIFO fill and overruns - the status call is not needed for every block; the hardware timestamp of the
+        // status re-anchors the sample clock of the TX/RX switch
+        if ((++rxBlocks % RADIO_METRICS_STATUS_BLOCKS) == 0)
+        {
+            for (size_t ch = 0; ch < m_rxChannels; ch++)
             {
-
-                for (int i = 0; i < samplesRead; i++)
+                LMS_GetStreamStatus(&m_rx_streamId[ch], &m_rx_status);
+                m_metrics.update_rx(m_rx_status);
+                if (ch == 0)
                 {
-                    s.real(pp[2 * i]);
-                    s.imag(pp[2 * i + 1]);
-
-                    m_rxIQdataOut->data.push_back(s);
+                    trSwitch.anchor(m_rx_status.timestamp);
+                    restartRX = m_tuner.update(m_rx_status);
                 }
             }
+        }
 
-            // add new sample buffer block in queue
-            if (!m_IQdataRXQueue->push(m_rxIQdataOut))
-            {
-                LOG_RADIO_ERROR("IQ buffer could not be pushed to Queue");
-            }
+        streamLock.unlock();
 
-            samplesTotalRX += samplesRead;
+        // add new sample buffer block in queue
+        if (!m_IQdataRXQueue[0]->push(m_rxIQdataOut[0]))
+        {
+            LOG_RADIO_ERROR("IQ buffer could not be pushed to Queue (overflow count {})", m_IQdataRXQueue[0]->overflow_count());
         }
-        else
+
+        // the other channels go to their own queue (e.g. sensing) - without queue the block is dropped
+        for (size_t ch = 1; ch < m_rxChannels; ch++)
         {
+            if (m_IQdataRXQueue[ch] != nullptr && !m_IQdataRXQueue[ch]->push(m_rxIQdataOut[ch]))
+            {
+                LOG_RADIO_DEBUG("IQ buffer of channel {} could not be pushed to Queue (overflow count {})", ch, m_IQdataRXQueue[ch]->overflow_count());
+            }
+            m_rxIQdataOut[ch].reset();
+        }
 
-            // Transmit Samples
+        samplesTotalRX += m_rxIQdataOut[0]->data.size();
 
-            // @tcheck  suboptimal ??
-            m_txIQdataOut = std::make_shared<RadioThreadIQData>();
+        // block size of the next receive; a new throughputVsLatency needs new RX streams (the TX worker keeps
+        // streaming, the switch is re-anchored with the next status)
+        if (restartRX)
+            restartRXStreaming();
+        m_rxSampleCnt = m_tuner.blockSamples();
+    }
 
-            // get queue item
-            if (m_IQdataTXQueue->pop(m_txIQdataOut))
-            {
+    t_tx.join();
+    trSwitch.stop();
 
-                auto samplesWrite = m_txIQdataOut->data.size();
+    // the TX worker is gone - run() is the only consumer left, blocks not sent are dropped
+    m_IQdataTXQueue->flush();
 
-                // I and Q samples are interleaved in buffer: IQIQIQ...
-                float *pp = (float *)m_txIQbuffer;
-                liquid_float_complex s;
+    m_isRxTxRunning.store(false);
+    LOG_RADIO_DEBUG("Total Samples RX {}", samplesTotalRX);
+    LOG_RADIO_DEBUG("IQ block pool misses {}", m_blockPool->miss_count());
+    LOG_RADIO_TRACE("SDR thread done.");
+}
 
-                if (samplesWrite > 0)
-                {
+/**
+ * @brief TX worker of run() - sends the blocks of the TX queue with their hardware timestamp (waitForTimestamp),
+ *        i.e. the blocks go to the air at their timestamp independent of when they are popped
+ *
+ * @param trSwitch the air time of each block is registered for the frontend switching
+ */
+void LimeRadioThread::tx_main(RadioTRSwitch& trSwitch)
+{
+    uint64_t txBlocks = 0;
+    double samplesTotalTX = 0;
 
-                    for (int i = 0; i < samplesWrite; i++)
-                    {
+    const float txScale = iqStreamFormatFullScale(m_streamFormat) - 1;
 
-                        s = m_rxIQdataOut->data.front();
-                        pp[2 * i] = s.real();
-                        pp[2 * i + 1] = s.imag();
+    while (!stopping)
+    {
+        // get queue item
+        if (!m_IQdataTXQueue->wait_pop(m_txIQdataOut, RADIO_TX_WAIT_MS))
+            continue;
 
-                        m_rxIQdataOut->data.pop_front();
-                    }
+        auto samplesWrite = m_txIQdataOut->data.size();
 
-                    // Send samples with delay from RX (waitForTimestamp is enabled)
-                    m_tx_metadata.timestamp = m_txIQdataOut->timestampFirstSample;
-                    LMS_SendStream(&m_tx_streamId, m_txIQbuffer, samplesWrite, &m_tx_metadata, 500);
+        if (samplesWrite > 0)
+        {
+            // the TX stream is stopped by retunes and calibrations (lockStreams()) - a waiting one goes first
+            while (m_stream_waiters.load() > 0)
+                std::this_thread::yield();
+            std::lock_guard<std::mutex> streamLock(m_tx_stream_mutex);
+
+            trSwitch.schedule_tx(m_txIQdataOut->timestampFirstSample, samplesWrite);
+
+            // Send samples directly from the block with delay from RX (waitForTimestamp is enabled); a block larger
+            // than the stream buffer (m_txSampleCnt) is sent in parts with consecutive timestamps
+            size_t samplesSent = 0;
+            auto t1 = std::chrono::steady_clock::now();
+            for (size_t offset = 0; offset < samplesWrite; offset += m_txSampleCnt)
+            {
+                const size_t n = std::min(samplesWrite - offset, (size_t)m_txSampleCnt);
+                m_tx_metadata.timestamp = m_txIQdataOut->timestampFirstSample + offset;
 
-                    samplesTotalTX += samplesWrite;
+                int sent;
+                if (m_streamFormat == IQStreamFormat::F32)
+                {
+                    sent = LMS_SendStream(&m_tx_streamId, m_txIQdataOut->data.data() + offset, n, &m_tx_metadata, 500);
+                }
+                else
+                {
+                    // m_txIQbufferI16 holds m_txSampleCnt samples (initStreaming())
+                    iq_convert_cf_to_i16(m_txIQdataOut->data.data() + offset, m_txIQbufferI16.data(), n, txScale, txScale);
+                    sent = LMS_SendStream(&m_tx_streamId, m_txIQbufferI16.data(), n, &m_tx_metadata, 500);
                 }
+
+                if (sent < 0)
+                {
+                    LOG_RADIO_ERROR("tx_main() send of {} samples @ {} failed - rest of the block dropped", n, m_tx_metadata.timestamp);
+                    break;
+                }
+                samplesSent += sent;
+                if ((size_t)sent < n)
+                    LOG_RADIO_WARN("tx_main() {} of {} samples @ {} sent", sent, n, m_tx_metadata.timestamp);
+            }
+
+            m_metrics.tx_send_time.record(std::chrono::steady_clock::now() - t1);
+            m_metrics.tx_samples.add(samplesSent);
+
+            if ((++txBlocks % RADIO_METRICS_STATUS_BLOCKS) == 0)
+            {
+                LMS_GetStreamStatus(&m_tx_streamId, &m_tx_status);
+                m_metrics.update_tx(m_tx_status);
             }
+
+            samplesTotalTX += samplesSent;
         }
+
+        m_txIQdataOut.reset();
     }
 
-    m_isRxTxRunning.store(false);
-    LOG_RADIO_DEBUG("Total Samples RX {}", samplesTotalRX);
     LOG_RADIO_DEBUG("Total Samples TX {}", samplesTotalTX);
-    LOG_RADIO_TRACE("SDR thread done.");
 }
 
 void LimeRadioThread::terminate()
 {
     RadioThread::terminate();
 
-    m_IQdataRXQueue = std::static_pointer_cast<RadioThreadIQDataQueue>(RadioThread::getRXQueue());
-
-    if (m_IQdataRXQueue != nullptr)
-    {
-        m_IQdataRXQueue->flush();
-    }
-
-    m_IQdataTXQueue = std::static_pointer_cast<RadioThreadIQDataQueue>(RadioThread::getTXQueue());
-
-    if (m_IQdataTXQueue != nullptr)
-    {
-        m_IQdataTXQueue->flush();
-    }
+    // no flush of the queues here - run() and tx_main() may still push / pop, the TX queue is flushed by run()
+    // once the TX worker is joined
 
     // GPIO STREAM LED off
     // GPIO SDR LED off
@@ -262,65 +404,76 @@ void LimeRadioThread::closeLimeSDR()
     LMS_Close(m_lms_device);
 }
 
-void LimeRadioThread::initStreaming()
+void LimeRadioThread::setupRXStreaming()
 {
 
     // RX Streaming Setup
     LOG_RADIO_TRACE("Init RX Streaming");
 
-    // Initialize stream
-    m_rx_streamId.channel = LMS_Channel;               // channel number
-    m_rx_streamId.fifoSize = 1024 * 1024;              // fifo size in samples
-    m_rx_streamId.throughputVsLatency = 0.5;           // optimize for max throughput
-    m_rx_streamId.isTx = false;                        // RX channel
-    m_rx_streamId.dataFmt = lms_stream_t::LMS_FMT_F32; // F32 not optimal but easier with liquid @todo check for 12bit
-    if (LMS_SetupStream(m_lms_device, &m_rx_streamId) != 0)
-        error();
-
-    // allocate memory for IQ Buffer used by LMS_Receive
-    if (m_rxIQbuffer != nullptr)
+    // Initialize one stream per RX channel - all streams are set up before they are started, so the channels
+    // start on the same timestamp
+    for (size_t ch = 0; ch < m_rxChannels; ch++)
     {
-        ::free(m_rxIQbuffer);
+        m_rx_streamId[ch].channel = lmsRXChannel(ch);          // channel number
+        m_rx_streamId[ch].fifoSize = m_tuner.fifoSize();       // fifo size in samples
+        m_rx_streamId[ch].throughputVsLatency = m_tuner.throughputVsLatency();     // 0 lowest latency - 1 max throughput
+        m_rx_streamId[ch].isTx = false;                        // RX channel
+        m_rx_streamId[ch].dataFmt = lmsDataFmt(m_streamFormat);  // host buffer - int16 halves it compared to F32
+        m_rx_streamId[ch].linkFmt = lmsLinkFmt(m_streamFormat);
+        if (LMS_SetupStream(m_lms_device, &m_rx_streamId[ch]) != 0)
+            error();
     }
-    m_rxIQbuffer = std::malloc(m_rxSampleCnt * 4 * sizeof(float));
 
-    LOG_RADIO_TRACE("initStreaming() rxSampleCnt {}", m_rxSampleCnt);
-    LOG_RADIO_TRACE("initStreaming() m_rxIQbuffer {}", m_rxIQbuffer);
-    LOG_RADIO_TRACE("initStreaming() size m_rxIQbuffer {}", m_rxSampleCnt * 4 * sizeof(int16_t));
+    // F32 samples are received directly into the blocks of the IQBlockPool (see run()); the integer formats need
+    // an int16 buffer which is then converted into the block - sized for the largest block of the tuner
+    m_rxSampleCnt = m_tuner.blockSamples();
+    if (m_streamFormat != IQStreamFormat::F32)
+        m_rxIQbufferI16.assign(2 * m_tuner.maxBlockSamples(), 0);
+    else
+        m_rxIQbufferI16.clear();
+
+    LOG_RADIO_TRACE("setupRXStreaming() rxSampleCnt {} format {} rx channels {}", m_rxSampleCnt, iqStreamFormatName(m_streamFormat), m_rxChannels);
 
     // Start streaming
-    if (LMS_StartStream(&m_rx_streamId) != 0)
-        LOG_RADIO_ERROR("RX StartStream Error");
+    for (size_t ch = 0; ch < m_rxChannels; ch++)
+    {
+        if (LMS_StartStream(&m_rx_streamId[ch]) != 0)
+            LOG_RADIO_ERROR("RX StartStream Error (channel {})", ch);
 
-    LOG_RADIO_TRACE("initStreaming() rx stream handle {}", m_rx_streamId.handle);
-    LOG_APP_INFO("Started RX Streaming, SampleCount: {}", m_rxSampleCnt);
+        // Streaming Metadata
+        m_rx_metadata[ch].flushPartialPacket = false; // currently has no effect in RX
+        m_rx_metadata[ch].waitForTimestamp = false;   // currently has no effect in RX
+    }
 
-    // Streaming Metadata
-    m_rx_metadata.flushPartialPacket = false; // currently has no effect in RX
-    m_rx_metadata.waitForTimestamp = false;   // currently has no effect in RX
+    LOG_RADIO_TRACE("setupRXStreaming() rx stream handle {}", m_rx_streamId[0].handle);
+    LOG_APP_INFO("Started RX Streaming, SampleCount: {}, Channels: {}", m_rxSampleCnt, m_rxChannels);
+}
+
+void LimeRadioThread::initStreaming()
+{
+
+    setupRXStreaming();
 
     // TX Streaming Setup
     LOG_RADIO_INFO("Init TX Streaming");
 
     // Initialize TX stream
     m_tx_streamId.channel = LMS_Channel;               // channel number
-    m_tx_streamId.fifoSize = 1024 * 1024;              // fifo size in samples
-    m_tx_streamId.throughputVsLatency = 0.5;           // optimize for max throughput
+    m_tx_streamId.fifoSize = m_tuner.fifoSize();       // fifo size in samples
+    m_tx_streamId.throughputVsLatency = m_tuner.config().throughput_vs_latency;    // optimize for max throughput
     m_tx_streamId.isTx = true;                         // RX channel
-    m_tx_streamId.dataFmt = lms_stream_t::LMS_FMT_F32; // F32 not optimal but easier with liquid @todo check for 12bit
+    m_tx_streamId.dataFmt = lmsDataFmt(m_streamFormat);
+    m_tx_streamId.linkFmt = lmsLinkFmt(m_streamFormat);
     if (LMS_SetupStream(m_lms_device, &m_tx_streamId) != 0)
         error();
 
-    // allocate memory for IQ Buffer used by LMS_Receive
-    if (m_txIQbuffer != nullptr)
-    {
-        ::free(m_txIQbuffer);
-    }
-    m_txIQbuffer = std::malloc(m_txSampleCnt * 4 * sizeof(float));
+    // F32 samples are sent directly from the blocks popped from the TX queue (see run())
+    if (m_streamFormat != IQStreamFormat::F32)
+        m_txIQbufferI16.assign(2 * m_txSampleCnt, 0);
+    else
+        m_txIQbufferI16.clear();
 
-    LOG_RADIO_TRACE("initStreaming() txSampleCnt {}", m_txSampleCnt);
-    LOG_RADIO_TRACE("initStreaming() m_txIQbuffer {}", m_txIQbuffer);
-    LOG_RADIO_TRACE("initStreaming() size m_txIQbuffer {}", m_txSampleCnt * 4 * sizeof(int16_t));
+    LOG_RADIO_TRACE("initStreaming() txSampleCnt {} format {}", m_txSampleCnt, iqStreamFormatName(m_streamFormat));
 
     // Start streaming
     if (LMS_StartStream(&m_tx_streamId) != 0)
@@ -343,12 +496,11 @@ void LimeRadioThread::stopStreaming()
     // Stop streaming
     LOG_RADIO_TRACE("Stop Streaming");
 
-    std::free(m_rxIQbuffer);
-
-    LMS_StopStream(&m_rx_streamId);                  // stream is stopped but can be started again with LMS_StartStream()
-    LMS_DestroyStream(m_lms_device, &m_rx_streamId); // stream is deallocated and can no longer be used
-
-    std::free(m_txIQbuffer);
+    for (size_t ch = 0; ch < m_rxChannels; ch++)
+    {
+        LMS_StopStream(&m_rx_streamId[ch]);                  // stream is stopped but can be started again with LMS_StartStream()
+        LMS_DestroyStream(m_lms_device, &m_rx_streamId[ch]); // stream is deallocated and can no longer be used
+    }
 
     LMS_StopStream(&m_tx_streamId);                  // stream is stopped but can be started again with LMS_StartStream()
     LMS_DestroyStream(m_lms_device, &m_tx_streamId); // stream is deallocated and can no longer be used
@@ -357,12 +509,122 @@ void LimeRadioThread::stopStreaming()
     set_HW_STREAM_LED_OFF();
 }
 
+void LimeRadioThread::setStreamFormat(IQStreamFormat format)
+{
+    LOG_RADIO_TRACE("setStreamFormat() set stream format to {}", iqStreamFormatName(format));
+
+    if (format == m_streamFormat)
+        return;
+
+    if (m_isRxTxRunning.load())
+    {
+        LOG_RADIO_ERROR("setStreamFormat() stream format cannot be changed while the thread is running");
+        return;
+    }
+
+    // the data format can only be set on stream setup - destroy and setup the streams again
+    stopStreaming();
+    m_streamFormat = format;
+    initStreaming();
+
+    LOG_APP_INFO("Set StreamFormat: {}", iqStreamFormatName(format));
+}
+
+void LimeRadioThread::restartRXStreaming()
+{
+    std::lock_guard<std::mutex> lock(m_stream_mutex);
+
+    for (size_t ch = 0; ch < m_rxChannels; ch++)
+    {
+        LMS_StopStream(&m_rx_streamId[ch]);
+        LMS_DestroyStream(m_lms_device, &m_rx_streamId[ch]);
+    }
+
+    setupRXStreaming();
+}
+
+void LimeRadioThread::setStreamConfig(const RadioStreamConfig& config)
+{
+    LOG_RADIO_TRACE("setStreamConfig() block {} fifo {} throughputVsLatency {}", config.block_samples, config.fifo_size, config.throughput_vs_latency);
+
+    if (m_isRxTxRunning.load())
+    {
+        LOG_RADIO_ERROR("setStreamConfig() stream config cannot be changed while the thread is running");
+        return;
+    }
+
+    // fifo size and throughputVsLatency can only be set on stream setup - destroy and setup the streams again
+    stopStreaming();
+    m_tuner.configure(config, m_sampleBufferCnt, blockCapacity());
+    initStreaming();
+
+    LOG_APP_INFO("Set StreamConfig: {} block {} samples, fifo {}, throughputVsLatency {}", config.adaptive ? "adaptive" : "fixed",
+                 m_tuner.blockSamples(), m_tuner.fifoSize(), m_tuner.throughputVsLatency());
+}
+
+void LimeRadioThread::setRXChannels(size_t channels)
+{
+    LOG_RADIO_TRACE("setRXChannels() set {} RX channels", channels);
+
+    if (channels < 1 || channels > RADIO_MAX_RX_CHANNELS)
+    {
+        LOG_RADIO_ERROR("setRXChannels() {} RX channels are not supported (1 .. {})", channels, RADIO_MAX_RX_CHANNELS);
+        return;
+    }
+
+    if (channels == m_rxChannels)
+        return;
+
+    if (m_isRxTxRunning.load())
+    {
+        LOG_RADIO_ERROR("setRXChannels() RX channels cannot be changed while the thread is running");
+        return;
+    }
+
+    // streams are set up per channel - destroy and setup the streams again; the RX LO of the LMS7002M is shared by
+    // both RX channels, so the center frequency needs no extra setting
+    stopStreaming();
+    for (size_t ch = 1; ch < RADIO_MAX_RX_CHANNELS; ch++)
+    {
+        if (LMS_EnableChannel(m_lms_device, LMS_CH_RX, lmsRXChannel(ch), ch < channels) != 0)
+            error();
+    }
+    m_rxChannels = channels;
+
+    // the cache key covers the RX channels - the new channel set has its own calibration
+    if (m_calibrationCache != nullptr && !restoreCalibration(m_frequency))
+        runCalibration(m_frequency);
+
+    initStreaming();
+
+    LOG_APP_INFO("Set RX Channels: {}", channels);
+}
+
 void LimeRadioThread::setFrequency(float_t frequency)
 {
     LOG_RADIO_TRACE("setFrequency() set freq to {} MHZ", frequency);
 
-    LMS_StopStream(&m_rx_streamId);
-    LMS_StopStream(&m_tx_streamId);
+    auto lock = lockStreams();
+    retune(frequency);
+}
+
+void LimeRadioThread::retune(double frequency)
+{
+    auto t0 = std::chrono::steady_clock::now();
+
+    // the streams are stopped for the retune - the restart drops the samples of the old LO still in the FIFO, the
+    // sample clock (CGEN) is not touched
+    pauseStreaming();
+    m_frequency = frequency;
+
+    // cached setting - LO and correctors are written back
+    if (m_calibrationCache != nullptr && restoreCalibration(frequency))
+    {
+        resumeStreaming();
+        m_metric_retune.record(std::chrono::steady_clock::now() - t0);
+        LOG_APP_INFO("Set CenterFreq: {} MHz (calibration cache)", frequency);
+        return;
+    }
 
     // Set center frequency to freq
     if (LMS_SetLOFrequency(m_lms_device, LMS_CH_RX, 0, frequency) != 0)
@@ -372,30 +634,183 @@ void LimeRadioThread::setFrequency(float_t frequency)
     if (LMS_SetLOFrequency(m_lms_device, LMS_CH_TX, 0, frequency) != 0)
         error();
 
-    if (LMS_StartStream(&m_rx_streamId) != 0)
-        LOG_RADIO_ERROR("RX StartStream Error");
-    if (LMS_StartStream(&m_tx_streamId) != 0)
-        LOG_RADIO_ERROR("TX StartStream Error");
+    // new setting - calibrated once, the next retune to it comes from the cache
+    if (m_calibrationCache != nullptr)
+        runCalibration(frequency);
+
+    resumeStreaming();
 
+    m_metric_retune.record(std::chrono::steady_clock::now() - t0);
     LOG_APP_INFO("Set CenterFreq: {} MHz", frequency);
 }
 
+bool LimeRadioThread::tryFrequency(float_t frequency)
+{
+    LOG_RADIO_TRACE("tryFrequency() {} Hz", frequency);
+
+    auto lock = lockStreams();
+
+    // without a cache setFrequency() does not calibrate either
+    if (m_calibrationCache == nullptr) {
+        retune(frequency);
+        return true;
+    }
+
+    // the streams are stopped as in retune() - the blocks after the restart are stamped with the new frequency
+    auto t0 = std::chrono::steady_clock::now();
+    pauseStreaming();
+
+    if (!restoreCalibration(frequency)) {
+        // a failed restore may have written part of the setting - back to the current one
+        if (!restoreCalibration(m_frequency))
+            LOG_RADIO_ERROR("tryFrequency() {} Hz could not be restored", m_frequency.load());
+        resumeStreaming();
+        return false;
+    }
+
+    m_frequency = frequency;
+    resumeStreaming();
+
+    m_metric_retune.record(std::chrono::steady_clock::now() - t0);
+    return true;
+}
+
+void LimeRadioThread::precalibrate(const std::vector<double>& frequencies)
+{
+    if (m_calibrationCache == nullptr)
+        return;
+
+    auto lock = lockStreams();
+
+    const double current = m_frequency;
+    size_t calibrated = 0;
+
+    // the streams stay stopped for the whole sweep - retune() starts them again at the current frequency
+    pauseStreaming();
+
+    for (double frequency : frequencies) {
+        if (restoreCalibration(frequency))
+            continue;
+
+        if (LMS_SetLOFrequency(m_lms_device, LMS_CH_RX, 0, frequency) != 0)
+            error();
+        if (LMS_SetLOFrequency(m_lms_device, LMS_CH_TX, 0, frequency) != 0)
+            error();
+
+        runCalibration(frequency);
+        calibrated++;
+    }
+
+    retune(current);
+
+    LOG_RADIO_INFO("precalibrate() {} of {} settings calibrated, {} Hz", calibrated, frequencies.size(), current);
+}
+
 void LimeRadioThread::setSamplingRate(float_t sampling_rate, size_t oversampling)
 {
-    LOG_RADIO_TRACE("setFrequency() set sampling_rate {} and oversampling {}", sampling_rate, oversampling);
+    LOG_RADIO_TRACE("setSamplingRate() set sampling_rate {} and oversampling {}", sampling_rate, oversampling);
 
-    LMS_StopStream(&m_rx_streamId);
-    LMS_StopStream(&m_tx_streamId);
+    auto lock = lockStreams();
+
+    // the sample rate changes CGEN and the interface clock - the streams have to be stopped, the blocks after the
+    // restart are stamped with the new rate
+    pauseStreaming();
 
     if (LMS_SetSampleRate(m_lms_device, sampling_rate, oversampling) != 0)
         error();
 
-    if (LMS_StartStream(&m_rx_streamId) != 0)
-        LOG_RADIO_ERROR("RX StartStream Error");
+    // the rate the device runs at (the CGEN steps) goes with the RX blocks
+    float_type rate, rf_rate;
+    m_sampleRate = LMS_GetSampleRate(m_lms_device, LMS_CH_RX, 0, &rate, &rf_rate) == 0 ? rate : sampling_rate;
+
+    // the calibration depends on the sample rate (filter bandwidth)
+    if (m_calibrationCache != nullptr && !restoreCalibration(m_frequency))
+        runCalibration(m_frequency);
+
+    resumeStreaming();
+
+    LOG_APP_INFO("Set SampleRate: {} MHz and OverSampling: {}", sampling_rate, oversampling);
+}
+
+void LimeRadioThread::setCalibrationCache(const std::string& file)
+{
+    LOG_RADIO_TRACE("setCalibrationCache() {}", file);
+
+    auto lock = lockStreams();
+
+    m_calibrationCache.reset(new LimeCalibrationCache(file));
+
+    // the current setting is restored (or calibrated) right away
+    if (!restoreCalibration(m_frequency))
+    {
+        pauseStreaming();
+        runCalibration(m_frequency);
+        resumeStreaming();
+    }
+
+    LOG_APP_INFO("Calibration cache {} ({} settings)", file, m_calibrationCache->size());
+}
+
+LimeRadioThread::StreamLock LimeRadioThread::lockStreams()
+{
+    m_stream_waiters++;
+    StreamLock lock{std::unique_lock<std::mutex>(m_stream_mutex), std::unique_lock<std::mutex>(m_tx_stream_mutex)};
+    m_stream_waiters--;
+    return lock;
+}
+
+void LimeRadioThread::pauseStreaming()
+{
+    for (size_t ch = 0; ch < m_rxChannels; ch++)
+        LMS_StopStream(&m_rx_streamId[ch]);
+    LMS_StopStream(&m_tx_streamId);
+}
+
+void LimeRadioThread::resumeStreaming()
+{
+    for (size_t ch = 0; ch < m_rxChannels; ch++)
+        if (LMS_StartStream(&m_rx_streamId[ch]) != 0)
+            LOG_RADIO_ERROR("RX StartStream Error (channel {})", ch);
     if (LMS_StartStream(&m_tx_streamId) != 0)
         LOG_RADIO_ERROR("TX StartStream Error");
+}
 
-    LOG_APP_INFO("Set SampleRate: {} MHz and OverSampling: {}", sampling_rate, oversampling);
+bool LimeRadioThread::restoreCalibration(double frequency)
+{
+    auto key = LimeCalibrationCache::makeKey(m_lms_device, frequency, m_rxChannels);
+    if (!m_calibrationCache->restore(m_lms_device, key))
+        return false;
+
+    LOG_RADIO_DEBUG("restoreCalibration() {} Hz restored from {}", frequency, m_calibrationCache->getFile());
+    return true;
+}
+
+void LimeRadioThread::runCalibration(double frequency)
+{
+    auto t0 = std::chrono::steady_clock::now();
+
+    float_type rate, rf_rate;
+    LMS_GetSampleRate(m_lms_device, LMS_CH_RX, 0, &rate, &rf_rate);
+
+    for (size_t ch = 0; ch < m_rxChannels; ch++)
+    {
+        if (LMS_Calibrate(m_lms_device, LMS_CH_RX, lmsRXChannel(ch), rate, 0) != 0)
+        {
+            LOG_RADIO_ERROR("runCalibration() RX calibration failed (channel {}) - {} Hz not cached", ch, frequency);
+            return;
+        }
+    }
+    if (LMS_Calibrate(m_lms_device, LMS_CH_TX, LMS_Channel, rate, 0) != 0)
+    {
+        LOG_RADIO_ERROR("runCalibration() TX calibration failed - {} Hz not cached", frequency);
+        return;
+    }
+
+    if (!m_calibrationCache->capture(m_lms_device, LimeCalibrationCache::makeKey(m_lms_device, frequency, m_rxChannels)))
+        LOG_RADIO_WARN("runCalibration() {} Hz not stored in {}", frequency, m_calibrationCache->getFile());
+
+    LOG_APP_INFO("Calibrated {} Hz @ {} Sps in {} ms", frequency, rate,
+                 std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count());
 }
 
 void LimeRadioThread::printRadioConfig()
@@ -444,6 +859,8 @@ void LimeRadioThread::set_HW_SDR_ON()
 
     LOG_RADIO_TRACE("set_HW_SDR_ON() called");
 
+    std::lock_guard<std::mutex> lock(m_gpio_mutex);
+
     uint8_t gpio_val = 0;
     if (LMS_GPIORead(m_lms_device, &gpio_val, 1) != 0)
     {
@@ -461,6 +878,7 @@ void LimeRadioThread::set_HW_SDR_ON()
         error();
     }
 
+    m_gpio_val = gpio_val;
     LOG_RADIO_TRACE("set_HW_SDR_ON() gpio readback {0:X}", gpio_val);
     LOG_APP_INFO("Set SDR_ON LED: {0:X}", gpio_val);
 }
@@ -475,6 +893,8 @@ void LimeRadioThread::set_HW_SDR_OFF()
 
     LOG_RADIO_TRACE("set_HW_SDR_OFF() called");
 
+    std::lock_guard<std::mutex> lock(m_gpio_mutex);
+
     uint8_t gpio_val = 0;
     if (LMS_GPIORead(m_lms_device, &gpio_val, 1) != 0)
     {
@@ -492,6 +912,7 @@ void LimeRadioThread::set_HW_SDR_OFF()
         error();
     }
 
+    m_gpio_val = gpio_val;
     LOG_RADIO_TRACE("set_HW_SDR_OFF() gpio readback {0:X}", gpio_val);
     LOG_APP_INFO("Set SDR_OFF LED: {0:X}", gpio_val);
 }
@@ -508,6 +929,10 @@ void LimeRadioThread::set_HW_RX()
 
     LOG_RADIO_TRACE("set_HW_RX() called");
 
+    std::lock_guard<std::mutex> lock(m_gpio_mutex);
+
+    m_isRX.store(true);
+
     // GPIO0=LOW - RX, GPIO1=LOW - PA off, GPIO2=LOW & GPIO3=LOW - 50Mhz Bandfilter
     // Set GPIOs to RX mode
     //
@@ -533,6 +958,7 @@ void LimeRadioThread::set_HW_RX()
         error();
     }
 
+    m_gpio_val = gpio_val;
     LOG_RADIO_TRACE("set_HW_RX() gpio readback {0:X}", gpio_val);
     LOG_APP_INFO("Set RX_MODE: {0:X}", gpio_val);
 }
@@ -549,6 +975,10 @@ void LimeRadioThread::set_HW_TX(uint8_t m)
     // TX_6M,
     // TX_2M,
     // TX_70cm
+    std::lock_guard<std::mutex> lock(m_gpio_mutex);
+
+    m_isRX.store(false);
+
     uint8_t gpio_val = 0;
     // Read and log GPIO values
     if (LMS_GPIORead(m_lms_device, &gpio_val, 1) != 0)
@@ -574,10 +1004,40 @@ void LimeRadioThread::set_HW_TX(uint8_t m)
         error();
     }
 
+    m_gpio_val = gpio_val;
     LOG_RADIO_TRACE("set_HW_TX() gpio readback {0:X}", gpio_val);
     LOG_APP_INFO("Set Mode to {}", m_modeName[m]);
 }
 
+/**
+ * @brief frontend switch of RadioTRSwitch - RX, or TX in the mode of set_HW_TX_mode(), for every burst
+ * @brief write only (no read / readback over USB) from the last written value, logged at TRACE - the switch
+ *        happens within the guard time of the burst
+ *
+ * @param tx
+ */
+void LimeRadioThread::switch_HW_TR(bool tx)
+{
+    std::lock_guard<std::mutex> lock(m_gpio_mutex);
+
+    m_isRX.store(!tx);
+
+    // keep state of STREAM LED, SDR LED on; RX or TX mode with its LED
+    uint8_t gpio_val = (m_gpio_val & m_setGPIOLED4) | m_setGPIOLED1;
+    if (tx)
+        gpio_val = gpio_val | m_modeGPIO[get_HW_TX_mode()] | m_setGPIOLED2;
+    else
+        gpio_val = gpio_val | m_setGPIORX | m_setGPIOLED3;
+
+    if (LMS_GPIOWrite(m_lms_device, &gpio_val, 1) != 0)
+    {
+        error();
+    }
+    m_gpio_val = gpio_val;
+
+    LOG_RADIO_TRACE("switch_HW_TR() {} gpio {:X}", tx ? m_modeName[get_HW_TX_mode()] : m_modeName[0], gpio_val);
+}
+
 /**
  * @brief Set GPIO to indicate to peripheral unit, that SDR is ON (e.g. LED)
  * @brief current value of gpio_val || 0x01
@@ -588,6 +1048,8 @@ void LimeRadioThread::set_HW_STREAM_LED_ON()
 
     LOG_RADIO_TRACE("set_HW_STREAM_LED_ON() called");
 
+    std::lock_guard<std::mutex> lock(m_gpio_mutex);
+
     uint8_t gpio_val = 0;
     if (LMS_GPIORead(m_lms_device, &gpio_val, 1) != 0)
     {
@@ -605,6 +1067,7 @@ void LimeRadioThread::set_HW_STREAM_LED_ON()
         error();
     }
 
+    m_gpio_val = gpio_val;
     LOG_RADIO_TRACE("set_HW_STREAM_LED_ON() gpio readback {0:X}", gpio_val);
     LOG_APP_INFO("Set STREAM LED ON: {0:X}", gpio_val);
 }
@@ -614,6 +1077,8 @@ void LimeRadioThread::set_HW_STREAM_LED_OFF()
 
     LOG_RADIO_TRACE("set_HW_STREAM_LED_OFF() called");
 
+    std::lock_guard<std::mutex> lock(m_gpio_mutex);
+
     uint8_t gpio_val = 0;
     if (LMS_GPIORead(m_lms_device, &gpio_val, 1) != 0)
     {
@@ -631,6 +1096,7 @@ void LimeRadioThread::set_HW_STREAM_LED_OFF()
         error();
     }
 
+    m_gpio_val = gpio_val;
     LOG_RADIO_TRACE("set_HW_STREAM_LED_OFF() gpio readback {0:X}", gpio_val);
     LOG_APP_INFO("Set STREAM LED OFF: {0:X}", gpio_val);
 }
\ No newline at end of file
@@ -16,13 +16,23 @@
 #include "lime/LimeSuite.h"
 #include "liquid/liquid.h"
 #include "phy/RadioThread.h"
+#include "phy/RadioMetrics.h"
+#include "phy/LimeRxAlign.h"
+#include "phy/RadioTRSwitch.h"
+#include "phy/LimeCalibrationCache.h"
+#include "phy/RadioStreamTuner.h"
 
 #include "util/log.h"
 
+
+// max wait of the TX worker for a block (stop latency)
+#define RADIO_TX_WAIT_MS    100
+
+
 class LimeRadioThread : public RadioThread {
 public:
 
-    size_t LMS_Channel = 0;
+    size_t LMS_Channel = 0;     // TX channel and first RX channel
 
 
     LimeRadioThread();
@@ -33,7 +43,13 @@ public:
     void terminate() override;
 
     void setFrequency(float_t frequency) override;
+    bool tryFrequency(float_t frequency) override;
+    void precalibrate(const std::vector<double>& frequencies) override;
     void setSamplingRate(float_t sampling_rate, size_t oversampling) override;
+    void setStreamFormat(IQStreamFormat format) override;
+    void setRXChannels(size_t channels) override;
+    void setCalibrationCache(const std::string& file) override;
+    void setStreamConfig(const RadioStreamConfig& config) override;
     // void getIQData();
     // void setIQData();
 
@@ -48,38 +64,96 @@ private:
 
 
     lms_device_t* m_lms_device = NULL;
-    lms_stream_t m_rx_streamId;         // RX stream structure
+    lms_stream_t m_rx_streamId[RADIO_MAX_RX_CHANNELS];      // RX stream structure per RX channel
     lms_stream_t m_tx_streamId;         // TX stream structure
-    lms_stream_meta_t m_rx_metadata;    // Use metadata for additional control over sample receive function behavior
+    lms_stream_meta_t m_rx_metadata[RADIO_MAX_RX_CHANNELS]; // Use metadata for additional control over sample receive function behavior
     lms_stream_meta_t m_tx_metadata;    // Use metadata for additional control over sample receive function behavior
+    lms_stream_status_t m_rx_status;    // status of RX stream from LMS_GetStreamStatus (for the metrics)
+    lms_stream_status_t m_tx_status;    // status of TX stream from LMS_GetStreamStatus (for the metrics)
+
+    std::mutex m_stream_mutex;      // receive and RX stream re-setup of run() vs. the stream stop / start of retunes and calibrations
+    std::mutex m_tx_stream_mutex;   // send of tx_main() vs. the stream stop / start of retunes and calibrations
+    std::atomic_int m_stream_waiters{0};   // threads waiting in lockStreams() - run() and tx_main() do not lock before them
+
+    struct StreamLock {
+        std::unique_lock<std::mutex> rx;
+        std::unique_lock<std::mutex> tx;
+    };
 
 
     //data buffers for RX
-    const int m_rxSampleCnt; //complex samples per buffer is set via constructor
-    void *m_rxIQbuffer  { nullptr };
+    int m_rxSampleCnt; //complex samples per buffer - set via constructor, adjusted by m_tuner
+    std::vector<int16_t> m_rxIQbufferI16;   // LMS_RecvStream buffer for the I12/I16 formats, converted into the block
+
+    RadioStreamTuner m_tuner;   // RX block size, FIFO size and throughputVsLatency
 
-    RadioThreadIQDataQueuePtr m_IQdataRXQueue; // = std::make_shared<RadioThreadIQDataQueue>();
-    RadioThreadIQDataPtr m_rxIQdataOut;
+    ThreadIQDataQueueBasePtr m_IQdataRXQueue[RADIO_MAX_RX_CHANNELS];
+    RadioThreadIQDataPtr m_rxIQdataOut[RADIO_MAX_RX_CHANNELS];
+    IQBlockPoolPtr m_blockPool;
+
+    LimeRxAlign m_rxAlign;  // keeps the blocks of the RX channels on the same timestamps
 
     //data buffers for TX
     const int m_txSampleCnt; //complex samples per buffer is set via constructor
-    void *m_txIQbuffer  { nullptr };
+    std::vector<int16_t> m_txIQbufferI16;   // LMS_SendStream buffer for the I12/I16 formats
 
-    RadioThreadIQDataQueuePtr m_IQdataTXQueue; // = std::make_shared<RadioThreadIQDataQueue>();
+    ThreadIQDataQueueBasePtr m_IQdataTXQueue;
     RadioThreadIQDataPtr m_txIQdataOut;
 
+    RadioStreamMetrics m_metrics;
+
+    // LO and calibration per setting - without cache the device is not calibrated (LMS_Init defaults)
+    std::unique_ptr<LimeCalibrationCache> m_calibrationCache;
+    // written under m_stream_mutex with the streams stopped - stamped on the RX blocks by run()
+    std::atomic<double> m_frequency{DEFAULT_CENTER_FREQ};    // last requested center frequency (key of the cache)
+    std::atomic<double> m_sampleRate{DEFAULT_SAMPLE_RATE};   // host sample rate of setSamplingRate()
+
+    MetricHistogram& m_metric_retune = Metrics::instance().histogram("radio_retune_seconds", "time of a center frequency change");
+
+
 
+    void tx_main(RadioTRSwitch& trSwitch);
 
     int initLimeSDR();
     void closeLimeSDR();
 
+    // LMS channel of the RX channel ch (0 is LMS_Channel)
+    size_t lmsRXChannel(size_t ch) const { return (LMS_Channel + ch) % RADIO_MAX_RX_CHANNELS; }
+
     void initStreaming();
     void stopStreaming();
 
+    // setup and start the RX streams with the values of m_tuner
+    void setupRXStreaming();
+
+    // RX streams destroyed and set up again (new throughputVsLatency of m_tuner) - TX keeps streaming
+    void restartRXStreaming();
+
+    // LO of RX and TX to frequency from the calibration cache, else tuned (and calibrated with a cache) - the streams
+    // are stopped and started again; lockStreams() has to be held
+    void retune(double frequency);
+
+    // both stream mutexes for the retunes and calibrations of other threads - run() holds m_stream_mutex for each
+    // receive, tx_main() m_tx_stream_mutex for each send
+    StreamLock lockStreams();
+
+    // stop / restart the set up streams (e.g. around a calibration) without destroying them
+    void pauseStreaming();
+    void resumeStreaming();
+
+    // restore the setting at frequency from the calibration cache - false if it is not cached (or did not lock)
+    bool restoreCalibration(double frequency);
+
+    // calibrate RX and TX at the current setting and add it to the cache - the streams have to be paused
+    void runCalibration(double frequency);
+
     void printRadioConfig();
 
     int initLimeGPIO();
 
+    // frontend switch of RadioTRSwitch (every TX burst) - write only
+    void switch_HW_TR(bool tx);
+
     int error();
 
 
@@ -95,6 +169,9 @@ private:
     uint8_t m_setGPIOLED3 = 0x40;   // GPIO6=HIGH
     uint8_t m_setGPIOLED4 = 0x80;   // GPIO7=HIGH
 
+    std::mutex m_gpio_mutex;    // GPIO read-modify-write of the set_HW_*() functions vs. the frontend switch of run()
+    uint8_t m_gpio_val = 0;     // last written GPIO value - the frontend switch does not read the GPIOs
+
     std::string m_modeName[5] = {"RX", "TXDirect", "TX6m", "TX2m", "TX70cm"};
     uint8_t m_modeGPIO[5] = {m_setGPIORX, m_setGPIOTXDirect, m_setGPIOTX6m, m_setGPIOTX2m, m_setGPIOTX70cm};
 
@@ -0,0 +1,87 @@
+#include "phy/LimeRxAlign.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+LimeRxAlign::LimeRxAlign() :
+        m_scratch(LIME_RX_ALIGN_CHUNK),
+        m_metric_realign(Metrics::instance().counter("radio_rx_channel_realign_total", "RX channel streams which were realigned on the timestamps")),
+        m_metric_discarded(Metrics::instance().counter("radio_rx_channel_discarded_samples_total", "samples dropped to realign the RX channel streams")) {
+}
+
+
+uint64_t LimeRxAlign::align(lms_stream_t *streams, const IQBlockPtr *blocks, size_t channels) {
+
+    if (channels < 2)
+        return 0;
+
+    uint64_t first = 0;
+    uint64_t last = UINT64_MAX;
+    uint64_t end_max = 0;
+    bool aligned = true;
+
+    for (size_t i = 0; i < channels; i++) {
+        // a short read without samples has no timestamp - it shows up as offset on the next read
+        if (blocks[i]->data.empty())
+            return 0;
+
+        const uint64_t ts = blocks[i]->timestampFirstSample;
+        const uint64_t end = ts + blocks[i]->data.size();
+
+        aligned = aligned && ts == blocks[0]->timestampFirstSample && blocks[i]->data.size() == blocks[0]->data.size();
+        first = std::max(first, ts);
+        last = std::min(last, end);
+        end_max = std::max(end_max, end);
+    }
+
+    if (aligned)
+        return 0;
+
+    // keep the span all channels cover - without overlap the samples of this read are dropped altogether
+    uint64_t offset = 0;
+    for (size_t i = 0; i < channels; i++) {
+        IQBlock& block = *blocks[i];
+        const uint64_t end = block.timestampFirstSample + block.data.size();
+
+        if (last > first) {
+            const size_t head = first - block.timestampFirstSample;
+            const size_t n = last - first;
+            if (head > 0)
+                std::memmove(block.data.data(), block.data.data() + head, n * sizeof(liquid_float_complex));
+            block.data.resize(n);
+            block.timestampFirstSample = first;
+        } else {
+            block.data.clear();
+            block.timestampFirstSample = end_max;
+        }
+
+        // the next read of this stream starts at end - read off the samples up to the stream which is ahead
+        offset = std::max(offset, end_max - end);
+        discard(streams[i], end_max - end);
+    }
+
+    m_metric_realign.add();
+    LOG_RADIO_WARN("LimeRxAlign::align() RX channels offset by {} samples - realigned at timestamp {}", offset, end_max);
+
+    return offset;
+}
+
+
+void LimeRxAlign::discard(lms_stream_t& stream, uint64_t samples) {
+
+    lms_stream_meta_t metadata;
+    metadata.flushPartialPacket = false;
+    metadata.waitForTimestamp = false;
+
+    while (samples > 0) {
+        const size_t n = std::min<uint64_t>(samples, m_scratch.size());
+        const int read = LMS_RecvStream(&stream, m_scratch.data(), n, &metadata, 500);
+        if (read <= 0) {
+            LOG_RADIO_ERROR("LimeRxAlign::discard() RX stream stalled with {} samples left to read off", samples);
+            return;
+        }
+        samples -= read;
+        m_metric_discarded.add(read);
+    }
+}
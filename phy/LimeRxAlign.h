@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#include "lime/LimeSuite.h"
+#include "liquid/liquid.h"
+#include "phy/DefaultRadioConfig.h"
+#include "phy/IQBlock.h"
+
+#include "util/log.h"
+#include "util/Metrics.h"
+
+
+// samples read off a stream per LMS_RecvStream call when it is realigned
+#define LIME_RX_ALIGN_CHUNK     4096
+
+
+/**
+ * LimeRxAlign class
+ *
+ * @note keeps the RX streams of the channels of one LimeSDR on the same timestamps; LimeRadio and LimeRadioThread
+ *       read the streams one after the other with the same sample count, which normally returns the same
+ *       timestamp for each channel - after an overrun or a short read on one FIFO the streams are offset
+ * @note align() trims the blocks of one read to the span all channels cover and reads the offset off the streams
+ *       which are behind, so the next reads start on the same timestamp again
+ *
+ */
+class LimeRxAlign {
+public:
+
+    LimeRxAlign();
+
+    /**
+     * @brief align the blocks received on streams[0..channels-1] in the same read
+     *
+     * @param streams RX streams of the channels
+     * @param blocks received blocks of the channels (timestampFirstSample and data set)
+     * @param channels number of channels
+     * @return uint64_t samples the blocks were offset, 0 if they were aligned
+     */
+    uint64_t align(lms_stream_t *streams, const IQBlockPtr *blocks, size_t channels);
+
+private:
+
+    void discard(lms_stream_t& stream, uint64_t samples);
+
+    // samples read off a stream which is behind; large enough for F32 and for the I12/I16 formats
+    std::vector<liquid_float_complex> m_scratch;
+
+    MetricCounter& m_metric_realign;
+    MetricCounter& m_metric_discarded;
+
+};
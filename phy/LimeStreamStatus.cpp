@@ -0,0 +1,42 @@
+#include "phy/LimeStreamStatus.h"
+
+
+bool LimeStreamStatus::read(lms_stream_t *stream, lms_stream_status_t& status, Cursor& cursor) {
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return read_locked(stream, status, cursor);
+}
+
+
+bool LimeStreamStatus::read(lms_stream_t *stream, lms_stream_status_t& status) {
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return read_locked(stream, status, m_shared);
+}
+
+
+bool LimeStreamStatus::read_locked(lms_stream_t *stream, lms_stream_status_t& status, Cursor& cursor) {
+
+    lms_stream_status_t s;
+    if (LMS_GetStreamStatus(stream, &s) != 0)
+        return false;
+
+    m_totals.overrun += s.overrun;
+    m_totals.underrun += s.underrun;
+    m_totals.dropped += s.droppedPackets;
+
+    status = s;
+    status.overrun = (uint32_t)(m_totals.overrun - cursor.overrun);
+    status.underrun = (uint32_t)(m_totals.underrun - cursor.underrun);
+    status.droppedPackets = (uint32_t)(m_totals.dropped - cursor.dropped);
+    cursor = m_totals;
+
+    return true;
+}
+
+
+LimeStreamStatus::Cursor LimeStreamStatus::totals() {
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_totals;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+
+#include "lime/LimeSuite.h"
+
+
+/**
+ * LimeStreamStatus class
+ *
+ * @note status of one LMS stream - LMS_GetStreamStatus() resets the overrun, underrun and droppedPackets counters
+ *       of the stream, i.e. two threads reading the same stream (e.g. the RX thread for the tuner and the metrics,
+ *       the TX side for the timestamp) would split the counts between them; all reads of a stream go through one
+ *       LimeStreamStatus which sums the counts, each reader gets the counts since its own last read (Cursor)
+ * @note the reads are serialized - the caller still has to keep the stream from being destroyed during a read
+ *
+ */
+class LimeStreamStatus {
+public:
+
+    struct Cursor {
+        uint64_t overrun = 0;
+        uint64_t underrun = 0;
+        uint64_t dropped = 0;
+    };
+
+    /**
+     * @brief LMS_GetStreamStatus() of stream; overrun, underrun and droppedPackets of status are the counts since
+     *        the last read with the same cursor
+     *
+     * @param stream
+     * @param status
+     * @param cursor counts seen by the reader so far
+     * @return false if the status call failed (status and cursor unchanged)
+     */
+    bool read(lms_stream_t *stream, lms_stream_status_t& status, Cursor& cursor);
+
+    /**
+     * @brief as above with the cursor of this LimeStreamStatus - readers sharing it (e.g. several threads) get each
+     *        count exactly once
+     */
+    bool read(lms_stream_t *stream, lms_stream_status_t& status);
+
+    /**
+     * @brief counts of all reads so far
+     */
+    Cursor totals();
+
+private:
+
+    bool read_locked(lms_stream_t *stream, lms_stream_status_t& status, Cursor& cursor);
+
+    std::mutex m_mutex;
+    Cursor m_totals;
+    Cursor m_shared;        // cursor of read() without a cursor
+
+};
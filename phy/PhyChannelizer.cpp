@@ -0,0 +1,192 @@
+#include "phy/PhyChannelizer.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+
+PhyChannelizer::PhyChannelizer(unsigned int num_channels, double input_rate, double center_freq, size_t input_block_capacity)
+        : m_num_channels(num_channels), m_input_rate(input_rate), m_center_freq(center_freq),
+          m_stopping(false), m_isRunning(false) {
+
+    if (num_channels < 2 || num_channels > PHY_CHANNELIZER_MAX_CHANNELS) {
+        throw std::invalid_argument("PhyChannelizer: number of channels out of range");
+    }
+
+    LOG_PHY_DEBUG("PhyChannelizer::PhyChannelizer() {} sub-channels of {} Sps around {} Hz", m_num_channels, getChannelRate(), m_center_freq);
+
+    m_filterbank = firpfbch_crcf_create_kaiser(LIQUID_ANALYZER, m_num_channels, PHY_CHANNELIZER_FILTER_DELAY, PHY_CHANNELIZER_STOPBAND_DB);
+
+    m_chunk.resize(m_num_channels);
+    m_out.resize(m_num_channels);
+
+    // an input block of n samples and the < N samples left over from the last one give at most n / N + 1 samples
+    // for each sub-channel
+    m_pool = IQBlockPool::create(PHY_CHANNELIZER_POOL_BLOCKS * m_num_channels, input_block_capacity / m_num_channels + 1);
+}
+
+
+PhyChannelizer::~PhyChannelizer() {
+
+    LOG_PHY_DEBUG("PhyChannelizer destructor");
+
+    firpfbch_crcf_destroy(m_filterbank);
+}
+
+
+void PhyChannelizer::threadMain() {
+    run();
+}
+
+
+void PhyChannelizer::terminate() {
+    LOG_PHY_DEBUG("PhyChannelizer::terminate()");
+    m_stopping.store(true);
+}
+
+
+void PhyChannelizer::setInputQueue(const ThreadIQDataQueueBasePtr& threadQueue) {
+    std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
+    m_input_queue = threadQueue;
+}
+
+
+void PhyChannelizer::setOutputQueue(unsigned int c, const ThreadIQDataQueueBasePtr& threadQueue) {
+    if (c >= m_num_channels) {
+        LOG_PHY_ERROR("PhyChannelizer::setOutputQueue() sub-channel {} out of range (0 .. {})", c, m_num_channels - 1);
+        return;
+    }
+    std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
+    m_output_queue[c] = threadQueue;
+}
+
+
+double PhyChannelizer::getChannelFrequency(unsigned int c) const {
+    return m_center_freq + ((double) c - (double) (m_num_channels / 2)) * getChannelRate();
+}
+
+
+void PhyChannelizer::reset() {
+    firpfbch_crcf_reset(m_filterbank);
+    m_chunk_fill = 0;
+    m_started = false;
+}
+
+
+void PhyChannelizer::distribute(size_t index) {
+
+    const int half = (int) (m_num_channels / 2);
+    for (unsigned int c = 0; c < m_num_channels; c++) {
+        if (m_out_block[c] == nullptr)
+            continue;
+        // sub-channel c is FFT bin c - N/2, the negative offsets are the upper half of the bins
+        const unsigned int bin = (unsigned int) ((int) c - half + (int) m_num_channels) % m_num_channels;
+        m_out_block[c]->data[index] = m_out[bin];
+    }
+}
+
+
+void PhyChannelizer::execute(const RadioThreadIQDataPtr& block) {
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    const size_t N = m_num_channels;
+    const size_t n = block->data.size();
+    const uint64_t ts = block->timestampFirstSample;
+
+    // the filterbank state only continues over contiguous input
+    if (m_started && ts != m_next_in_ts) {
+        LOG_PHY_DEBUG("PhyChannelizer::execute() input gap {} -> {}", m_next_in_ts, ts);
+        m_metric_gaps.add();
+        reset();
+    }
+    m_started = true;
+    m_next_in_ts = ts + n;
+
+    if (m_chunk_fill == 0)
+        m_chunk_ts = ts;
+
+    const size_t outputs = (m_chunk_fill + n) / N;
+    if (outputs == 0) {
+        std::copy(block->data.begin(), block->data.end(), m_chunk.begin() + m_chunk_fill);
+        m_chunk_fill += n;
+        return;
+    }
+
+    for (unsigned int c = 0; c < N; c++) {
+        if (m_output_queue[c] == nullptr)
+            continue;
+        auto& out = m_out_block[c];
+        out = m_pool->acquire();
+        out->data.resize(outputs);
+        out->timestampFirstSample = m_chunk_ts / N;
+        out->sampleRate = (long long) getChannelRate();
+        out->frequency = (long long) getChannelFrequency(c);
+        out->channel = c;
+    }
+
+    size_t i = 0;
+    size_t o = 0;
+
+    // complete the samples left over from the last block
+    if (m_chunk_fill > 0) {
+        i = N - m_chunk_fill;
+        std::copy(block->data.begin(), block->data.begin() + i, m_chunk.begin() + m_chunk_fill);
+        firpfbch_crcf_analyzer_execute(m_filterbank, m_chunk.data(), m_out.data());
+        distribute(o++);
+    }
+
+    // whole chunks are taken from the block directly
+    for (; i + N <= n; i += N) {
+        firpfbch_crcf_analyzer_execute(m_filterbank, &block->data[i], m_out.data());
+        distribute(o++);
+    }
+
+    m_chunk_fill = n - i;
+    m_chunk_ts = ts + i;
+    std::copy(block->data.begin() + i, block->data.end(), m_chunk.begin());
+
+    for (unsigned int c = 0; c < N; c++) {
+        if (m_out_block[c] == nullptr)
+            continue;
+        if (!m_output_queue[c]->push(m_out_block[c])) {
+            LOG_PHY_DEBUG("PhyChannelizer::execute() block of sub-channel {} could not be pushed to Queue (overflow count {})", c, m_output_queue[c]->overflow_count());
+        }
+        m_out_block[c].reset();
+    }
+
+    m_metric_block_time.record(std::chrono::steady_clock::now() - t1);
+}
+
+
+void PhyChannelizer::run() {
+
+    ThreadIQDataQueueBasePtr queue;
+    {
+        std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
+        queue = m_input_queue;
+    }
+
+    if (queue == nullptr) {
+        LOG_PHY_ERROR("PhyChannelizer::run() no input queue set");
+        return;
+    }
+
+    LOG_PHY_INFO("PhyChannelizer::run() {} sub-channels of {} Sps", m_num_channels, getChannelRate());
+
+    m_isRunning.store(true);
+
+    RadioThreadIQDataPtr block;
+
+    while (!m_stopping) {
+        if (queue->wait_pop(block, PHY_CHANNELIZER_WAIT_MS)) {
+            execute(block);
+            block.reset();
+        }
+    }
+
+    m_isRunning.store(false);
+
+    LOG_PHY_INFO("PhyChannelizer::run() stopped");
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "liquid/liquid.h"
+
+#include "phy/RadioThread.h"
+#include "phy/IQBlock.h"
+
+#include "util/log.h"
+#include "util/Metrics.h"
+
+
+#define PHY_CHANNELIZER_MAX_CHANNELS    16
+#define PHY_CHANNELIZER_FILTER_DELAY    4           // prototype filter semi-length in output samples
+#define PHY_CHANNELIZER_STOPBAND_DB     60.0f       // prototype filter stop-band attenuation
+#define PHY_CHANNELIZER_POOL_BLOCKS     256         // output blocks per sub-channel
+#define PHY_CHANNELIZER_WAIT_MS         100         // max wait for an input block (stop latency)
+
+
+/**
+ * PhyChannelizer class
+ *
+ * @note splits one wide capture (num_channels x channel rate around the center frequency) into num_channels
+ *       decimated sub-channel streams with a critically sampled polyphase analysis filterbank (liquid firpfbch);
+ *       each sub-channel has its own IQ queue, i.e. frame sync, spectrum and sensing can run per sub-channel on
+ *       own threads instead of retuning the radio
+ * @note sub-channel c (0 .. num_channels - 1) is centered at center + (c - num_channels / 2) * channel rate, i.e.
+ *       the sub-channels are in ascending frequency and num_channels / 2 is the one on the center frequency
+ * @note critically sampled - the band edges of neighbour sub-channels alias into each other over the transition
+ *       band of the prototype filter; the guard band of the OFDM symbol covers it
+ * @note the output timestamps run on the sub-channel sample clock (input timestamp / num_channels); a gap in the
+ *       input timestamps shows up as gap in the output timestamps
+ * @note only sub-channels with a queue are produced; the blocks come from an own pool per channelizer, sized for
+ *       input blocks up to input_block_capacity samples (larger ones grow the output blocks on the heap)
+ *
+ */
+class PhyChannelizer {
+public:
+
+    /**
+     * @param num_channels number of sub-channels (2 .. PHY_CHANNELIZER_MAX_CHANNELS)
+     * @param input_rate sample rate of the wide capture (Hz)
+     * @param center_freq center frequency of the wide capture (Hz)
+     * @param input_block_capacity samples of the largest input block - bounds the output blocks of the pool
+     */
+    PhyChannelizer(unsigned int num_channels, double input_rate, double center_freq, size_t input_block_capacity = DEFAULT_SAMPLEBUFFERCNT);
+
+    ~PhyChannelizer();
+
+    PhyChannelizer(const PhyChannelizer&) = delete;
+
+    PhyChannelizer& operator=(const PhyChannelizer&) = delete;
+
+    void threadMain();
+
+    void terminate();
+
+    void setInputQueue(const ThreadIQDataQueueBasePtr& threadQueue);
+
+    /**
+     * @brief queue of sub-channel c - has to be set before the thread is started
+     */
+    void setOutputQueue(unsigned int c, const ThreadIQDataQueueBasePtr& threadQueue);
+
+    /**
+     * @brief channelize one block of the wide capture and push a block to each sub-channel queue
+     */
+    void execute(const RadioThreadIQDataPtr& block);
+
+    /**
+     * @brief drop the filterbank state and the pending input samples (e.g. after a retune)
+     */
+    void reset();
+
+    unsigned int getNumChannels() const { return m_num_channels; }
+
+    double getChannelRate() const { return m_input_rate / m_num_channels; }
+
+    double getChannelFrequency(unsigned int c) const;
+
+    bool isRunning() { return m_isRunning.load(); }
+
+private:
+
+    void run();
+
+    void distribute(size_t index);
+
+    const unsigned int m_num_channels;
+    const double m_input_rate;
+    const double m_center_freq;
+
+    firpfbch_crcf m_filterbank;
+
+    // expected timestamp of the next input block, input timestamp of m_chunk[0]
+    bool m_started = false;
+    uint64_t m_next_in_ts = 0;
+    uint64_t m_chunk_ts = 0;
+
+    // input samples which did not fill a whole filterbank input of num_channels samples
+    std::vector<liquid_float_complex> m_chunk;
+    size_t m_chunk_fill = 0;
+
+    // filterbank output of one input chunk, indexed by FFT bin
+    std::vector<liquid_float_complex> m_out;
+
+    // output blocks of the current input block, indexed by sub-channel
+    RadioThreadIQDataPtr m_out_block[PHY_CHANNELIZER_MAX_CHANNELS];
+
+    ThreadIQDataQueueBasePtr m_input_queue;
+    ThreadIQDataQueueBasePtr m_output_queue[PHY_CHANNELIZER_MAX_CHANNELS];
+    IQBlockPoolPtr m_pool;
+    std::mutex m_queue_bindings_mutex;
+
+    std::atomic_bool m_stopping;
+    std::atomic_bool m_isRunning;
+
+    MetricHistogram& m_metric_block_time = Metrics::instance().histogram("phy_channelizer_block_seconds", "channelizer time per input block");
+    MetricCounter& m_metric_gaps = Metrics::instance().counter("phy_channelizer_input_gaps_total", "timestamp gaps of the channelizer input");
+
+};
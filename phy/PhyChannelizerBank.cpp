@@ -0,0 +1,73 @@
+#include "phy/PhyChannelizerBank.h"
+
+
+PhyChannelizerBank::PhyChannelizerBank(unsigned int num_channels, double channel_rate, double center_freq, size_t input_block_capacity)
+        : m_channelizer(num_channels, captureRate(num_channels, channel_rate), center_freq, input_block_capacity) {
+
+    LOG_PHY_DEBUG("PhyChannelizerBank::PhyChannelizerBank() {} sub-channels", num_channels);
+}
+
+
+PhyChannelizerBank::~PhyChannelizerBank() {
+
+    stop();
+}
+
+
+ThreadIQDataQueueBasePtr PhyChannelizerBank::start(const ThreadIQDataQueueBasePtr& input, unsigned int spectrum_channel,
+                                                   const std::vector<unsigned int>& phy_channels, const std::string& queue_type,
+                                                   size_t oversampling, const std::function<void(PhyThread *)>& configure) {
+
+    m_channelizer.setInputQueue(input);
+
+    ThreadIQDataQueueBasePtr spectrum = createRadioThreadIQDataQueue(queue_type, PHY_CHANNELIZER_BANK_QUEUE_DEPTH);
+    m_channelizer.setOutputQueue(spectrum_channel, spectrum);
+
+    for (unsigned int c : phy_channels) {
+        if (c >= m_channelizer.getNumChannels() || c == spectrum_channel) {
+            LOG_PHY_ERROR("PhyChannelizerBank::start() Channelizer PHY_CHANNELS {} out of range or used by the spectrum - skipped", c);
+            continue;
+        }
+        ThreadIQDataQueueBasePtr queue = createRadioThreadIQDataQueue(queue_type, PHY_CHANNELIZER_BANK_QUEUE_DEPTH);
+        m_channelizer.setOutputQueue(c, queue);
+
+        // the phy owns its radio; the sub-channel threads are left to the scheduler (no Threads config)
+        QueueRadio *radio = new QueueRadio(queue);
+        PhyThread *phy = new PhyThread(PhyThread::PhyMode::CPE, m_channelizer.getChannelRate(), oversampling, m_channelizer.getChannelFrequency(c), radio);
+        if (configure)
+            configure(phy);
+        LOG_PHY_INFO("PhyChannelizerBank::start() sub-channel {} @ {} Hz - CPE phy", c, m_channelizer.getChannelFrequency(c));
+
+        m_radios.push_back(radio);
+        m_phys.push_back(phy);
+        m_phy_threads.emplace_back(&PhyThread::threadMain, phy);
+    }
+
+    m_thread = std::thread(&PhyChannelizer::threadMain, &m_channelizer);
+
+    return spectrum;
+}
+
+
+void PhyChannelizerBank::stop() {
+
+    if (!m_thread.joinable())
+        return;
+
+    m_channelizer.terminate();
+    m_thread.join();
+
+    // the sub-channel phys stop at the end of their queue
+    for (QueueRadio *radio : m_radios)
+        radio->terminate();
+    for (std::thread& t : m_phy_threads)
+        t.join();
+    for (PhyThread *phy : m_phys)
+        delete(phy);
+
+    m_radios.clear();
+    m_phys.clear();
+    m_phy_threads.clear();
+
+    LOG_PHY_DEBUG("PhyChannelizerBank::stop() done");
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "phy/PhyChannelizer.h"
+#include "phy/PhyThread.h"
+#include "phy/QueueRadio.h"
+#include "phy/RadioThread.h"
+
+#include "util/log.h"
+
+
+#define PHY_CHANNELIZER_BANK_QUEUE_DEPTH    2000        // blocks of the sub-channel queues (spectrum and phys)
+
+
+/**
+ * PhyChannelizerBank class
+ *
+ * @note channelizer of the wide capture with its consumers - the spectrum gets one sub-channel, a CPE PhyThread
+ *       (on a QueueRadio of the sub-channel queue) runs on each of the phy channels; start() creates the queues,
+ *       the phys and the threads, stop() joins and deletes them
+ * @note the capture (radio sample rate) has to cover all sub-channels - see captureRate()
+ *
+ */
+class PhyChannelizerBank {
+public:
+
+    /**
+     * @param num_channels number of sub-channels (2 .. PHY_CHANNELIZER_MAX_CHANNELS)
+     * @param channel_rate sample rate of a sub-channel (Hz)
+     * @param center_freq center frequency of the wide capture (Hz)
+     * @param input_block_capacity samples of the largest input block (block capacity of the radio pool)
+     */
+    PhyChannelizerBank(unsigned int num_channels, double channel_rate, double center_freq, size_t input_block_capacity);
+
+    ~PhyChannelizerBank();
+
+    PhyChannelizerBank(const PhyChannelizerBank&) = delete;
+
+    PhyChannelizerBank& operator=(const PhyChannelizerBank&) = delete;
+
+    /**
+     * @brief sample rate of the radio for num_channels sub-channels of channel_rate (num_channels 1: no channelizer)
+     */
+    static double captureRate(unsigned int num_channels, double channel_rate) { return channel_rate * (num_channels > 1 ? num_channels : 1); }
+
+    /**
+     * @brief start the channelizer on input and the phys of phy_channels
+     *
+     * @param input queue of the wide capture
+     * @param spectrum_channel sub-channel for the spectrum
+     * @param phy_channels sub-channels with a CPE phy (out of range ones and the spectrum channel are skipped)
+     * @param queue_type type of the sub-channel queues (see createRadioThreadIQDataQueue())
+     * @param oversampling of the phys
+     * @param configure called for each phy before it is started (detector, pipeline, ...)
+     * @return queue of the spectrum sub-channel
+     */
+    ThreadIQDataQueueBasePtr start(const ThreadIQDataQueueBasePtr& input, unsigned int spectrum_channel,
+                                   const std::vector<unsigned int>& phy_channels, const std::string& queue_type,
+                                   size_t oversampling, const std::function<void(PhyThread *)>& configure);
+
+    /**
+     * @brief stop the channelizer, the phys stop at the end of their queues
+     */
+    void stop();
+
+    PhyChannelizer& getChannelizer() { return m_channelizer; }
+
+private:
+
+    PhyChannelizer m_channelizer;
+    std::thread m_thread;
+
+    std::vector<QueueRadio *> m_radios;     // owned by the phys
+    std::vector<PhyThread *> m_phys;
+    std::vector<std::thread> m_phy_threads;
+
+};
@@ -0,0 +1,199 @@
+#include "phy/PhyDSPKernels.h"
+
+#include <atomic>
+#include <cmath>
+#include <complex>
+
+#include "util/log.h"
+
+
+static std::atomic<const PhyDSPKernels *> s_active{nullptr};
+
+
+// plain float loops with independent partial sums - std::complex and a single accumulator keep the compiler from
+// vectorizing without -ffast-math
+
+static float scalar_energy(const liquid_float_complex *x, size_t n) {
+
+    const float *f = reinterpret_cast<const float *>(x);
+
+    float acc[8] = {0.0f};
+    size_t i = 0;
+    for (; i + 8 <= 2*n; i += 8)
+        for (unsigned int l = 0; l < 8; l++)
+            acc[l] += f[i+l]*f[i+l];
+    for (; i < 2*n; i++)
+        acc[0] += f[i]*f[i];
+
+    float e = 0.0f;
+    for (float a : acc)
+        e += a;
+    return e;
+}
+
+static void scalar_mag2_acc(const liquid_float_complex *x, float *y, size_t n) {
+
+    const float *f = reinterpret_cast<const float *>(x);
+    for (size_t i = 0; i < n; i++)
+        y[i] += f[2*i]*f[2*i] + f[2*i+1]*f[2*i+1];
+}
+
+static void scalar_mul_conj(const liquid_float_complex *a, const liquid_float_complex *b, liquid_float_complex *y, size_t n, float gain) {
+
+    const float *fa = reinterpret_cast<const float *>(a);
+    const float *fb = reinterpret_cast<const float *>(b);
+    float *fy = reinterpret_cast<float *>(y);
+
+    for (size_t i = 0; i < n; i++) {
+        const float ar = fa[2*i], ai = fa[2*i+1];
+        const float br = fb[2*i], bi = fb[2*i+1];
+        fy[2*i]   = (ar*br + ai*bi) * gain;
+        fy[2*i+1] = (ai*br - ar*bi) * gain;
+    }
+}
+
+static liquid_float_complex scalar_dot_conj(const liquid_float_complex *a, const liquid_float_complex *b, size_t n) {
+
+    const float *fa = reinterpret_cast<const float *>(a);
+    const float *fb = reinterpret_cast<const float *>(b);
+
+    float re[4] = {0.0f}, im[4] = {0.0f};
+    for (size_t i = 0; i < n; i++) {
+        const float ar = fa[2*i], ai = fa[2*i+1];
+        const float br = fb[2*i], bi = fb[2*i+1];
+        re[i & 3] += ar*br + ai*bi;
+        im[i & 3] += ai*br - ar*bi;
+    }
+
+    return liquid_float_complex(re[0] + re[1] + re[2] + re[3], im[0] + im[1] + im[2] + im[3]);
+}
+
+static void scalar_rotate(const liquid_float_complex *x, liquid_float_complex *y, size_t n, float theta, float d_theta) {
+
+    const float *fx = reinterpret_cast<const float *>(x);
+    float *fy = reinterpret_cast<float *>(y);
+    const float sr = cosf(d_theta), si = sinf(d_theta);
+
+    // float phasor within a block, the block start is advanced in double (no drift of phase or amplitude)
+    std::complex<double> base = std::polar(1.0, (double)theta);
+    const std::complex<double> base_step = std::polar(1.0, (double)d_theta * PHY_DSP_ROTATE_RENORM);
+
+    for (size_t i = 0; i < n; i += PHY_DSP_ROTATE_RENORM, base *= base_step) {
+        const size_t end = i + PHY_DSP_ROTATE_RENORM < n ? i + PHY_DSP_ROTATE_RENORM : n;
+        float pr = (float)base.real(), pi = (float)base.imag();
+
+        for (size_t k = i; k < end; k++) {
+            const float xr = fx[2*k], xi = fx[2*k+1];
+            fy[2*k]   = xr*pr - xi*pi;
+            fy[2*k+1] = xr*pi + xi*pr;
+            const float t = pr*sr - pi*si;
+            pi = pr*si + pi*sr;
+            pr = t;
+        }
+    }
+}
+
+static void scalar_scale(liquid_float_complex *x, size_t n, float g) {
+
+    float *f = reinterpret_cast<float *>(x);
+    for (size_t i = 0; i < 2*n; i++)
+        f[i] *= g;
+}
+
+static void scalar_window(const liquid_float_complex *x, const float *w, liquid_float_complex *y, size_t n) {
+
+    const float *fx = reinterpret_cast<const float *>(x);
+    float *fy = reinterpret_cast<float *>(y);
+    for (size_t i = 0; i < n; i++) {
+        fy[2*i]   = fx[2*i]   * w[i];
+        fy[2*i+1] = fx[2*i+1] * w[i];
+    }
+}
+
+static void scalar_taper(liquid_float_complex *y, const liquid_float_complex *p, const float *w, size_t n) {
+
+    float *fy = reinterpret_cast<float *>(y);
+    const float *fp = reinterpret_cast<const float *>(p);
+    for (size_t i = 0; i < n; i++) {
+        const float a = w[i], b = w[n-i-1];
+        fy[2*i]   = fy[2*i]*a   + fp[2*i]*b;
+        fy[2*i+1] = fy[2*i+1]*a + fp[2*i+1]*b;
+    }
+}
+
+
+const PhyDSPKernels& phy_dsp_kernels_scalar() {
+
+    static const PhyDSPKernels kernels = {
+        "scalar",
+        scalar_energy,
+        scalar_mag2_acc,
+        scalar_mul_conj,
+        scalar_dot_conj,
+        scalar_rotate,
+        scalar_scale,
+        scalar_window,
+        scalar_taper
+    };
+
+    return kernels;
+}
+
+
+const PhyDSPKernels *PhyDSPKernels::find(const std::string& name) {
+
+    if (name == "auto") {
+        if (const PhyDSPKernels *k = phy_dsp_kernels_avx2())
+            return k;
+        if (const PhyDSPKernels *k = phy_dsp_kernels_neon())
+            return k;
+        return &phy_dsp_kernels_scalar();
+    }
+
+    if (name == "scalar")
+        return &phy_dsp_kernels_scalar();
+    if (name == "avx2")
+        return phy_dsp_kernels_avx2();
+    if (name == "neon")
+        return phy_dsp_kernels_neon();
+
+    return nullptr;
+}
+
+
+std::vector<std::string> PhyDSPKernels::available() {
+
+    std::vector<std::string> names;
+    for (const char *name : {"avx2", "neon", "scalar"})
+        if (find(name))
+            names.push_back(name);
+    return names;
+}
+
+
+const PhyDSPKernels& PhyDSPKernels::get() {
+
+    const PhyDSPKernels *kernels = s_active.load(std::memory_order_acquire);
+    if (kernels == nullptr) {
+        // first use - a concurrent select() wins
+        const PhyDSPKernels *best = find("auto");
+        if (s_active.compare_exchange_strong(kernels, best, std::memory_order_acq_rel))
+            kernels = best;
+        LOG_PHY_INFO("PhyDSPKernels::get() {} kernels", kernels->name);
+    }
+    return *kernels;
+}
+
+
+bool PhyDSPKernels::select(const std::string& name) {
+
+    const PhyDSPKernels *kernels = find(name);
+    if (kernels == nullptr) {
+        LOG_PHY_WARN("PhyDSPKernels::select() {} kernels not available - {} active", name, get().name);
+        return false;
+    }
+
+    s_active.store(kernels, std::memory_order_release);
+    LOG_PHY_INFO("PhyDSPKernels::select() {} kernels", kernels->name);
+    return true;
+}
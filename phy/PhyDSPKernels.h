@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <liquid.h>
+
+
+#define PHY_DSP_ROTATE_RENORM     64          // samples between two exact phasors of rotate() (no amplitude drift)
+
+
+/**
+ * PhyDSPKernels
+ *
+ * @note vector kernels of the PHY inner loops (PhyOFDMKernels, PhySensingEngine, PhyFrameSync NCO) as a table of
+ *       functions per instruction set: "scalar" (plain float loops, vectorized by the compiler as far as it can),
+ *       "avx2" (x86 AVX2 + FMA) and "neon" (ARM NEON, e.g. the Cortex-A72 of the CM4)
+ * @note get() is selected once at runtime - the best set the CPU supports, "avx2" > "neon" > "scalar"; select()
+ *       overrides it (SystemConfig "Phy" "DSP_KERNELS"), it has to be called before the PHY objects are created
+ *       as they keep the table of their construction
+ * @note the avx2 functions carry a target attribute, i.e. a generic x86-64 build contains them and the CPU check
+ *       decides; neon is compiled if the target has NEON (always on aarch64, -mfpu=neon on 32 bit ARM)
+ * @note no alignment is required, n may be any size - the SIMD versions handle the remainder with the scalar code
+ * @note sums use independent partial sums - they differ from a sequential sum (and from each other) by float
+ *       rounding only
+ *
+ */
+struct PhyDSPKernels {
+
+    const char *name;
+
+    /**
+     * @brief sum |x[i]|^2
+     */
+    float (*energy)(const liquid_float_complex *x, size_t n);
+
+    /**
+     * @brief y[i] += |x[i]|^2 (magnitude squared, accumulated e.g. into a periodogram - clear y for the plain values)
+     */
+    void (*mag2_acc)(const liquid_float_complex *x, float *y, size_t n);
+
+    /**
+     * @brief y[i] = a[i] conj(b[i]) gain (y may be a)
+     */
+    void (*mul_conj)(const liquid_float_complex *a, const liquid_float_complex *b, liquid_float_complex *y, size_t n, float gain);
+
+    /**
+     * @brief sum a[i] conj(b[i])
+     */
+    liquid_float_complex (*dot_conj)(const liquid_float_complex *a, const liquid_float_complex *b, size_t n);
+
+    /**
+     * @brief y[i] = x[i] exp{j (theta + i d_theta)} (y may be x) - the phasor is recomputed every
+     *        PHY_DSP_ROTATE_RENORM samples
+     */
+    void (*rotate)(const liquid_float_complex *x, liquid_float_complex *y, size_t n, float theta, float d_theta);
+
+    /**
+     * @brief x[i] *= g
+     */
+    void (*scale)(liquid_float_complex *x, size_t n, float g);
+
+    /**
+     * @brief y[i] = x[i] w[i] with a real window w (y may be x)
+     */
+    void (*window)(const liquid_float_complex *x, const float *w, liquid_float_complex *y, size_t n);
+
+    /**
+     * @brief y[i] = y[i] w[i] + p[i] w[n-1-i] - overlap of the symbol start y with the postfix p of the previous symbol
+     */
+    void (*taper)(liquid_float_complex *y, const liquid_float_complex *p, const float *w, size_t n);
+
+    /**
+     * @brief active kernels - selected by the CPU features at the first call unless select() came first
+     */
+    static const PhyDSPKernels& get();
+
+    /**
+     * @brief set the active kernels by name ("auto", "scalar", "avx2", "neon")
+     *
+     * @return false if the set is not built in or not supported by the CPU - the active kernels stay as they are
+     */
+    static bool select(const std::string& name);
+
+    /**
+     * @brief kernels by name - nullptr if not built in or not supported by the CPU ("auto": the best supported)
+     */
+    static const PhyDSPKernels *find(const std::string& name);
+
+    /**
+     * @brief names of the sets this CPU can run
+     */
+    static std::vector<std::string> available();
+};
+
+
+// the sets of the instruction sets - nullptr if not built in or not supported by the CPU
+const PhyDSPKernels& phy_dsp_kernels_scalar();
+const PhyDSPKernels *phy_dsp_kernels_avx2();
+const PhyDSPKernels *phy_dsp_kernels_neon();
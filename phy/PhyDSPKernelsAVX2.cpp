@@ -0,0 +1,213 @@
+#include "phy/PhyDSPKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <cmath>
+#include <complex>
+#include <immintrin.h>
+
+// the file is compiled for the generic target - only the functions below use AVX2 / FMA and they are only called
+// if the CPU has both (phy_dsp_kernels_avx2())
+#define PHY_DSP_AVX2 __attribute__((target("avx2,fma")))
+
+
+// [ar ai ...] * [br bi ...] and [ar ai ...] * conj([br bi ...]) for 4 interleaved complex values
+PHY_DSP_AVX2 static inline __m256 cmul(__m256 a, __m256 b) {
+    const __m256 t = _mm256_mul_ps(_mm256_permute_ps(a, 0xb1), _mm256_movehdup_ps(b));
+    return _mm256_fmaddsub_ps(a, _mm256_moveldup_ps(b), t);
+}
+
+PHY_DSP_AVX2 static inline __m256 cmul_conj(__m256 a, __m256 b) {
+    const __m256 t = _mm256_mul_ps(_mm256_permute_ps(a, 0xb1), _mm256_movehdup_ps(b));
+    return _mm256_fmsubadd_ps(a, _mm256_moveldup_ps(b), t);
+}
+
+PHY_DSP_AVX2 static inline float hsum(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+// four real values w[0..3] as [w0 w0 w1 w1 w2 w2 w3 w3] - reversed [w3 w3 w2 w2 w1 w1 w0 w0]
+PHY_DSP_AVX2 static inline __m256 widen(const float *w) {
+    return _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_loadu_ps(w)), _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3));
+}
+
+PHY_DSP_AVX2 static inline __m256 widen_reverse(const float *w) {
+    return _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_loadu_ps(w)), _mm256_setr_epi32(3, 3, 2, 2, 1, 1, 0, 0));
+}
+
+
+PHY_DSP_AVX2 static float avx2_energy(const liquid_float_complex *x, size_t n) {
+
+    const float *f = reinterpret_cast<const float *>(x);
+
+    // four accumulators - the FMA latency, not the loads, limits a single one
+    __m256 acc[4] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+        for (unsigned int l = 0; l < 4; l++) {
+            const __m256 a = _mm256_loadu_ps(f + 2*i + 8*l);
+            acc[l] = _mm256_fmadd_ps(a, a, acc[l]);
+        }
+
+    return hsum(_mm256_add_ps(_mm256_add_ps(acc[0], acc[1]), _mm256_add_ps(acc[2], acc[3]))) + phy_dsp_kernels_scalar().energy(x + i, n - i);
+}
+
+PHY_DSP_AVX2 static void avx2_mag2_acc(const liquid_float_complex *x, float *y, size_t n) {
+
+    const float *f = reinterpret_cast<const float *>(x);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256 a = _mm256_loadu_ps(f + 2*i);
+        const __m256 b = _mm256_loadu_ps(f + 2*i + 8);
+        // pair sums in the order 0 1 4 5 2 3 6 7 - the 64 bit lanes back into order
+        const __m256 m = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+        const __m256 s = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(m), 0xd8));
+        _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), s));
+    }
+
+    phy_dsp_kernels_scalar().mag2_acc(x + i, y + i, n - i);
+}
+
+PHY_DSP_AVX2 static void avx2_mul_conj(const liquid_float_complex *a, const liquid_float_complex *b, liquid_float_complex *y, size_t n, float gain) {
+
+    const float *fa = reinterpret_cast<const float *>(a);
+    const float *fb = reinterpret_cast<const float *>(b);
+    float *fy = reinterpret_cast<float *>(y);
+    const __m256 g = _mm256_set1_ps(gain);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m256 r = cmul_conj(_mm256_loadu_ps(fa + 2*i), _mm256_loadu_ps(fb + 2*i));
+        _mm256_storeu_ps(fy + 2*i, _mm256_mul_ps(r, g));
+    }
+
+    phy_dsp_kernels_scalar().mul_conj(a + i, b + i, y + i, n - i, gain);
+}
+
+PHY_DSP_AVX2 static liquid_float_complex avx2_dot_conj(const liquid_float_complex *a, const liquid_float_complex *b, size_t n) {
+
+    const float *fa = reinterpret_cast<const float *>(a);
+    const float *fb = reinterpret_cast<const float *>(b);
+
+    // p = a re(b), q = swap(a) im(b); the sum is re: p + q on the even, im: p - q on the odd lanes
+    __m256 p[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()}, q[2] = {_mm256_setzero_ps(), _mm256_setzero_ps()};
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        for (unsigned int l = 0; l < 2; l++) {
+            const __m256 va = _mm256_loadu_ps(fa + 2*i + 8*l);
+            const __m256 vb = _mm256_loadu_ps(fb + 2*i + 8*l);
+            p[l] = _mm256_fmadd_ps(va, _mm256_moveldup_ps(vb), p[l]);
+            q[l] = _mm256_fmadd_ps(_mm256_permute_ps(va, 0xb1), _mm256_movehdup_ps(vb), q[l]);
+        }
+
+    const __m256 s = _mm256_addsub_ps(_mm256_add_ps(p[0], p[1]), _mm256_sub_ps(_mm256_setzero_ps(), _mm256_add_ps(q[0], q[1])));
+    alignas(32) float v[8];
+    _mm256_store_ps(v, s);
+
+    const liquid_float_complex tail = phy_dsp_kernels_scalar().dot_conj(a + i, b + i, n - i);
+    return liquid_float_complex(v[0] + v[2] + v[4] + v[6] + tail.real(), v[1] + v[3] + v[5] + v[7] + tail.imag());
+}
+
+PHY_DSP_AVX2 static void avx2_rotate(const liquid_float_complex *x, liquid_float_complex *y, size_t n, float theta, float d_theta) {
+
+    const float *fx = reinterpret_cast<const float *>(x);
+    float *fy = reinterpret_cast<float *>(y);
+
+    const std::complex<double> s1 = std::polar(1.0, (double)d_theta);
+    const std::complex<double> s4 = std::polar(1.0, 4.0 * d_theta);
+    const __m256 step = _mm256_setr_ps(s4.real(), s4.imag(), s4.real(), s4.imag(), s4.real(), s4.imag(), s4.real(), s4.imag());
+
+    // float phasors of the 4 lanes within a block, the block start is advanced in double (no drift)
+    std::complex<double> base = std::polar(1.0, (double)theta);
+    const std::complex<double> base_step = std::polar(1.0, (double)d_theta * PHY_DSP_ROTATE_RENORM);
+
+    size_t i = 0;
+    while (i + 4 <= n) {
+        const std::complex<double> p0 = base, p1 = p0 * s1, p2 = p1 * s1, p3 = p2 * s1;
+        __m256 p = _mm256_setr_ps(p0.real(), p0.imag(), p1.real(), p1.imag(), p2.real(), p2.imag(), p3.real(), p3.imag());
+
+        const size_t end = i + PHY_DSP_ROTATE_RENORM < n ? i + PHY_DSP_ROTATE_RENORM : n;
+        for (; i + 4 <= end; i += 4) {
+            _mm256_storeu_ps(fy + 2*i, cmul(_mm256_loadu_ps(fx + 2*i), p));
+            p = cmul(p, step);
+        }
+        base *= base_step;
+    }
+
+    phy_dsp_kernels_scalar().rotate(x + i, y + i, n - i, (float)std::remainder((double)theta + (double)i * (double)d_theta, 2.0 * M_PI), d_theta);
+}
+
+PHY_DSP_AVX2 static void avx2_scale(liquid_float_complex *x, size_t n, float g) {
+
+    float *f = reinterpret_cast<float *>(x);
+    const __m256 vg = _mm256_set1_ps(g);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_ps(f + 2*i, _mm256_mul_ps(_mm256_loadu_ps(f + 2*i), vg));
+
+    phy_dsp_kernels_scalar().scale(x + i, n - i, g);
+}
+
+PHY_DSP_AVX2 static void avx2_window(const liquid_float_complex *x, const float *w, liquid_float_complex *y, size_t n) {
+
+    const float *fx = reinterpret_cast<const float *>(x);
+    float *fy = reinterpret_cast<float *>(y);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        _mm256_storeu_ps(fy + 2*i, _mm256_mul_ps(_mm256_loadu_ps(fx + 2*i), widen(w + i)));
+
+    phy_dsp_kernels_scalar().window(x + i, w + i, y + i, n - i);
+}
+
+PHY_DSP_AVX2 static void avx2_taper(liquid_float_complex *y, const liquid_float_complex *p, const float *w, size_t n) {
+
+    float *fy = reinterpret_cast<float *>(y);
+    const float *fp = reinterpret_cast<const float *>(p);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m256 a = _mm256_mul_ps(_mm256_loadu_ps(fy + 2*i), widen(w + i));
+        _mm256_storeu_ps(fy + 2*i, _mm256_fmadd_ps(_mm256_loadu_ps(fp + 2*i), widen_reverse(w + n - i - 4), a));
+    }
+
+    // the remainder with the window indices of the full length
+    for (; i < n; i++) {
+        const float a = w[i], b = w[n-i-1];
+        fy[2*i]   = fy[2*i]*a   + fp[2*i]*b;
+        fy[2*i+1] = fy[2*i+1]*a + fp[2*i+1]*b;
+    }
+}
+
+
+const PhyDSPKernels *phy_dsp_kernels_avx2() {
+
+    static const PhyDSPKernels kernels = {
+        "avx2",
+        avx2_energy,
+        avx2_mag2_acc,
+        avx2_mul_conj,
+        avx2_dot_conj,
+        avx2_rotate,
+        avx2_scale,
+        avx2_window,
+        avx2_taper
+    };
+
+    static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+
+    return supported ? &kernels : nullptr;
+}
+
+#else
+
+const PhyDSPKernels *phy_dsp_kernels_avx2() {
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,229 @@
+#include "phy/PhyDSPKernels.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+#include <cmath>
+#include <complex>
+#include <arm_neon.h>
+
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+
+// vld2q / vst2q split the interleaved samples into the real and the imaginary parts of 4 complex values
+
+static inline float hsum(float32x4_t v) {
+#if defined(__aarch64__)
+    return vaddvq_f32(v);
+#else
+    const float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+    return vget_lane_f32(vpadd_f32(s, s), 0);
+#endif
+}
+
+static inline float32x4_t reverse(float32x4_t v) {
+    const float32x4_t r = vrev64q_f32(v);
+    return vcombine_f32(vget_high_f32(r), vget_low_f32(r));
+}
+
+
+static float neon_energy(const liquid_float_complex *x, size_t n) {
+
+    const float *f = reinterpret_cast<const float *>(x);
+
+    float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float32x4_t a = vld1q_f32(f + 2*i);
+        const float32x4_t b = vld1q_f32(f + 2*i + 4);
+        acc0 = vmlaq_f32(acc0, a, a);
+        acc1 = vmlaq_f32(acc1, b, b);
+    }
+
+    return hsum(vaddq_f32(acc0, acc1)) + phy_dsp_kernels_scalar().energy(x + i, n - i);
+}
+
+static void neon_mag2_acc(const liquid_float_complex *x, float *y, size_t n) {
+
+    const float *f = reinterpret_cast<const float *>(x);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float32x4x2_t v = vld2q_f32(f + 2*i);
+        float32x4_t acc = vld1q_f32(y + i);
+        acc = vmlaq_f32(acc, v.val[0], v.val[0]);
+        acc = vmlaq_f32(acc, v.val[1], v.val[1]);
+        vst1q_f32(y + i, acc);
+    }
+
+    phy_dsp_kernels_scalar().mag2_acc(x + i, y + i, n - i);
+}
+
+static void neon_mul_conj(const liquid_float_complex *a, const liquid_float_complex *b, liquid_float_complex *y, size_t n, float gain) {
+
+    const float *fa = reinterpret_cast<const float *>(a);
+    const float *fb = reinterpret_cast<const float *>(b);
+    float *fy = reinterpret_cast<float *>(y);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float32x4x2_t va = vld2q_f32(fa + 2*i);
+        const float32x4x2_t vb = vld2q_f32(fb + 2*i);
+        float32x4x2_t r;
+        r.val[0] = vmlaq_f32(vmulq_f32(va.val[0], vb.val[0]), va.val[1], vb.val[1]);
+        r.val[1] = vmlsq_f32(vmulq_f32(va.val[1], vb.val[0]), va.val[0], vb.val[1]);
+        r.val[0] = vmulq_n_f32(r.val[0], gain);
+        r.val[1] = vmulq_n_f32(r.val[1], gain);
+        vst2q_f32(fy + 2*i, r);
+    }
+
+    phy_dsp_kernels_scalar().mul_conj(a + i, b + i, y + i, n - i, gain);
+}
+
+static liquid_float_complex neon_dot_conj(const liquid_float_complex *a, const liquid_float_complex *b, size_t n) {
+
+    const float *fa = reinterpret_cast<const float *>(a);
+    const float *fb = reinterpret_cast<const float *>(b);
+
+    float32x4_t re = vdupq_n_f32(0.0f), im = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float32x4x2_t va = vld2q_f32(fa + 2*i);
+        const float32x4x2_t vb = vld2q_f32(fb + 2*i);
+        re = vmlaq_f32(re, va.val[0], vb.val[0]);
+        re = vmlaq_f32(re, va.val[1], vb.val[1]);
+        im = vmlaq_f32(im, va.val[1], vb.val[0]);
+        im = vmlsq_f32(im, va.val[0], vb.val[1]);
+    }
+
+    const liquid_float_complex tail = phy_dsp_kernels_scalar().dot_conj(a + i, b + i, n - i);
+    return liquid_float_complex(hsum(re) + tail.real(), hsum(im) + tail.imag());
+}
+
+static void neon_rotate(const liquid_float_complex *x, liquid_float_complex *y, size_t n, float theta, float d_theta) {
+
+    const float *fx = reinterpret_cast<const float *>(x);
+    float *fy = reinterpret_cast<float *>(y);
+
+    const std::complex<double> s1 = std::polar(1.0, (double)d_theta);
+    const std::complex<double> s4 = std::polar(1.0, 4.0 * d_theta);
+    const float sr = (float)s4.real(), si = (float)s4.imag();
+
+    // float phasors of the 4 lanes within a block, the block start is advanced in double (no drift)
+    std::complex<double> base = std::polar(1.0, (double)theta);
+    const std::complex<double> base_step = std::polar(1.0, (double)d_theta * PHY_DSP_ROTATE_RENORM);
+
+    size_t i = 0;
+    while (i + 4 <= n) {
+        float pr_l[4], pi_l[4];
+        std::complex<double> pl = base;
+        for (unsigned int l = 0; l < 4; l++, pl *= s1) {
+            pr_l[l] = (float)pl.real();
+            pi_l[l] = (float)pl.imag();
+        }
+        float32x4_t pr = vld1q_f32(pr_l), pi = vld1q_f32(pi_l);
+
+        const size_t end = i + PHY_DSP_ROTATE_RENORM < n ? i + PHY_DSP_ROTATE_RENORM : n;
+        for (; i + 4 <= end; i += 4) {
+            const float32x4x2_t v = vld2q_f32(fx + 2*i);
+            float32x4x2_t r;
+            r.val[0] = vmlsq_f32(vmulq_f32(v.val[0], pr), v.val[1], pi);
+            r.val[1] = vmlaq_f32(vmulq_f32(v.val[0], pi), v.val[1], pr);
+            vst2q_f32(fy + 2*i, r);
+
+            const float32x4_t t = vmlsq_n_f32(vmulq_n_f32(pr, sr), pi, si);
+            pi = vmlaq_n_f32(vmulq_n_f32(pr, si), pi, sr);
+            pr = t;
+        }
+        base *= base_step;
+    }
+
+    phy_dsp_kernels_scalar().rotate(x + i, y + i, n - i, (float)std::remainder((double)theta + (double)i * (double)d_theta, 2.0 * M_PI), d_theta);
+}
+
+static void neon_scale(liquid_float_complex *x, size_t n, float g) {
+
+    float *f = reinterpret_cast<float *>(x);
+
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+        vst1q_f32(f + 2*i, vmulq_n_f32(vld1q_f32(f + 2*i), g));
+
+    phy_dsp_kernels_scalar().scale(x + i, n - i, g);
+}
+
+static void neon_window(const liquid_float_complex *x, const float *w, liquid_float_complex *y, size_t n) {
+
+    const float *fx = reinterpret_cast<const float *>(x);
+    float *fy = reinterpret_cast<float *>(y);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4x2_t v = vld2q_f32(fx + 2*i);
+        const float32x4_t vw = vld1q_f32(w + i);
+        v.val[0] = vmulq_f32(v.val[0], vw);
+        v.val[1] = vmulq_f32(v.val[1], vw);
+        vst2q_f32(fy + 2*i, v);
+    }
+
+    phy_dsp_kernels_scalar().window(x + i, w + i, y + i, n - i);
+}
+
+static void neon_taper(liquid_float_complex *y, const liquid_float_complex *p, const float *w, size_t n) {
+
+    float *fy = reinterpret_cast<float *>(y);
+    const float *fp = reinterpret_cast<const float *>(p);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4x2_t vy = vld2q_f32(fy + 2*i);
+        const float32x4x2_t vp = vld2q_f32(fp + 2*i);
+        const float32x4_t a = vld1q_f32(w + i);
+        const float32x4_t b = reverse(vld1q_f32(w + n - i - 4));
+        vy.val[0] = vmlaq_f32(vmulq_f32(vy.val[0], a), vp.val[0], b);
+        vy.val[1] = vmlaq_f32(vmulq_f32(vy.val[1], a), vp.val[1], b);
+        vst2q_f32(fy + 2*i, vy);
+    }
+
+    // the remainder with the window indices of the full length
+    for (; i < n; i++) {
+        const float a = w[i], b = w[n-i-1];
+        fy[2*i]   = fy[2*i]*a   + fp[2*i]*b;
+        fy[2*i+1] = fy[2*i+1]*a + fp[2*i+1]*b;
+    }
+}
+
+
+const PhyDSPKernels *phy_dsp_kernels_neon() {
+
+    static const PhyDSPKernels kernels = {
+        "neon",
+        neon_energy,
+        neon_mag2_acc,
+        neon_mul_conj,
+        neon_dot_conj,
+        neon_rotate,
+        neon_scale,
+        neon_window,
+        neon_taper
+    };
+
+    // Advanced SIMD is part of ARMv8-A - a 32 bit build asks the kernel (HWCAP)
+#if defined(__aarch64__)
+    static const bool supported = true;
+#else
+    static const bool supported = (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#endif
+
+    return supported ? &kernels : nullptr;
+}
+
+#else
+
+const PhyDSPKernels *phy_dsp_kernels_neon() {
+    return nullptr;
+}
+
+#endif
@@ -11,6 +11,40 @@
 //3.0f  -> 3.8f ?
 #define PHY_STS_DETECT_UPR_THR    4.5f
 
+// Schmidl-Cox metric |P|^2/R^2 (0..1) which has to be crossed before the FFT based STS estimate is run
+#define PHY_STS_SC_DETECT_THR     0.4f
+
+// max samples in FRAMESYNC_STATE_SYNC_STS before falling back to detection (~1.5 symbols)
+#define PHY_SYNC_STS_MAX_SAMPLES  1920
+// samples waited in FRAMESYNC_STATE_RXSYMBOLS before re-syncing on the next STS
+#define PHY_RXSYMBOLS_WAIT        (16*1280)
+
+// payload symbols - cyclic prefix, used subcarriers on each side of DC (DC and the band edges are null) and a
+// pilot on every PHY_DATA_PILOT_SPACING-th used subcarrier (840 used: 120 pilots, 720 data)
+#define PHY_CP_DATA               256
+#define PHY_DATA_USED_HALF        420
+#define PHY_DATA_PILOT_SPACING    7
+// pilot values: BPSK from the x^7 + x^4 + 1 LFSR with this seed, one bit per pilot in ascending frequency
+#define PHY_DATA_PILOT_LFSR_SEED  0x7f
+// payload symbols demodulated with one batched FFT (PHY_RXSYMBOLS_WAIT is one batch)
+#define PHY_DEMOD_BATCH_SYMBOLS   16
+// smoothing of the pilot phase slope over the symbols of a payload
+#define PHY_DEMOD_PILOT_ALPHA     0.3f
+
+// frame period in samples (10ms @ DEFAULT_SAMPLE_RATE)
+#define PHY_FRAME_PERIOD_SAMPLES  22850
+// frames queued with hardware timestamp ahead of the air time in BASESTATION mode
+#define PHY_TX_LEAD_FRAMES        2
+
+// IQ blocks buffered between the stages of the CPE receive pipeline (~1.3ms per block)
+#define PHY_PIPELINE_QUEUE_DEPTH  256
+// sleep of the ingest while a replay waits for the frame sync
+#define PHY_PIPELINE_IDLE_US      50
+// max wait of a pipeline stage for an input block (stop latency)
+#define PHY_PIPELINE_WAIT_MS      100
+// blocks the debug stage takes from its queue at once
+#define PHY_PIPELINE_DEBUG_BATCH  16
+
 
 // orig
 #define PHY_STS_SEQUENCE          { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 1, 0, 1, 0,     \
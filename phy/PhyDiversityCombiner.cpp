@@ -0,0 +1,101 @@
+#include "phy/PhyDiversityCombiner.h"
+
+#include <cmath>
+
+
+PhyDiversityCombiner::PhyDiversityCombiner(float alpha) : m_alpha(alpha) {
+
+    reset();
+}
+
+
+void PhyDiversityCombiner::reset() {
+
+    m_r00 = m_r11 = 0;
+    m_r01 = 0;
+    m_has_estimate = false;
+
+    // channel 0 only until there is an estimate
+    m_w[0] = 1.0f;
+    m_w[1] = 0.0f;
+}
+
+
+void PhyDiversityCombiner::execute(const liquid_float_complex *x0, const liquid_float_complex *x1,
+                                   liquid_float_complex *y, size_t n) {
+
+    if (n == 0)
+        return;
+
+    // covariance of this block
+    double p00 = 0, p11 = 0;
+    std::complex<double> c01 = 0;
+    for (size_t i = 0; i < n; i++) {
+        p00 += x0[i].real() * x0[i].real() + x0[i].imag() * x0[i].imag();
+        p11 += x1[i].real() * x1[i].real() + x1[i].imag() * x1[i].imag();
+        c01 += std::complex<double>(x0[i].real(), x0[i].imag()) * std::complex<double>(x1[i].real(), -x1[i].imag());
+    }
+    p00 /= n;
+    p11 /= n;
+    c01 /= (double) n;
+
+    const bool first = !m_has_estimate;
+    if (first) {
+        m_r00 = p00;
+        m_r11 = p11;
+        m_r01 = c01;
+        m_has_estimate = true;
+    } else {
+        m_r00 += m_alpha * (p00 - m_r00);
+        m_r11 += m_alpha * (p11 - m_r11);
+        m_r01 += (double) m_alpha * (c01 - m_r01);
+    }
+
+    const liquid_float_complex w0_prev = m_w[0];
+    const liquid_float_complex w1_prev = m_w[1];
+
+    update_weights();
+
+    // the first block starts with the new weights, later ones ramp over the block
+    liquid_float_complex w0 = first ? m_w[0] : w0_prev;
+    liquid_float_complex w1 = first ? m_w[1] : w1_prev;
+    const liquid_float_complex dw0 = (m_w[0] - w0) / (float) n;
+    const liquid_float_complex dw1 = (m_w[1] - w1) / (float) n;
+
+    for (size_t i = 0; i < n; i++) {
+        w0 += dw0;
+        w1 += dw1;
+        y[i] = std::conj(w0) * x0[i] + std::conj(w1) * x1[i];
+    }
+}
+
+
+void PhyDiversityCombiner::update_weights() {
+
+    // principal eigenvalue of R = [r00 r01; conj(r01) r11]
+    const double mean = 0.5 * (m_r00 + m_r11);
+    const double diff = 0.5 * (m_r00 - m_r11);
+    const double lambda = mean + std::sqrt(diff * diff + std::norm(m_r01));
+
+    // two forms of the eigenvector - take the better conditioned one (the first vanishes for r01 -> 0, r00 > r11)
+    std::complex<double> a0 = m_r01, a1 = lambda - m_r00;
+    std::complex<double> b0 = lambda - m_r11, b1 = std::conj(m_r01);
+    if (std::norm(b0) + std::norm(b1) > std::norm(a0) + std::norm(a1)) {
+        a0 = b0;
+        a1 = b1;
+    }
+
+    const double norm = std::sqrt(std::norm(a0) + std::norm(a1));
+    if (!(norm > 0)) {
+        // no signal at all - stay with the current weights
+        return;
+    }
+
+    // unit norm with w0 real and positive (phase of channel 0)
+    std::complex<double> rot = std::abs(a0) > 0 ? std::conj(a0) / std::abs(a0) : 1.0;
+    a0 *= rot / norm;
+    a1 *= rot / norm;
+
+    m_w[0] = liquid_float_complex((float) a0.real(), (float) a0.imag());
+    m_w[1] = liquid_float_complex((float) a1.real(), (float) a1.imag());
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+
+#include "liquid/liquid.h"
+
+#include "util/log.h"
+
+
+// smoothing of the channel covariance per block (~20 blocks time constant)
+#define PHY_DIVERSITY_ALPHA         0.05f
+
+
+/**
+ * PhyDiversityCombiner class
+ *
+ * @note maximal-ratio combining of the two RX channels ahead of PhyFrameSync; the combining runs on the raw
+ *       samples before any sync, so the channel vector h is estimated blind as principal eigenvector of the 2x2
+ *       channel covariance R = E[x x^H] (exponentially averaged per block) - for one dominant signal and equal
+ *       noise on both RX paths this is the MRC weight vector
+ * @note the weights are unit norm, i.e. the noise power stays the one of a single channel while the signal adds
+ *       up coherently; the phase is referenced to channel 0 so the combined signal keeps its phase over blocks
+ * @note the weights are ramped linearly from the previous to the new ones across a block - no steps at block
+ *       boundaries for the sync
+ *
+ */
+class PhyDiversityCombiner {
+public:
+
+    explicit PhyDiversityCombiner(float alpha = PHY_DIVERSITY_ALPHA);
+
+    void reset();
+
+    /**
+     * @brief combine n samples of both channels; y = conj(w0) x0 + conj(w1) x1 - y can be x0 or x1 (in place)
+     *
+     * @param x0 samples of channel 0
+     * @param x1 samples of channel 1 (same timestamps as x0)
+     * @param y combined samples
+     * @param n number of samples
+     */
+    void execute(const liquid_float_complex *x0, const liquid_float_complex *x1, liquid_float_complex *y, size_t n);
+
+    /**
+     * @brief current combining weight of a channel (0 or 1)
+     */
+    liquid_float_complex getWeight(size_t ch) const { return m_w[ch & 1]; }
+
+private:
+
+    void update_weights();
+
+    float m_alpha;
+
+    // channel covariance: r00 = E|x0|^2, r11 = E|x1|^2, r01 = E[x0 conj(x1)]
+    double m_r00 = 0;
+    double m_r11 = 0;
+    std::complex<double> m_r01 = 0;
+    bool m_has_estimate = false;
+
+    liquid_float_complex m_w[2];
+
+};
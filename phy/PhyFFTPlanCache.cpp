@@ -0,0 +1,175 @@
+#include "phy/PhyFFTPlanCache.h"
+
+
+PhyFFTPlanCache& PhyFFTPlanCache::instance() {
+    static PhyFFTPlanCache cache;
+    return cache;
+}
+
+PhyFFTPlanCache::PhyFFTPlanCache() {
+    LOG_PHY_DEBUG("PhyFFTPlanCache::PhyFFTPlanCache() constructor");
+}
+
+PhyFFTPlanCache::~PhyFFTPlanCache() {
+
+    std::lock_guard < std::mutex > lock(m_plans_mutex);
+
+    for (auto& p : m_plans)
+        FFT_DESTROY_PLAN(p.second);
+
+    m_plans.clear();
+}
+
+
+FFT_PLAN PhyFFTPlanCache::get_plan(unsigned int n, liquid_float_complex *in, liquid_float_complex *out, int direction) {
+
+    std::lock_guard < std::mutex > lock(m_plans_mutex);
+
+#if HAVE_FFTW3_H && !defined LIQUID_FFTOVERRIDE
+    const bool inplace = (in == out);
+    const uintptr_t align_in = fftwf_alignment_of(reinterpret_cast<float *>(in));
+    const uintptr_t align_out = fftwf_alignment_of(reinterpret_cast<float *>(out));
+
+    PlanKey key = std::make_tuple(n, 1u, direction, align_in, align_out, inplace);
+
+    auto it = m_plans.find(key);
+    if (it != m_plans.end())
+        return it->second;
+
+    // plan on scratch buffers with the same alignment - FFTW_MEASURE and above overwrite the arrays while planning
+    const size_t bytes = n * sizeof(fftwf_complex) + 64;
+    char *scratch_in = static_cast<char *>(fftwf_malloc(bytes));
+    char *scratch_out = inplace ? scratch_in : static_cast<char *>(fftwf_malloc(bytes));
+
+    fftwf_complex *plan_in = reinterpret_cast<fftwf_complex *>(scratch_in + align_in);
+    fftwf_complex *plan_out = reinterpret_cast<fftwf_complex *>(scratch_out + align_out);
+
+    FFT_PLAN plan = fftwf_plan_dft_1d(n, plan_in, plan_out, direction, m_planner_flags);
+
+    fftwf_free(scratch_in);
+    if (!inplace)
+        fftwf_free(scratch_out);
+
+    LOG_PHY_DEBUG("PhyFFTPlanCache::get_plan() new plan n={} dir={} align={}/{} inplace={}", n, direction, align_in, align_out, inplace);
+#else
+    // liquid fft plans are bound to their buffers
+    PlanKey key = std::make_tuple(n, 1u, direction, reinterpret_cast<uintptr_t>(in), reinterpret_cast<uintptr_t>(out), in == out);
+
+    auto it = m_plans.find(key);
+    if (it != m_plans.end())
+        return it->second;
+
+    FFT_PLAN plan = FFT_CREATE_PLAN(n, in, out, direction, m_planner_flags);
+
+    LOG_PHY_DEBUG("PhyFFTPlanCache::get_plan() new plan n={} dir={}", n, direction);
+#endif
+
+    m_plans[key] = plan;
+    return plan;
+}
+
+
+std::vector<FFT_PLAN> PhyFFTPlanCache::get_plan_many(unsigned int n, unsigned int howmany, liquid_float_complex *in,
+                                                     liquid_float_complex *out, int direction) {
+
+#if HAVE_FFTW3_H && !defined LIQUID_FFTOVERRIDE
+    if (howmany <= 1)
+        return { get_plan(n, in, out, direction) };
+
+    std::lock_guard < std::mutex > lock(m_plans_mutex);
+
+    const bool inplace = (in == out);
+    const uintptr_t align_in = fftwf_alignment_of(reinterpret_cast<float *>(in));
+    const uintptr_t align_out = fftwf_alignment_of(reinterpret_cast<float *>(out));
+
+    PlanKey key = std::make_tuple(n, howmany, direction, align_in, align_out, inplace);
+
+    auto it = m_plans.find(key);
+    if (it != m_plans.end())
+        return { it->second };
+
+    // plan on scratch buffers with the same alignment (see get_plan())
+    const size_t bytes = (size_t)howmany * n * sizeof(fftwf_complex) + 64;
+    char *scratch_in = static_cast<char *>(fftwf_malloc(bytes));
+    char *scratch_out = inplace ? scratch_in : static_cast<char *>(fftwf_malloc(bytes));
+
+    fftwf_complex *plan_in = reinterpret_cast<fftwf_complex *>(scratch_in + align_in);
+    fftwf_complex *plan_out = reinterpret_cast<fftwf_complex *>(scratch_out + align_out);
+
+    const int size = (int)n;
+    FFT_PLAN plan = fftwf_plan_many_dft(1, &size, (int)howmany, plan_in, nullptr, 1, size, plan_out, nullptr, 1, size,
+                                        direction, m_planner_flags);
+
+    fftwf_free(scratch_in);
+    if (!inplace)
+        fftwf_free(scratch_out);
+
+    LOG_PHY_DEBUG("PhyFFTPlanCache::get_plan_many() new plan n={} howmany={} dir={} align={}/{} inplace={}", n, howmany, direction, align_in, align_out, inplace);
+
+    m_plans[key] = plan;
+    return { plan };
+#else
+    // one plan per batch entry, each bound to its part of the buffers
+    std::vector<FFT_PLAN> plans;
+    for (unsigned int k = 0; k < howmany; k++)
+        plans.push_back(get_plan(n, in + (size_t)k * n, out + (size_t)k * n, direction));
+    return plans;
+#endif
+}
+
+
+void PhyFFTPlanCache::setPlanner(const std::string& planner) {
+
+#if HAVE_FFTW3_H && !defined LIQUID_FFTOVERRIDE
+    if (planner == "measure")
+        m_planner_flags = FFTW_MEASURE;
+    else if (planner == "patient")
+        m_planner_flags = FFTW_PATIENT;
+    else if (planner == "exhaustive")
+        m_planner_flags = FFTW_EXHAUSTIVE;
+    else
+        m_planner_flags = FFTW_ESTIMATE;
+
+    LOG_PHY_INFO("PhyFFTPlanCache::setPlanner() FFTW planner {}", planner);
+#else
+    LOG_PHY_INFO("PhyFFTPlanCache::setPlanner() {} ignored - built without FFTW", planner);
+#endif
+}
+
+
+bool PhyFFTPlanCache::importWisdom(const std::string& filename) {
+
+#if HAVE_FFTW3_H && !defined LIQUID_FFTOVERRIDE
+    std::lock_guard < std::mutex > lock(m_plans_mutex);
+
+    if (fftwf_import_wisdom_from_filename(filename.c_str())) {
+        LOG_PHY_INFO("PhyFFTPlanCache::importWisdom() imported FFTW wisdom from {}", filename);
+        return true;
+    }
+
+    LOG_PHY_INFO("PhyFFTPlanCache::importWisdom() no FFTW wisdom in {} - plans are measured on first use", filename);
+#endif
+    return false;
+}
+
+
+bool PhyFFTPlanCache::exportWisdom(const std::string& filename) {
+
+#if HAVE_FFTW3_H && !defined LIQUID_FFTOVERRIDE
+    std::lock_guard < std::mutex > lock(m_plans_mutex);
+
+    if (fftwf_export_wisdom_to_filename(filename.c_str())) {
+        LOG_PHY_INFO("PhyFFTPlanCache::exportWisdom() exported FFTW wisdom to {}", filename);
+        return true;
+    }
+
+    LOG_PHY_ERROR("PhyFFTPlanCache::exportWisdom() cannot write FFTW wisdom to {}", filename);
+#endif
+    return false;
+}
+
+
+size_t PhyFFTPlanCache::size() {
+    std::lock_guard < std::mutex > lock(m_plans_mutex);
+    return m_plans.size();
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <mutex>
+#include <map>
+#include <tuple>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "liquid.h"
+
+#include "phy/PhyDefinitions.h"
+#include "util/log.h"
+
+
+#define PHY_FFT_WISDOM_FILE       "fftw_wisdom.dat"
+
+
+/**
+ * PhyFFTPlanCache class
+ *
+ * @note process wide cache of FFT plans shared by PhyFrameSync, PhyFrameGen,... - plans are created once per
+ *       (size, direction, alignment of in/out) and are owned by the cache
+ * @note with FFTW the plans are executed with fftwf_execute_dft() on the callers buffers (new-array execute), the
+ *       planner is run on internal scratch buffers so FFTW_MEASURE/FFTW_PATIENT do not overwrite caller data;
+ *       wisdom can be imported/exported to keep measured plans over a restart
+ * @note without FFTW (liquid fft) a plan is bound to its buffers, i.e. the buffers are part of the key
+ *
+ */
+class PhyFFTPlanCache {
+public:
+
+    static PhyFFTPlanCache& instance();
+
+    PhyFFTPlanCache(const PhyFFTPlanCache&) = delete;
+
+    PhyFFTPlanCache& operator=(const PhyFFTPlanCache&) = delete;
+
+    /**
+     * @brief get a plan for an n point transform from in to out
+     *
+     * @param n transform size
+     * @param in input buffer (used for alignment, with liquid fft the plan is bound to it)
+     * @param out output buffer
+     * @param direction FFT_DIR_FORWARD or FFT_DIR_BACKWARD
+     * @return FFT_PLAN owned by the cache
+     */
+    FFT_PLAN get_plan(unsigned int n, liquid_float_complex *in, liquid_float_complex *out, int direction);
+
+    /**
+     * @brief get the plans for howmany contiguous n point transforms, entry k of the batch is at in + k*n / out + k*n
+     *
+     * @note with FFTW this is a single fftwf_plan_many_dft plan; liquid fft has no batched transform, i.e. there is
+     *       one plan per batch entry bound to its buffers
+     *
+     * @param n transform size
+     * @param howmany number of transforms
+     * @param in input buffer of howmany*n samples
+     * @param out output buffer of howmany*n samples
+     * @param direction FFT_DIR_FORWARD or FFT_DIR_BACKWARD
+     * @return std::vector<FFT_PLAN> owned by the cache - hand it to execute_many()
+     */
+    std::vector<FFT_PLAN> get_plan_many(unsigned int n, unsigned int howmany, liquid_float_complex *in,
+                                        liquid_float_complex *out, int direction);
+
+    /**
+     * @brief run the batch plans of get_plan_many() on in/out
+     */
+    static inline void execute_many(const std::vector<FFT_PLAN>& plans, liquid_float_complex *in, liquid_float_complex *out) {
+#if HAVE_FFTW3_H && !defined LIQUID_FFTOVERRIDE
+        fftwf_execute_dft(plans.front(), reinterpret_cast<fftwf_complex *>(in), reinterpret_cast<fftwf_complex *>(out));
+#else
+        (void)in;
+        (void)out;
+        for (auto& plan : plans)
+            FFT_EXECUTE(plan);
+#endif
+    }
+
+    /**
+     * @brief run plan on in/out - in/out must have the same alignment as the buffers given to get_plan()
+     */
+    static inline void execute(FFT_PLAN plan, liquid_float_complex *in, liquid_float_complex *out) {
+#if HAVE_FFTW3_H && !defined LIQUID_FFTOVERRIDE
+        fftwf_execute_dft(plan, reinterpret_cast<fftwf_complex *>(in), reinterpret_cast<fftwf_complex *>(out));
+#else
+        (void)in;
+        (void)out;
+        FFT_EXECUTE(plan);
+#endif
+    }
+
+    /**
+     * @brief planner effort for new plans: "estimate", "measure", "patient" or "exhaustive" (FFTW only)
+     *
+     * @param planner
+     */
+    void setPlanner(const std::string& planner);
+
+    /**
+     * @brief import FFTW wisdom from file - call at startup before plans are created
+     *
+     * @param filename
+     * @return true if wisdom was imported
+     */
+    bool importWisdom(const std::string& filename = PHY_FFT_WISDOM_FILE);
+
+    /**
+     * @brief export the accumulated FFTW wisdom to file - call at shutdown
+     *
+     * @param filename
+     * @return true if wisdom was written
+     */
+    bool exportWisdom(const std::string& filename = PHY_FFT_WISDOM_FILE);
+
+    size_t size();
+
+private:
+
+    PhyFFTPlanCache();
+
+    ~PhyFFTPlanCache();
+
+    // (size, batch, direction, alignment in, alignment out, in-place) or (size, 1, direction, in, out) for liquid fft
+    typedef std::tuple<unsigned int, unsigned int, int, uintptr_t, uintptr_t, bool> PlanKey;
+
+    std::map<PlanKey, FFT_PLAN> m_plans;
+
+    std::mutex m_plans_mutex;
+
+    unsigned int m_planner_flags = FFT_METHOD;
+
+};
@@ -12,7 +12,7 @@ PhyFrameGen::PhyFrameGen() {
 PhyFrameGen::PhyFrameGen(unsigned int M,
                          unsigned int cp_len,
                          unsigned int taper_len) 
-    : m_M{M}, m_cp_len{cp_len}, m_taper_len{taper_len} {
+    : m_M{M}, m_cp_len{cp_len}, m_kernels{PhyOFDMKernels::create(M, cp_len, taper_len)}, m_taper_len{taper_len} {
 
     LOG_PHY_INFO("PhyFrameGen::PhyFrameGen(M,cp,taper) called {} {} {} ", M, cp_len, taper_len );
 
@@ -21,8 +21,9 @@ PhyFrameGen::PhyFrameGen(unsigned int M,
     // derived values
     m_M2 = m_M/2;
 
-    m_subcarrier_allocation_STS = (unsigned char*) malloc((m_M)*sizeof(unsigned char)); 
-    m_subcarrier_allocation_LTS = (unsigned char*) malloc((m_M)*sizeof(unsigned char)); 
+    // the per symbol buffers live in the kernels (aligned, std::array for the compile-time profiles)
+    m_subcarrier_allocation_STS = m_kernels->allocation(PhyOFDMKernels::ALLOC_STS);
+    m_subcarrier_allocation_LTS = m_kernels->allocation(PhyOFDMKernels::ALLOC_LTS);
 
     // init_STS_sctype();
     // init_LTS_sctype();
@@ -33,25 +34,32 @@ PhyFrameGen::PhyFrameGen(unsigned int M,
 
 
     // create transform object
-    m_X = (liquid_float_complex*) FFT_MALLOC((m_M)*sizeof(liquid_float_complex));
-    m_x = (liquid_float_complex*) FFT_MALLOC((m_M)*sizeof(liquid_float_complex));
-    m_ifft = FFT_CREATE_PLAN(m_M, m_x, m_X, FFT_DIR_BACKWARD, FFT_METHOD);
+    m_X = m_kernels->buffer(PhyOFDMKernels::BUF_X);
+    m_x = m_kernels->buffer(PhyOFDMKernels::BUF_x);
+    m_ifft = PhyFFTPlanCache::instance().get_plan(m_M, m_X, m_x, FFT_DIR_BACKWARD);     // frequency -> time domain
 
     m_frame_len = m_M + m_cp_len;    // frame length
     m_buf_tx = (liquid_float_complex*) FFT_MALLOC((m_frame_len)*sizeof(liquid_float_complex));
 
 
     // allocate memory for PLCP arrays
-    m_STS = (liquid_float_complex*) malloc((m_M)*sizeof(liquid_float_complex)); // q->S0 frequency domain
-    m_sts = (liquid_float_complex*) malloc((m_M)*sizeof(liquid_float_complex)); // q->s0 time domain
+    m_STS = m_kernels->buffer(PhyOFDMKernels::BUF_STS); // q->S0 frequency domain
+    m_sts = m_kernels->buffer(PhyOFDMKernels::BUF_sts); // q->s0 time domain
     // q->S1 = (float complex*) malloc((q->M)*sizeof(float complex));
     // q->s1 = (float complex*) malloc((q->M)*sizeof(float complex));
     init_STS();
     // ofdmframe_init_S1(q->p, q->M, q->S1, q->s1, &q->M_S1);
 
 
+    // @todo subcarrier allocation (init_STS_sctype/validate) is not done yet - all subcarriers carry data/LTS
+    m_M_null  = 0;
+    m_M_pilot = 0;
+    m_M_data  = m_M;
+    m_M_LTS   = m_M;
+
     // compute scaling factor
-    m_g_data  = sqrtf(m_M) / sqrtf(m_M_pilot + m_M_data);
+    // data symbols are normalized like the STS time domain sequence (the ifft is not normalized)
+    m_g_data  = 1.0f / sqrtf(m_M_pilot + m_M_data);
     m_g_STS   = sqrtf(m_M) / sqrtf(m_M_STS);
     m_g_LTS   = sqrtf(m_M) / sqrtf(m_M_LTS);
 
@@ -74,6 +82,10 @@ PhyFrameGen::PhyFrameGen(unsigned int M,
     for (i=0; i < m_taper_len; i++)
         m_postfix[i] = 0.0f;
 
+    // render the constant preamble once
+    m_sts_postfix = (liquid_float_complex*) malloc(m_taper_len * sizeof(liquid_float_complex));
+    init_templates();
+
 }
 
 PhyFrameGen::~PhyFrameGen() {
@@ -177,14 +189,88 @@ int PhyFrameGen::init_STS() {
 
     // normalize time-domain sequence level
     float g = 1.0f / sqrtf(M_STS);
-    for (i=0; i<m_M; i++)
-        m_sts[i] *= g * 0.6;           // @todo CHECK CHECK how to handle the gain of the IQ signal ..seems to be overloading for testing lower
+    m_kernels->scale(m_sts, g * 0.6f);           // @todo CHECK CHECK how to handle the gain of the IQ signal ..seems to be overloading for testing lower
 
     return 0;
 }
 
 
 
+/**
+ * @brief render the STS symbol into the template cache
+ *
+ * @note the STS starts a frame, i.e. it is rendered with an empty postfix (silence before the frame), the postfix
+ *       it leaves for the following symbol is kept in m_sts_postfix
+ *
+ * @return int
+ */
+int PhyFrameGen::init_templates() {
+
+    m_sts_template.resize(m_frame_len);
+
+    std::fill_n(m_postfix, m_taper_len, liquid_float_complex(0.0f));
+    write_STS(m_sts_template.data());
+    memmove(m_sts_postfix, m_postfix, m_taper_len * sizeof(liquid_float_complex));
+
+    std::fill_n(m_postfix, m_taper_len, liquid_float_complex(0.0f));
+
+    return 0;
+}
+
+
+void PhyFrameGen::create_STS_symbol() {
+
+    m_tx_buffer->data.resize(m_frame_len);
+    memcpy(m_tx_buffer->data.data(), m_sts_template.data(), m_frame_len * sizeof(liquid_float_complex));
+}
+
+
+size_t PhyFrameGen::create_frame(const RadioIQDataPtr& block, const liquid_float_complex *symbols, unsigned int num_symbols) {
+
+    const size_t frame_len = getFrameLength(num_symbols);
+
+    block->data.resize(frame_len);
+    liquid_float_complex *y = block->data.data();
+
+    // preamble from the template cache
+    memcpy(y, m_sts_template.data(), m_frame_len * sizeof(liquid_float_complex));
+    memmove(m_postfix, m_sts_postfix, m_taper_len * sizeof(liquid_float_complex));
+    y += m_frame_len;
+
+    // header and payload symbols are rendered directly into the block
+    for (unsigned int n=0; n < num_symbols; n++) {
+        write_symbol(&symbols[n * m_M], y);
+        y += m_frame_len;
+    }
+
+    // next frame starts after silence
+    std::fill_n(m_postfix, m_taper_len, liquid_float_complex(0.0f));
+
+    return frame_len;
+}
+
+
+/**
+ * @brief write_symbol transforms one symbol from frequency to time domain (data gain applied) and adds the
+ *        cyclic prefix/taper
+ *
+ * @param _X M subcarrier values
+ * @param _y output [size: M + cp]
+ * @return int
+ */
+int PhyFrameGen::write_symbol(const liquid_float_complex * _X, liquid_float_complex * _y) {
+
+    memmove(m_X, _X, m_M * sizeof(liquid_float_complex));
+    PhyFFTPlanCache::execute(m_ifft, m_X, m_x);
+
+    m_kernels->scale(m_x, m_g_data);
+
+    genSymbol(_y);
+
+    return 0;
+}
+
+
 /**
  * @brief write_STS is creating the STS symbol in the time domain
  * 
@@ -236,30 +322,9 @@ int PhyFrameGen::write_STS(liquid_float_complex * _y)
 //  _buffer         :   output sample buffer [size: (_q->M + _q->cp_len) x 1]
 int PhyFrameGen::genSymbol(liquid_float_complex * _buffer)
 {
-    // copy input symbol with cyclic prefix to output symbol
-    memmove( &_buffer[0],        &m_x[m_M-m_cp_len], m_cp_len * sizeof(liquid_float_complex));
-    memmove( &_buffer[m_cp_len], &m_x[           0], m_M      * sizeof(liquid_float_complex));
-    
-    // apply tapering window to over-lapping regions
-    unsigned int i;
-    for (i=0; i<m_taper_len; i++) {
-        _buffer[i] *= m_taper[i];
-        _buffer[i] += m_postfix[i] * m_taper[m_taper_len-i-1];
-    }
-
+    // copy input symbol with cyclic prefix to output symbol, apply tapering window to over-lapping regions and
     // copy post-fix to output (first 'taper_len' samples of input symbol)
-    memmove(m_postfix, m_x, m_taper_len*sizeof(liquid_float_complex));
-
-
-    // ensure that buffer is empty
-    m_tx_buffer->data.clear();
-
-    //move time iq data in tx symbol buffer
-    for(auto s=0; s < (m_M+m_cp_len); s++) {
-        m_tx_buffer->data.push_back(m_x[s]);    
-    }
-
- //   std::cout << "gs" << std::endl;               // DEBUG
+    m_kernels->cyclic_prefix_taper(m_x, _buffer, m_postfix, m_taper);
 
     return 0;
 }
@@ -7,12 +7,15 @@
 #include <assert.h>
 #include <complex>
 #include <iostream>
+#include <algorithm>
 //#include <complex.h>
 
 #include "liquid.h"
 //#include "liquid.internal.h"
 
 #include "phy/PhyDefinitions.h"
+#include "phy/PhyFFTPlanCache.h"
+#include "phy/PhyOFDMKernels.h"
 #include "phy/Radio.h"
 #include "util/log.h"
 
@@ -37,7 +40,33 @@ public:
     ~PhyFrameGen();
 
 
-    void create_STS_symbol() { write_STS(m_buf_tx); }
+    /**
+     * @brief copy the precomputed STS symbol (CP and taper applied) into the TX buffer
+     */
+    void create_STS_symbol();
+
+    /**
+     * @brief assemble a whole frame - STS preamble followed by num_symbols OFDM symbols (frame header first, then
+     *        payload) - into one contiguous block
+     *
+     * @note the preamble is copied from the template cache, only the header/payload symbols run through the ifft;
+     *       every symbol is written in place into block->data (one copy per segment, no per sample push_back)
+     *
+     * @param block destination block, resized to getFrameLength(num_symbols) samples
+     * @param symbols num_symbols * M subcarrier values (frequency domain), symbol after symbol
+     * @param num_symbols number of header + payload symbols
+     * @return size_t number of samples in the frame
+     */
+    size_t create_frame(const RadioIQDataPtr& block, const liquid_float_complex *symbols, unsigned int num_symbols);
+
+    /**
+     * @brief precomputed time domain STS symbol (M + cp samples with tapered cyclic prefix)
+     */
+    const IQSampleBuffer& getSTSTemplate() const { return m_sts_template; }
+
+    unsigned int getSymbolLength() const { return m_frame_len; }
+
+    size_t getFrameLength(unsigned int num_symbols) const { return (size_t)(1 + num_symbols) * m_frame_len; }
 
     void setTXBuffer(const RadioIQDataPtr& buffer);
 
@@ -47,11 +76,15 @@ protected:
 
 private:
 
+    // microbenchmarks of the private kernels (bench/bench_phy.cpp)
+    friend struct PhyFrameGenBench;
+
     // symbol information
     unsigned int m_M;                               // number of subcarriers
     unsigned int m_M2;                              // number of subcarriers div by 2
     unsigned int m_cp_len;                          // cyclic prefix length
     unsigned int m_frame_len;                       // frame length ( M+cp)
+    std::unique_ptr<PhyOFDMKernels> m_kernels;      // buffers and inner loops of the profile (M, cp_len, taper_len)
 
     unsigned char * m_subcarrier_allocation_STS;    // subcarrier allocation (null, pilot, data)
     unsigned char * m_subcarrier_allocation_LTS;    // subcarrier allocation (null, pilot, data)
@@ -76,7 +109,7 @@ private:
     float m_g_LTS;            // LTS training symbols gain
 
     // transform object
-    FFT_PLAN m_ifft;           // ifft object
+    FFT_PLAN m_ifft;           // ifft object (owned by PhyFFTPlanCache)
     
     liquid_float_complex *m_X;      // frequency-domain buffer
     liquid_float_complex *m_x;      // time-domain buffer
@@ -91,6 +124,10 @@ private:
     liquid_float_complex *m_LTS;     // LTS sequence (freq)
     liquid_float_complex *m_lts;     // LTS sequence (time)
 
+    // template cache of the constant preamble symbols
+    IQSampleBuffer m_sts_template;            // rendered STS symbol incl. tapered cyclic prefix
+    liquid_float_complex *m_sts_postfix;      // postfix (first taper_len samples) the STS leaves for the next symbol
+
 
 
 
@@ -103,6 +140,10 @@ private:
 
     int write_STS(liquid_float_complex * _y);
 
+    int init_templates();
+
+    int write_symbol(const liquid_float_complex * _X, liquid_float_complex * _y);
+
     int genSymbol(liquid_float_complex * _buffer);
 
 
@@ -10,7 +10,8 @@ PhyFrameSync::PhyFrameSync() {
 PhyFrameSync::PhyFrameSync(unsigned int M,
                            unsigned int cp_len,
                            unsigned int taper_len) 
-    : m_M{M}, m_cp_len{cp_len}, m_taper_len{taper_len}, m_frameSyncState{FRAMESYNC_STATE_DETECT_STS} {
+    : m_M{M}, m_cp_len{cp_len}, m_taper_len{taper_len}, m_frameSyncState{FRAMESYNC_STATE_DETECT_STS},
+      m_kernels{PhyOFDMKernels::create(M, cp_len, taper_len)}, m_demod{M, PHY_CP_DATA} {
 
     LOG_PHY_INFO("PhyFrameSync::PhyFrameSync(M,cp,taper) called {} {} {} ", M, cp_len, taper_len );
 
@@ -22,8 +23,9 @@ PhyFrameSync::PhyFrameSync(unsigned int M,
 
     
 
-    m_subcarrier_allocation_STS = (unsigned char*) malloc((m_M)*sizeof(unsigned char)); 
-    m_subcarrier_allocation_LTS = (unsigned char*) malloc((m_M)*sizeof(unsigned char)); 
+    // the per symbol buffers live in the kernels (aligned, std::array for the compile-time profiles)
+    m_subcarrier_allocation_STS = m_kernels->allocation(PhyOFDMKernels::ALLOC_STS);
+    m_subcarrier_allocation_LTS = m_kernels->allocation(PhyOFDMKernels::ALLOC_LTS);
 
     // init_STS_sctype();
     // init_LTS_sctype();
@@ -34,17 +36,18 @@ PhyFrameSync::PhyFrameSync(unsigned int M,
 
 
     // create transform object
-    m_X = (liquid_float_complex*) FFT_MALLOC((m_M)*sizeof(liquid_float_complex));
-    m_x = (liquid_float_complex*) FFT_MALLOC((m_M)*sizeof(liquid_float_complex));
-    m_fft = FFT_CREATE_PLAN(m_M, m_x, m_X, FFT_DIR_FORWARD, FFT_METHOD);
+    m_X = m_kernels->buffer(PhyOFDMKernels::BUF_X);
+    m_x = m_kernels->buffer(PhyOFDMKernels::BUF_x);
+    m_fft = PhyFFTPlanCache::instance().get_plan(m_M, m_x, m_X, FFT_DIR_FORWARD);
  
     // create input buffer the length of the transform
     m_input_buffer = windowcf_create(m_M + m_cp_len);
+    m_mix_buffer.resize(m_M);
 
 
     // allocate memory for PLCP arrays
-    m_STS = (liquid_float_complex*) malloc((m_M)*sizeof(liquid_float_complex)); // q->S0 frequency domain
-    m_sts = (liquid_float_complex*) malloc((m_M)*sizeof(liquid_float_complex)); // q->s0 time domain
+    m_STS = m_kernels->buffer(PhyOFDMKernels::BUF_STS); // q->S0 frequency domain
+    m_sts = m_kernels->buffer(PhyOFDMKernels::BUF_sts); // q->s0 time domain
     // q->S1 = (float complex*) malloc((q->M)*sizeof(float complex));
     // q->s1 = (float complex*) malloc((q->M)*sizeof(float complex));
     init_STS();
@@ -57,11 +60,11 @@ PhyFrameSync::PhyFrameSync(unsigned int M,
 
     // gain
     m_g0 = 1.0f;
-    m_gain_STSa = (liquid_float_complex*) malloc((m_M)*sizeof(liquid_float_complex));
-    m_gain_STSb = (liquid_float_complex*) malloc((m_M)*sizeof(liquid_float_complex));
-    m_gain_G   = (liquid_float_complex*) malloc((m_M)*sizeof(liquid_float_complex));
-    m_gain_B   = (liquid_float_complex*) malloc((m_M)*sizeof(liquid_float_complex));
-    m_gain_R   = (liquid_float_complex*) malloc((m_M)*sizeof(liquid_float_complex));
+    m_gain_STSa = m_kernels->buffer(PhyOFDMKernels::BUF_GAIN_STSA);
+    m_gain_STSb = m_kernels->buffer(PhyOFDMKernels::BUF_GAIN_STSB);
+    m_gain_G   = m_kernels->buffer(PhyOFDMKernels::BUF_GAIN_G);
+    m_gain_B   = m_kernels->buffer(PhyOFDMKernels::BUF_GAIN_B);
+    m_gain_R   = m_kernels->buffer(PhyOFDMKernels::BUF_GAIN_R);
 
     memset(m_gain_STSa, 0x00, m_M*sizeof(liquid_float_complex));
     memset(m_gain_STSb, 0x00, m_M*sizeof(liquid_float_complex));
@@ -101,6 +104,14 @@ PhyFrameSync::PhyFrameSync(unsigned int M,
 
     m_sync_STS_count = 0;
 
+    // Schmidl-Cox detector
+    m_sc_thresh = PHY_STS_SC_DETECT_THR;
+    m_sc_metric = 0.0f;
+    m_sc_L = m_M4;
+    m_sc_hist.resize(2*m_sc_L);
+    m_sc_next_ts = 0;
+    sc_reset();
+
     // // reset object
     reset_parameters();
 
@@ -121,6 +132,10 @@ int PhyFrameSync::reset_parameters() {
     // reset synchronizer objects
     nco_crcf_reset(m_nco_rx);
 
+    // Schmidl-Cox history - the next sample starts it again
+    sc_reset();
+    m_sc_next_ts = 0;
+
     // reset timers
     m_timer = 0;
     m_num_symbols = 0;
@@ -242,8 +257,7 @@ int PhyFrameSync::init_STS() {
 
     // normalize time-domain sequence level
     float g = 1.0f / sqrtf(M_STS);
-    for (i=0; i<m_M; i++)
-        m_sts[i] *= g;
+    m_kernels->scale(m_sts, g);
 
     return 0;
 }
@@ -303,6 +317,9 @@ void PhyFrameSync::execute(liquid_float_complex sample) {
 
     // @todo - NCO must be handled in PhyThread as it is needed for all samples not only STS/LTS but also data samples
 
+    if (m_frameSyncState == FRAMESYNC_STATE_DETECT_STS && m_sts_detector == STS_DETECTOR_SCHMIDL_COX)
+        sc_push(sample, m_currentSampleTimestamp);
+
     // correct for carrier frequency offset
     if (m_frameSyncState != FRAMESYNC_STATE_DETECT_STS) {
 
@@ -331,10 +348,10 @@ void PhyFrameSync::execute(liquid_float_complex sample) {
     case FRAMESYNC_STATE_SYNC_STS:
         execute_sync_STS();
         m_sync_STS_count++;
-        if(m_sync_STS_count > 1920)    // wenn nach 1,5 symbols kein sync da ist dann ist etwas faul ... 
+        if(m_sync_STS_count > PHY_SYNC_STS_MAX_SAMPLES)    // wenn nach 1,5 symbols kein sync da ist dann ist etwas faul ... 
         {
             // we need too long to sync .. something is wrong
-            std::cout << "something is wrong" << std::endl;
+            PHY_TRACE(SYNC_STS_TIMEOUT, m_currentSampleTimestamp, 0.0f, 0.0f, 0.0f, m_g0, (int32_t)m_sync_STS_count);
             m_iqdebug->freeze();                                    //IQDEBUG stop adding data to iq debug queue
             m_frameSyncState = FRAMESYNC_STATE_DETECT_STS;
             m_sync_STS_count = 0;
@@ -353,17 +370,22 @@ void PhyFrameSync::execute(liquid_float_complex sample) {
         if(m_timer > 0)
             m_timer--;              // finish STS frame
         else {
+            // payload starts with the next sample
+            estimate_gain_G();
+            m_demod.start(m_gain_G, m_currentSampleTimestamp + 1);
             m_frameSyncState = FRAMESYNC_STATE_RXSYMBOLS;
         }
         break;
     case FRAMESYNC_STATE_RXSYMBOLS:
-        if(m_wait > (16*1280)) {
+        if(m_wait > PHY_RXSYMBOLS_WAIT) {
+            m_demod.flush();
             m_wait = 0;
             m_timer = 0;
             m_sync_STS_count = 0;
             m_frameSyncState = FRAMESYNC_STATE_SYNC_STS;
-            std::cout << m_currentSampleTimestamp << std::endl;
+            PHY_TRACE(RXSYMBOLS_RESYNC, m_currentSampleTimestamp, 0.0f, 0.0f, 0.0f, m_g0, 0);
         } else {
+            m_demod.push(&sample, 1);
             m_wait++;
         }
         break;
@@ -377,6 +399,119 @@ void PhyFrameSync::execute(liquid_float_complex sample) {
 
 }
 
+void PhyFrameSync::execute(const liquid_float_complex *samples, size_t n) {
+
+    size_t i = 0;
+
+    while (i < n) {
+
+        size_t k = samples_to_decision();
+
+        if (k == 0) {
+            // decision point - handled sample by sample
+            execute(samples[i]);
+            m_currentSampleTimestamp++;
+            i++;
+            continue;
+        }
+
+        if (k > n - i)
+            k = n - i;
+
+        skip_samples(&samples[i], k);
+        m_currentSampleTimestamp += k;
+        i += k;
+    }
+}
+
+/**
+ * @brief number of following samples for which execute(sample) would only advance the timers of the current state
+ *        (i.e. no detection, metric or state change)
+ *
+ * @return size_t
+ */
+size_t PhyFrameSync::samples_to_decision() {
+
+    switch (m_frameSyncState)
+    {
+    case FRAMESYNC_STATE_DETECT_STS:
+        return (m_timer + 1 < m_M4) ? m_M4 - 1 - m_timer : 0;
+
+    case FRAMESYNC_STATE_SYNC_STS: {
+        if (m_timer + 1 >= m_M4 || m_sync_STS_count >= PHY_SYNC_STS_MAX_SAMPLES)
+            return 0;
+        size_t k = m_M4 - 1 - m_timer;
+        size_t c = PHY_SYNC_STS_MAX_SAMPLES - m_sync_STS_count;
+        return k < c ? k : c;
+    }
+
+    case FRAMESYNC_STATE_STS_0:
+    case FRAMESYNC_STATE_STS_1:
+        return (m_timer + 1 < m_M2) ? m_M2 - 1 - m_timer : 0;
+
+    case FRAMESYNC_STATE_LTS:
+        return m_timer;
+
+    case FRAMESYNC_STATE_RXSYMBOLS:
+        return (m_wait <= PHY_RXSYMBOLS_WAIT) ? PHY_RXSYMBOLS_WAIT - m_wait + 1 : 0;
+
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief bulk equivalent of n calls to execute(sample) without a decision, see samples_to_decision()
+ *
+ * @param samples
+ * @param n
+ */
+void PhyFrameSync::skip_samples(const liquid_float_complex *samples, size_t n) {
+
+    if (m_frameSyncState == FRAMESYNC_STATE_DETECT_STS) {
+        // no carrier frequency offset correction during detection
+        windowcf_write(m_input_buffer, const_cast<liquid_float_complex *>(samples), n);
+
+        if (m_sts_detector == STS_DETECTOR_SCHMIDL_COX) {
+            for (size_t i = 0; i < n; i++)
+                sc_push(samples[i], m_currentSampleTimestamp + i);
+        }
+    } else {
+        // Rotate input vector down by NCO angle in chunks of m_M, y = x exp{-j theta} - the vector rotate of the
+        // DSP kernels, the NCO phase is advanced by the chunk (same as nco_crcf_mix_block_down)
+        const PhyDSPKernels& dsp = m_kernels->dsp();
+        const float d_theta = nco_crcf_get_frequency(m_nco_rx);
+        size_t done = 0;
+        while (done < n) {
+            size_t chunk = (n - done) < m_M ? (n - done) : m_M;
+            const float theta = nco_crcf_get_phase(m_nco_rx);
+            dsp.rotate(&samples[done], m_mix_buffer.data(), chunk, -theta, -d_theta);
+            nco_crcf_set_phase(m_nco_rx, (float)remainder((double)theta + (double)chunk * d_theta, 2.0 * M_PI));
+            windowcf_write(m_input_buffer, m_mix_buffer.data(), chunk);
+            if (m_frameSyncState == FRAMESYNC_STATE_RXSYMBOLS)
+                m_demod.push(m_mix_buffer.data(), chunk);
+            done += chunk;
+        }
+    }
+
+    switch (m_frameSyncState)
+    {
+    case FRAMESYNC_STATE_SYNC_STS:
+        m_sync_STS_count += n;
+        m_timer += n;
+        break;
+    case FRAMESYNC_STATE_LTS:
+        m_timer -= n;
+        break;
+    case FRAMESYNC_STATE_RXSYMBOLS:
+        m_wait += n;
+        break;
+    default:
+        m_timer += n;
+        break;
+    }
+}
+
 int PhyFrameSync::execute_detect_STS() {
 
     m_timer++;
@@ -385,24 +520,26 @@ int PhyFrameSync::execute_detect_STS() {
         return 0;
 
 
-    std::cout << "det_STS" << std::endl;
-
-
     // reset timer
     m_timer = 0;
 
+    // the cheap Schmidl-Cox metric decides if the FFT based estimate is run at all
+    if (m_sts_detector == STS_DETECTOR_SCHMIDL_COX) {
+        m_sc_metric = sc_metric();
+        if (m_sc_metric < m_sc_thresh) {
+            // same as below lower threshold
+            m_STS_detect_hit_upper_tresh = false;
+            return 0;
+        }
+    }
+
     //
     liquid_float_complex *rc;
     windowcf_read(m_input_buffer, &rc);
 
     // estimate gain
-    unsigned int i;
     // start with a reasonably small number to avoid divide-by-zero warning
-    float g = 1.0e-9f;
-    for (i= m_cp_len; i<m_M + m_cp_len; i++) {
-        // compute |rc[i]|^2 efficiently
-        g += rc[i].real()*rc[i].real() + rc[i].imag()*rc[i].imag();
-    }
+    float g = 1.0e-9f + m_kernels->energy(&rc[m_cp_len]);
     g = (float)(m_M) / g;
 
 // #if ENABLE_SQUELCH
@@ -436,8 +573,7 @@ int PhyFrameSync::execute_detect_STS() {
     // save gain (permits dynamic invocation of get_rssi() method)
     m_g0 = g;
 
-    if(g < 300)
-       std::cout  << "detect: g " << g << " rssi " << -10*log10(g) << " shat " << std::abs(s_hat)  << std::endl;
+    PHY_TRACE(DETECT_STS, m_currentSampleTimestamp, s_hat, tau_hat, 0.0f, g, 0);
 
     // 
     if (std::abs(s_hat) > m_STS_detect_lower_thresh) {
@@ -445,7 +581,6 @@ int PhyFrameSync::execute_detect_STS() {
     //     m_timer = 2*m_M;
 
         int dt = (int)roundf(tau_hat);
-        std::cout << "grepgrepgrepZ," << m_currentSampleTimestamp << "," << std::abs(s_hat) << "," << std::arg(s_hat) << "," << tau_hat << "," << dt << std::endl;
 
 
         if(std::abs(s_hat) < m_STS_detect_upper_thresh) {
@@ -454,7 +589,7 @@ int PhyFrameSync::execute_detect_STS() {
             
             if(!m_STS_detect_hit_upper_tresh) {         
 
-                std::cout << "framestart (roughly)" << (m_currentSampleTimestamp - 1024 + (512- dt)) << std::endl;
+                PHY_TRACE(DETECT_FRAMESTART, m_currentSampleTimestamp, s_hat, tau_hat, 0.0f, g, (int32_t)(-1024 + (512- dt)));
 
                 // set timer appropriately...
                 m_timer = (m_M + dt) % (m_M2);
@@ -464,7 +599,7 @@ int PhyFrameSync::execute_detect_STS() {
                 // we are on the raising slope of detection i.e. we are at the beginning of the STS symbol
                 m_frameSyncState = FRAMESYNC_STATE_STS_0;
             } else {
-                std::cout << "coming from upper" << std::endl;
+                PHY_TRACE(DETECT_FROM_UPPER, m_currentSampleTimestamp, s_hat, tau_hat, 0.0f, g, dt);
                 // we hit the symbol in the middel 
                 // we forward a bit and let the STS_DETECT run
                 m_timer = 0;
@@ -474,13 +609,13 @@ int PhyFrameSync::execute_detect_STS() {
 
             
         } else {
-            std::cout << "hit upper" << std::endl;
+            PHY_TRACE(DETECT_HIT_UPPER, m_currentSampleTimestamp, s_hat, tau_hat, 0.0f, g, dt);
             m_STS_detect_hit_upper_tresh = true;
             m_timer = 0;
         }
     } else {
         // when we hit a non STS frame we reset the upper threshold hit
-        std::cout << "below lower" << std::endl;
+        PHY_TRACE(DETECT_BELOW_LOWER, m_currentSampleTimestamp, s_hat, tau_hat, 0.0f, g, 0);
         m_STS_detect_hit_upper_tresh = false;
     }
     return 0;
@@ -502,8 +637,6 @@ int PhyFrameSync::execute_sync_STS() {
     }
     //std::cout << std::endl;
 
-    std::cout << "sync_STS" << std::endl;
-
 
     // reset timer
     m_timer = 0;
@@ -513,13 +646,8 @@ int PhyFrameSync::execute_sync_STS() {
     windowcf_read(m_input_buffer, &rc);
 
     // estimate gain
-    unsigned int i;
     // start with a reasonably small number to avoid divide-by-zero warning
-    float g = 1.0e-9f;
-    for (i= m_cp_len; i<m_M + m_cp_len; i++) {
-        // compute |rc[i]|^2 efficiently
-        g += rc[i].real()*rc[i].real() + rc[i].imag()*rc[i].imag();
-    }
+    float g = 1.0e-9f + m_kernels->energy(&rc[m_cp_len]);
     g = (float)(m_M) / g;
 
     // estimate S0 gain
@@ -540,14 +668,12 @@ int PhyFrameSync::execute_sync_STS() {
     // save gain (permits dynamic invocation of get_rssi() method)
     m_g0 = g;
 
-    // // DEBUG RSSI !!!
-    // if(g < 10000)
-        std::cout  << "sync: g " << g << " rssi " << -10*log10(g) << " shat " << std::abs(s_hat)  << std::endl;
+    PHY_TRACE(SYNC_STS, m_currentSampleTimestamp, s_hat, tau_hat, 0.0f, g, 0);
 
 
     if (std::abs(s_hat) > m_STS_detect_lower_thresh) {
         int dt = (int)roundf(tau_hat);
-        std::cout << "\ngrepgrepgrepX," << m_currentSampleTimestamp << "," << std::abs(s_hat) << "," << std::arg(s_hat) << "," << tau_hat << "," << dt << std::endl;
+        PHY_TRACE(SYNC_STS_FOUND, m_currentSampleTimestamp, s_hat, tau_hat, 0.0f, g, dt);
 
         m_timer = m_M; // add delay to help ensure good S0 estimate
 
@@ -572,9 +698,6 @@ int PhyFrameSync::execute_sync_STSa()
     if (m_timer < m_M2)
         return 0;
 
-    std::cout << "STSa" << std::endl;
-
-
 
     // reset timer
     m_timer = 0;
@@ -591,13 +714,12 @@ int PhyFrameSync::execute_sync_STSa()
     liquid_float_complex s_hat;
     STS_metrics(m_gain_STSa, s_hat);
 
-    std::cout << "s_hat abs,arg, m_g0: " << std::abs(s_hat) << ":" << std::arg(s_hat) << ":" << m_g0 << ":" << std::abs(s_hat*m_g0) << std::endl;
-
-
     s_hat *= m_g0;
 
     m_s_hat_0 = s_hat;
 
+    PHY_TRACE(STS_A, m_currentSampleTimestamp, s_hat, 0.0f, 0.0f, m_g0, 0);
+
 // #if DEBUG_OFDMFRAMESYNC_PRINT
 //     float tau_hat  = cargf(s_hat) * (float)(_q->M2) / (2*M_PI);
 //     printf("********** S0[0] received ************\n");
@@ -631,9 +753,6 @@ int PhyFrameSync::execute_sync_STSb()
     // m_timer = m_M + m_cp_len - m_backoff;
 
 
-    std::cout << "STSb" << std::endl;
-
-
     //
     liquid_float_complex *rc;
     windowcf_read(m_input_buffer, &rc);
@@ -644,8 +763,6 @@ int PhyFrameSync::execute_sync_STSb()
     liquid_float_complex s_hat;
     STS_metrics(m_gain_STSb, s_hat);
 
-    std::cout << "s_hat abs,arg, m_g0: " << std::abs(s_hat) << ":" << std::arg(s_hat) << ":" << m_g0 << ":" << std::abs(s_hat*m_g0) << std::endl;
-
     s_hat *= m_g0;
 
     m_s_hat_1 = s_hat;
@@ -664,8 +781,6 @@ int PhyFrameSync::execute_sync_STSb()
 // #endif
 
 
-    std::cout << "s_hat0_1 arg: " << std::arg(m_s_hat_0 + m_s_hat_1) << std::endl;
-
     // re-adjust timer accordingly
 //    float tau_prime = std::arg(m_s_hat_0 + m_s_hat_1) * (float)(m_M2) / (2*M_PI);
 //    m_timer = 256 - (int)roundf(tau_prime);
@@ -677,8 +792,7 @@ int PhyFrameSync::execute_sync_STSb()
 
     if(std::abs(m_s_hat_1) < (std::abs(m_s_hat_0)-0.5)) {
         // we hit the frame at the very end on the first bunch of smaples received by the SDR
-        std::cout << "STSb hit coming from upper" << std::endl;
-        std::cout << "STSb " << m_currentSampleTimestamp << "," << std::abs(m_s_hat_0) << "," << std::abs(m_s_hat_1)<< ","  << tau_prime << std::endl;
+        PHY_TRACE(STS_B_FROM_UPPER, m_currentSampleTimestamp, m_s_hat_1, tau_prime, 0.0f, m_g0, (int32_t)m_timer);
 
         m_iqdebug->freeze(); // DEBUG
 
@@ -700,7 +814,6 @@ int PhyFrameSync::execute_sync_STSb()
 //     }
 // #endif
 
-     unsigned int i;
 // #if 0
 //     float complex g_hat = 0.0f;
 //     for (i=0; i<_q->M; i++)
@@ -710,10 +823,7 @@ int PhyFrameSync::execute_sync_STSb()
 //     float nu_hat = 2.0f * cargf(g_hat) / (float)(_q->M);
 // #else
     // compute carrier frequency offset estimate using ML method
-    liquid_float_complex t0 = 0.0f;
-    for (i=0; i<m_M2; i++) {
-        t0 += conj(rc[i]) * m_sts[i] * rc[i+m_M2] * conj(m_sts[i+m_M2]);
-    }
+    liquid_float_complex t0 = m_kernels->cfo_correlation(rc, m_sts);
     float nu_hat = std::arg(t0) / (float)(m_M2);
 // #endif
 
@@ -721,11 +831,12 @@ int PhyFrameSync::execute_sync_STSb()
 //     printf("   nu_hat   :   %12.8f\n", nu_hat);
 // #endif
 
-    std::cout << "grepgrepgrep_b," << m_currentSampleTimestamp << "," << std::abs(s_hat) << "," << std::arg(s_hat) << "," << tau_prime << "," << m_timer << "," << nu_hat << std::endl;
+    PHY_TRACE(STS_B, m_currentSampleTimestamp, s_hat, tau_prime, nu_hat, m_g0, (int32_t)m_timer);
 
     // NICHT SICHER OB DAS STIMMT MIT DEM FRAME START ....
     // muss die cp_len dazugekommen werden?
-    std::cout << "STSb framestart (roughly) ," << (m_currentSampleTimestamp - (m_M + m_cp_len) + (0 - (int)roundf(tau_prime))) << std::endl;
+    PHY_TRACE(STS_B_FRAMESTART, m_currentSampleTimestamp, m_s_hat_0 + m_s_hat_1, tau_prime, nu_hat, m_g0,
+              (int32_t)(-(int)(m_M + m_cp_len) - (int)roundf(tau_prime)));
 
 
 
@@ -741,16 +852,96 @@ int PhyFrameSync::execute_sync_STSb()
 
 
 
+void PhyFrameSync::sc_reset() {
+
+    for (unsigned int i=0; i<2*m_sc_L; i++)
+        m_sc_hist[i] = 0.0f;
+
+    m_sc_pos = 0;
+    m_sc_fill = 0;
+    m_sc_P = 0.0;
+    m_sc_R = 0.0;
+    m_sc_exact = 0;
+}
+
+/**
+ * @brief add sample r[n] to the running Schmidl-Cox sums
+ * @brief P += conj(r[n-L]) r[n] - conj(r[n-2L]) r[n-L] ; R += |r[n]|^2 - |r[n-L]|^2
+ *
+ * @param x sample r[n]
+ * @param ts timestamp of x - a gap in the timestamps restarts the sums
+ */
+void PhyFrameSync::sc_push(liquid_float_complex x, uint64_t ts) {
+
+    if (ts != m_sc_next_ts)
+        sc_reset();
+    m_sc_next_ts = ts + 1;
+
+    const unsigned int L2 = 2*m_sc_L;
+
+    std::complex<double> x0(x.real(), x.imag());
+    std::complex<double> xL(m_sc_hist[(m_sc_pos + m_sc_L) % L2].real(), m_sc_hist[(m_sc_pos + m_sc_L) % L2].imag());
+    std::complex<double> x2L(m_sc_hist[m_sc_pos].real(), m_sc_hist[m_sc_pos].imag());
+
+    m_sc_P += std::conj(xL) * x0 - std::conj(x2L) * xL;
+    m_sc_R += std::norm(x0) - std::norm(xL);
+
+    m_sc_hist[m_sc_pos] = x;
+    m_sc_pos = (m_sc_pos + 1) % L2;
+
+    if (m_sc_fill < L2)
+        m_sc_fill++;
+
+    // the running sums accumulate the rounding of every add and subtract - summed up again once per window
+    if (++m_sc_exact >= L2 && m_sc_fill == L2)
+        sc_resum();
+}
+
+/**
+ * @brief P and R summed up from the history (r[n-2L+1] .. r[n]) instead of the running updates
+ */
+void PhyFrameSync::sc_resum() {
+
+    const unsigned int L2 = 2*m_sc_L;
+
+    std::complex<double> P = 0.0;
+    double R = 0.0;
+    for (unsigned int j = m_sc_L; j < L2; j++) {
+        const liquid_float_complex a = m_sc_hist[(m_sc_pos + j - m_sc_L) % L2];
+        const liquid_float_complex b = m_sc_hist[(m_sc_pos + j) % L2];
+        P += std::conj(std::complex<double>(a.real(), a.imag())) * std::complex<double>(b.real(), b.imag());
+        R += std::norm(std::complex<double>(b.real(), b.imag()));
+    }
+
+    m_sc_P = P;
+    m_sc_R = R;
+    m_sc_exact = 0;
+}
+
+/**
+ * @brief |P|^2 / R^2 - close to 1 when the last 2L samples are periodic with L (STS), 0 before the history is filled
+ *
+ * @return float
+ */
+float PhyFrameSync::sc_metric() {
+
+    if (m_sc_fill < 2*m_sc_L)
+        return 0.0f;
+
+    double r = m_sc_R > 1.0e-12 ? m_sc_R : 1.0e-12;
+    return (float)(std::norm(m_sc_P) / (r * r));
+}
+
+
 int PhyFrameSync::estimate_gain_STS(liquid_float_complex *rc, liquid_float_complex *G) {
 
     // move input array into fft input buffer
     memmove(m_x, rc, (m_M)*sizeof(liquid_float_complex));
 
     // compute fft, storing result into _q->X
-    FFT_EXECUTE(m_fft);
+    PhyFFTPlanCache::execute(m_fft, m_x, m_X);
     
     // compute gain, ignoring NULL subcarriers
-    unsigned int i;
 
     //value derived through checking with octave - value smaller than 0.55f created kind of a distortion
     //original - sqrtf(m_M_STS) / (float)(m_M);
@@ -768,10 +959,40 @@ int PhyFrameSync::estimate_gain_STS(liquid_float_complex *rc, liquid_float_compl
 //   //      G[n] *= gain;
 //     }
 
-    // @todo - optimize to not touch all entries 
+    // all entries - the dense loop vectorizes, the NULL subcarriers come out 0
+    m_kernels->sts_gain(m_X, m_STS, G, gain);
+
+    return 0;
+}
+
+
+/**
+ * @brief payload equalizer m_gain_G from the STS[b] estimate - the STS is on every 4th subcarrier; the channel is
+ *        interpolated linearly in between (circular over the FFT bins) and inverted
+ *
+ * @return int
+ */
+int PhyFrameSync::estimate_gain_G() {
+
+    // scaling used in estimate_gain_STS()
+    const float gain = 0.055f;
+
+    unsigned int i;
     for (i=0; i<m_M; i++) {
-        G[i] = m_X[i] * conj(m_STS[i]);
-        G[i] *= gain;
+        // STS subcarriers are the bins 3, 7, 11, ... (the fftshift of init_STS() keeps that)
+        const unsigned int r = (i + 1) % 4;
+        const unsigned int lo = (i + m_M - r) % m_M;
+        const unsigned int hi = (lo + 4) % m_M;
+        const float t = (float)r / 4.0f;
+
+        // m_gain_STSb is X conj(S) gain already - divided by |S|^2 it is the channel, the STS sign is removed
+        const float s_lo = std::norm(m_STS[lo]), s_hi = std::norm(m_STS[hi]);
+        const liquid_float_complex H_lo = s_lo > 0.0f ? m_gain_STSb[lo] / (gain * s_lo) : liquid_float_complex(0.0f);
+        const liquid_float_complex H_hi = s_hi > 0.0f ? m_gain_STSb[hi] / (gain * s_hi) : liquid_float_complex(0.0f);
+        liquid_float_complex H = (1.0f - t) * H_lo + t * H_hi;
+
+        float h2 = std::norm(H);
+        m_gain_G[i] = h2 > 1.0e-12f ? std::conj(H) / h2 : liquid_float_complex(0.0f);
     }
 
     return 0;
@@ -781,7 +1002,6 @@ int PhyFrameSync::estimate_gain_STS(liquid_float_complex *rc, liquid_float_compl
 int PhyFrameSync::STS_metrics(liquid_float_complex *G, liquid_float_complex &s ) {
 
     // timing, carrier offset correction
-    unsigned int i;
     liquid_float_complex s_hat = 0.0f;
 
     // for(i=0; i < m_M; i++)
@@ -791,10 +1011,8 @@ int PhyFrameSync::STS_metrics(liquid_float_complex *G, liquid_float_complex &s )
     // compute timing estimate, accumulate phase difference across
     // gains on subsequent pilot subcarriers (note that all the odd
     // subcarriers are NULL)
-    for (i=3; i<(m_M-4); i+=4) {
-        s_hat += G[(i+4)]*conj(G[i]);
+    s_hat = m_kernels->sts_metrics(G);
 //        s_hat += G[i]*conj(G[(i+4)]);
-    }
 
     //the normalizing as done in the liquid ofdmframesync does create problems 
     s_hat /= m_M_STS; // normalize output
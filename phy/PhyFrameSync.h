@@ -7,11 +7,16 @@
 #include <cassert>
 #include <complex>
 #include <iostream>
+#include <vector>
 
 #include <liquid.h>
 //#include "liquid.internal.h"
 
 #include "phy/PhyDefinitions.h"
+#include "phy/PhyFFTPlanCache.h"
+#include "phy/PhyOFDMDemod.h"
+#include "phy/PhyOFDMKernels.h"
+#include "phy/PhyTrace.h"
 #include "util/log.h"
 #include "PhyIQDebug.h"
 
@@ -31,18 +36,64 @@ public:
 
     void execute(liquid_float_complex sample);
 
+    /**
+     * @brief process a block of samples, m_currentSampleTimestamp has to be the timestamp of samples[0] and is
+     *        advanced by n
+     *
+     * @note samples which only advance the timers of the current state are processed in bulk (NCO mixdown via
+     *       PhyDSPKernels::rotate with the NCO phase, windowcf_write); only decision points are handed to execute(sample)
+     *
+     * @param samples
+     * @param n number of samples
+     */
+    void execute(const liquid_float_complex *samples, size_t n);
+
 
     uint64_t m_currentSampleTimestamp;
 
 
     void setIQDebug(PhyIQDebugPtr iqd) { m_iqdebug = iqd; }
 
+
+    // STS detector used in FRAMESYNC_STATE_DETECT_STS
+    typedef enum {
+        STS_DETECTOR_FFT=0,             // FFT gain estimate + STS_metrics every M/4 samples
+        STS_DETECTOR_SCHMIDL_COX        // sliding delay-and-correlate metric gates the FFT estimate
+    } StsDetector;
+
+    /**
+     * @brief select the STS detector; STS_DETECTOR_SCHMIDL_COX only runs the FFT estimate when the O(1) per sample
+     *        Schmidl-Cox metric is above PHY_STS_SC_DETECT_THR
+     *
+     * @param detector
+     */
+    void setSTSDetector(StsDetector detector) { m_sts_detector = detector; }
+
+    StsDetector getSTSDetector() { return m_sts_detector; }
+
+    /**
+     * @brief last Schmidl-Cox metric |P|^2/R^2 evaluated in detection
+     *
+     * @return float
+     */
+    float getSCMetric() { return m_sc_metric; }
+
+    /**
+     * @brief payload demodulator - runs in FRAMESYNC_STATE_RXSYMBOLS; its soft bits are valid until the next batch
+     *
+     * @return PhyOFDMDemod&
+     */
+    PhyOFDMDemod& getDemod() { return m_demod; }
+
 protected:
 
 
 
 private:
 
+    // microbenchmarks of the private kernels (bench/bench_phy.cpp)
+    friend struct PhyFrameSyncBench;
+
     // statemachine
     // receiver sync state
     enum {
@@ -63,6 +114,7 @@ private:
     unsigned int m_M4;                               // number of subcarriers div by 4
     unsigned int m_cp_len;                          // cyclic prefix length
     unsigned int m_taper_len;                       // taper length
+    std::unique_ptr<PhyOFDMKernels> m_kernels;      // buffers and inner loops of the profile (M, cp_len, taper_len)
     unsigned char * m_subcarrier_allocation_STS;    // subcarrier allocation (null, pilot, data)
     unsigned char * m_subcarrier_allocation_LTS;    // subcarrier allocation (null, pilot, data)
 
@@ -79,11 +131,12 @@ private:
     float m_g_LTS;            // LTS training symbols gain
 
     // transform object
-    FFT_PLAN m_fft;           // ifft object
+    FFT_PLAN m_fft;           // fft object (owned by PhyFFTPlanCache)
     
     liquid_float_complex *m_X;      // frequency-domain buffer
     liquid_float_complex *m_x;      // time-domain buffer
     windowcf m_input_buffer;  // input sequence buffer
+    std::vector<liquid_float_complex> m_mix_buffer;     // NCO mixdown output for the block execute()
 
     // STS and LTS sequences
     liquid_float_complex *m_STS;     // STS sequence (freq) //_S0
@@ -132,6 +185,25 @@ private:
     int m_sync_STS_count;
 
 
+    // Schmidl-Cox detector - running correlation of r[n] with r[n-L] over L = M/4 samples (STS period)
+    StsDetector m_sts_detector = STS_DETECTOR_FFT;
+    float m_sc_thresh;
+    float m_sc_metric;
+    unsigned int m_sc_L;
+    std::vector<liquid_float_complex> m_sc_hist;        // last 2L samples (circular)
+    unsigned int m_sc_pos;                  // position of r[n-2L] in m_sc_hist
+    unsigned int m_sc_fill;                 // valid samples in m_sc_hist
+    std::complex<double> m_sc_P;            // sum conj(r[k-L]) r[k]
+    double m_sc_R;                          // sum |r[k]|^2
+    unsigned int m_sc_exact;                // samples since P and R were summed up from m_sc_hist (no drift)
+    uint64_t m_sc_next_ts;                  // expected timestamp of the next sample - history is reset on a gap
+
+    void sc_reset();
+    void sc_push(liquid_float_complex x, uint64_t ts);
+    void sc_resum();
+    float sc_metric();
+
+
     int init_STS_sctype(); 
     int init_LTS_sctype();
 
@@ -141,6 +213,9 @@ private:
 
     int reset_parameters();
 
+    size_t samples_to_decision();
+    void skip_samples(const liquid_float_complex *samples, size_t n);
+
     int execute_detect_STS();
     int execute_sync_STS();
 
@@ -151,6 +226,11 @@ private:
 
     int STS_metrics(liquid_float_complex *G, liquid_float_complex &s );
 
+    int estimate_gain_G();
+
+    // batched payload demodulation, fed with the CFO corrected samples of FRAMESYNC_STATE_RXSYMBOLS
+    PhyOFDMDemod m_demod;
+
 
 
     PhyIQDebugPtr m_iqdebug;
@@ -1,5 +1,9 @@
 #include "PhyIQDebug.h"
 
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
 
 PhyIQDebug::PhyIQDebug() {
 
@@ -12,89 +16,175 @@ PhyIQDebug::PhyIQDebug() {
     m_timestamp = 0;
     m_freeze_period = IQDEBUG_FREEZE_PERIOD;
 
+    // preallocate both rings - push_iq() never allocates
+    m_rings[0].resize(IQDEBUG_BUFFER_LENGTH);
+    m_rings[1].resize(IQDEBUG_BUFFER_LENGTH);
+
+    m_dump_thread = std::thread(&PhyIQDebug::dump_main, this);
 }
 
 PhyIQDebug::~PhyIQDebug() {
 
     LOG_PHY_INFO("PhyIQDebug::~PhyIQDebug() de-constructor");
     m_stopped.store(true);
-    m_freeze.store(true);
-
-    dump_iq();      // dumps the data on de-construction - just in case it was not dumped before
 
-    m_IQDebugData.clear(); // cleanup
+    // finish a pending background dump first
+    {
+        std::lock_guard < std::mutex > lock(m_dump_mutex);
+        m_dump_cv.notify_all();
+    }
+    m_dump_thread.join();
 
+    dump_iq();      // dumps the data on de-construction - just in case it was not dumped before
 }
 
 
-void PhyIQDebug::push_iq(uint64_t ts, liquid_float_complex sample) {
+void PhyIQDebug::push_iq(uint64_t ts, const liquid_float_complex *samples, size_t n) {
 
-    if(!m_stopped) {
+    if(m_stopped)
+        return;
 
-        m_timestamp = ts;
-        m_IQDebugData.push_back(sample);
+    IQSampleBuffer& ring = m_rings[m_active];
+
+    // only the last IQDEBUG_BUFFER_LENGTH samples of a large block are kept
+    if(n > IQDEBUG_BUFFER_LENGTH) {
+        samples += n - IQDEBUG_BUFFER_LENGTH;
+        ts += n - IQDEBUG_BUFFER_LENGTH;
+        n = IQDEBUG_BUFFER_LENGTH;
+    }
 
-        if(m_IQDebugData.size() > IQDEBUG_BUFFER_LENGTH) {
-            // size of queue has reached max .. making room in the front
-            m_IQDebugData.pop_front();
+    // at most two copies - up to the end of the ring and the wrapped rest
+    const size_t first = std::min(n, (size_t)IQDEBUG_BUFFER_LENGTH - m_write_pos);
+    memcpy(ring.data() + m_write_pos, samples, first * sizeof(liquid_float_complex));
+    if(first < n)
+        memcpy(ring.data(), samples + first, (n - first) * sizeof(liquid_float_complex));
+
+    m_write_pos = (m_write_pos + n) % IQDEBUG_BUFFER_LENGTH;
+    m_fill = std::min(m_fill + n, (size_t)IQDEBUG_BUFFER_LENGTH);
+    m_timestamp = ts + n;
+
+    m_bufferspace_left = IQDEBUG_BUFFER_LENGTH - m_fill;
+
+    // if the debug gets freezed the iq data collection is running for the freeze period and then the ring is
+    // handed to the dump thread
+    if(m_freeze) {
+        m_freeze_period -= n;
+
+        if(m_freeze_period <= 0) {
+            std::lock_guard < std::mutex > lock(m_dump_mutex);
+
+            if(!m_dump_pending) {
+                m_snapshot.ring = &m_rings[m_active];
+                m_snapshot.write_pos = m_write_pos;
+                m_snapshot.fill = m_fill;
+                m_snapshot.ts_first = m_timestamp - m_fill;
+                m_dump_pending = true;
+
+                // continue in the spare ring
+                m_active ^= 1;
+                m_write_pos = 0;
+                m_fill = 0;
+
+                m_dump_cv.notify_one();
+            } else {
+                LOG_PHY_WARN("PhyIQDebug::push_iq() freeze ignored - previous dump still running");
+            }
+
+            m_freeze_period = IQDEBUG_FREEZE_PERIOD;
+            m_freeze.store(false);
         }
+    }
+}
 
 
-        // if the debug gets freezed the iq data collection is running for the freeze period and then stops
-        if(m_freeze)
-            m_freeze_period--;
+void PhyIQDebug::dump_main() {
 
-        if(!m_freeze_period)
-            m_stopped.store(true);
+    std::unique_lock < std::mutex > lock(m_dump_mutex);
 
-        m_bufferspace_left = m_IQDebugData.size();
-    }
+    while(true) {
+        m_dump_cv.wait(lock, [this] { return m_dump_pending || m_stopped; });
+
+        if(m_dump_pending) {
+            Snapshot snap = m_snapshot;
+            std::string basename = next_dumpname();
 
+            // the snapshot ring is not touched by push_iq() until m_dump_pending is cleared
+            lock.unlock();
+            write_sigmf(snap, basename);
+            lock.lock();
 
+            m_dump_pending = false;
+        } else if(m_stopped) {
+            break;
+        }
+    }
 }
 
+
 /**
- * @brief dumps the IQ data from the deque buffer to a file
- * 
+ * @brief write a snapshot as <basename>.sigmf-data (cf32_le) and <basename>.sigmf-meta
+ *
  */
-void PhyIQDebug::dump_iq() {
-
-    // write data for debug to ramdisk (cmdline -w option) - anyways  is even with ram very slow ...
-    // root@x:~# mkdir /tmp/ramdisk
-    // root@x:~# chmod 777 ramdisk/
-    // root@x:~# mount -t tmpfs -o size=200M myramdisk /tmp/ramdisk/
-
-    // bool stop = true;
-
-    // if(result.count("w")) {
-    //     write_csv_file(sdr, iqpipe_rx,"/tmp/ramdisk/IQData.csv");
-    //     stop = false;
-    // }
+bool PhyIQDebug::write_sigmf(const Snapshot& snap, const std::string& basename) {
 
-    uint64_t t = 0;
+    const std::string datafile = basename + ".sigmf-data";
+    const std::string metafile = basename + ".sigmf-meta";
 
-    std::ofstream myfile(IQDEBUG_DUMP_FILE);
-
-    // error checking if file is there ... maybe a bit overkill for a test script :-)
-    if(!myfile.is_open()) {
-        LOG_TEST_ERROR("cannot open {}", IQDEBUG_DUMP_FILE);
-
-    } else {
+    std::FILE *f = std::fopen(datafile.c_str(), "wb");
+    if(f == nullptr) {
+        LOG_PHY_ERROR("PhyIQDebug::write_sigmf() cannot open {}", datafile);
+        return false;
+    }
 
-        // get the received IQ data via the queue which is attached to the SDR thread
+    // liquid_float_complex is interleaved float I/Q, i.e. cf32_le on the targets we run on
+    // oldest sample first - the ring only wrapped when it is full
+    const size_t start = (snap.fill == IQDEBUG_BUFFER_LENGTH) ? snap.write_pos : 0;
+    const size_t first = std::min(snap.fill, (size_t)IQDEBUG_BUFFER_LENGTH - start);
+    std::fwrite(snap.ring->data() + start, sizeof(liquid_float_complex), first, f);
+    std::fwrite(snap.ring->data(), sizeof(liquid_float_complex), snap.fill - first, f);
+    std::fclose(f);
+
+    std::ofstream meta(metafile);
+    if(!meta.is_open()) {
+        LOG_PHY_ERROR("PhyIQDebug::write_sigmf() cannot open {}", metafile);
+        return false;
+    }
 
-        t = m_timestamp - m_IQDebugData.size();
+    meta << "{\n"
+         << "  \"global\": {\n"
+         << "    \"core:datatype\": \"cf32_le\",\n"
+         << "    \"core:sample_rate\": " << m_sample_rate << ",\n"
+         << "    \"core:version\": \"1.0.0\",\n"
+         << "    \"core:recorder\": \"RPX-100 PhyIQDebug\"\n"
+         << "  },\n"
+         << "  \"captures\": [\n"
+         << "    {\n"
+         << "      \"core:sample_start\": 0,\n"
+         << "      \"core:frequency\": " << m_frequency << ",\n"
+         << "      \"rpx:timestamp\": " << snap.ts_first << "\n"
+         << "    }\n"
+         << "  ],\n"
+         << "  \"annotations\": []\n"
+         << "}\n";
+    meta.close();
+
+    LOG_PHY_INFO("PhyIQDebug::write_sigmf() {} samples from timestamp {} dumped to {}", snap.fill, snap.ts_first, datafile);
+    return true;
+}
 
-        for(auto s: m_IQDebugData)
-        {
-            if(myfile.is_open())
-                myfile << s.real() << ", " << s.imag()<< ", " << t << std::endl;
-            t++;
-        }
 
-        myfile.close();
-        LOG_TEST_INFO("iq data dumpe to {} done", IQDEBUG_DUMP_FILE);
-    }
+/**
+ * @brief dumps the IQ data of the active ring to a file
+ * 
+ */
+void PhyIQDebug::dump_iq() {
 
+    Snapshot snap;
+    snap.ring = &m_rings[m_active];
+    snap.write_pos = m_write_pos;
+    snap.fill = m_fill;
+    snap.ts_first = m_timestamp - m_fill;
 
-}
\ No newline at end of file
+    if(snap.fill > 0)
+        write_sigmf(snap, next_dumpname());
+}
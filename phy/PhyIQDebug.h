@@ -5,28 +5,38 @@
 #include <fstream>
 #include <chrono>
 #include <vector>
-#include <deque>
+#include <string>
+#include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
 #include <unistd.h>
 
 #include "liquid/liquid.h"
 
+#include "phy/IQBlock.h"
 #include "util/log.h"
 
 
 #define IQDEBUG_BUFFER_LENGTH       350000
 #define IQDEBUG_FREEZE_PERIOD       50000
-#define IQDEBUG_DUMP_FILE           "IQData.txt"
-
-
-// class PhyIQDebugData {
-
-
-
-// };
-
-
+#define IQDEBUG_DUMP_FILE           "IQData"         // basename - <name>_<n>.sigmf-data and <name>_<n>.sigmf-meta
+#define IQDEBUG_DUMP_FILES          8                // dumps kept - <n> runs 0 .. IQDEBUG_DUMP_FILES-1, the oldest is overwritten
+
+
+/**
+ * PhyIQDebug class
+ *
+ * @note keeps the last IQDEBUG_BUFFER_LENGTH received samples in a preallocated ring; push_iq() copies whole
+ *       blocks with memcpy
+ * @note freeze() keeps recording for IQDEBUG_FREEZE_PERIOD samples and then swaps the ring with a spare one
+ *       (O(1) snapshot) - the snapshot is written by a background thread as binary cf32_le with a SigMF
+ *       .sigmf-meta sidecar while recording continues in the other ring
+ * @note the dumps are rotated over IQDEBUG_DUMP_FILES file names (~2.8 MB each) - a freeze per frame error does not
+ *       fill the disk
+ * @note push_iq() has to be called from one thread; freeze() can be called from any thread
+ *
+ */
 class PhyIQDebug {
 public:
 
@@ -34,29 +44,74 @@ public:
     
     ~PhyIQDebug();
 
-    void push_iq(uint64_t ts, liquid_float_complex sample);
+    void push_iq(uint64_t ts, liquid_float_complex sample) { push_iq(ts, &sample, 1); }
+
+    /**
+     * @brief push a block of n samples, ts is the timestamp of the first sample
+     */
+    void push_iq(uint64_t ts, const liquid_float_complex *samples, size_t n);
 
+    /**
+     * @brief synchronous dump of the samples currently in the ring (e.g. on shutdown)
+     */
     void dump_iq();
 
-    void clear_iq() { m_IQDebugData.clear(); }
+    void clear_iq() { m_write_pos = 0; m_fill = 0; m_bufferspace_left = IQDEBUG_BUFFER_LENGTH; }
 
+    /**
+     * @brief snapshot the ring after another IQDEBUG_FREEZE_PERIOD samples and dump it in the background; ignored
+     *        while a freeze or dump is pending
+     */
     void freeze() { m_freeze.store(true); }
 
+    void setSampleRate(double sample_rate) { m_sample_rate = sample_rate; }
+    void setFrequency(double frequency) { m_frequency = frequency; }
+    void setDumpFile(const std::string& basename) { m_dumpfile = basename; }
+
     uint64_t m_bufferspace_left;
 
 private:
 
+    struct Snapshot {
+        const IQSampleBuffer *ring;
+        size_t write_pos;           // oldest sample is at write_pos when the ring is full
+        size_t fill;
+        uint64_t ts_first;          // timestamp of the oldest sample
+    };
+
+    void dump_main();
+
+    bool write_sigmf(const Snapshot& snap, const std::string& basename);
+
+    // basename of the next dump (rotated)
+    std::string next_dumpname() { return m_dumpfile + "_" + std::to_string(m_dump_count++ % IQDEBUG_DUMP_FILES); }
+
     std::atomic_bool m_stopped;
     std::atomic_bool m_freeze;
 
     std::string m_dumpfile = IQDEBUG_DUMP_FILE;
+    unsigned int m_dump_count = 0;
+
+    double m_sample_rate = 0;
+    double m_frequency = 0;
+
+    // rings - m_active is written by push_iq(), the other one is owned by the dump thread while a dump is pending
+    IQSampleBuffer m_rings[2];
+    unsigned int m_active = 0;
+    size_t m_write_pos = 0;
+    size_t m_fill = 0;
 
-    uint64_t m_timestamp;
-    uint64_t m_freeze_period;
+    uint64_t m_timestamp;           // timestamp after the last pushed sample
+    int64_t m_freeze_period;
 
-    std::deque<liquid_float_complex> m_IQDebugData;
+    // background dump
+    std::thread m_dump_thread;
+    std::mutex m_dump_mutex;
+    std::condition_variable m_dump_cv;
+    bool m_dump_pending = false;
+    Snapshot m_snapshot;
 
 };
 
 
-typedef std::shared_ptr<PhyIQDebug> PhyIQDebugPtr;
\ No newline at end of file
+typedef std::shared_ptr<PhyIQDebug> PhyIQDebugPtr;
@@ -0,0 +1,286 @@
+#include "phy/PhyOFDMDemod.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+
+// y = a * b over n complex values - plain float arithmetic on contiguous arrays so the compiler can vectorize it
+static inline void cmul_block(const liquid_float_complex * __restrict a, const liquid_float_complex * __restrict b,
+                              liquid_float_complex * __restrict y, size_t n) {
+
+    const float * __restrict fa = reinterpret_cast<const float *>(a);
+    const float * __restrict fb = reinterpret_cast<const float *>(b);
+    float * __restrict fy = reinterpret_cast<float *>(y);
+
+    for (size_t i = 0; i < n; i++) {
+        const float ar = fa[2*i], ai = fa[2*i+1];
+        const float br = fb[2*i], bi = fb[2*i+1];
+        fy[2*i]   = ar*br - ai*bi;
+        fy[2*i+1] = ar*bi + ai*br;
+    }
+}
+
+// y *= b over n complex values
+static inline void cmul_block_inplace(liquid_float_complex * __restrict y, const liquid_float_complex * __restrict b, size_t n) {
+
+    float * __restrict fy = reinterpret_cast<float *>(y);
+    const float * __restrict fb = reinterpret_cast<const float *>(b);
+
+    for (size_t i = 0; i < n; i++) {
+        const float yr = fy[2*i], yi = fy[2*i+1];
+        const float br = fb[2*i], bi = fb[2*i+1];
+        fy[2*i]   = yr*br - yi*bi;
+        fy[2*i+1] = yr*bi + yi*br;
+    }
+}
+
+
+PhyOFDMDemod::PhyOFDMDemod(unsigned int M, unsigned int cp_len, unsigned int batch)
+    : m_M{M}, m_cp_len{cp_len}, m_batch{batch > 0 ? batch : 1} {
+
+    m_backoff = m_cp_len < 2 ? m_cp_len : 2;
+    m_half = std::min((unsigned int)PHY_DATA_USED_HALF, m_M/2 - 1);
+    m_M_used = 2*m_half;
+
+    // used subcarriers in ascending frequency, -H..-1, 1..H
+    m_freq = (float*) malloc(m_M_used*sizeof(float));
+    for (unsigned int i=0; i<m_half; i++) {
+        m_freq[i] = -(float)(m_half - i);
+        m_freq[m_half + i] = (float)(i + 1);
+    }
+
+    // pilots are BPSK from a x^7 + x^4 + 1 LFSR (PHY_DATA_PILOT_LFSR_SEED) - the pattern of this PHY, not the one of
+    // 802.22; PhyFrameGen does not insert pilots yet, the pilot tracking only applies to a TX using this pattern
+    unsigned int lfsr = PHY_DATA_PILOT_LFSR_SEED;
+    for (unsigned int i=0; i<m_M_used; i++) {
+        if ((i % PHY_DATA_PILOT_SPACING) == 0) {
+            unsigned int bit = ((lfsr >> 6) ^ (lfsr >> 3)) & 0x01;
+            lfsr = ((lfsr << 1) | bit) & 0x7f;
+            m_pilot_pos.push_back(i);
+            m_pilot_ref.push_back(bit ? -1.0f : 1.0f);
+        } else {
+            m_data_pos.push_back(i);
+        }
+    }
+    m_M_pilot = m_pilot_pos.size();
+    m_M_data = m_data_pos.size();
+    m_pilot_z.resize(m_M_pilot);
+
+    // batch buffers - FFT_MALLOC for the alignment of the batched plan
+    m_in  = (liquid_float_complex*) FFT_MALLOC((size_t)m_batch*m_M*sizeof(liquid_float_complex));
+    m_out = (liquid_float_complex*) FFT_MALLOC((size_t)m_batch*m_M*sizeof(liquid_float_complex));
+    std::fill_n(m_in, (size_t)m_batch*m_M, liquid_float_complex(0.0f, 0.0f));
+    m_fft = PhyFFTPlanCache::instance().get_plan_many(m_M, m_batch, m_in, m_out, FFT_DIR_FORWARD);
+
+    m_used = (liquid_float_complex*) malloc((size_t)m_batch*m_M_used*sizeof(liquid_float_complex));
+    m_eq   = (liquid_float_complex*) malloc(m_M_used*sizeof(liquid_float_complex));
+    m_rot  = (liquid_float_complex*) malloc(m_M_used*sizeof(liquid_float_complex));
+    m_data = (liquid_float_complex*) malloc((size_t)m_batch*m_M_data*sizeof(liquid_float_complex));
+    m_softbits.resize((size_t)m_batch*m_M_data*MOD_QAM64);
+
+    for (unsigned int i=0; i<m_M_used; i++)
+        m_eq[i] = 1.0f;
+
+    LOG_PHY_DEBUG("PhyOFDMDemod::PhyOFDMDemod() M={} cp={} batch={} used={} pilots={} data={}", m_M, m_cp_len, m_batch, m_M_used, m_M_pilot, m_M_data);
+}
+
+
+PhyOFDMDemod::~PhyOFDMDemod() {
+
+    // the plans are owned by PhyFFTPlanCache
+    FFT_FREE(m_in);
+    FFT_FREE(m_out);
+    free(m_used);
+    free(m_eq);
+    free(m_rot);
+    free(m_data);
+    free(m_freq);
+}
+
+
+void PhyOFDMDemod::start(const liquid_float_complex *G, uint64_t timestamp) {
+
+    // the window starts backoff samples early, i.e. bin k is rotated by exp(-j 2pi k backoff / M) - undone here
+    const float phi = (float)(m_backoff)*2.0f*M_PI/(float)(m_M);
+
+    for (unsigned int i=0; i<m_M_used; i++) {
+        int f = (int)m_freq[i];
+        unsigned int bin = (unsigned int)((f + (int)m_M) % (int)m_M);
+        m_eq[i] = G[bin] * liquid_float_complex(cosf(f*phi), sinf(f*phi));
+    }
+
+    m_pos = 0;
+    m_sym = 0;
+    m_ts = timestamp;
+    m_batch_symbols = 0;
+    m_num_softbits = 0;
+    m_slope = 0.0f;
+    m_slope_valid = false;
+}
+
+
+size_t PhyOFDMDemod::push(const liquid_float_complex *x, size_t n) {
+
+    const unsigned int sym_len = m_M + m_cp_len;
+    const unsigned int keep = m_cp_len - m_backoff;           // first sample of the FFT window in the symbol
+    size_t demodulated = 0;
+    size_t i = 0;
+
+    while (i < n) {
+        const size_t take = std::min(n - i, (size_t)(sym_len - m_pos));
+
+        // part of [m_pos, m_pos + take) inside the FFT window [keep, keep + M) - the rest is CP
+        const size_t lo = std::max((size_t)m_pos, (size_t)keep);
+        const size_t hi = std::min((size_t)m_pos + take, (size_t)keep + m_M);
+        if (lo < hi)
+            memcpy(&m_in[(size_t)m_sym*m_M + (lo - keep)], &x[i + (lo - m_pos)], (hi - lo)*sizeof(liquid_float_complex));
+
+        m_pos += take;
+        i += take;
+
+        if (m_pos == sym_len) {
+            m_pos = 0;
+            if (++m_sym == m_batch) {
+                demod_batch(m_sym);
+                demodulated += m_sym;
+                m_sym = 0;
+            }
+        }
+    }
+
+    return demodulated;
+}
+
+
+size_t PhyOFDMDemod::flush() {
+
+    size_t count = m_sym;
+    if (count > 0)
+        demod_batch(count);
+
+    m_sym = 0;
+    m_pos = 0;
+    return count;
+}
+
+
+void PhyOFDMDemod::demod_batch(size_t count) {
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    // all symbols of the batch in one transform (a short batch transforms stale entries as well)
+    PhyFFTPlanCache::execute_many(m_fft, m_in, m_out);
+
+    for (size_t k=0; k<count; k++) {
+        const liquid_float_complex *X = &m_out[k*m_M];
+        liquid_float_complex *Y = &m_used[k*m_M_used];
+
+        // negative frequencies are the upper bins of the FFT - two contiguous ranges
+        cmul_block(&X[m_M - m_half], m_eq, Y, m_half);
+        cmul_block(&X[1], &m_eq[m_half], &Y[m_half], m_half);
+
+        track_pilots(Y);
+
+        liquid_float_complex *D = &m_data[k*m_M_data];
+        for (unsigned int d=0; d<m_M_data; d++)
+            D[d] = Y[m_data_pos[d]];
+    }
+
+    soft_bits(count);
+
+    m_batch_ts = m_ts;
+    m_batch_symbols = count;
+    m_ts += count * (m_M + m_cp_len);
+
+    m_metric_symbols.add(count);
+    m_metric_batch_time.record(std::chrono::steady_clock::now() - t1);
+}
+
+
+void PhyOFDMDemod::track_pilots(liquid_float_complex *Y) {
+
+    if (m_M_pilot < 2)
+        return;
+
+    // pilots with the BPSK value removed
+    for (unsigned int j=0; j<m_M_pilot; j++)
+        m_pilot_z[j] = Y[m_pilot_pos[j]] * m_pilot_ref[j];
+
+    // phase slope over frequency from the phase difference of neighbouring pilots
+    liquid_float_complex d = 0.0f;
+    for (unsigned int j=1; j<m_M_pilot; j++)
+        d += m_pilot_z[j] * std::conj(m_pilot_z[j-1]);
+
+    const float spacing = (m_freq[m_pilot_pos.back()] - m_freq[m_pilot_pos.front()]) / (float)(m_M_pilot - 1);
+    const float slope = std::arg(d) / spacing;
+
+    if (m_slope_valid) {
+        m_slope += PHY_DEMOD_PILOT_ALPHA * (slope - m_slope);
+    } else {
+        m_slope = slope;
+        m_slope_valid = true;
+    }
+
+    // common phase and gain after removing the slope
+    liquid_float_complex c = 0.0f;
+    for (unsigned int j=0; j<m_M_pilot; j++) {
+        const float theta = -m_slope * m_freq[m_pilot_pos[j]];
+        c += m_pilot_z[j] * liquid_float_complex(cosf(theta), sinf(theta));
+    }
+
+    const float a = std::abs(c) / (float)(m_M_pilot);
+    const float phi0 = std::arg(c);
+    const float g = a > 1.0e-9f ? 1.0f / a : 0.0f;
+
+    for (unsigned int i=0; i<m_M_used; i++) {
+        const float theta = -(phi0 + m_slope * m_freq[i]);
+        m_rot[i] = liquid_float_complex(g * cosf(theta), g * sinf(theta));
+    }
+
+    cmul_block_inplace(Y, m_rot, m_M_used);
+}
+
+
+void PhyOFDMDemod::soft_bits(size_t count) {
+
+    // the I and Q components of the data subcarriers are one contiguous float array; each component gives
+    // bits/2 soft bits on the integer constellation grid (+-1, +-3, ...)
+    const float *y = reinterpret_cast<const float *>(m_data);
+    const size_t n = count*m_M_data*2;
+    float *b = m_softbits.data();
+
+    switch (m_modulation)
+    {
+    case MOD_QAM16: {
+        const float s = sqrtf(10.0f);
+        for (size_t e=0; e<n; e++) {
+            const float v = y[e]*s;
+            b[2*e]   = v;
+            b[2*e+1] = 2.0f - fabsf(v);
+        }
+        break;
+    }
+    case MOD_QAM64: {
+        const float s = sqrtf(42.0f);
+        for (size_t e=0; e<n; e++) {
+            const float v = y[e]*s;
+            const float v1 = 4.0f - fabsf(v);
+            b[3*e]   = v;
+            b[3*e+1] = v1;
+            b[3*e+2] = 2.0f - fabsf(v1);
+        }
+        break;
+    }
+    case MOD_QPSK:
+    default: {
+        const float s = sqrtf(2.0f);
+        for (size_t e=0; e<n; e++)
+            b[e] = y[e]*s;
+        break;
+    }
+    }
+
+    m_num_softbits = count*m_M_data*(size_t)m_modulation;
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <liquid.h>
+
+#include "phy/PhyDefinitions.h"
+#include "phy/PhyFFTPlanCache.h"
+#include "util/log.h"
+#include "util/Metrics.h"
+
+
+/**
+ * PhyOFDMDemod class
+ *
+ * @note batched demodulation of the payload symbols after the frame sync locked: the CP is stripped while the
+ *       samples are collected, batch symbols are transformed with one batched FFT plan (fftwf_plan_many_dft) and
+ *       equalization, pilot tracking and soft bit generation run over contiguous subcarrier arrays of the whole
+ *       batch - no per sample or per subcarrier callbacks
+ * @note used subcarriers are the PHY_DATA_USED_HALF on each side of DC, kept in ascending frequency (-H..-1, 1..H);
+ *       every PHY_DATA_PILOT_SPACING-th used subcarrier is a BPSK pilot, the others carry data
+ * @note the symbol is taken m_backoff samples ahead of the end of the CP (same timing backoff as the frame sync),
+ *       the resulting linear phase is part of the equalizer
+ * @note pilot tracking per symbol: common phase, common gain and a phase slope over frequency (residual timing
+ *       offset, smoothed over the symbols with PHY_DEMOD_PILOT_ALPHA)
+ * @note soft bits are max-log LLR approximations up to a positive scale (SNR): > 0 is a 1 bit, bits of the I
+ *       component first (802.22 gray mapping); they are valid until the next batch
+ *
+ */
+class PhyOFDMDemod {
+public:
+
+    typedef enum {
+        MOD_QPSK = 2,       // bits per subcarrier
+        MOD_QAM16 = 4,
+        MOD_QAM64 = 6
+    } Modulation;
+
+    PhyOFDMDemod(unsigned int M = PHY_SUBCARRIERS__M, unsigned int cp_len = PHY_CP_DATA,
+                 unsigned int batch = PHY_DEMOD_BATCH_SYMBOLS);
+
+    ~PhyOFDMDemod();
+
+    PhyOFDMDemod(const PhyOFDMDemod&) = delete;
+
+    PhyOFDMDemod& operator=(const PhyOFDMDemod&) = delete;
+
+    void setModulation(Modulation modulation) { m_modulation = modulation; }
+
+    Modulation getModulation() const { return m_modulation; }
+
+    /**
+     * @brief start a payload - the next sample pushed is the first sample (CP) of the first symbol
+     *
+     * @param G complex subcarrier equalizer (M subcarriers in FFT order, multiplied onto the FFT output)
+     * @param timestamp timestamp of the first sample of the first symbol
+     */
+    void start(const liquid_float_complex *G, uint64_t timestamp);
+
+    /**
+     * @brief add n samples (carrier frequency offset corrected) of the payload
+     *
+     * @return size_t number of symbols demodulated in this call (0 or a multiple of the batch size)
+     */
+    size_t push(const liquid_float_complex *x, size_t n);
+
+    /**
+     * @brief demodulate the whole symbols collected for a not yet complete batch (end of payload)
+     *
+     * @return size_t number of symbols demodulated
+     */
+    size_t flush();
+
+    /**
+     * @brief soft bits of the last batch - symbols() x data subcarriers x bits per subcarrier
+     */
+    const float *getSoftBits() const { return m_softbits.data(); }
+
+    size_t getNumSoftBits() const { return m_num_softbits; }
+
+    /**
+     * @brief equalized data subcarriers of the last batch (symbols() x getNumDataSubcarriers())
+     */
+    const liquid_float_complex *getDataSymbols() const { return m_data; }
+
+    /**
+     * @brief number of symbols in the last batch and timestamp of the first sample of its first symbol
+     */
+    size_t symbols() const { return m_batch_symbols; }
+
+    uint64_t getBatchTimestamp() const { return m_batch_ts; }
+
+    unsigned int getNumDataSubcarriers() const { return m_M_data; }
+
+    unsigned int getNumPilotSubcarriers() const { return m_M_pilot; }
+
+private:
+
+    void demod_batch(size_t count);
+
+    void track_pilots(liquid_float_complex *Y);
+
+    void soft_bits(size_t count);
+
+    const unsigned int m_M;             // subcarriers
+    const unsigned int m_cp_len;        // cyclic prefix of the payload symbols
+    const unsigned int m_batch;         // symbols per batched FFT
+    unsigned int m_backoff;             // samples the FFT window starts ahead of the end of the CP
+    unsigned int m_half;                // used subcarriers on each side of DC
+
+    unsigned int m_M_used;
+    unsigned int m_M_pilot;
+    unsigned int m_M_data;
+
+    Modulation m_modulation = MOD_QPSK;
+
+    // batch buffers (m_batch x m_M), CP already stripped
+    liquid_float_complex *m_in;
+    liquid_float_complex *m_out;
+    std::vector<FFT_PLAN> m_fft;
+
+    // used subcarriers of the batch (m_batch x m_M_used), ascending frequency
+    liquid_float_complex *m_used;
+    liquid_float_complex *m_eq;         // equalizer incl. backoff phase (m_M_used)
+    liquid_float_complex *m_rot;        // pilot correction of the current symbol (m_M_used)
+    float *m_freq;                      // subcarrier offset of the used subcarriers
+
+    std::vector<unsigned int> m_pilot_pos;      // positions in the used subcarriers
+    std::vector<unsigned int> m_data_pos;
+    std::vector<float> m_pilot_ref;             // BPSK pilot values
+    std::vector<liquid_float_complex> m_pilot_z;
+
+    liquid_float_complex *m_data;       // equalized data subcarriers of the batch (m_batch x m_M_data)
+    std::vector<float> m_softbits;
+    size_t m_num_softbits = 0;
+
+    // collector state
+    unsigned int m_pos = 0;             // sample position in the current symbol (0 .. M + cp - 1)
+    unsigned int m_sym = 0;             // symbols collected in the batch
+    uint64_t m_ts = 0;                  // timestamp of the first sample of the batch being collected
+    uint64_t m_batch_ts = 0;
+    size_t m_batch_symbols = 0;
+
+    // pilot phase slope over frequency (rad per subcarrier), filtered over the symbols of a payload
+    float m_slope = 0.0f;
+    bool m_slope_valid = false;
+
+    MetricHistogram& m_metric_batch_time = Metrics::instance().histogram("phy_demod_batch_seconds", "demodulation time per symbol batch");
+    MetricCounter& m_metric_symbols = Metrics::instance().counter("phy_demod_symbols_total", "payload symbols demodulated");
+
+};
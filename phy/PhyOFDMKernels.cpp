@@ -0,0 +1,24 @@
+#include "phy/PhyOFDMKernels.h"
+
+
+template<class Profile>
+static bool is_profile(unsigned int M, unsigned int cp_len, unsigned int taper_len) {
+    return M == Profile::M && cp_len == Profile::cp_len && taper_len == Profile::taper_len;
+}
+
+
+std::unique_ptr<PhyOFDMKernels> PhyOFDMKernels::create(unsigned int M, unsigned int cp_len, unsigned int taper_len) {
+
+    std::unique_ptr<PhyOFDMKernels> kernels;
+
+    if (is_profile<PhyProfile1024>(M, cp_len, taper_len))
+        kernels.reset(new PhyOFDMKernelsT<PhyProfile1024::M, PhyProfile1024::cp_len, PhyProfile1024::taper_len>());
+    else if (is_profile<PhyProfile2048>(M, cp_len, taper_len))
+        kernels.reset(new PhyOFDMKernelsT<PhyProfile2048::M, PhyProfile2048::cp_len, PhyProfile2048::taper_len>());
+    else
+        kernels.reset(new PhyOFDMKernelsT<0, 0, 0>(M, cp_len, taper_len));
+
+    LOG_PHY_DEBUG("PhyOFDMKernels::create() M={} cp={} taper={} {}", M, cp_len, taper_len, kernels->isFixed() ? "compile-time profile" : "runtime sized");
+
+    return kernels;
+}
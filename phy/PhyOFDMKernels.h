@@ -0,0 +1,284 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#include <liquid.h>
+
+#include "phy/PhyDefinitions.h"
+#include "phy/PhyDSPKernels.h"
+#include "util/log.h"
+
+
+// alignment of the kernel buffers - covers 128 bit NEON, 256 bit AVX and 64 byte cache lines
+#define PHY_KERNEL_ALIGNMENT      64
+
+
+/**
+ * PhyOFDMKernels class
+ *
+ * @note buffers and inner loops which PhyFrameSync and PhyFrameGen run for one OFDM profile (M, cp_len, taper_len)
+ * @note create() returns a compile-time specialized PhyOFDMKernelsT<M, CP, TAPER> with std::array storage for the
+ *       built in profiles (PhyProfile1024, PhyProfile2048); the sizes are constants in the loops, i.e. the compiler
+ *       unrolls and vectorizes them; any other profile gets the same code sized at runtime (PhyOFDMKernelsT<0,0,0>)
+ * @note the element wise loops and sums run on the PhyDSPKernels (AVX2 / NEON / scalar) active at construction;
+ *       cfo_correlation() stays a fused loop with independent partial sums (one pass instead of three kernel calls)
+ * @note the kernels are called at the decision points of the frame sync (every M/4 samples at most), i.e. the
+ *       virtual call is not on the per sample path
+ *
+ */
+class PhyOFDMKernels {
+public:
+
+    // buffers of M samples, PHY_KERNEL_ALIGNMENT aligned
+    typedef enum {
+        BUF_X = 0,              // frequency-domain FFT buffer
+        BUF_x,                  // time-domain FFT buffer
+        BUF_STS,                // STS sequence (freq)
+        BUF_sts,                // STS sequence (time)
+        BUF_GAIN_STSA,          // subcarrier gain estimate STS[a]
+        BUF_GAIN_STSB,          // subcarrier gain estimate STS[b]
+        BUF_GAIN_G,             // subcarrier gain estimate / equalizer
+        BUF_GAIN_B,             // subcarrier phase rotation due to backoff
+        BUF_GAIN_R,
+        BUF_COUNT
+    } Buffer;
+
+    typedef enum {
+        ALLOC_STS = 0,
+        ALLOC_LTS,
+        ALLOC_COUNT
+    } Allocation;
+
+    /**
+     * @brief kernels of the profile - compile-time specialized if the profile is built in
+     */
+    static std::unique_ptr<PhyOFDMKernels> create(unsigned int M, unsigned int cp_len, unsigned int taper_len);
+
+    virtual ~PhyOFDMKernels() = default;
+
+    unsigned int getM() const { return m_M; }
+    unsigned int getCPLen() const { return m_cp_len; }
+    unsigned int getTaperLen() const { return m_taper_len; }
+
+    /**
+     * @brief vector kernels used by the profile (PhyDSPKernels::get() at construction)
+     */
+    const PhyDSPKernels& dsp() const { return m_dsp; }
+
+    /**
+     * @brief true if the sizes are compile-time constants
+     */
+    virtual bool isFixed() const = 0;
+
+    virtual liquid_float_complex *buffer(Buffer b) = 0;
+
+    virtual unsigned char *allocation(Allocation a) = 0;
+
+    /**
+     * @brief sum |x[i]|^2 over M samples
+     */
+    virtual float energy(const liquid_float_complex *x) const = 0;
+
+    /**
+     * @brief G[i] = X[i] conj(S[i]) gain over M subcarriers
+     */
+    virtual void sts_gain(const liquid_float_complex *X, const liquid_float_complex *S, liquid_float_complex *G, float gain) const = 0;
+
+    /**
+     * @brief sum G[i+4] conj(G[i]) over the STS subcarriers i = 3, 7, ... < M-4 (not normalized)
+     *
+     * @note G of sts_gain() is 0 on the other subcarriers (S is), i.e. the sum over all i < M-4 is the same
+     */
+    virtual liquid_float_complex sts_metrics(const liquid_float_complex *G) const = 0;
+
+    /**
+     * @brief sum conj(r[i]) s[i] r[i+M/2] conj(s[i+M/2]) over M/2 samples (ML carrier frequency offset)
+     */
+    virtual liquid_float_complex cfo_correlation(const liquid_float_complex *r, const liquid_float_complex *s) const = 0;
+
+    /**
+     * @brief x[i] *= g over M samples
+     */
+    virtual void scale(liquid_float_complex *x, float g) const = 0;
+
+    /**
+     * @brief symbol x with cyclic prefix into y (M + cp samples), tapered overlap with the postfix of the previous
+     *        symbol; postfix is replaced by the first taper_len samples of x
+     */
+    virtual void cyclic_prefix_taper(const liquid_float_complex *x, liquid_float_complex *y,
+                                     liquid_float_complex *postfix, const float *taper) const = 0;
+
+protected:
+
+    PhyOFDMKernels(unsigned int M, unsigned int cp_len, unsigned int taper_len)
+        : m_M{M}, m_cp_len{cp_len}, m_taper_len{taper_len}, m_dsp{PhyDSPKernels::get()} {}
+
+    const unsigned int m_M;
+    const unsigned int m_cp_len;
+    const unsigned int m_taper_len;
+    const PhyDSPKernels& m_dsp;
+
+};
+
+
+/**
+ * PhyOFDMProfile
+ *
+ * @note compile-time OFDM profile; PhyProfile1024 is the profile of PhyDefinitions.h
+ *
+ */
+template<unsigned int M_, unsigned int CP_, unsigned int TAPER_>
+struct PhyOFDMProfile {
+    static constexpr unsigned int M = M_;
+    static constexpr unsigned int cp_len = CP_;
+    static constexpr unsigned int taper_len = TAPER_;
+};
+
+typedef PhyOFDMProfile<PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN> PhyProfile1024;
+typedef PhyOFDMProfile<2048, 512, 64> PhyProfile2048;
+
+
+/**
+ * PhyOFDMStorage
+ *
+ * @note buffers of PhyOFDMKernelsT - aligned std::array for a fixed M, aligned heap storage for M = 0 (runtime)
+ *
+ */
+template<unsigned int M_>
+struct PhyOFDMStorage {
+    static_assert(M_ % 8 == 0, "M has to be a multiple of 8 to keep all buffers aligned");
+
+    alignas(PHY_KERNEL_ALIGNMENT) std::array<liquid_float_complex, M_> buf[PhyOFDMKernels::BUF_COUNT];
+    std::array<unsigned char, M_> alloc[PhyOFDMKernels::ALLOC_COUNT];
+
+    explicit PhyOFDMStorage(unsigned int) {
+        for (auto& b : buf)
+            b.fill(liquid_float_complex(0.0f));
+        for (auto& a : alloc)
+            a.fill(0);
+    }
+
+    liquid_float_complex *buffer(unsigned int b) { return buf[b].data(); }
+    unsigned char *allocation(unsigned int a) { return alloc[a].data(); }
+};
+
+template<>
+struct PhyOFDMStorage<0> {
+
+    liquid_float_complex *buf[PhyOFDMKernels::BUF_COUNT];
+    unsigned char *alloc[PhyOFDMKernels::ALLOC_COUNT];
+
+    explicit PhyOFDMStorage(unsigned int M) {
+        // aligned_alloc requires the size to be a multiple of the alignment
+        const size_t bytes = (M * sizeof(liquid_float_complex) + PHY_KERNEL_ALIGNMENT - 1) & ~((size_t)PHY_KERNEL_ALIGNMENT - 1);
+        for (auto& b : buf) {
+            b = static_cast<liquid_float_complex *>(std::aligned_alloc(PHY_KERNEL_ALIGNMENT, bytes));
+            if (b == nullptr)
+                throw std::bad_alloc();
+            for (unsigned int i = 0; i < M; i++)
+                b[i] = 0.0f;
+        }
+        for (auto& a : alloc)
+            a = static_cast<unsigned char *>(std::calloc(M, 1));
+    }
+
+    ~PhyOFDMStorage() {
+        for (auto& b : buf)
+            std::free(b);
+        for (auto& a : alloc)
+            std::free(a);
+    }
+
+    PhyOFDMStorage(const PhyOFDMStorage&) = delete;
+
+    PhyOFDMStorage& operator=(const PhyOFDMStorage&) = delete;
+
+    liquid_float_complex *buffer(unsigned int b) { return buf[b]; }
+    unsigned char *allocation(unsigned int a) { return alloc[a]; }
+};
+
+
+/**
+ * PhyOFDMKernelsT class
+ *
+ * @note kernels for M_ / CP_ / TAPER_; with M_ = 0 the sizes are taken from the constructor at runtime
+ *
+ */
+template<unsigned int M_, unsigned int CP_, unsigned int TAPER_>
+class PhyOFDMKernelsT : public PhyOFDMKernels {
+public:
+
+    PhyOFDMKernelsT(unsigned int M = M_, unsigned int cp_len = CP_, unsigned int taper_len = TAPER_)
+        : PhyOFDMKernels(M_ ? M_ : M, M_ ? CP_ : cp_len, M_ ? TAPER_ : taper_len), m_storage(M_ ? M_ : M) {}
+
+    bool isFixed() const override { return M_ != 0; }
+
+    liquid_float_complex *buffer(Buffer b) override { return m_storage.buffer(b); }
+
+    unsigned char *allocation(Allocation a) override { return m_storage.allocation(a); }
+
+    float energy(const liquid_float_complex *x) const override {
+        return m_dsp.energy(x, size());
+    }
+
+    void sts_gain(const liquid_float_complex *X, const liquid_float_complex *S, liquid_float_complex *G, float gain) const override {
+        m_dsp.mul_conj(X, S, G, size(), gain);
+    }
+
+    liquid_float_complex sts_metrics(const liquid_float_complex *G) const override {
+        // dense over the zero bins in between - contiguous loads instead of a stride 4 gather
+        return m_dsp.dot_conj(&G[4], &G[0], size() - 4);
+    }
+
+    liquid_float_complex cfo_correlation(const liquid_float_complex *r, const liquid_float_complex *s) const override {
+
+        const unsigned int M2 = size() / 2;
+        const float *fr = reinterpret_cast<const float *>(r);
+        const float *fs = reinterpret_cast<const float *>(s);
+
+        float re[4] = {0.0f}, im[4] = {0.0f};
+        for (unsigned int i = 0; i < M2; i++) {
+            // a = conj(r[i]) s[i], b = r[i+M2] conj(s[i+M2])
+            const float r0r = fr[2*i], r0i = fr[2*i+1], s0r = fs[2*i], s0i = fs[2*i+1];
+            const float r1r = fr[2*(i+M2)], r1i = fr[2*(i+M2)+1], s1r = fs[2*(i+M2)], s1i = fs[2*(i+M2)+1];
+            const float ar = r0r*s0r + r0i*s0i, ai = r0r*s0i - r0i*s0r;
+            const float br = r1r*s1r + r1i*s1i, bi = r1i*s1r - r1r*s1i;
+            re[i & 3] += ar*br - ai*bi;
+            im[i & 3] += ar*bi + ai*br;
+        }
+
+        return liquid_float_complex(re[0] + re[1] + re[2] + re[3], im[0] + im[1] + im[2] + im[3]);
+    }
+
+    void scale(liquid_float_complex *x, float g) const override {
+        m_dsp.scale(x, size(), g);
+    }
+
+    void cyclic_prefix_taper(const liquid_float_complex *x, liquid_float_complex *y,
+                             liquid_float_complex *postfix, const float *taper) const override {
+
+        const unsigned int M = size();
+        const unsigned int cp = M_ ? CP_ : m_cp_len;
+        const unsigned int taper_len = M_ ? TAPER_ : m_taper_len;
+
+        memmove(&y[0],  &x[M - cp], cp * sizeof(liquid_float_complex));
+        memmove(&y[cp], &x[0],      M  * sizeof(liquid_float_complex));
+
+        m_dsp.taper(y, postfix, taper, taper_len);
+
+        memmove(postfix, x, taper_len * sizeof(liquid_float_complex));
+    }
+
+private:
+
+    // compile-time constant for a fixed profile - the compiler folds the runtime branch away
+    unsigned int size() const { return M_ ? M_ : m_M; }
+
+    PhyOFDMStorage<M_> m_storage;
+
+};
@@ -0,0 +1,392 @@
+#include "phy/PhySensing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+
+void from_json(const nlohmann::json& j, PhySensingConfig& config) {
+    config.channels = j.value("CHANNELS", config.channels);
+    config.dwell_samples = j.value("DWELL_SAMPLES", config.dwell_samples);
+    config.settle_samples = j.value("SETTLE_SAMPLES", config.settle_samples);
+    config.quiet_ms = j.value("QUIET_MS", config.quiet_ms);
+    config.interval_ms = j.value("INTERVAL_MS", config.interval_ms);
+    config.energy_threshold_db = j.value("ENERGY_THRESHOLD_DB", config.energy_threshold_db);
+    config.feature_threshold_db = j.value("FEATURE_THRESHOLD_DB", config.feature_threshold_db);
+    config.noise_floor_db = j.value("NOISE_FLOOR_DB", config.noise_floor_db);
+}
+
+
+PhySensingEngine::PhySensingEngine(TuneFunction tune, double home_frequency, double sample_rate, const PhySensingConfig& config)
+        : m_tune(std::move(tune)), m_home_frequency(home_frequency), m_sample_rate(sample_rate), m_config(config),
+          m_quiet(false), m_stopping(false), m_isRunning(false) {
+
+    if (m_config.dwell_samples < PHY_SENSING_NFFT)
+        m_config.dwell_samples = PHY_SENSING_NFFT;
+
+    LOG_PHY_DEBUG("PhySensingEngine::PhySensingEngine() {} channels, dwell {} samples, settle {} samples, quiet {} ms every {} ms",
+                  m_config.channels.size(), m_config.dwell_samples, m_config.settle_samples, m_config.quiet_ms, m_config.interval_ms);
+
+    // visiting order by frequency - short LO steps between the dwells
+    m_order.resize(m_config.channels.size());
+    std::iota(m_order.begin(), m_order.end(), 0);
+    std::sort(m_order.begin(), m_order.end(), [this](size_t a, size_t b) { return m_config.channels[a] < m_config.channels[b]; });
+
+    m_table.resize(m_config.channels.size());
+    for (size_t i = 0; i < m_table.size(); i++)
+        m_table[i].frequency = m_config.channels[i];
+
+    m_dwell.resize(m_config.dwell_samples);
+
+    // all transforms of a dwell in one batched plan
+    m_segments = m_config.dwell_samples / PHY_SENSING_NFFT;
+    m_fft_in  = (liquid_float_complex*) FFT_MALLOC((size_t)m_segments*PHY_SENSING_NFFT*sizeof(liquid_float_complex));
+    m_fft_out = (liquid_float_complex*) FFT_MALLOC((size_t)m_segments*PHY_SENSING_NFFT*sizeof(liquid_float_complex));
+    std::fill_n(m_fft_in, (size_t)m_segments*PHY_SENSING_NFFT, liquid_float_complex(0.0f, 0.0f));
+    m_fft = PhyFFTPlanCache::instance().get_plan_many(PHY_SENSING_NFFT, m_segments, m_fft_in, m_fft_out, FFT_DIR_FORWARD);
+
+    m_window.resize(PHY_SENSING_NFFT);
+    for (unsigned int i = 0; i < PHY_SENSING_NFFT; i++)
+        m_window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * (float)i / (float)(PHY_SENSING_NFFT - 1));
+    m_psd.resize(PHY_SENSING_NFFT);
+}
+
+
+PhySensingEngine::~PhySensingEngine() {
+
+    LOG_PHY_DEBUG("PhySensingEngine destructor");
+
+    FFT_FREE(m_fft_in);
+    FFT_FREE(m_fft_out);
+}
+
+
+void PhySensingEngine::threadMain() {
+    run();
+}
+
+
+void PhySensingEngine::terminate() {
+    LOG_PHY_DEBUG("PhySensingEngine::terminate()");
+    {
+        std::lock_guard<std::mutex> lock(m_request_mutex);
+        m_stopping.store(true);
+    }
+    m_request_cv.notify_one();
+}
+
+
+void PhySensingEngine::setInputQueue(const ThreadIQDataQueueBasePtr& threadQueue) {
+    std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
+    m_input_queue = threadQueue;
+}
+
+
+void PhySensingEngine::requestQuietPeriod(unsigned int duration_ms) {
+    {
+        std::lock_guard<std::mutex> lock(m_request_mutex);
+        m_requested_ms = std::max(m_requested_ms, duration_ms);
+    }
+    m_request_cv.notify_one();
+}
+
+
+std::vector<PhySensingChannel> PhySensingEngine::getOccupancy() {
+    std::lock_guard<std::mutex> lock(m_table_mutex);
+    return m_table;
+}
+
+
+void PhySensingEngine::detect(const liquid_float_complex *x, size_t n, PhySensingChannel& entry) {
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    // energy
+    const float e = m_dsp.energy(x, n);
+    entry.energy_db = 10.0f * log10f(e / (float)std::max<size_t>(n, 1) + 1.0e-20f);
+
+    // feature - averaged periodogram of the windowed segments
+    const unsigned int N = PHY_SENSING_NFFT;
+    const unsigned int segments = std::min<unsigned int>(m_segments, n / N);
+    entry.feature_db = 0.0f;
+    entry.feature_offset_hz = 0;
+    if (segments == 0) {
+        m_metric_detect_time.record(std::chrono::steady_clock::now() - t1);
+        return;
+    }
+
+    for (unsigned int s = 0; s < segments; s++)
+        m_dsp.window(&x[(size_t)s*N], m_window.data(), &m_fft_in[(size_t)s*N], N);
+
+    PhyFFTPlanCache::execute_many(m_fft, m_fft_in, m_fft_out);
+
+    std::fill(m_psd.begin(), m_psd.end(), 0.0f);
+    for (unsigned int s = 0; s < segments; s++)
+        m_dsp.mag2_acc(&m_fft_out[(size_t)s*N], m_psd.data(), N);
+
+    // strongest bin against the mean, bins around DC (bin 0, LO leakage) are not used
+    float sum = 0.0f, peak = 0.0f;
+    unsigned int peak_bin = 0, used = 0;
+    for (unsigned int k = PHY_SENSING_DC_GUARD_BINS + 1; k < N - PHY_SENSING_DC_GUARD_BINS; k++) {
+        sum += m_psd[k];
+        used++;
+        if (m_psd[k] > peak) {
+            peak = m_psd[k];
+            peak_bin = k;
+        }
+    }
+    const float mean = sum / (float)used;
+    entry.feature_db = mean > 0.0f ? 10.0f * log10f(peak / mean) : 0.0f;
+    entry.feature_offset_hz = ((int)peak_bin < (int)(N/2) ? (double)peak_bin : (double)peak_bin - N) * m_sample_rate / N;
+
+    m_metric_detect_time.record(std::chrono::steady_clock::now() - t1);
+}
+
+
+size_t PhySensingEngine::next_channel() {
+
+    // forth and back with the end channels twice in a row - each channel gets the same share, the repeated end
+    // channel needs no retune
+    const size_t index = m_order[m_position];
+    if (m_forward) {
+        if (m_position + 1 < m_order.size())
+            m_position++;
+        else
+            m_forward = false;
+    } else {
+        if (m_position > 0)
+            m_position--;
+        else
+            m_forward = true;
+    }
+    return index;
+}
+
+
+bool PhySensingEngine::collect(const ThreadIQDataQueueBasePtr& queue, uint64_t& timestamp, std::chrono::steady_clock::time_point deadline) {
+
+    size_t skip = m_dwell_fill;         // settle samples to drop, set by the caller
+    m_dwell_fill = 0;
+
+    RadioThreadIQDataPtr block;
+    while (m_dwell_fill < m_dwell.size()) {
+        if (m_stopping)
+            return false;
+
+        // the radio has to be back home when the quiet period ends - no wait goes past the deadline
+        const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+        if (remaining <= 0)
+            return false;
+
+        if (!queue->wait_pop(block, (int)std::min<int64_t>(remaining, PHY_SENSING_DWELL_TIMEOUT_MS)))
+            return false;
+
+        const size_t n = block->data.size();
+        size_t off = std::min(skip, n);
+        skip -= off;
+        if (off == n)
+            continue;
+
+        if (m_dwell_fill == 0)
+            timestamp = block->timestampFirstSample + off;
+
+        const size_t take = std::min(n - off, m_dwell.size() - m_dwell_fill);
+        memcpy(&m_dwell[m_dwell_fill], &block->data[off], take * sizeof(liquid_float_complex));
+        m_dwell_fill += take;
+    }
+
+    return true;
+}
+
+
+void PhySensingEngine::evaluate(size_t index, uint64_t timestamp) {
+
+    PhySensingChannel result;
+    detect(m_dwell.data(), m_dwell.size(), result);
+
+    std::lock_guard<std::mutex> lock(m_table_mutex);
+
+    PhySensingChannel& entry = m_table[index];
+    const bool was_occupied = entry.occupied;
+
+    entry.energy_db = result.energy_db;
+    entry.feature_db = result.feature_db;
+    entry.feature_offset_hz = result.feature_offset_hz;
+    entry.timestamp = timestamp;
+    entry.sensed = std::chrono::system_clock::now();
+    entry.dwells++;
+
+    // noise floor - fixed, or the quietest channel of the table
+    float floor_db = m_config.noise_floor_db;
+    if (floor_db == 0.0f) {
+        floor_db = entry.energy_db;
+        for (const auto& c : m_table)
+            if (c.dwells > 0)
+                floor_db = std::min(floor_db, c.energy_db);
+    }
+
+    entry.energy_detect = entry.energy_db > floor_db + m_config.energy_threshold_db;
+    entry.feature_detect = entry.feature_db > m_config.feature_threshold_db;
+    entry.occupied = entry.energy_detect || entry.feature_detect;
+    if (entry.occupied)
+        entry.detections++;
+
+    if (entry.occupied != was_occupied)
+        LOG_PHY_INFO("PhySensingEngine {} Hz {} - energy {:.1f} dBFS (floor {:.1f}) feature {:.1f} dB @ {:.0f} Hz", entry.frequency,
+                     entry.occupied ? "occupied" : "clear", entry.energy_db, floor_db, entry.feature_db, entry.feature_offset_hz);
+
+    int64_t occupied = 0;
+    for (const auto& c : m_table)
+        occupied += c.occupied ? 1 : 0;
+    m_metric_occupied.set(occupied);
+}
+
+
+void PhySensingEngine::quiet_period(std::chrono::steady_clock::time_point deadline) {
+
+    ThreadIQDataQueueBasePtr queue;
+    {
+        std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
+        queue = m_input_queue;
+    }
+
+    m_quiet.store(true);
+    if (m_quiet_cb)
+        m_quiet_cb(true);
+    m_metric_quiet.add();
+
+    // blocks queued before the quiet period may be from before a retune of the last one
+    queue->flush();
+
+    const auto t_start = std::chrono::steady_clock::now();
+    double current = m_home_frequency;
+    bool pending = false;
+    size_t pending_index = 0;
+    uint64_t pending_ts = 0;
+    size_t sensed = 0;
+    size_t skipped = 0;
+
+    while (!m_stopping) {
+        // a dwell is only started if it fits (the estimate covers retune, settle, dwell and the detection)
+        const auto t0 = std::chrono::steady_clock::now();
+        if (t0 + std::chrono::duration<double>(m_channel_seconds) > deadline)
+            break;
+
+        const size_t index = next_channel();
+        const double frequency = m_config.channels[index];
+
+        m_dwell_fill = 0;
+        if (frequency != current) {
+            if (!m_tune(frequency)) {
+                // not cached - skipped instead of a calibration in the quiet period
+                m_metric_skipped.add();
+                LOG_PHY_DEBUG("PhySensingEngine::quiet_period() {} Hz skipped - no retune without calibration", frequency);
+                if (++skipped >= m_config.channels.size())
+                    break;
+                continue;
+            }
+            current = frequency;
+            queue->flush();
+            m_dwell_fill = m_config.settle_samples;
+        }
+        skipped = 0;
+
+        // detection of the last dwell while the samples of this channel settle
+        if (pending) {
+            evaluate(pending_index, pending_ts);
+            pending = false;
+        }
+
+        uint64_t timestamp = 0;
+        if (!collect(queue, timestamp, deadline)) {
+            if (!m_stopping && std::chrono::steady_clock::now() < deadline) {
+                m_metric_timeouts.add();
+                LOG_PHY_WARN("PhySensingEngine::quiet_period() no samples on {} Hz - quiet period ended", frequency);
+            }
+            break;
+        }
+
+        pending = true;
+        pending_index = index;
+        pending_ts = timestamp;
+        sensed++;
+        m_metric_dwells.add();
+
+        const auto t1 = std::chrono::steady_clock::now();
+        const double dt = std::chrono::duration<double>(t1 - t0).count();
+        m_channel_seconds = m_channel_seconds == 0 ? dt : 0.8 * m_channel_seconds + 0.2 * dt;
+        m_metric_channel_time.record(t1 - t0);
+    }
+
+    if (current != m_home_frequency && !m_tune(m_home_frequency))
+        LOG_PHY_ERROR("PhySensingEngine::quiet_period() retune to the home frequency {} Hz failed", m_home_frequency);
+
+    m_quiet.store(false);
+    if (m_quiet_cb)
+        m_quiet_cb(false);
+
+    if (pending)
+        evaluate(pending_index, pending_ts);
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+    m_metric_rate.set(elapsed > 0 ? (int64_t)std::lround((double)sensed / elapsed) : 0);
+
+    LOG_PHY_DEBUG("PhySensingEngine::quiet_period() {} channels in {:.1f} ms", sensed, elapsed * 1000.0);
+}
+
+
+void PhySensingEngine::run() {
+
+    ThreadIQDataQueueBasePtr queue;
+    {
+        std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
+        queue = m_input_queue;
+    }
+
+    if (queue == nullptr) {
+        LOG_PHY_ERROR("PhySensingEngine::run() no input queue set");
+        return;
+    }
+
+    if (m_config.channels.empty()) {
+        LOG_PHY_WARN("PhySensingEngine::run() no channels to sense");
+        return;
+    }
+
+    LOG_PHY_INFO("PhySensingEngine::run() {} channels, home {} Hz", m_config.channels.size(), m_home_frequency);
+
+    m_isRunning.store(true);
+
+    const auto interval = std::chrono::milliseconds(m_config.interval_ms);
+    auto next = std::chrono::steady_clock::now() + interval;
+
+    while (!m_stopping) {
+        unsigned int duration_ms = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_request_mutex);
+            const auto wake = m_config.interval_ms > 0 ? next : std::chrono::steady_clock::now() + std::chrono::seconds(1);
+            m_request_cv.wait_until(lock, wake, [this]() { return m_stopping.load() || m_requested_ms > 0; });
+            if (m_stopping)
+                break;
+
+            const auto now = std::chrono::steady_clock::now();
+            if (m_requested_ms > 0) {
+                duration_ms = m_requested_ms;
+                m_requested_ms = 0;
+            } else if (m_config.interval_ms > 0 && now >= next) {
+                duration_ms = m_config.quiet_ms;
+                next += interval;
+                if (next < now)
+                    next = now + interval;
+            }
+        }
+
+        if (duration_ms > 0)
+            quiet_period(std::chrono::steady_clock::now() + std::chrono::milliseconds(duration_ms));
+    }
+
+    m_isRunning.store(false);
+
+    LOG_PHY_INFO("PhySensingEngine::run() stopped");
+}
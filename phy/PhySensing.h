@@ -0,0 +1,209 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "liquid/liquid.h"
+
+#include "phy/PhyDSPKernels.h"
+#include "phy/PhyFFTPlanCache.h"
+#include "phy/RadioThread.h"
+
+#include "util/log.h"
+#include "util/Metrics.h"
+
+
+#define PHY_SENSING_NFFT                256         // feature detection transform size
+#define PHY_SENSING_DWELL_SAMPLES       8192        // samples per dwell (32 transforms)
+#define PHY_SENSING_SETTLE_SAMPLES      4096        // samples dropped after a retune (LO lock, block in flight)
+#define PHY_SENSING_QUIET_MS            20          // length of a periodic quiet period
+#define PHY_SENSING_INTERVAL_MS         1000        // distance of the periodic quiet periods (0: on request only)
+#define PHY_SENSING_ENERGY_THR_DB       6.0f        // energy above the noise floor
+#define PHY_SENSING_FEATURE_THR_DB      12.0f       // spectral peak above the mean of the dwell
+#define PHY_SENSING_DC_GUARD_BINS       2           // bins around DC ignored by the feature detector (LO leakage)
+#define PHY_SENSING_DWELL_TIMEOUT_MS    50          // no samples for this long ends the quiet period (at most the rest of it)
+#define PHY_SENSING_QUEUE_DEPTH         64          // blocks of the sense queue created by PhyThread::setSensing()
+
+
+/**
+ * PhySensingConfig
+ *
+ * @note channel list and timing of the sensing sweep (SystemConfig "Sensing")
+ *
+ */
+struct PhySensingConfig {
+    std::vector<double> channels;                               // center frequencies (Hz)
+    unsigned int dwell_samples = PHY_SENSING_DWELL_SAMPLES;
+    unsigned int settle_samples = PHY_SENSING_SETTLE_SAMPLES;
+    unsigned int quiet_ms = PHY_SENSING_QUIET_MS;
+    unsigned int interval_ms = PHY_SENSING_INTERVAL_MS;
+    float energy_threshold_db = PHY_SENSING_ENERGY_THR_DB;
+    float feature_threshold_db = PHY_SENSING_FEATURE_THR_DB;
+    float noise_floor_db = 0.0f;                                // fixed noise floor (dBFS); 0 = lowest channel of the table
+};
+
+// SystemConfig "Sensing" - missing keys keep the defaults
+void from_json(const nlohmann::json& j, PhySensingConfig& config);
+
+
+/**
+ * PhySensingChannel
+ *
+ * @note entry of the occupancy table - result of the last dwell on the channel
+ *
+ */
+struct PhySensingChannel {
+    double frequency = 0;
+    float energy_db = -200.0f;          // mean power (dBFS)
+    float feature_db = 0.0f;            // strongest bin over the mean of the averaged spectrum
+    double feature_offset_hz = 0;       // offset of the strongest bin from the center
+    bool energy_detect = false;
+    bool feature_detect = false;
+    bool occupied = false;
+    uint64_t timestamp = 0;             // sample timestamp of the first dwell sample
+    std::chrono::system_clock::time_point sensed;   // time of the last dwell
+    uint32_t dwells = 0;
+    uint32_t detections = 0;
+};
+
+
+/**
+ * PhySensingEngine class
+ *
+ * @note incumbent sensing in quiet periods: the radio is retuned to a channel of the list, the samples of a dwell
+ *       are collected from the sense queue, and the radio returns to the home frequency before the quiet period
+ *       ends - the frame sync and TX keep their own thread and only see the quiet flag (isQuiet())
+ * @note the retune goes through the tune function (e.g. Radio::tryFrequency() with the calibration cache, i.e.
+ *       milliseconds per channel instead of a calibration) - a channel the tune function refuses (not cached) is
+ *       skipped, a calibration never runs inside a quiet period
+ * @note channels per second: the list is visited in frequency order forth and back (short LO steps), a quiet
+ *       period continues where the last one stopped, a dwell is only started if the measured time per channel
+ *       still fits, and the detection of a dwell runs while the samples of the next channel settle
+ * @note energy detection: mean power against the noise floor (fixed or the lowest channel of the table); feature
+ *       detection: Hann windowed periodogram averaged over the dwell (one batched FFT), strongest bin against the
+ *       mean - narrowband incumbent features (DTV pilot, microphones) stand out even near the noise floor
+ *
+ */
+class PhySensingEngine {
+public:
+
+    /**
+     * @brief retune the radio (Hz) - called from the sensing thread; false if the retune is not possible in a quiet
+     *        period (e.g. the setting would need a calibration), the radio stays where it was
+     */
+    typedef std::function<bool(double frequency)> TuneFunction;
+
+    /**
+     * @brief start (true) / end (false) of a quiet period - called from the sensing thread
+     */
+    typedef std::function<void(bool quiet)> QuietFunction;
+
+    PhySensingEngine(TuneFunction tune, double home_frequency, double sample_rate, const PhySensingConfig& config);
+
+    ~PhySensingEngine();
+
+    PhySensingEngine(const PhySensingEngine&) = delete;
+
+    PhySensingEngine& operator=(const PhySensingEngine&) = delete;
+
+    void threadMain();
+
+    void terminate();
+
+    void setInputQueue(const ThreadIQDataQueueBasePtr& threadQueue);
+
+    void setQuietCallback(QuietFunction quiet) { m_quiet_cb = std::move(quiet); }
+
+    /**
+     * @brief quiet period of duration_ms as soon as possible (e.g. scheduled by the MAC) - in addition to the
+     *        periodic ones
+     */
+    void requestQuietPeriod(unsigned int duration_ms);
+
+    /**
+     * @brief true while the radio is (or may be) away from the home frequency
+     */
+    bool isQuiet() const { return m_quiet.load(); }
+
+    /**
+     * @brief copy of the occupancy table, in the order of the channel list
+     */
+    std::vector<PhySensingChannel> getOccupancy();
+
+    bool isRunning() { return m_isRunning.load(); }
+
+    /**
+     * @brief energy and feature detection on n samples; result goes into entry
+     */
+    void detect(const liquid_float_complex *x, size_t n, PhySensingChannel& entry);
+
+private:
+
+    void run();
+
+    void quiet_period(std::chrono::steady_clock::time_point deadline);
+
+    // dwell samples of the current channel after the settle samples - false on timeout, deadline or stop
+    bool collect(const ThreadIQDataQueueBasePtr& queue, uint64_t& timestamp, std::chrono::steady_clock::time_point deadline);
+
+    // detection of the collected dwell of channel index and update of the table
+    void evaluate(size_t index, uint64_t timestamp);
+
+    size_t next_channel();
+
+    TuneFunction m_tune;
+    QuietFunction m_quiet_cb;
+    const double m_home_frequency;
+    const double m_sample_rate;
+    PhySensingConfig m_config;
+
+    std::vector<size_t> m_order;            // channel indices by frequency
+    size_t m_position = 0;                  // position in m_order
+    bool m_forward = true;
+
+    std::vector<liquid_float_complex> m_dwell;
+    size_t m_dwell_fill = 0;
+
+    // feature detection - one batched transform over the dwell
+    unsigned int m_segments;
+    liquid_float_complex *m_fft_in;
+    liquid_float_complex *m_fft_out;
+    std::vector<FFT_PLAN> m_fft;
+    std::vector<float> m_window;
+    std::vector<float> m_psd;
+    const PhyDSPKernels& m_dsp = PhyDSPKernels::get();
+
+    std::mutex m_table_mutex;
+    std::vector<PhySensingChannel> m_table;
+
+    // time per channel (retune, settle, dwell) - a dwell only starts if it fits into the quiet period
+    double m_channel_seconds = 0;
+
+    ThreadIQDataQueueBasePtr m_input_queue;
+    std::mutex m_queue_bindings_mutex;
+
+    std::mutex m_request_mutex;
+    std::condition_variable m_request_cv;
+    unsigned int m_requested_ms = 0;
+
+    std::atomic_bool m_quiet;
+    std::atomic_bool m_stopping;
+    std::atomic_bool m_isRunning;
+
+    MetricCounter& m_metric_quiet = Metrics::instance().counter("sensing_quiet_periods_total", "quiet periods of the sensing engine");
+    MetricCounter& m_metric_dwells = Metrics::instance().counter("sensing_dwells_total", "channel dwells of the sensing engine");
+    MetricCounter& m_metric_timeouts = Metrics::instance().counter("sensing_dwell_timeouts_total", "dwells without samples");
+    MetricCounter& m_metric_skipped = Metrics::instance().counter("sensing_channels_skipped_total", "channels skipped as the radio could not retune in the quiet period");
+    MetricHistogram& m_metric_channel_time = Metrics::instance().histogram("sensing_channel_seconds", "retune, settle and dwell time per channel");
+    MetricHistogram& m_metric_detect_time = Metrics::instance().histogram("sensing_detect_seconds", "energy and feature detection time per dwell");
+    MetricGauge& m_metric_occupied = Metrics::instance().gauge("sensing_channels_occupied", "channels of the list with an incumbent");
+    MetricGauge& m_metric_rate = Metrics::instance().gauge("sensing_channels_per_second", "channels sensed per second in the last quiet period");
+
+};
@@ -2,26 +2,31 @@
 #include "phy/PhyThread.h"
 
 
-PhyThread::PhyThread(PhyMode mode) : m_phyMode{mode}, m_currentSampleTimestamp{0} {
+PhyThread::PhyThread(PhyMode mode) 
+                : PhyThread(mode, DEFAULT_SAMPLE_RATE, DEFAULT_OVERSAMPLING, DEFAULT_CENTER_FREQ) {
     LOG_PHY_INFO("PhyThread::PhyThread(mode) constructor - phy is runing in mode {}", (int) mode);
-
-    PhyThread(mode, DEFAULT_SAMPLE_RATE, DEFAULT_OVERSAMPLING, DEFAULT_CENTER_FREQ);
-
 }
 
 PhyThread::PhyThread(PhyMode mode, float_t samp_rate, size_t oversampling, float_t center_freq) 
-                : m_phyMode{mode}, m_currentSampleTimestamp{0}, m_samp_rate{samp_rate}, m_oversampling{oversampling}, m_center_freq{center_freq} {
+                : PhyThread(mode, samp_rate, oversampling, center_freq, nullptr) {
+}
+
+PhyThread::PhyThread(PhyMode mode, float_t samp_rate, size_t oversampling, float_t center_freq, Radio *radio)
+                : m_phyMode{mode}, m_currentSampleTimestamp{0}, m_samp_rate{samp_rate}, m_oversampling{oversampling}, m_center_freq{center_freq},
+                  m_frameSync(PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN),
+                  m_frameGen(PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN) {
     LOG_PHY_INFO("PhyThread::PhyThread() constructor - phy is runing in mode {}", (int) mode);
     terminated.store(false);
     stopping.store(false);
 
-    m_frameSync = PhyFrameSync(PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN);
-
-    m_frameGen = PhyFrameGen(PHY_SUBCARRIERS__M, PHY_CP_STS_LTS, PHY_TAPERLEN);
+    // frame sync and frame gen are constructed once in the initializer list (FFT plans come from PhyFFTPlanCache)
     m_frameGen.setTXBuffer(m_iqbuffer_tx);
 
     // @todo change this to modular approach to being able to select what hardware gets initalized
-    m_sdrRadio = new LimeRadio(1300);                   // the LMS streaming protocol sends depending on throughputvslatency different sizes for our case 4080@1.8ms (2.28MSps)
+    if(radio != nullptr)
+        m_sdrRadio = radio;
+    else
+        m_sdrRadio = new LimeRadio(1300);               // the LMS streaming protocol sends depending on throughputvslatency different sizes for our case 4080@1.8ms (2.28MSps)
     m_sdrRadio->setFrequency(m_center_freq);
     m_sdrRadio->setSamplingRate(m_samp_rate, m_oversampling);
     m_sdrRadio->setRXBuffer(m_iqbuffer_rx);
@@ -31,6 +36,8 @@ PhyThread::PhyThread(PhyMode mode, float_t samp_rate, size_t oversampling, float
 
 
     m_iqdebug = std::make_shared<PhyIQDebug>();
+    m_iqdebug->setSampleRate(m_samp_rate);
+    m_iqdebug->setFrequency(m_center_freq);
     m_frameSync.setIQDebug(m_iqdebug);
 
 }
@@ -65,11 +72,47 @@ void PhyThread::terminate() {
 
 
 
+void PhyThread::setSensing(const PhySensingConfig& config) {
+
+    // all settings of the sweep are calibrated now - a quiet period only restores them (a calibration there would
+    // stall the streams for far longer than the quiet period)
+    std::vector<double> frequencies = config.channels;
+    frequencies.push_back(m_center_freq);
+    m_sdrRadio->precalibrate(frequencies);
+
+    m_sensing_radio = nullptr;
+    makeSensing(config, [this](double frequency) { return m_sdrRadio->tryFrequency(frequency); });
+}
+
+
+void PhyThread::setSensing(const PhySensingConfig& config, RadioThread *radio) {
+
+    // the channels are calibrated by the owner of radio before its thread streams (see PhyThread.h)
+    m_sensing_radio = radio;
+    makeSensing(config, [radio](double frequency) { return radio->tryFrequency(frequency); });
+}
+
+
+void PhyThread::makeSensing(const PhySensingConfig& config, PhySensingEngine::TuneFunction tune) {
+
+    if(m_sense_queue == nullptr)
+        m_sense_queue = createRadioThreadIQDataQueue("ring", PHY_SENSING_QUEUE_DEPTH);
+
+    m_sensing = std::make_unique<PhySensingEngine>(std::move(tune), m_center_freq, m_samp_rate, config);
+    m_sensing->setInputQueue(m_sense_queue);
+}
+
+
 void PhyThread::run() {
     // do signal processing magic here
 
     LOG_PHY_INFO("PHY thread starting.");
 
+    // the sensing engine retunes the radio of this phy in its quiet periods
+    std::thread t_sensing;
+    if(m_sensing != nullptr && (m_phyMode != TEST || m_sensing_radio != nullptr))
+        t_sensing = std::thread(&PhySensingEngine::threadMain, m_sensing.get());
+
 
     // m_IQdataRXQueue = std::static_pointer_cast<RadioThreadIQDataQueue>( PhyThread::getRXQueue());
     // m_IQdataTXQueue = std::static_pointer_cast<RadioThreadIQDataQueue>( PhyThread::getTXQueue());
@@ -93,182 +136,340 @@ void PhyThread::run() {
         // first basic goal is to create the LTS/STS every 10ms w/o any data header,...
         // next step would then be to create a header symbol which is sent by the basestation and received correctly by the CPE
 
-        m_framestart_timestamp = m_sdrRadio->get_rx_timestamp() + 22850;
+        // full duplex - the uplink is received by the same receive chain as on the CPE while the downlink is
+        // scheduled; the frontend is only switched to TX for the air time of the downlink bursts
+        m_sdrRadio->set_HW_TX_mode(Radio::TxMode::TX_6M);
+        m_sdrRadio->set_HW_RX();
 
-        std::cout << m_framestart_timestamp << std::endl;
+        {
+            std::thread t_uplink([this]() {
+                if(m_cpe_pipeline)
+                    run_cpe_pipeline();
+                else
+                    run_cpe_serial();
+            });
+
+            RadioTRSwitch trSwitch([this](bool tx) {
+                if(tx)
+                    m_sdrRadio->set_HW_TX();
+                else
+                    m_sdrRadio->set_HW_RX();
+            }, m_samp_rate);
+
+            // frames are sent with hardware timestamp - the scheduler sleeps until the next frame has to be queued
+            PhyTxScheduler txScheduler(m_sdrRadio, PHY_FRAME_PERIOD_SAMPLES, m_samp_rate, m_tx_lead_frames);
+            txScheduler.setTRSwitch(&trSwitch);
+            txScheduler.start(m_sdrRadio->get_rx_timestamp() + PHY_FRAME_PERIOD_SAMPLES);
+
+            while(!stopping)
+            {
+                m_framestart_timestamp = txScheduler.wait_next_frame();
 
-        // test set TX
-        m_sdrRadio->set_HW_TX(Radio::TxMode::TX_6M);
+                // no downlink while the radio is away from the home frequency
+                if(sensing_quiet())
+                    continue;
 
+                m_frameGen.create_STS_symbol();
 
-        while(!stopping)
-        {
+                m_iqbuffer_tx->timestampFirstSample =  m_framestart_timestamp;
 
-            auto t1 = std::chrono::steady_clock::now();
+                // send_IQ_data() clears the TX buffer
+                trSwitch.schedule_tx(m_framestart_timestamp, m_iqbuffer_tx->data.size());
 
-            m_frameGen.create_STS_symbol();
+                m_sdrRadio->send_IQ_data();
+                //m_sdrRadio->send_Tone();
 
-//            std::cout << m_iqbuffer_tx->data.size() << std::endl;
+                debug_counter += 1;
+            }
 
-            // for(auto x: m_iqbuffer_tx->data) {
-            //     std::cout << x.real() << " : " << x.imag() << std::endl;
-            // }
+            LOG_PHY_INFO("PhyThread::run() BaseStation sent {} frames, {} late, {} TX underruns", txScheduler.frames(), txScheduler.late_frames(), txScheduler.underruns());
 
-            std::cout << "TX ts " << m_sdrRadio->m_tx_status.timestamp << std::endl;
-            std::cout << "RX ts " << m_sdrRadio->m_rx_status.timestamp << std::endl;
-            std::cout << "RX ts x " << m_sdrRadio->get_rx_timestamp() << std::endl;
+            t_uplink.join();
+            trSwitch.stop();
+        }
 
-            m_iqbuffer_tx->timestampFirstSample =  m_framestart_timestamp;
-            
-            m_sdrRadio->send_IQ_data();
-            //m_sdrRadio->send_Tone();
+        LOG_PHY_DEBUG("PhyThread::run() BaseStation debug counter {}", debug_counter);
 
-            std::cout << "xx: " << m_framestart_timestamp << std::endl;
+        break;
+
+
+    case CPE:
+        LOG_PHY_INFO("PHY is running as CPE");
 
+        m_isPhyRunning.store(true);
 
-            auto t2 = std::chrono::steady_clock::now();
+        // test set RX
+        m_sdrRadio->set_HW_RX();
 
-            std::cout << std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() << std::endl;
+        if(m_cpe_pipeline)
+            run_cpe_pipeline();
+        else
+            run_cpe_serial();
 
+        break;
 
-            m_framestart_timestamp += 22850;
 
+    case TEST:
 
+        m_IQdataRXQueue = PhyThread::getRXQueue();
+        m_IQdataTXQueue = PhyThread::getTXQueue();
 
- //           uint64_t t = m_sdrRadio->get_sample_timestamp();
- //           std::cout << t << std::endl;
-            while(m_sdrRadio->get_rx_timestamp()+10000 < m_framestart_timestamp) {
-                //std::cout << ".";
-            }
-//            std::cout << std::endl;
+        while(!stopping)
+        {
+            if(m_IQdataRXQueue->wait_pop(m_rxIQdataOut, PHY_PIPELINE_WAIT_MS)) {
+                // samples of the sensing dwells are not from the home frequency
+                if(sensing_quiet()) {
+                    m_sense_queue->push(m_rxIQdataOut);
+                    continue;
+                }
 
-            
-            debug_counter += 1;
+                m_currentSampleTimestamp = m_rxIQdataOut->timestampFirstSample;
+                std::cout << m_currentSampleTimestamp << " " << m_rxIQdataOut->data.size() << std::endl;
 
+                m_frameSync.m_currentSampleTimestamp = m_currentSampleTimestamp;
+                m_frameSync.execute(m_rxIQdataOut->data.data(), m_rxIQdataOut->data.size());
+                m_currentSampleTimestamp += m_rxIQdataOut->data.size();
+            }
         }
 
-        std::cout << "debug counter: " << debug_counter << std::endl;
+        break;
+
+    default:
+        LOG_PHY_INFO("selected PHY mode is not supported - stopping");
 
         break;
+    }
 
+    if(t_sensing.joinable()) {
+        m_sensing->terminate();
+        t_sensing.join();
+    }
 
-    case CPE:
-        LOG_PHY_INFO("PHY is running as CPE");
+    m_isPhyRunning.store(false);
 
-        m_isPhyRunning.store(true);
+}
 
-        // test set RX
-        m_sdrRadio->set_HW_RX();
 
-        while(!stopping)
-        {
 
-            auto t1 = std::chrono::steady_clock::now();
 
-            //PhyThread statemachine
+void PhyThread::process_rx_block(const RadioIQDataPtr& block) {
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    if(m_currentSampleTimestamp != block->timestampFirstSample) {
+        m_metric_gaps.add();
+        if(block->timestampFirstSample > m_currentSampleTimestamp)
+            m_metric_lost.add(block->timestampFirstSample - m_currentSampleTimestamp);
+        // the stream status of the radio is written by the receiving thread - the overruns are counted by the radio
+        LOG_PHY_ERROR("lost samples !!! expected {} got {} (gap {})", m_currentSampleTimestamp,
+                      block->timestampFirstSample, (int64_t)(block->timestampFirstSample - m_currentSampleTimestamp));
+    }
 
+    m_currentSampleTimestamp = block->timestampFirstSample;
 
-            // m_rxIQdataOut = std::make_shared<RadioThreadIQData>();
+    // samples of the sensing dwells are not from the home frequency
+    if(sensing_quiet()) {
+        m_currentSampleTimestamp += block->data.size();
+        return;
+    }
 
-            // if(m_IQdataRXQueue->size() > 5) {
-            //     m_IQdataRXQueue->pop(m_rxIQdataOut);
+    // whole block at once - frame sync only drops to single samples at its decision points
+    m_frameSync.m_currentSampleTimestamp = m_currentSampleTimestamp;
+    m_frameSync.execute(block->data.data(), block->data.size());
 
-            //     m_currentSampleTimestamp = m_rxIQdataOut->timestampFirstSample;
-            //     std::cout << m_currentSampleTimestamp << " " << m_rxIQdataOut->data.size() << std::endl;
+    m_currentSampleTimestamp += block->data.size();
+    m_samples_processed += block->data.size();
 
-            //     for(auto sample: m_rxIQdataOut->data)
-            //     {
-            //         m_frameSync.m_currentSampleTimestamp = m_currentSampleTimestamp;
-            //         m_frameSync.execute(sample);
-            //         m_currentSampleTimestamp++;
-            //     }
-            // }
+    m_metric_sync_time.record(std::chrono::steady_clock::now() - t1);
+}
 
 
-            // test framesync
+RadioIQDataPtr PhyThread::take_rx_block() {
 
-            // frame sync topics are sample oriented
+    RadioIQDataPtr block = m_sdrRadio->getRXBuffer();
 
-            // read samples from sdr radio; amount of samples is defined when sdr class gets initalized
-            m_sdrRadio->receive_IQ_data();
+    if(m_sdrRadio->getRXChannels() < 2 || block == nullptr) {
+        // single channel - the sensing engine gets channel 0 while it is retuned
+        if(block != nullptr && m_sense_queue != nullptr && sensing_quiet())
+            m_sense_queue->push(block);
+        return block;
+    }
 
-            if(m_currentSampleTimestamp != m_iqbuffer_rx->timestampFirstSample) {
-                LOG_PHY_ERROR("lost samples !!!");
-                std::cout << std::endl << "DEBUG: lost samples !!! " << m_currentSampleTimestamp << ":";
-                std::cout << m_iqbuffer_rx->timestampFirstSample << ":";
-                std::cout << (m_iqbuffer_rx->timestampFirstSample - m_currentSampleTimestamp) << ":";
-                std::cout << m_sdrRadio->m_rx_status.overrun << ":" << m_sdrRadio->m_rx_status.underrun;
-                std::cout << std::endl;
-            }
+    RadioIQDataPtr block_b = m_sdrRadio->getRXBuffer(1);
+    if(block_b == nullptr)
+        return block;
 
+    // channel 1 is shared with the sense queue before channel 0 is combined in place
+    if(m_sense_queue != nullptr)
+        m_sense_queue->push(block_b);
 
-            auto t2 = std::chrono::steady_clock::now();
+    // the radio delivers the channels aligned - a block without its counterpart goes through uncombined
+    if(m_diversity_mrc && block_b->timestampFirstSample == block->timestampFirstSample &&
+       block_b->data.size() == block->data.size()) {
+        auto t1 = std::chrono::steady_clock::now();
+        m_combiner.execute(block->data.data(), block_b->data.data(), block->data.data(), block->data.size());
+        m_metric_combine_time.record(std::chrono::steady_clock::now() - t1);
+    }
 
-            m_currentSampleTimestamp = m_iqbuffer_rx->timestampFirstSample;
+    return block;
+}
 
-            std::cout << m_currentSampleTimestamp << " " << m_iqbuffer_rx->data.size() << std::endl; //debug
 
-            for(auto sample: m_iqbuffer_rx->data)
-            {
-                m_frameSync.m_currentSampleTimestamp = m_currentSampleTimestamp;
-                m_frameSync.execute(sample);
+void PhyThread::run_cpe_serial() {
 
-                m_iqdebug->push_iq(m_currentSampleTimestamp, sample);
+    auto start = std::chrono::steady_clock::now();
 
-                m_currentSampleTimestamp++;
-            }
+    while(!stopping)
+    {
+        // read samples from sdr radio; amount of samples is defined when sdr class gets initalized
+        m_sdrRadio->receive_IQ_data();
+
+        if(m_sdrRadio->isEndOfStream())
+            break;
 
-            auto t3 = std::chrono::steady_clock::now();
+        // the radio receives into a new pooled block each time - take over the current one
+        m_iqbuffer_rx = take_rx_block();
 
-            std::cout << "ts : ";
-            std::cout << std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() << " : ";
-            std::cout << std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count() << std::endl;
+        process_rx_block(m_iqbuffer_rx);
+
+        m_iqdebug->push_iq(m_iqbuffer_rx->timestampFirstSample, m_iqbuffer_rx->data.data(), m_iqbuffer_rx->data.size());
+    }
+
+    log_throughput(start);
+}
 
+
+// radio ingest -> [m_pipe_rx] -> frame sync (this thread) -> [m_pipe_debug] -> debug/recording
+void PhyThread::run_cpe_pipeline() {
+
+    // the blocks queued in both stages come from the pool of the radio - with full queues the pool still has the
+    // blocks held by the stages (ingest, frame sync, debug batch), otherwise the radio falls back to the heap
+    m_pipe_depth = m_pipeline_depth;
+    if(IQBlockPoolPtr pool = m_sdrRadio->getBlockPool()) {
+        const size_t in_stages = PHY_PIPELINE_DEBUG_BATCH + 2;
+        const size_t max_depth = pool->num_blocks() > in_stages + 2 ? (pool->num_blocks() - in_stages) / 2 : 1;
+        if(m_pipe_depth > max_depth) {
+            LOG_PHY_WARN("PhyThread::run_cpe_pipeline() queue depth {} limited to {} by the IQ block pool ({} blocks)",
+                         m_pipe_depth, max_depth, pool->num_blocks());
+            m_pipe_depth = (unsigned int)max_depth;
         }
+    }
 
+    m_pipe_rx = std::make_shared<RadioThreadIQDataRingQueue>();
+    m_pipe_rx->set_max_items(m_pipe_depth);
+    m_pipe_debug = std::make_shared<RadioThreadIQDataRingQueue>();
+    m_pipe_debug->set_max_items(m_pipe_depth);
 
-        break;
+    m_pipe_stopping.store(false);
 
+    Metrics::instance().gauge("phy_pipeline_rx_queue_depth", "IQ blocks queued between ingest and frame sync").setCallback([q = m_pipe_rx]() { return (int64_t)q->size(); });
+    Metrics::instance().gauge("phy_pipeline_debug_queue_depth", "IQ blocks queued between frame sync and debug").setCallback([q = m_pipe_debug]() { return (int64_t)q->size(); });
 
-    case TEST:
+    std::thread t_debug(&PhyThread::debug_main, this);
+    std::thread t_rx(&PhyThread::rx_ingest_main, this);
 
-        m_IQdataRXQueue = std::static_pointer_cast<RadioThreadIQDataQueue>( PhyThread::getRXQueue());
-        m_IQdataTXQueue = std::static_pointer_cast<RadioThreadIQDataQueue>( PhyThread::getTXQueue());
+    thread_sched_apply("phy-sync", m_thread_sched[STAGE_SYNC]);
 
-        while(!stopping)
-        {
-            m_rxIQdataOut = std::make_shared<RadioThreadIQData>();
+    RadioIQDataPtr block;
 
-            if(m_IQdataRXQueue->size() > 5) {
-                m_IQdataRXQueue->pop(m_rxIQdataOut);
+    auto start = std::chrono::steady_clock::now();
 
-                m_currentSampleTimestamp = m_rxIQdataOut->timestampFirstSample;
-                std::cout << m_currentSampleTimestamp << " " << m_rxIQdataOut->data.size() << std::endl;
+    while(!stopping)
+    {
+        if(!m_pipe_rx->wait_pop(block, PHY_PIPELINE_WAIT_MS)) {
+            // a finite source (replay) is done when the ingest stopped and everything was processed
+            if(!m_pipe_stopping)
+                continue;
+            if(!m_pipe_rx->pop(block))
+                break;
+        }
 
-                for(auto sample: m_rxIQdataOut->data)
-                {
-                    m_frameSync.m_currentSampleTimestamp = m_currentSampleTimestamp;
-                    m_frameSync.execute(sample);
-                    m_currentSampleTimestamp++;
-                }
-            }
+        process_rx_block(block);
+
+        // debug is best effort - a full queue only drops the block for the debug buffer
+        m_pipe_debug->push(block);
+        block.reset();
+    }
+
+    log_throughput(start);
+
+    m_pipe_stopping.store(true);
+    m_pipe_debug->wakeup();
+    t_rx.join();
+    t_debug.join();
+
+    LOG_PHY_INFO("PhyThread::run_cpe_pipeline() stopped - rx queue overflows {}, debug queue overflows {}",
+                 m_pipe_rx->overflow_count(), m_pipe_debug->overflow_count());
+
+    m_pipe_rx->flush();
+    m_pipe_debug->flush();
+}
+
+
+void PhyThread::rx_ingest_main() {
+
+    thread_sched_apply("phy-rx", m_thread_sched[STAGE_RX]);
+
+    uint64_t overflows = 0;
+
+    // a replay source waits for the frame sync instead of dropping blocks
+    const bool realtime = m_sdrRadio->isRealtime();
+
+    while(!m_pipe_stopping)
+    {
+        // blocking receive into a new pooled block
+        m_sdrRadio->receive_IQ_data();
+
+        if(m_sdrRadio->isEndOfStream()) {
+            m_pipe_stopping.store(true);
+            m_pipe_rx->wakeup();
+            break;
         }
 
-        break;
+        RadioIQDataPtr block = take_rx_block();
 
-    default:
-        LOG_PHY_INFO("selected PHY mode is not supported - stopping");
+        while(!realtime && m_pipe_rx->size() + 1 >= m_pipe_depth && !m_pipe_stopping)
+            std::this_thread::sleep_for(std::chrono::microseconds(PHY_PIPELINE_IDLE_US));
 
-        break;
+        if(!m_pipe_rx->push(block)) {
+            if((overflows++ % 100) == 0)
+                LOG_PHY_WARN("PhyThread::rx_ingest_main() frame sync too slow - rx pipeline queue full ({} blocks dropped)", overflows);
+        }
     }
+}
 
-    m_isPhyRunning.store(false);
 
+void PhyThread::debug_main() {
+
+    thread_sched_apply("phy-debug", m_thread_sched[STAGE_DEBUG]);
+
+    std::vector<RadioIQDataPtr> blocks;
+    blocks.reserve(PHY_PIPELINE_DEBUG_BATCH);
+
+    while(!m_pipe_stopping)
+    {
+        if(m_pipe_debug->pop_n(blocks, PHY_PIPELINE_DEBUG_BATCH, PHY_PIPELINE_WAIT_MS) == 0)
+            continue;
+
+        for(const RadioIQDataPtr& block : blocks)
+            m_iqdebug->push_iq(block->timestampFirstSample, block->data.data(), block->data.size());
+        blocks.clear();
+    }
 }
 
 
 
 
+void PhyThread::log_throughput(std::chrono::steady_clock::time_point start) {
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    LOG_PHY_INFO("PhyThread frame sync throughput {} samples in {:.3f} s ({:.3f} MSps, {:.2f}x real time)",
+                 m_samples_processed, seconds, seconds > 0 ? m_samples_processed / seconds / 1e6 : 0.0,
+                 seconds > 0 ? m_samples_processed / seconds / m_samp_rate : 0.0);
+}
+
+
 bool PhyThread::phyConfig(/*parameter*/) {
 
 //  // validate input
@@ -4,6 +4,7 @@
 #include <iostream>
 #include <fstream>
 #include <chrono>
+#include <memory>
 #include <unistd.h>
 
 #include "liquid/liquid.h"
@@ -11,13 +12,19 @@
 #include "phy/RadioThread.h"
 #include "phy/Radio.h"
 #include "phy/LimeRadio.h"
+#include "phy/ReplayRadio.h"
 #include "phy/PhyFrameSync.h"
 #include "phy/PhyFrameGen.h"
+#include "phy/PhyTxScheduler.h"
+#include "phy/PhyDiversityCombiner.h"
+#include "phy/PhySensing.h"
 #include "phy/PhyDefinitions.h"
 
 #include "phy/PhyIQDebug.h"
 
 #include "util/log.h"
+#include "util/thread_sched.h"
+#include "util/Metrics.h"
 
 /**
  * @brief class is managing Timing information of the Phy e.g. NCO for other information
@@ -43,10 +50,28 @@ public:
         TEST
     } PhyMode;
 
+    /**
+     * @brief threads of the CPE receive pipeline - radio ingest, frame sync/demod (the thread calling run()) and
+     *        debug/recording
+     */
+    typedef enum
+    {
+        STAGE_RX=0,
+        STAGE_SYNC,
+        STAGE_DEBUG,
+        STAGE_COUNT
+    } PipelineStage;
+
     PhyThread(PhyMode mode);
 
     PhyThread(PhyMode mode, float_t samp_rate, size_t oversampling, float_t center_freq);
 
+    /**
+     * @brief run the phy on the given radio instead of a LimeRadio (e.g. ReplayRadio) - the PhyThread takes
+     *        ownership of radio
+     */
+    PhyThread(PhyMode mode, float_t samp_rate, size_t oversampling, float_t center_freq, Radio *radio);
+
 
     ~PhyThread();
 
@@ -61,6 +86,111 @@ public:
 
     bool phyConfig(/*parameter*/);
 
+    /**
+     * @brief set the sample format of the SDR stream (F32, I16, I12) - call before run()
+     *
+     * @param format IQStreamFormat
+     */
+    void setStreamFormat(IQStreamFormat format) { m_sdrRadio->setStreamFormat(format); }
+
+    /**
+     * @brief select the STS detector of the frame sync ("fft" or "schmidl-cox") - call before run()
+     *
+     * @param detector
+     */
+    void setSTSDetector(PhyFrameSync::StsDetector detector) { m_frameSync.setSTSDetector(detector); }
+
+    /**
+     * @brief number of frames which are queued with hardware timestamp ahead of the air time (BASESTATION) - call
+     *        before run()
+     *
+     * @param frames
+     */
+    void setTxLeadFrames(unsigned int frames) { m_tx_lead_frames = frames; }
+
+    /**
+     * @brief run the CPE receive path as pipeline (ingest, sync, debug each on an own thread connected by IQ block
+     *        queues of queue_depth blocks) or serial in one loop - call before run()
+     *
+     * @param enabled
+     * @param queue_depth
+     */
+    void setPipeline(bool enabled, unsigned int queue_depth) { m_cpe_pipeline = enabled; m_pipeline_depth = queue_depth; }
+
+    /**
+     * @brief CPU affinity and SCHED_FIFO priority of a pipeline stage - call before run()
+     *
+     * @param stage
+     * @param sched
+     */
+    void setThreadSched(PipelineStage stage, const ThreadSched& sched) { m_thread_sched[stage] = sched; }
+
+    /**
+     * @brief number of RX channels of the radio (1 or 2) - channel 0 does sync and data, the blocks of channel 1
+     *        go to the sense queue (setSenseQueue()) - call before run()
+     *
+     * @param channels
+     */
+    void setRXChannels(size_t channels) { m_sdrRadio->setRXChannels(channels); }
+
+    /**
+     * @brief maximal-ratio combining of both RX channels ahead of the frame sync (see PhyDiversityCombiner); only
+     *        used with 2 RX channels - call before run()
+     *
+     * @param mrc
+     */
+    void setDiversity(bool mrc) { m_diversity_mrc = mrc; }
+
+    /**
+     * @brief queue for the blocks of RX channel 1 (e.g. scanning for incumbents); the blocks are shared, not copied -
+     *        a full queue drops the block for the sense queue only - call before run()
+     *
+     * @param threadQueue
+     */
+    void setSenseQueue(const ThreadIQDataQueueBasePtr& threadQueue) { m_sense_queue = threadQueue; }
+
+    /**
+     * @brief LMS calibration cache of the radio (see LimeCalibrationCache) - retunes of the sensing engine restore
+     *        instead of calibrating - call before run()
+     *
+     * @param file
+     */
+    void setCalibrationCache(const std::string& file) { m_sdrRadio->setCalibrationCache(file); }
+
+    /**
+     * @brief block size and LMS stream tuning of the radio (see RadioStreamTuner) - the frame sync wants small
+     *        blocks (e.g. RadioStreamConfig::profile("latency")) - call before run()
+     *
+     * @param config
+     */
+    void setStreamConfig(const RadioStreamConfig& config) { m_sdrRadio->setStreamConfig(config); }
+
+    /**
+     * @brief incumbent sensing in quiet periods (see PhySensingEngine) - the engine retunes the radio of the phy and
+     *        reads the sense queue (created if not set); while quiet, channel 0 goes to the sense queue with 1 RX
+     *        channel, the frame sync is skipped and the BASESTATION sends no frames; the channels are calibrated here
+     *        (Radio::precalibrate()), set the calibration cache first - call before run(), not with TEST
+     *
+     * @param config
+     */
+    void setSensing(const PhySensingConfig& config);
+
+    /**
+     * @brief incumbent sensing as above, the engine retunes radio instead - the radio thread which feeds the RX queue
+     *        (e.g. TEST with the IQ bus); while quiet the blocks of the RX queue go to the sense queue - call before run()
+     * @note the channels and the center frequency are not calibrated here - call radio->precalibrate() for them
+     *       before the radio thread is started
+     *
+     * @param config
+     * @param radio
+     */
+    void setSensing(const PhySensingConfig& config, RadioThread *radio);
+
+    /**
+     * @brief sensing engine set by setSensing() (nullptr otherwise) e.g. for requestQuietPeriod(), getOccupancy()
+     */
+    PhySensingEngine *getSensing() { return m_sensing.get(); }
+
 
     // keep keep RX and TX for the direction sync with the SDR i.e. RXQueue for PHY is what SDR received
     // this could then be either US or DS depending on what mode the Phy is running (BS or CPE)
@@ -120,6 +250,47 @@ private:
 
     uint64_t    m_framestart_timestamp;
 
+    unsigned int m_tx_lead_frames = PHY_TX_LEAD_FRAMES;
+
+    // CPE receive pipeline
+    void run_cpe_serial();
+    void run_cpe_pipeline();
+    void rx_ingest_main();
+    void debug_main();
+
+    // frame sync on one received block incl. lost sample check
+    void process_rx_block(const RadioIQDataPtr& block);
+
+    // block of the last receive from the radio - hands channel 1 to the sense queue and combines the channels
+    RadioIQDataPtr take_rx_block();
+
+    bool m_diversity_mrc = false;
+    PhyDiversityCombiner m_combiner;
+    ThreadIQDataQueueBasePtr m_sense_queue;
+
+    std::unique_ptr<PhySensingEngine> m_sensing;
+    RadioThread *m_sensing_radio = nullptr;     // radio of the sensing engine if not m_sdrRadio
+    bool sensing_quiet() const { return m_sensing != nullptr && m_sensing->isQuiet(); }
+    void makeSensing(const PhySensingConfig& config, PhySensingEngine::TuneFunction tune);
+
+    // samples through the frame sync - logged as throughput when the CPE loop ends
+    uint64_t m_samples_processed = 0;
+    void log_throughput(std::chrono::steady_clock::time_point start);
+
+    bool m_cpe_pipeline = true;
+    unsigned int m_pipeline_depth = PHY_PIPELINE_QUEUE_DEPTH;
+    ThreadSched m_thread_sched[STAGE_COUNT];
+
+    ThreadIQDataQueueBasePtr m_pipe_rx;         // ingest -> sync
+    ThreadIQDataQueueBasePtr m_pipe_debug;      // sync -> debug
+    unsigned int m_pipe_depth = PHY_PIPELINE_QUEUE_DEPTH;   // m_pipeline_depth limited by the IQ block pool
+
+    MetricHistogram& m_metric_sync_time = Metrics::instance().histogram("phy_sync_block_seconds", "frame sync time per received block");
+    MetricCounter& m_metric_gaps = Metrics::instance().counter("phy_rx_sample_gaps_total", "timestamp gaps between received blocks");
+    MetricCounter& m_metric_lost = Metrics::instance().counter("phy_rx_lost_samples_total", "samples lost in timestamp gaps");
+    MetricHistogram& m_metric_combine_time = Metrics::instance().histogram("phy_diversity_combine_seconds", "diversity combining time per received block");
+    std::atomic_bool m_pipe_stopping;
+
     /**
      * @brief phyMode is either 0 for BaseStation; 1 for CPE; or other future modes
      * @brief default the Phy is running as BaseStation; mode cannot be changed on runtime
@@ -128,10 +299,10 @@ private:
     const PhyMode m_phyMode;
 
 
-    RadioThreadIQDataQueuePtr m_IQdataRXQueue; // = std::make_shared<RadioThreadIQDataQueue>();
+    ThreadIQDataQueueBasePtr m_IQdataRXQueue;
     RadioThreadIQDataPtr m_rxIQdataOut;
 
-    RadioThreadIQDataQueuePtr m_IQdataTXQueue; // = std::make_shared<RadioThreadIQDataQueue>();
+    ThreadIQDataQueueBasePtr m_IQdataTXQueue;
     RadioThreadIQDataPtr m_txIQdataOut;
 
     PhyIQDebugPtr m_iqdebug;
@@ -0,0 +1,218 @@
+#include "phy/PhyTrace.h"
+
+#include <cstring>
+#include <algorithm>
+
+
+std::atomic_bool PhyTrace::s_enabled{false};
+std::atomic_bool PhyTrace::s_running{false};
+
+std::mutex PhyTrace::s_rings_mutex;
+std::vector<std::unique_ptr<PhyTrace::Ring>> PhyTrace::s_rings;
+uint16_t PhyTrace::s_next_thread = 0;
+std::atomic<uint64_t> PhyTrace::s_dropped_freed{0};
+
+std::FILE *PhyTrace::s_file = nullptr;
+std::thread PhyTrace::s_drainer;
+
+
+const char* phyTraceEventName(PhyTraceEventId id) {
+    switch (id) {
+    case PhyTraceEventId::DETECT_STS:           return "detect_sts";
+    case PhyTraceEventId::DETECT_BELOW_LOWER:   return "below_lower";
+    case PhyTraceEventId::DETECT_HIT_UPPER:     return "hit_upper";
+    case PhyTraceEventId::DETECT_FROM_UPPER:    return "from_upper";
+    case PhyTraceEventId::DETECT_FRAMESTART:    return "detect_framestart";
+    case PhyTraceEventId::SYNC_STS:             return "sync_sts";
+    case PhyTraceEventId::SYNC_STS_FOUND:       return "sync_sts_found";
+    case PhyTraceEventId::SYNC_STS_TIMEOUT:     return "sync_sts_timeout";
+    case PhyTraceEventId::STS_A:                return "sts_a";
+    case PhyTraceEventId::STS_B:                return "sts_b";
+    case PhyTraceEventId::STS_B_FROM_UPPER:     return "sts_b_from_upper";
+    case PhyTraceEventId::STS_B_FRAMESTART:     return "sts_b_framestart";
+    case PhyTraceEventId::RXSYMBOLS_RESYNC:     return "rxsymbols_resync";
+    default:                                    return "unknown";
+    }
+}
+
+
+PhyTrace::Ring* PhyTrace::thread_ring() {
+
+    // the ring is owned by s_rings - the drainer frees it after the thread is gone and its events are written
+    thread_local RingOwner owner;
+
+    if (owner.ring == nullptr) {
+        std::lock_guard < std::mutex > lock(s_rings_mutex);
+        s_rings.emplace_back(new Ring());
+        owner.ring = s_rings.back().get();
+        owner.ring->thread = s_next_thread++;
+    }
+
+    return owner.ring;
+}
+
+
+void PhyTrace::record(PhyTraceEventId id, uint64_t timestamp, liquid_float_complex s_hat, float tau_hat,
+                      float nu_hat, float gain, int32_t value) {
+
+    Ring *ring = thread_ring();
+
+    const size_t tail = ring->tail.load(std::memory_order_relaxed);
+    if (tail - ring->head.load(std::memory_order_acquire) >= PHYTRACE_RING_SIZE) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    PhyTraceEvent& e = ring->events[tail & (PHYTRACE_RING_SIZE - 1)];
+    e.timestamp = timestamp;
+    e.time_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+    e.id = (uint16_t)id;
+    e.thread = ring->thread;
+    e.value = value;
+    e.s_hat_abs = std::abs(s_hat);
+    e.s_hat_arg = std::arg(s_hat);
+    e.tau_hat = tau_hat;
+    e.nu_hat = nu_hat;
+    e.gain = gain;
+    e.reserved = 0.0f;
+
+    ring->tail.store(tail + 1, std::memory_order_release);
+}
+
+
+void PhyTrace::drain() {
+
+    // the file is written without the lock - a thread creating its ring does not wait for the disk; the rings stay
+    // valid as only drain() frees them
+    std::vector<Ring *> rings;
+    {
+        std::lock_guard < std::mutex > lock(s_rings_mutex);
+        rings.reserve(s_rings.size());
+        for (auto& ring : s_rings)
+            rings.push_back(ring.get());
+    }
+
+    for (Ring *ring : rings) {
+        size_t head = ring->head.load(std::memory_order_relaxed);
+        const size_t tail = ring->tail.load(std::memory_order_acquire);
+
+        while (head != tail) {
+            // write the contiguous part of the ring at once
+            const size_t idx = head & (PHYTRACE_RING_SIZE - 1);
+            const size_t n = std::min(tail - head, (size_t)PHYTRACE_RING_SIZE - idx);
+
+            if (s_file != nullptr)
+                std::fwrite(&ring->events[idx], sizeof(PhyTraceEvent), n, s_file);
+
+            head += n;
+        }
+
+        ring->head.store(head, std::memory_order_release);
+    }
+
+    // rings of exited threads which are drained (retired is set after the last event of the thread)
+    std::lock_guard < std::mutex > lock(s_rings_mutex);
+    s_rings.erase(std::remove_if(s_rings.begin(), s_rings.end(), [](const std::unique_ptr<Ring>& ring) {
+        if (!ring->retired.load(std::memory_order_acquire) ||
+            ring->head.load(std::memory_order_relaxed) != ring->tail.load(std::memory_order_acquire))
+            return false;
+        s_dropped_freed.fetch_add(ring->dropped.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return true;
+    }), s_rings.end());
+}
+
+
+void PhyTrace::drainer_main() {
+
+    while (s_running.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(PHYTRACE_DRAIN_PERIOD_MS));
+        drain();
+    }
+
+    drain();
+}
+
+
+bool PhyTrace::start(const std::string& filename) {
+
+    if (s_running.load())
+        return true;
+
+    s_file = std::fopen(filename.c_str(), "wb");
+    if (s_file == nullptr) {
+        LOG_PHY_ERROR("PhyTrace::start() cannot open trace file {}", filename);
+        return false;
+    }
+
+    const uint32_t event_size = sizeof(PhyTraceEvent);
+    std::fwrite(PHYTRACE_FILE_MAGIC, 1, 8, s_file);
+    std::fwrite(&event_size, sizeof(event_size), 1, s_file);
+
+    s_running.store(true);
+    s_drainer = std::thread(&PhyTrace::drainer_main);
+
+    s_enabled.store(true);
+
+    LOG_PHY_INFO("PhyTrace::start() tracing frame sync events to {}", filename);
+    return true;
+}
+
+
+void PhyTrace::stop() {
+
+    if (!s_running.load())
+        return;
+
+    s_enabled.store(false);
+    s_running.store(false);
+    s_drainer.join();
+
+    std::fclose(s_file);
+    s_file = nullptr;
+
+    LOG_PHY_INFO("PhyTrace::stop() tracing stopped - {} events dropped", dropped());
+}
+
+
+uint64_t PhyTrace::dropped() {
+
+    std::lock_guard < std::mutex > lock(s_rings_mutex);
+
+    uint64_t n = s_dropped_freed.load(std::memory_order_relaxed);
+    for (auto& ring : s_rings)
+        n += ring->dropped.load(std::memory_order_relaxed);
+
+    return n;
+}
+
+
+long PhyTrace::decode(const std::string& filename, std::ostream& out) {
+
+    std::FILE *f = std::fopen(filename.c_str(), "rb");
+    if (f == nullptr)
+        return -1;
+
+    char magic[8];
+    uint32_t event_size = 0;
+
+    if (std::fread(magic, 1, 8, f) != 8 || std::memcmp(magic, PHYTRACE_FILE_MAGIC, 8) != 0
+        || std::fread(&event_size, sizeof(event_size), 1, f) != 1 || event_size != sizeof(PhyTraceEvent)) {
+        std::fclose(f);
+        return -1;
+    }
+
+    out << "time_ns,thread,event,timestamp,s_hat_abs,s_hat_arg,tau_hat,nu_hat,gain,value" << std::endl;
+
+    long n = 0;
+    PhyTraceEvent e;
+    while (std::fread(&e, sizeof(e), 1, f) == 1) {
+        out << e.time_ns << "," << e.thread << "," << phyTraceEventName((PhyTraceEventId)e.id) << ","
+            << e.timestamp << "," << e.s_hat_abs << "," << e.s_hat_arg << "," << e.tau_hat << ","
+            << e.nu_hat << "," << e.gain << "," << e.value << "\n";
+        n++;
+    }
+
+    std::fclose(f);
+    return n;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+
+#include "liquid/liquid.h"
+
+#include "util/log.h"
+
+
+// events per thread ring (power of 2) - at one event per M/4 samples this covers > 1s
+#define PHYTRACE_RING_SIZE          16384
+// period of the background drainer
+#define PHYTRACE_DRAIN_PERIOD_MS    10
+#define PHYTRACE_FILE_MAGIC         "PHYTRC01"
+
+
+/**
+ * PhyTraceEventId
+ *
+ * @note ids of the frame sync events; new ids are only appended so that older trace files can still be decoded
+ *
+ */
+enum class PhyTraceEventId : uint16_t {
+    DETECT_STS = 0,             // STS detection estimate (every M/4 samples)
+    DETECT_BELOW_LOWER,         // |s_hat| below lower threshold
+    DETECT_HIT_UPPER,           // |s_hat| above upper threshold
+    DETECT_FROM_UPPER,          // between thresholds but coming from upper
+    DETECT_FRAMESTART,          // raising slope - value: rough frame start relative to timestamp
+    SYNC_STS,                   // periodic re-sync estimate
+    SYNC_STS_FOUND,             // re-sync above lower threshold - value: dt
+    SYNC_STS_TIMEOUT,           // no sync within PHY_SYNC_STS_MAX_SAMPLES
+    STS_A,                      // first STS half - s_hat_0
+    STS_B,                      // second STS half - s_hat_1, tau_prime, nu_hat, value: timer
+    STS_B_FROM_UPPER,           // STSb hit at the end of the symbol - back to detection
+    STS_B_FRAMESTART,           // value: rough frame start relative to timestamp
+    RXSYMBOLS_RESYNC,           // back to re-sync after PHY_RXSYMBOLS_WAIT samples
+    EVENT_COUNT
+};
+
+const char* phyTraceEventName(PhyTraceEventId id);
+
+
+/**
+ * PhyTraceEvent
+ *
+ * @note fixed size binary event as written to the ring and the trace file
+ *
+ */
+struct PhyTraceEvent {
+    uint64_t timestamp;         // sample timestamp
+    uint64_t time_ns;           // steady_clock in ns
+    uint16_t id;                // PhyTraceEventId
+    uint16_t thread;            // index of the recording thread
+    int32_t value;              // event specific (dt, timer, frame start - timestamp, ...)
+    float s_hat_abs;
+    float s_hat_arg;
+    float tau_hat;
+    float nu_hat;
+    float gain;                 // m_g0
+    float reserved;
+};
+
+static_assert(sizeof(PhyTraceEvent) == 48, "PhyTraceEvent must keep its binary layout");
+
+
+/**
+ * PhyTrace class
+ *
+ * @note record() writes into a wait-free SPSC ring owned by the calling thread (created on the first event of the
+ *       thread); a background drainer moves the events of all rings to a binary trace file
+ * @note when a ring is full the event is dropped and counted - the real time path never blocks on the trace
+ * @note the ring of a thread is retired when the thread exits and freed by the drainer once it is drained
+ * @note tracing is off until start() is called, a disabled record() is one relaxed atomic load
+ *
+ */
+class PhyTrace {
+public:
+
+    /**
+     * @brief open the trace file and start the drainer thread
+     *
+     * @param filename binary trace file
+     * @return true if the file could be opened
+     */
+    static bool start(const std::string& filename);
+
+    /**
+     * @brief drain the remaining events, stop the drainer and close the file
+     */
+    static void stop();
+
+    static inline bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    static void record(PhyTraceEventId id, uint64_t timestamp, liquid_float_complex s_hat, float tau_hat,
+                       float nu_hat, float gain, int32_t value);
+
+    /**
+     * @brief decode a binary trace file to CSV
+     *
+     * @param filename
+     * @param out
+     * @return number of decoded events, -1 if the file is not a trace file
+     */
+    static long decode(const std::string& filename, std::ostream& out);
+
+    /**
+     * @brief events dropped because a thread ring was full
+     */
+    static uint64_t dropped();
+
+private:
+
+    struct Ring {
+        PhyTraceEvent events[PHYTRACE_RING_SIZE];
+        alignas(64) std::atomic<size_t> head{0};        // drainer
+        alignas(64) std::atomic<size_t> tail{0};        // recording thread
+        std::atomic<uint64_t> dropped{0};
+        std::atomic_bool retired{false};                // thread has exited - no more events
+        uint16_t thread = 0;
+    };
+
+    // retires the ring of the thread when the thread exits
+    struct RingOwner {
+        Ring *ring = nullptr;
+        ~RingOwner() {
+            if (ring != nullptr)
+                ring->retired.store(true, std::memory_order_release);
+        }
+    };
+
+    static Ring* thread_ring();
+
+    static void drain();
+
+    static void drainer_main();
+
+    static std::atomic_bool s_enabled;
+    static std::atomic_bool s_running;
+
+    static std::mutex s_rings_mutex;
+    static std::vector<std::unique_ptr<Ring>> s_rings;
+    static uint16_t s_next_thread;
+    static std::atomic<uint64_t> s_dropped_freed;         // drops of the freed rings
+
+    static std::FILE *s_file;
+    static std::thread s_drainer;
+
+};
+
+
+/**
+ * @brief record a frame sync trace event - compiles to a relaxed load and a branch while tracing is off
+ */
+#define PHY_TRACE(id, ts, s_hat, tau_hat, nu_hat, gain, value)                                          \
+    do {                                                                                                \
+        if (PhyTrace::enabled())                                                                        \
+            PhyTrace::record(PhyTraceEventId::id, (ts), (s_hat), (tau_hat), (nu_hat), (gain), (value)); \
+    } while (0)
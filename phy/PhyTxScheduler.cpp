@@ -0,0 +1,86 @@
+#include "phy/PhyTxScheduler.h"
+
+
+PhyTxScheduler::PhyTxScheduler(Radio *radio, uint64_t frame_period, double sample_rate, unsigned int lead_frames)
+        : m_radio{radio}, m_frame_period{frame_period}, m_sample_rate{sample_rate},
+          m_lead_frames{lead_frames > 0 ? lead_frames : 1} {
+    LOG_PHY_INFO("PhyTxScheduler::PhyTxScheduler() period {} samples @ {} Sps, {} frames ahead", m_frame_period, m_sample_rate, m_lead_frames);
+}
+
+
+void PhyTxScheduler::start(uint64_t first_frame_ts) {
+
+    m_next_frame_ts = first_frame_ts;
+
+    reanchor();
+
+    m_frames = 0;
+    m_late_frames = 0;
+    m_underruns = 0;
+    m_underruns_base = m_radio->get_tx_underruns();
+}
+
+
+uint64_t PhyTxScheduler::sample_clock(std::chrono::steady_clock::time_point t) const {
+
+    const double elapsed = std::chrono::duration<double>(t - m_anchor_time).count();
+    return m_anchor_ts + (uint64_t)(elapsed * m_sample_rate);
+}
+
+
+void PhyTxScheduler::reanchor() {
+
+    m_anchor_ts = m_radio->get_rx_timestamp();          // reads the TX stream status of the radio as well
+    m_anchor_time = std::chrono::steady_clock::now();
+
+    if (m_trswitch != nullptr)
+        m_trswitch->anchor(m_anchor_ts, m_anchor_time);
+}
+
+
+uint64_t PhyTxScheduler::wait_next_frame() {
+
+    const uint64_t lead = m_lead_frames * m_frame_period;
+
+    // submission deadline - the frame gets into the SDR FIFO lead_frames ahead of its air time
+    if (m_next_frame_ts > lead) {
+        const uint64_t deadline_ts = m_next_frame_ts - lead;
+        const uint64_t now_ts = sample_clock(std::chrono::steady_clock::now());
+
+        if (deadline_ts > now_ts) {
+            auto until = std::chrono::duration<double>((double)(deadline_ts - m_anchor_ts) / m_sample_rate);
+            std::this_thread::sleep_until(m_anchor_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(until));
+        }
+    }
+
+    // correct the extrapolation (drift of steady_clock vs. the SDR clock) - one stream status call per frame
+    reanchor();
+
+    // underruns of all TX status reads since start() - not only of the one above
+    const uint64_t underruns = m_radio->get_tx_underruns() - m_underruns_base;
+    if (underruns > m_underruns) {
+        m_underruns = underruns;
+        LOG_PHY_WARN("PhyTxScheduler::wait_next_frame() TX underrun (total {})", m_underruns);
+    }
+
+    // frame would not make it to the air in time - skip to the next frame which still has enough lead
+    // how far behind its submission deadline the frame is handed to the SDR
+    if (m_next_frame_ts > lead && m_anchor_ts > m_next_frame_ts - lead)
+        m_metric_lateness.record((uint64_t)((double)(m_anchor_ts - (m_next_frame_ts - lead)) * 1e9 / m_sample_rate));
+    else
+        m_metric_lateness.record((uint64_t)0);
+
+    while (m_next_frame_ts < m_anchor_ts + m_frame_period / 2) {
+        m_late_frames++;
+        m_metric_late.add();
+        LOG_PHY_WARN("PhyTxScheduler::wait_next_frame() frame {} late (sample clock {}), skipped", m_next_frame_ts, m_anchor_ts);
+        m_next_frame_ts += m_frame_period;
+    }
+
+    const uint64_t frame_ts = m_next_frame_ts;
+    m_next_frame_ts += m_frame_period;
+    m_frames++;
+    m_metric_frames.add();
+
+    return frame_ts;
+}
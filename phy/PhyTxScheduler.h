@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+#include <cstdint>
+
+#include "phy/Radio.h"
+#include "phy/RadioTRSwitch.h"
+#include "phy/PhyDefinitions.h"
+#include "util/log.h"
+#include "util/Metrics.h"
+
+
+/**
+ * PhyTxScheduler class
+ *
+ * @note paces the TX of frames which are sent with a hardware timestamp (waitForTimestamp) - a frame with
+ *       timestamp ts is submitted when the SDR sample clock reaches ts - lead_frames * frame_period, i.e. up to
+ *       lead_frames frames are queued in the SDR FIFO ahead of the air time
+ * @note the sample clock is extrapolated from steady_clock and is re-anchored with one get_rx_timestamp() per
+ *       frame; the thread sleeps until the next submission deadline instead of polling the stream status
+ * @note frames whose timestamp is already too close (less than half a frame period of lead) are reported late and
+ *       skipped, TX underruns of the SDR stream are reported as well
+ * @note with setTRSwitch() each re-anchor is handed to the RadioTRSwitch as well, so the RF frontend is switched on
+ *       the same sample clock the frames are scheduled on
+ *
+ */
+class PhyTxScheduler {
+public:
+
+    PhyTxScheduler(Radio *radio, uint64_t frame_period, double sample_rate, unsigned int lead_frames);
+
+    /**
+     * @brief anchor the sample clock and set the timestamp of the first frame
+     *
+     * @param first_frame_ts hardware timestamp of the first frame (samples)
+     */
+    void start(uint64_t first_frame_ts);
+
+    /**
+     * @brief sleep until the submission deadline of the next frame and return the timestamp it has to be sent with
+     *
+     * @return uint64_t hardware timestamp of the frame (samples)
+     */
+    uint64_t wait_next_frame();
+
+    /**
+     * @brief RX/TX switch of the frontend which gets the sample clock of the scheduler - call before start()
+     *
+     * @param trswitch not owned, nullptr for none
+     */
+    void setTRSwitch(RadioTRSwitch *trswitch) { m_trswitch = trswitch; }
+
+    uint64_t frames() const { return m_frames; }
+    uint64_t late_frames() const { return m_late_frames; }
+    uint64_t underruns() const { return m_underruns; }
+
+    unsigned int lead_frames() const { return m_lead_frames; }
+
+private:
+
+    // extrapolated sample clock of the SDR
+    uint64_t sample_clock(std::chrono::steady_clock::time_point t) const;
+
+    void reanchor();
+
+    Radio *m_radio;
+    RadioTRSwitch *m_trswitch = nullptr;
+
+    const uint64_t m_frame_period;
+    const double m_sample_rate;
+    const unsigned int m_lead_frames;
+
+    uint64_t m_next_frame_ts = 0;
+
+    uint64_t m_anchor_ts = 0;
+    std::chrono::steady_clock::time_point m_anchor_time;
+
+    uint64_t m_frames = 0;
+    uint64_t m_late_frames = 0;
+    uint64_t m_underruns = 0;
+    uint64_t m_underruns_base = 0;      // get_tx_underruns() of the radio at start()
+
+    MetricHistogram& m_metric_lateness = Metrics::instance().histogram("phy_tx_submit_lateness_seconds", "delay of the frame submission behind its deadline");
+    MetricCounter& m_metric_late = Metrics::instance().counter("phy_tx_late_frames_total", "frames skipped as too late for their air time");
+    MetricCounter& m_metric_frames = Metrics::instance().counter("phy_tx_frames_total", "frames submitted with hardware timestamp");
+
+};
@@ -0,0 +1,59 @@
+#include "phy/QueueRadio.h"
+
+#include <unistd.h>
+#include <cstring>
+
+
+QueueRadio::QueueRadio(const ThreadIQDataQueueBasePtr& queue, int sampleBufferCnt)
+    : Radio(sampleBufferCnt), m_queue(queue) {
+
+    LOG_RADIO_TRACE("QueueRadio() constructor");
+
+    std::memset(&m_rx_status, 0, sizeof(m_rx_status));
+
+    if (m_queue == nullptr) {
+        LOG_RADIO_ERROR("QueueRadio() no queue set");
+        m_eof.store(true);
+    }
+}
+
+
+QueueRadio::~QueueRadio() {
+
+    LOG_RADIO_TRACE("QueueRadio destructor");
+}
+
+
+int QueueRadio::receive_IQ_data() {
+
+    RadioIQDataPtr block;
+
+    while (!m_eof) {
+        if (m_queue->wait_pop(block, QUEUE_RADIO_WAIT_MS)) {
+            m_timestamp.store(block->timestampFirstSample + block->data.size());
+            setRXBuffer(block);
+            return (int)block->data.size();
+        }
+
+        // the queue is drained when the producer is gone
+        if (m_stopping) {
+            LOG_RADIO_DEBUG("QueueRadio::receive_IQ_data() end of stream");
+            m_eof.store(true);
+            break;
+        }
+    }
+
+    setRXBuffer(getBlockPool()->acquire());
+    return 0;
+}
+
+
+int QueueRadio::send_IQ_data() {
+    // nothing to send to
+    return 0;
+}
+
+
+uint64_t QueueRadio::get_rx_timestamp() {
+    return m_timestamp.load();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "phy/Radio.h"
+#include "phy/RadioThread.h"
+#include "phy/IQBlock.h"
+
+#include "util/log.h"
+
+
+#define QUEUE_RADIO_WAIT_MS         100         // max wait for a block (stop latency)
+
+
+/**
+ * QueueRadio class
+ *
+ * @note Radio which receives the blocks of an IQ queue instead of a hardware stream - lets a PhyThread run on a
+ *       stream produced by another stage, e.g. one sub-channel of the PhyChannelizer
+ * @note receive_IQ_data() waits until a block is queued; after terminate() the queue is drained and the radio
+ *       signals end of stream, i.e. the PhyThread stops like on the end of a replay
+ * @note the blocks arrive at the rate of the producer (isRealtime()); TX is discarded
+ *
+ */
+class QueueRadio : public Radio {
+public:
+
+    explicit QueueRadio(const ThreadIQDataQueueBasePtr& queue, int sampleBufferCnt = DEFAULT_SAMPLEBUFFERCNT);
+
+    ~QueueRadio();
+
+    int receive_IQ_data() override;
+    int send_IQ_data() override;
+
+    uint64_t get_rx_timestamp() override;
+
+    bool isEndOfStream() override { return m_eof.load(); }
+
+    /**
+     * @brief stop receiving - end of stream after the queued blocks
+     */
+    void terminate() { m_stopping.store(true); }
+
+private:
+
+    ThreadIQDataQueueBasePtr m_queue;
+
+    std::atomic_bool m_stopping{false};
+    std::atomic_bool m_eof{false};
+
+    std::atomic<uint64_t> m_timestamp{0};      // timestamp of the next sample
+
+};
@@ -23,7 +23,7 @@ Radio::Radio(int sampleBufferCnt) : m_sampleBufferCnt{sampleBufferCnt} {
 
     // m_rx_buffer = std::make_shared<RadioIQData>();
 
-    std::cout << m_rx_buffer << std::endl;
+    std::cout << m_rx_buffer[0] << std::endl;
 }
 
 Radio::~Radio() {
@@ -38,10 +38,38 @@ void Radio::setFrequency(float_t frequency) {
     // defined in radio specific class (e.g. LimeRadio)
 }
 
+bool Radio::tryFrequency(float_t frequency) {
+    // no calibration by default - a plain retune
+    setFrequency(frequency);
+    return true;
+}
+
+void Radio::precalibrate(const std::vector<double>& frequencies) {
+    // defined in radio specific class (e.g. LimeRadio)
+}
+
 void Radio::setSamplingRate(float_t sampling_rate, size_t oversampling) {
     // defined in radio specific class (e.g. LimeRadio)
 }
 
+void Radio::setStreamFormat(IQStreamFormat format) {
+    // defined in radio specific class (e.g. LimeRadio)
+}
+
+void Radio::setCalibrationCache(const std::string& file) {
+    // defined in radio specific class (e.g. LimeRadio)
+}
+
+void Radio::setStreamConfig(const RadioStreamConfig& config) {
+    // defined in radio specific class (e.g. LimeRadio)
+}
+
+void Radio::setRXChannels(size_t channels) {
+    // defined in radio specific class (e.g. LimeRadio) - a radio with one RX path stays with one channel
+    if(channels != 1)
+        LOG_RADIO_ERROR("Radio::setRXChannels() {} RX channels are not supported by this radio", channels);
+}
+
 void Radio::set_HW_RX() {
     // defined in radio specific class (e.g. LimeRadio)
 };
@@ -70,22 +98,41 @@ uint64_t Radio::get_rx_timestamp() {
     return 0;
 };
 
+uint64_t Radio::get_tx_underruns() {
+    // defined in radio specific class (e.g. LimeRadio)
+    return 0;
+}
+
 
 void Radio::setRXBuffer(const RadioIQDataPtr& buffer) {
     std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
-    LOG_RADIO_DEBUG("Radio::setRXBuffer()");
-    m_rx_buffer = buffer;
+    // LOG_RADIO_DEBUG("Radio::setRXBuffer()");
+    m_rx_buffer[0] = buffer;
 }
 
 RadioIQDataPtr Radio::getRXBuffer() {
     std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
     // LOG_RADIO_DEBUG("Radio::getRXBuffer() ");
-    return m_rx_buffer;
+    return m_rx_buffer[0];
+}
+
+void Radio::setRXBuffer(size_t channel, const RadioIQDataPtr& buffer) {
+    std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
+    if(channel >= RADIO_MAX_RX_CHANNELS) {
+        LOG_RADIO_ERROR("Radio::setRXBuffer() no RX channel {}", channel);
+        return;
+    }
+    m_rx_buffer[channel] = buffer;
+}
+
+RadioIQDataPtr Radio::getRXBuffer(size_t channel) {
+    std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
+    return channel < RADIO_MAX_RX_CHANNELS ? m_rx_buffer[channel] : nullptr;
 }
 
 void Radio::setTXBuffer(const RadioIQDataPtr& buffer) {
     std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
-    LOG_RADIO_DEBUG("Radio::setTXBuffer()");
+    // LOG_RADIO_DEBUG("Radio::setTXBuffer()");
     m_tx_buffer = buffer;
 }
 
@@ -94,3 +141,22 @@ RadioIQDataPtr Radio::getTXBuffer() {
     // LOG_RADIO_DEBUG("Radio::getTXBuffer() ");
     return m_tx_buffer;
 }
+
+void Radio::setBlockPool(const IQBlockPoolPtr& pool) {
+    std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
+    LOG_RADIO_DEBUG("Radio::setBlockPool() blocks {} capacity {}", pool->num_blocks(), pool->block_capacity());
+    m_block_pool = pool;
+}
+
+IQBlockPoolPtr Radio::getBlockPool() {
+    std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
+    // default pool on first use - most radios get their pool via setBlockPool() before the first block
+    if (m_block_pool == nullptr)
+        m_block_pool = IQBlockPool::create(DEFAULT_IQBLOCKPOOL_BLOCKS, m_sampleBufferCnt);
+    return m_block_pool;
+}
+
+size_t Radio::blockCapacity() {
+    std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
+    return m_block_pool != nullptr ? m_block_pool->block_capacity() : (size_t)m_sampleBufferCnt;
+}
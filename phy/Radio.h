@@ -17,6 +17,9 @@
 #include "lime/LimeSuite.h"
 #include "liquid/liquid.h"
 #include "phy/DefaultRadioConfig.h"
+#include "phy/IQBlock.h"
+#include "phy/IQConvert.h"
+#include "phy/RadioStreamTuner.h"
 
 #include "util/log.h"
 
@@ -54,29 +57,15 @@
 // };
 
 /**
- * RadioIQData class
+ * RadioIQData
  *
- * @note one block of received IQ data with timestamp of first sample of block; data is stored in liquid_float_complex
+ * @note one block of received IQ data with timestamp of first sample of block; data is stored contiguous in
+ *       liquid_float_complex (see IQBlock)
  *
  */
-class RadioIQData {
-public:
-    long long frequency;
-    long long sampleRate;
-
-    uint64_t timestampFirstSample;
-
-    std::deque<liquid_float_complex> data;   //std::complex<float>
-
-    RadioIQData() :
-            frequency(DEFAULT_CENTER_FREQ), sampleRate(DEFAULT_SAMPLE_RATE), timestampFirstSample(0) {
-        LOG_RADIO_DEBUG("RadioIQData::RadioIQData() constructor");
-    }
-
-    virtual ~RadioIQData() = default;
-};
+typedef IQBlock RadioIQData;
 
-typedef std::shared_ptr<RadioIQData> RadioIQDataPtr;
+typedef IQBlockPtr RadioIQDataPtr;
 
 
 class Radio {
@@ -100,6 +89,14 @@ public:
         return m_isRxTxRunning.load();
     }
 
+    /**
+     * @brief state of the RF frontend (GPIO RX/TX switch) - receive_IQ_data() and send_IQ_data() work in both states
+     *        and can be called from different threads at the same time (full duplex)
+     */
+    bool isRxOn() {
+        return m_isRX.load();
+    }
+
     void setRxOn() {
         m_isRX.store(true); // true = RX
     }
@@ -112,9 +109,32 @@ public:
     void setRXBuffer(const RadioIQDataPtr& buffer);
     RadioIQDataPtr getRXBuffer();
 
+    /**
+     * @brief block of one RX channel of the last receive_IQ_data() (see setRXChannels()); channel 0 is the block of
+     *        getRXBuffer() - the blocks of all channels have the same timestamp
+     *
+     * @param channel RX channel 0 .. RADIO_MAX_RX_CHANNELS - 1
+     */
+    void setRXBuffer(size_t channel, const RadioIQDataPtr& buffer);
+    RadioIQDataPtr getRXBuffer(size_t channel);
+
     void setTXBuffer(const RadioIQDataPtr& buffer);
     RadioIQDataPtr getTXBuffer();
 
+    /**
+     * @brief set the pool the RX blocks are taken from; receive_IQ_data() receives directly into a block of the
+     *        pool and hands it over via setRXBuffer() - the consumer has to call getRXBuffer() after each receive
+     *
+     * @param pool IQBlockPoolPtr
+     */
+    void setBlockPool(const IQBlockPoolPtr& pool);
+
+    /**
+     * @brief pool of the RX blocks - without setBlockPool() a pool of DEFAULT_IQBLOCKPOOL_BLOCKS blocks of
+     *        m_sampleBufferCnt samples is created on the first call
+     */
+    IQBlockPoolPtr getBlockPool();
+
 
 
     /**
@@ -126,6 +146,24 @@ public:
      */
     virtual void setFrequency(float_t frequency);
 
+    /**
+     * @brief retune only if it needs no calibration (a cached setting, see setCalibrationCache()) - e.g. the retunes
+     *        of a sensing quiet period which must not block the streams for a calibration
+     *
+     * @param frequency RF center frequency in Hz
+     *
+     * @return false if the setting is not cached - the radio stays at the current frequency
+     */
+    virtual bool tryFrequency(float_t frequency);
+
+    /**
+     * @brief calibrate the settings at frequencies which are not cached yet and return to the current frequency -
+     *        at startup, before tryFrequency() is used for them (e.g. the channel list of the sensing engine)
+     *
+     * @param frequencies RF center frequencies in Hz
+     */
+    virtual void precalibrate(const std::vector<double>& frequencies);
+
     /**
      * @brief Set the Sampling_Rate and Oversampling
      * 
@@ -134,6 +172,42 @@ public:
      */
     virtual void setSamplingRate(float_t sampling_rate, size_t oversampling);
 
+    /**
+     * @brief Set the host side sample format of the LMS stream (F32, I16, I12); streams are restarted
+     *
+     * @param format IQStreamFormat
+     */
+    virtual void setStreamFormat(IQStreamFormat format);
+
+    IQStreamFormat getStreamFormat() { return m_streamFormat; }
+
+    /**
+     * @brief number of RX channels received at once (1 .. RADIO_MAX_RX_CHANNELS); receive_IQ_data() receives a
+     *        block per channel, aligned on the timestamps - streams are restarted
+     *
+     * @param channels
+     */
+    virtual void setRXChannels(size_t channels);
+
+    size_t getRXChannels() { return m_rxChannels; }
+
+    /**
+     * @brief keep the LO and calibration settings per (frequency, sample rate, gains) in file - a retune to a cached
+     *        setting restores it instead of calibrating, a new setting is calibrated once and added to the cache
+     *
+     * @param file calibration cache (JSON)
+     */
+    virtual void setCalibrationCache(const std::string& file);
+
+    /**
+     * @brief block size and LMS stream parameters (FIFO size, throughputVsLatency), fixed or adapted to the latency
+     *        budget at runtime (see RadioStreamTuner); the block size is bounded by the IQBlockPool - set the pool
+     *        first; streams are restarted
+     *
+     * @param config RadioStreamConfig
+     */
+    virtual void setStreamConfig(const RadioStreamConfig& config);
+
     // done via queues now
     // virtual void getIQData();
     // virtual void setIQData();
@@ -178,16 +252,37 @@ public:
 
     virtual uint64_t get_rx_timestamp();
 
+    /**
+     * @brief TX underruns of the radio so far - all status reads of the TX stream count, whichever thread made
+     *        them (e.g. the one per frame of get_rx_timestamp())
+     */
+    virtual uint64_t get_tx_underruns();
+
+    /**
+     * @brief true for hardware radios which deliver samples at the sample rate whether they are consumed or not;
+     *        a replay source returns false so that consumers wait instead of dropping blocks
+     */
+    virtual bool isRealtime() { return true; }
+
+    /**
+     * @brief true when a finite source (e.g. ReplayRadio) has no more samples
+     */
+    virtual bool isEndOfStream() { return false; }
+
 
 
     lms_stream_status_t m_rx_status;    // status of RX stream from LMS_GetStatus   (is updated on receive and get timestamp)
-    lms_stream_status_t m_tx_status;    // status of TX stream from LMS_GetStatus   (is updated on transmit and get timestamp)
 
     
 protected:
 
     RadioIQDataPtr m_tx_buffer;
-    RadioIQDataPtr m_rx_buffer;
+    RadioIQDataPtr m_rx_buffer[RADIO_MAX_RX_CHANNELS];
+
+    IQBlockPoolPtr m_block_pool;    // created by getBlockPool() if not set
+
+    // samples per block of the pool (m_sampleBufferCnt for the default pool) - does not create the pool
+    size_t blockCapacity();
 
 
     std::mutex m_queue_bindings_mutex;
@@ -195,13 +290,17 @@ protected:
     std::atomic_bool m_isRxTxRunning;
 
     /**
-     * @brief m_isRX is true when the RadioThread is in RX mode; if false the thread is running in TX
+     * @brief m_isRX is true when the RF frontend is switched to RX; if false it is in TX (streams are not affected)
      * 
      */
     std::atomic_bool m_isRX;
 
     int m_sampleBufferCnt;
 
+    IQStreamFormat m_streamFormat = IQStreamFormat::F32;
+
+    size_t m_rxChannels = 1;
+
 private:
 
     TxMode  m_TxMode = TxMode::TX_DIRECT;
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "lime/LimeSuite.h"
+
+#include "util/Metrics.h"
+
+
+// LimeRadioThread reads the LMS stream status every RADIO_METRICS_STATUS_BLOCKS blocks
+#define RADIO_METRICS_STATUS_BLOCKS     64
+
+
+/**
+ * RadioStreamMetrics
+ *
+ * @note metrics of the LMS RX/TX streams shared by LimeRadio and LimeRadioThread; the LMS overrun, underrun and
+ *       droppedPackets fields are reset by every LMS_GetStreamStatus() call, so they are accumulated here
+ *
+ */
+struct RadioStreamMetrics {
+
+    MetricHistogram& rx_recv_time;
+    MetricHistogram& tx_send_time;
+    MetricGauge& rx_fifo_fill;
+    MetricGauge& tx_fifo_fill;
+    MetricCounter& rx_samples;
+    MetricCounter& tx_samples;
+    MetricCounter& rx_overrun;
+    MetricCounter& rx_dropped;
+    MetricCounter& tx_underrun;
+    MetricCounter& tx_dropped;
+
+    RadioStreamMetrics() :
+        rx_recv_time(Metrics::instance().histogram("radio_rx_recv_seconds", "duration of LMS_RecvStream per block")),
+        tx_send_time(Metrics::instance().histogram("radio_tx_send_seconds", "duration of LMS_SendStream per block")),
+        rx_fifo_fill(Metrics::instance().gauge("radio_rx_fifo_fill_samples", "filled samples of the LMS RX FIFO")),
+        tx_fifo_fill(Metrics::instance().gauge("radio_tx_fifo_fill_samples", "filled samples of the LMS TX FIFO")),
+        rx_samples(Metrics::instance().counter("radio_rx_samples_total", "received samples")),
+        tx_samples(Metrics::instance().counter("radio_tx_samples_total", "transmitted samples")),
+        rx_overrun(Metrics::instance().counter("radio_rx_overrun_total", "LMS RX FIFO overruns")),
+        rx_dropped(Metrics::instance().counter("radio_rx_dropped_packets_total", "LMS RX dropped packets")),
+        tx_underrun(Metrics::instance().counter("radio_tx_underrun_total", "LMS TX FIFO underruns")),
+        tx_dropped(Metrics::instance().counter("radio_tx_dropped_packets_total", "LMS TX dropped packets")) {
+    }
+
+    void update_rx(const lms_stream_status_t& status) {
+        rx_fifo_fill.set(status.fifoFilledCount);
+        rx_overrun.add(status.overrun);
+        rx_dropped.add(status.droppedPackets);
+    }
+
+    void update_tx(const lms_stream_status_t& status) {
+        tx_fifo_fill.set(status.fifoFilledCount);
+        tx_underrun.add(status.underrun);
+        tx_dropped.add(status.droppedPackets);
+    }
+};
@@ -0,0 +1,190 @@
+#include "phy/RadioStreamTuner.h"
+
+#include <algorithm>
+
+#include "util/log.h"
+
+
+RadioStreamConfig RadioStreamConfig::profile(const std::string& name) {
+
+    RadioStreamConfig config;
+
+    if (name == "latency") {
+        // frame sync / CPE: small blocks, small FIFO, USB transfers flushed early
+        config.latency_budget_ms = 3.0;
+        config.min_block_samples = 2 * RADIO_STREAM_BLOCK_ALIGN;
+        config.fifo_size = 1024 * 100;
+        config.throughput_vs_latency = 0.25f;
+        config.min_throughput_vs_latency = 0.0f;
+        config.max_throughput_vs_latency = 0.5f;
+    } else {
+        // spectrum / recorder: large blocks, large FIFO, full USB transfers
+        config.latency_budget_ms = 50.0;
+        config.min_block_samples = 3 * RADIO_STREAM_BLOCK_ALIGN;
+        config.fifo_size = 1024 * 1024;
+        config.throughput_vs_latency = 0.5f;
+        config.min_throughput_vs_latency = 0.5f;
+        config.max_throughput_vs_latency = 1.0f;
+    }
+
+    return config;
+}
+
+
+RadioStreamTuner::RadioStreamTuner() {
+    m_tvl_changed = std::chrono::steady_clock::now();
+}
+
+
+void RadioStreamTuner::configure(const RadioStreamConfig& config, unsigned int default_block, unsigned int block_capacity) {
+
+    m_config = config;
+
+    m_max_block = m_config.max_block_samples > 0 ? m_config.max_block_samples : block_capacity;
+    if (block_capacity > 0 && m_max_block > block_capacity) {
+        LOG_RADIO_WARN("RadioStreamTuner::configure() max block {} above the block capacity {} of the pool", m_max_block, block_capacity);
+        m_max_block = block_capacity;
+    }
+    m_min_block = std::min(std::max(m_config.min_block_samples, 1u), m_max_block);
+
+    // the start value is taken as it is (e.g. the block size of the radio constructor), only the steps are aligned
+    m_block = m_config.block_samples > 0 ? m_config.block_samples : default_block;
+    m_block = std::min(std::max(m_block, m_min_block), m_max_block);
+
+    m_config.min_throughput_vs_latency = std::max(m_config.min_throughput_vs_latency, 0.0f);
+    m_config.max_throughput_vs_latency = std::min(m_config.max_throughput_vs_latency, 1.0f);
+    m_tvl = std::min(std::max(m_config.throughput_vs_latency, m_config.min_throughput_vs_latency), m_config.max_throughput_vs_latency);
+
+    m_shrink_windows = 0;
+    m_grow_windows = 0;
+    m_latency_ms = 0;
+    reset_window();
+    publish();
+
+    LOG_RADIO_INFO("RadioStreamTuner::configure() {} block {} ({} .. {}), fifo {}, throughputVsLatency {} ({} .. {}), budget {} ms",
+                   m_config.adaptive ? "adaptive" : "fixed", m_block, m_min_block, m_max_block, m_config.fifo_size,
+                   m_tvl, m_config.min_throughput_vs_latency, m_config.max_throughput_vs_latency, m_config.latency_budget_ms);
+}
+
+
+void RadioStreamTuner::record(std::chrono::steady_clock::duration recv_time) {
+    m_window_blocks++;
+    m_window_recv_s += std::chrono::duration<double>(recv_time).count();
+}
+
+
+bool RadioStreamTuner::update(const lms_stream_status_t& status) {
+
+    // overrun and droppedPackets are reset by each status call - summed over the window
+    m_window_fifo_max = std::max(m_window_fifo_max, status.fifoFilledCount);
+    m_window_overrun += status.overrun;
+    m_window_dropped += status.droppedPackets;
+
+    if (m_window_blocks < RADIO_STREAM_WINDOW_BLOCKS)
+        return false;
+
+    const double rate = status.sampleRate;
+    if (rate <= 0) {
+        reset_window();
+        return false;
+    }
+
+    const double block_ms = 1e3 * m_block / rate;
+    const double recv_ms = 1e3 * m_window_recv_s / m_window_blocks;
+    m_latency_ms = 1e3 * (m_window_fifo_max + m_block) / rate;
+
+    // a consumer which keeps up waits about a block in the receive call - a backlog returned right away is falling
+    // behind as well as a FIFO near full
+    const bool backlog = m_window_fifo_max > 2 * m_block && recv_ms < 0.5 * block_ms;
+    const bool behind = m_window_overrun > 0 || m_window_dropped > 0 || backlog
+                        || m_window_fifo_max > RADIO_STREAM_FIFO_HIGH * m_config.fifo_size;
+
+    bool restart = false;
+
+    if (m_config.adaptive) {
+        if (behind) {
+            m_shrink_windows = 0;
+            m_grow_windows = 0;
+            if (!set_block(2 * m_block, "falling behind"))
+                restart = step_tvl(RADIO_STREAM_TVL_STEP, "falling behind");
+        } else if (m_latency_ms > m_config.latency_budget_ms) {
+            m_grow_windows = 0;
+            if (++m_shrink_windows >= RADIO_STREAM_ADAPT_WINDOWS) {
+                m_shrink_windows = 0;
+                if (!set_block(m_block / 2, "over budget"))
+                    restart = step_tvl(-RADIO_STREAM_TVL_STEP, "over budget");
+            }
+        } else if (m_latency_ms + block_ms <= RADIO_STREAM_GROW_MARGIN * m_config.latency_budget_ms) {
+            m_shrink_windows = 0;
+            if (++m_grow_windows >= RADIO_STREAM_ADAPT_WINDOWS) {
+                m_grow_windows = 0;
+                set_block(2 * m_block, "headroom");
+            }
+        } else {
+            m_shrink_windows = 0;
+            m_grow_windows = 0;
+        }
+    }
+
+    reset_window();
+    publish();
+
+    return restart;
+}
+
+
+unsigned int RadioStreamTuner::clamp_block(unsigned int n) const {
+    n = std::max(n / RADIO_STREAM_BLOCK_ALIGN, 1u) * RADIO_STREAM_BLOCK_ALIGN;
+    return std::min(std::max(n, m_min_block), m_max_block);
+}
+
+
+bool RadioStreamTuner::set_block(unsigned int n, const char *reason) {
+
+    n = clamp_block(n);
+    if (n == m_block)
+        return false;
+
+    LOG_RADIO_INFO("RadioStreamTuner block {} -> {} samples ({}, latency {:.2f} ms)", m_block, n, reason, m_latency_ms);
+
+    m_block = n;
+    m_metric_adjust.add();
+    return true;
+}
+
+
+bool RadioStreamTuner::step_tvl(float step, const char *reason) {
+
+    const float tvl = std::min(std::max(m_tvl + step, m_config.min_throughput_vs_latency), m_config.max_throughput_vs_latency);
+    if (tvl == m_tvl)
+        return false;
+
+    // each change sets up the RX streams again - not more often than the hold-off
+    const auto now = std::chrono::steady_clock::now();
+    if (now - m_tvl_changed < std::chrono::seconds(RADIO_STREAM_TVL_HOLDOFF_S))
+        return false;
+
+    LOG_RADIO_INFO("RadioStreamTuner throughputVsLatency {} -> {} ({}, latency {:.2f} ms)", m_tvl, tvl, reason, m_latency_ms);
+
+    m_tvl = tvl;
+    m_tvl_changed = now;
+    m_metric_adjust.add();
+    return true;
+}
+
+
+void RadioStreamTuner::reset_window() {
+    m_window_blocks = 0;
+    m_window_recv_s = 0;
+    m_window_fifo_max = 0;
+    m_window_overrun = 0;
+    m_window_dropped = 0;
+}
+
+
+void RadioStreamTuner::publish() {
+    m_metric_block.set(m_block);
+    m_metric_tvl.set((int64_t)(1000 * m_tvl));
+    m_metric_fifo.set(m_config.fifo_size);
+    m_metric_latency.set((int64_t)(1000 * m_latency_ms));
+}
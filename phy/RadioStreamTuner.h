@@ -0,0 +1,139 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#include "lime/LimeSuite.h"
+
+#include "util/Metrics.h"
+
+
+#define RADIO_STREAM_BLOCK_ALIGN        340         // block sizes are steps of a third I16 / a quarter I12 LMS packet (1020 / 1360 samples)
+#define RADIO_STREAM_WINDOW_BLOCKS      64          // blocks per adaptation window (RADIO_METRICS_STATUS_BLOCKS of LimeRadioThread)
+#define RADIO_STREAM_ADAPT_WINDOWS      2           // consecutive windows before a grow / shrink (hysteresis)
+#define RADIO_STREAM_FIFO_HIGH          0.25        // FIFO fill (share of the fifo size) that counts as falling behind
+#define RADIO_STREAM_GROW_MARGIN        0.8         // a larger block has to stay below this share of the budget
+#define RADIO_STREAM_TVL_STEP           0.25f       // throughputVsLatency step of a stream re-setup
+#define RADIO_STREAM_TVL_HOLDOFF_S      10          // min distance of two stream re-setups
+
+
+/**
+ * RadioStreamConfig
+ *
+ * @note block size and LMS stream parameters of a radio (SystemConfig "Stream"); profile() gives the defaults of
+ *       the "latency" (frame sync, CPE) and "throughput" (spectrum, recorder) use, single values override them
+ * @note a block_samples / max_block_samples of 0 takes the block size of the radio constructor / the block
+ *       capacity of its IQBlockPool
+ *
+ */
+struct RadioStreamConfig {
+    bool adaptive = false;                      // adjust block size and throughputVsLatency at runtime
+    double latency_budget_ms = 10.0;            // target of block + FIFO latency
+    unsigned int block_samples = 0;             // start (or fixed) block size
+    unsigned int min_block_samples = RADIO_STREAM_BLOCK_ALIGN;
+    unsigned int max_block_samples = 0;
+    unsigned int fifo_size = 1024 * 1024;       // LMS FIFO size in samples (RX and TX)
+    float throughput_vs_latency = 0.5f;         // RX start value and TX value (0 lowest latency .. 1 max throughput)
+    float min_throughput_vs_latency = 0.0f;
+    float max_throughput_vs_latency = 1.0f;
+
+    /**
+     * @brief defaults of a profile - "latency" or "throughput" (unknown names give the throughput profile)
+     */
+    static RadioStreamConfig profile(const std::string& name);
+};
+
+
+/**
+ * RadioStreamTuner
+ *
+ * @note RX block size and throughputVsLatency of LimeRadio / LimeRadioThread within the bounds of the
+ *       RadioStreamConfig: the duration of the receive calls and the LMS FIFO fill are measured per window of
+ *       RADIO_STREAM_WINDOW_BLOCKS blocks, the latency estimate is (FIFO fill + block) / sample rate
+ * @note falling behind (FIFO above RADIO_STREAM_FIFO_HIGH, overruns, dropped packets) grows the block right away
+ *       (fewer calls per second), beyond the max block throughputVsLatency goes up; over budget shrinks the block,
+ *       below the min block throughputVsLatency goes down; with headroom the block grows as far as the budget allows
+ * @note a new block size applies with the next receive call, a new throughputVsLatency needs a setup of the RX
+ *       streams - update() returns true and the radio re-creates the RX streams (at most every
+ *       RADIO_STREAM_TVL_HOLDOFF_S seconds)
+ * @note without adaptive the values of the configuration are used as they are, the metrics are kept up to date
+ * @note not thread safe - record() and update() are called by the receiving thread
+ *
+ */
+class RadioStreamTuner {
+public:
+
+    RadioStreamTuner();
+
+    /**
+     * @brief (re)start with config
+     *
+     * @param config
+     * @param default_block block size if the config has none (radio constructor)
+     * @param block_capacity samples per block of the IQBlockPool - upper bound of the block size
+     */
+    void configure(const RadioStreamConfig& config, unsigned int default_block, unsigned int block_capacity);
+
+    const RadioStreamConfig& config() const { return m_config; }
+
+    unsigned int blockSamples() const { return m_block; }
+
+    unsigned int maxBlockSamples() const { return m_max_block; }
+
+    float throughputVsLatency() const { return m_tvl; }
+
+    unsigned int fifoSize() const { return m_config.fifo_size; }
+
+    double latencyEstimateMs() const { return m_latency_ms; }
+
+    /**
+     * @brief duration of the receive call(s) of one block
+     */
+    void record(std::chrono::steady_clock::duration recv_time);
+
+    /**
+     * @brief status of the first RX stream - evaluated once per window
+     *
+     * @return true if throughputVsLatency() changed and the RX streams have to be set up again
+     */
+    bool update(const lms_stream_status_t& status);
+
+private:
+
+    // block size n in RADIO_STREAM_BLOCK_ALIGN steps within the bounds
+    unsigned int clamp_block(unsigned int n) const;
+
+    bool set_block(unsigned int n, const char *reason);
+
+    bool step_tvl(float step, const char *reason);
+
+    void reset_window();
+
+    void publish();
+
+    RadioStreamConfig m_config;
+    unsigned int m_block = 0;
+    unsigned int m_min_block = 0;
+    unsigned int m_max_block = 0;
+    float m_tvl = 0;
+
+    // window of RADIO_STREAM_WINDOW_BLOCKS blocks
+    uint32_t m_window_blocks = 0;
+    double m_window_recv_s = 0;
+    uint32_t m_window_fifo_max = 0;
+    uint32_t m_window_overrun = 0;
+    uint32_t m_window_dropped = 0;
+
+    int m_shrink_windows = 0;
+    int m_grow_windows = 0;
+    double m_latency_ms = 0;
+    std::chrono::steady_clock::time_point m_tvl_changed;
+
+    MetricGauge& m_metric_block = Metrics::instance().gauge("radio_rx_block_samples", "RX block size in samples");
+    MetricGauge& m_metric_tvl = Metrics::instance().gauge("radio_rx_throughput_vs_latency_permille", "LMS RX throughputVsLatency x 1000");
+    MetricGauge& m_metric_fifo = Metrics::instance().gauge("radio_stream_fifo_size_samples", "LMS FIFO size in samples");
+    MetricGauge& m_metric_latency = Metrics::instance().gauge("radio_rx_latency_estimate_us", "RX block + FIFO latency estimate");
+    MetricCounter& m_metric_adjust = Metrics::instance().counter("radio_stream_adjustments_total", "block size and throughputVsLatency changes of the stream tuner");
+
+};
@@ -0,0 +1,134 @@
+#include "phy/RadioTRSwitch.h"
+
+
+RadioTRSwitch::RadioTRSwitch(SwitchFunction function, double sample_rate, uint64_t guard_samples)
+        : m_switch(std::move(function)), m_sample_rate(sample_rate), m_guard(guard_samples) {
+
+    LOG_RADIO_DEBUG("RadioTRSwitch::RadioTRSwitch() guard {} samples @ {} Sps", m_guard, m_sample_rate);
+
+    m_thread = std::thread(&RadioTRSwitch::worker, this);
+}
+
+
+RadioTRSwitch::~RadioTRSwitch() {
+
+    stop();
+}
+
+
+void RadioTRSwitch::anchor(uint64_t ts, std::chrono::steady_clock::time_point t) {
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_anchor_ts = ts;
+        m_anchor_time = t;
+        m_anchored = true;
+    }
+    m_cv.notify_one();
+}
+
+
+void RadioTRSwitch::schedule_tx(uint64_t ts, uint64_t samples) {
+
+    if (samples == 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_bursts.empty() && ts <= m_bursts.back().second + 2 * m_guard)
+            m_bursts.back().second = std::max(m_bursts.back().second, ts + samples);
+        else
+            m_bursts.emplace_back(ts, ts + samples);
+    }
+    m_cv.notify_one();
+}
+
+
+void RadioTRSwitch::stop() {
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping)
+            return;
+        m_stopping = true;
+    }
+    m_cv.notify_one();
+
+    if (m_thread.joinable())
+        m_thread.join();
+
+    if (m_tx.load()) {
+        m_switch(false);
+        m_tx.store(false);
+    }
+}
+
+
+std::chrono::steady_clock::time_point RadioTRSwitch::time_of(uint64_t ts) const {
+
+    const double dt = ((double) ts - (double) m_anchor_ts) / m_sample_rate;
+    return m_anchor_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(dt));
+}
+
+
+void RadioTRSwitch::worker() {
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    // every wakeup (new burst, new anchor, deadline) re-evaluates the next switch
+    while (!m_stopping) {
+
+        if (m_bursts.empty() || !m_anchored) {
+            m_cv.wait(lock);
+            continue;
+        }
+
+        auto& burst = m_bursts.front();
+        const auto now = std::chrono::steady_clock::now();
+
+        if (!m_tx.load()) {
+            // burst is already over - nothing left to switch for
+            if (now >= time_of(burst.second)) {
+                m_metric_missed.add();
+                LOG_RADIO_WARN("RadioTRSwitch::worker() TX burst {} - {} over before the frontend was switched", burst.first, burst.second);
+                m_bursts.pop_front();
+                continue;
+            }
+
+            const auto deadline = time_of(burst.first > m_guard ? burst.first - m_guard : 0);
+            if (now < deadline) {
+                m_cv.wait_until(lock, deadline);
+                continue;
+            }
+
+            m_metric_lateness.record(now - deadline);
+            lock.unlock();
+            m_switch(true);
+            lock.lock();
+            m_tx.store(true);
+            m_metric_switches.add();
+            continue;
+        }
+
+        // bursts scheduled meanwhile which follow without a gap keep the frontend in TX
+        if (m_bursts.size() > 1 && m_bursts[1].first <= burst.second + 2 * m_guard) {
+            burst.second = std::max(burst.second, m_bursts[1].second);
+            m_bursts.erase(m_bursts.begin() + 1);
+            continue;
+        }
+
+        const auto deadline = time_of(burst.second + m_guard);
+        if (now < deadline) {
+            m_cv.wait_until(lock, deadline);
+            continue;
+        }
+
+        m_bursts.pop_front();
+        m_metric_lateness.record(now - deadline);
+        lock.unlock();
+        m_switch(false);
+        lock.lock();
+        m_tx.store(false);
+        m_metric_switches.add();
+    }
+}
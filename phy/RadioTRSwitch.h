@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "util/log.h"
+#include "util/Metrics.h"
+
+
+// the frontend is switched to TX this many samples before a burst and back to RX after it (~110us @ 2.285 MSps);
+// covers the GPIO write over USB and the settling of the RF switch and the PA
+#define RADIO_TRSWITCH_GUARD_SAMPLES    256
+
+
+/**
+ * RadioTRSwitch class
+ *
+ * @note switches the RF frontend (GPIO RX/TX, PA) along the TX timeline while the RX and TX streams keep running:
+ *       the TX side registers each burst with its hardware timestamp (schedule_tx()), the switch thread sleeps on
+ *       the extrapolated sample clock and calls the switch function guard samples ahead of the burst and guard
+ *       samples after it
+ * @note bursts which are less than two guards apart are merged - continuous TX does not toggle the frontend
+ * @note the sample clock is anchored by the owner of the timeline (PhyTxScheduler, or the RX stream of
+ *       LimeRadioThread) - no switching happens before the first anchor()
+ * @note the switch function is called without a lock held from the switch thread only
+ *
+ */
+class RadioTRSwitch {
+public:
+
+    /**
+     * @brief switch the frontend - true for TX, false for RX
+     */
+    typedef std::function<void(bool tx)> SwitchFunction;
+
+    RadioTRSwitch(SwitchFunction function, double sample_rate, uint64_t guard_samples = RADIO_TRSWITCH_GUARD_SAMPLES);
+
+    ~RadioTRSwitch();
+
+    RadioTRSwitch(const RadioTRSwitch&) = delete;
+
+    RadioTRSwitch& operator=(const RadioTRSwitch&) = delete;
+
+    /**
+     * @brief the sample clock was at ts at time t
+     */
+    void anchor(uint64_t ts, std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now());
+
+    /**
+     * @brief a burst of samples samples goes to the air at hardware timestamp ts
+     */
+    void schedule_tx(uint64_t ts, uint64_t samples);
+
+    /**
+     * @brief stop the switch thread - the frontend is switched back to RX if it is in TX
+     */
+    void stop();
+
+    bool isTx() const { return m_tx.load(); }
+
+private:
+
+    void worker();
+
+    std::chrono::steady_clock::time_point time_of(uint64_t ts) const;
+
+    SwitchFunction m_switch;
+    const double m_sample_rate;
+    const uint64_t m_guard;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+
+    std::deque<std::pair<uint64_t, uint64_t>> m_bursts;     // [start, end) in samples, ordered
+
+    uint64_t m_anchor_ts = 0;
+    std::chrono::steady_clock::time_point m_anchor_time;
+    bool m_anchored = false;
+
+    bool m_stopping = false;
+    std::atomic_bool m_tx{false};
+
+    std::thread m_thread;
+
+    MetricCounter& m_metric_switches = Metrics::instance().counter("radio_trswitch_switches_total", "RX/TX switches of the RF frontend");
+    MetricCounter& m_metric_missed = Metrics::instance().counter("radio_trswitch_missed_bursts_total", "TX bursts which were over before the frontend could be switched");
+    MetricHistogram& m_metric_lateness = Metrics::instance().histogram("radio_trswitch_lateness_seconds", "delay of the frontend switch behind its deadline");
+
+};
@@ -122,6 +122,40 @@ void RadioThread::setSamplingRate(float_t sampling_rate, size_t oversampling)
     // defined in radio specific class (e.g. LimeRadioThread)
 }
 
+void RadioThread::setStreamFormat(IQStreamFormat format)
+{
+    // defined in radio specific class (e.g. LimeRadioThread)
+}
+
+bool RadioThread::tryFrequency(float_t frequency)
+{
+    // no calibration by default - a plain retune
+    setFrequency(frequency);
+    return true;
+}
+
+void RadioThread::precalibrate(const std::vector<double>& frequencies)
+{
+    // defined in radio specific class (e.g. LimeRadioThread)
+}
+
+void RadioThread::setCalibrationCache(const std::string& file)
+{
+    // defined in radio specific class (e.g. LimeRadioThread)
+}
+
+void RadioThread::setStreamConfig(const RadioStreamConfig& config)
+{
+    // defined in radio specific class (e.g. LimeRadioThread)
+}
+
+void RadioThread::setRXChannels(size_t channels)
+{
+    // defined in radio specific class (e.g. LimeRadioThread) - a radio with one RX path stays with one channel
+    if (channels != 1)
+        LOG_RADIO_ERROR("setRXChannels() {} RX channels are not supported by this radio", channels);
+}
+
 // void RadioThread::getIQData()
 // {
 //     // defined in radio specific class (e.g. LimeRadioThread)
@@ -152,14 +186,32 @@ void RadioThread::setRXQueue(const ThreadIQDataQueueBasePtr &threadQueue)
 {
     std::lock_guard<std::mutex> lock(m_queue_bindings_mutex);
     LOG_RADIO_DEBUG("setRXQueue()");
-    m_rx_queue = threadQueue;
+    m_rx_queue[0] = threadQueue;
 }
 
 ThreadIQDataQueueBasePtr RadioThread::getRXQueue()
 {
     std::lock_guard<std::mutex> lock(m_queue_bindings_mutex);
-    LOG_RADIO_DEBUG("getRXQueue() ");
-    return m_rx_queue;
+    // LOG_RADIO_DEBUG("getRXQueue() ");
+    return m_rx_queue[0];
+}
+
+void RadioThread::setRXQueue(size_t channel, const ThreadIQDataQueueBasePtr &threadQueue)
+{
+    std::lock_guard<std::mutex> lock(m_queue_bindings_mutex);
+    LOG_RADIO_DEBUG("setRXQueue() channel {}", channel);
+    if (channel >= RADIO_MAX_RX_CHANNELS)
+    {
+        LOG_RADIO_ERROR("setRXQueue() no RX channel {}", channel);
+        return;
+    }
+    m_rx_queue[channel] = threadQueue;
+}
+
+ThreadIQDataQueueBasePtr RadioThread::getRXQueue(size_t channel)
+{
+    std::lock_guard<std::mutex> lock(m_queue_bindings_mutex);
+    return channel < RADIO_MAX_RX_CHANNELS ? m_rx_queue[channel] : nullptr;
 }
 
 void RadioThread::setTXQueue(const ThreadIQDataQueueBasePtr &threadQueue)
@@ -172,6 +224,28 @@ void RadioThread::setTXQueue(const ThreadIQDataQueueBasePtr &threadQueue)
 ThreadIQDataQueueBasePtr RadioThread::getTXQueue()
 {
     std::lock_guard<std::mutex> lock(m_queue_bindings_mutex);
-    LOG_RADIO_DEBUG("getTXQueue() ");
+    // LOG_RADIO_DEBUG("getTXQueue() ");
     return m_tx_queue;
 }
+
+void RadioThread::setBlockPool(const IQBlockPoolPtr &pool)
+{
+    std::lock_guard<std::mutex> lock(m_queue_bindings_mutex);
+    LOG_RADIO_DEBUG("setBlockPool() blocks {} capacity {}", pool->num_blocks(), pool->block_capacity());
+    m_block_pool = pool;
+}
+
+IQBlockPoolPtr RadioThread::getBlockPool()
+{
+    std::lock_guard<std::mutex> lock(m_queue_bindings_mutex);
+    // default pool on first use - most radios get their pool via setBlockPool() before the thread is started
+    if (m_block_pool == nullptr)
+        m_block_pool = IQBlockPool::create(DEFAULT_IQBLOCKPOOL_BLOCKS, m_sampleBufferCnt);
+    return m_block_pool;
+}
+
+size_t RadioThread::blockCapacity()
+{
+    std::lock_guard<std::mutex> lock(m_queue_bindings_mutex);
+    return m_block_pool != nullptr ? m_block_pool->block_capacity() : (size_t)m_sampleBufferCnt;
+}
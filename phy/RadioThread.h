@@ -13,10 +13,19 @@
 #include <vector>
 #include <deque>
 #include <complex>
+#include <chrono>
+#include <cstdint>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include "lime/LimeSuite.h"
 #include "liquid/liquid.h"
 #include "phy/DefaultRadioConfig.h"
+#include "phy/IQBlock.h"
+#include "phy/IQConvert.h"
+#include "phy/RadioStreamTuner.h"
 
 #include "util/log.h"
 
@@ -54,35 +63,212 @@ struct map_string_less
 };
 
 /**
- * RadioThreadIQData class
+ * RadioThreadIQData
  *
- * @note one block of received IQ data with timestamp of first sample of block; data is stored in liquid_float_complex
+ * @note one block of received IQ data with timestamp of first sample of block; data is stored contiguous in
+ *       liquid_float_complex (see IQBlock) - blocks are taken from an IQBlockPool
  *
  */
-class RadioThreadIQData {
+typedef IQBlock RadioThreadIQData;
+
+typedef IQBlockPtr RadioThreadIQDataPtr;
+
+
+
+#define IQQUEUE_WAIT_FOREVER        -1          // wait_pop() / pop_n() timeout: until an item or wakeup()
+#define IQQUEUE_FALLBACK_IDLE_US    200         // poll interval of the waits without eventfd
+
+
+/**
+ * ThreadIQDataQueueBase class
+ *
+ * @note common interface of the IQ sample block queues which connect the radio thread with its consumers
+ * @note push() is done by the producer (e.g. LimeRadioThread::run()), pop() by one consumer; a push on a full
+ *       queue drops the block and is counted in overflow_count()
+ * @note wait_pop() / pop_n() sleep on an eventfd instead of polling - the producer only signals the eventfd while
+ *       the consumer waits (or the fd is used by an event loop, see event_fd()), i.e. a push costs a fence and a
+ *       load otherwise
+ *
+ */
+class ThreadIQDataQueueBase {
 public:
-    long long frequency;
-    long long sampleRate;
 
-    uint64_t timestampFirstSample;
+    typedef RadioThreadIQDataPtr value_type;
+    typedef size_t size_type;
 
-    std::deque<liquid_float_complex> data;   //std::complex<float>
+    ThreadIQDataQueueBase() {
+        m_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_event_fd < 0)
+            LOG_RADIO_WARN("ThreadIQDataQueueBase() no eventfd ({}) - waiting consumers poll", errno);
+    }
 
-    RadioThreadIQData() :
-            frequency(DEFAULT_CENTER_FREQ), sampleRate(DEFAULT_SAMPLE_RATE), timestampFirstSample(0) {
+    ThreadIQDataQueueBase(const ThreadIQDataQueueBase&) = delete;
 
-//        LOG_RADIO_DEBUG("RadioThreadIQData() constructor");
+    ThreadIQDataQueueBase& operator=(const ThreadIQDataQueueBase&) = delete;
 
+    virtual ~ThreadIQDataQueueBase() {
+        if (m_event_fd >= 0)
+            close(m_event_fd);
     }
 
-    virtual ~RadioThreadIQData() = default;
-};
+    virtual void set_max_items(unsigned int max_items) = 0;
 
-typedef std::shared_ptr<RadioThreadIQData> RadioThreadIQDataPtr;
+    virtual bool push(const value_type& item) = 0;
 
+    virtual bool pop(value_type& item) = 0;
 
+    virtual void flush() = 0;
+
+    virtual size_type size() const = 0;
+
+    virtual void print_size() = 0;
+
+    /**
+     * @brief number of blocks which were dropped because the queue was full
+     *
+     * @return uint64_t
+     */
+    uint64_t overflow_count() const { return m_overflow_count.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief pop() which sleeps until an item is pushed - consumer side only, like pop()
+     *
+     * @param item
+     * @param timeout_ms max wait in ms; IQQUEUE_WAIT_FOREVER until an item or wakeup()
+     * @return false on timeout or wakeup()
+     */
+    bool wait_pop(value_type& item, int timeout_ms) {
+
+        if (pop(item))
+            return true;
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms < 0 ? 0 : timeout_ms);
+        while (wait_for_push(deadline, timeout_ms < 0)) {
+            if (pop(item))
+                return true;
+        }
+
+        return pop(item);
+    }
+
+    /**
+     * @brief batch pop - appends up to max_items to items, waits up to timeout_ms for the first one (0: no wait)
+     *
+     * @param items
+     * @param max_items
+     * @param timeout_ms see wait_pop()
+     * @return number of items appended
+     */
+    size_t pop_n(std::vector<value_type>& items, size_t max_items, int timeout_ms = 0) {
+
+        if (max_items == 0)
+            return 0;
+
+        value_type item;
+        if (!(timeout_ms == 0 ? pop(item) : wait_pop(item, timeout_ms)))
+            return 0;
+
+        size_t n = 0;
+        do {
+            items.push_back(std::move(item));
+            n++;
+        } while (n < max_items && pop(item));
+
+        return n;
+    }
+
+    /**
+     * @brief ends the current (or next) wait of the consumer, e.g. on terminate()
+     */
+    void wakeup() {
+        m_wakeup.store(true);
+        signal();
+    }
+
+    /**
+     * @brief eventfd which becomes readable after a push, for consumers in an event loop (e.g. lws_sock_file_fd_type
+     *        with a foreign fd, poll()) - from the first call on each push signals the fd; the consumer calls
+     *        clear_event() before it drains the queue with pop() / pop_n()
+     *
+     * @return int fd, -1 without eventfd
+     */
+    int event_fd() {
+        m_event_exported.store(true);
+        return m_event_fd;
+    }
+
+    void clear_event() {
+        uint64_t value;
+        if (m_event_fd >= 0 && read(m_event_fd, &value, sizeof(value)) < 0) {
+            // EAGAIN - nothing pushed since the last clear
+        }
+    }
+
+protected:
+
+    /**
+     * @brief to be called by the producer after an item was pushed
+     */
+    void notify() {
+        // pairs with the fence in wait_for_push(): either the consumer sees the item or the producer sees the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiting.load(std::memory_order_relaxed) || m_event_exported.load(std::memory_order_relaxed))
+            signal();
+    }
+
+    std::atomic<uint64_t> m_overflow_count{0};
+
+private:
+
+    void signal() {
+        const uint64_t one = 1;
+        if (m_event_fd >= 0 && write(m_event_fd, &one, sizeof(one)) < 0) {
+            // EAGAIN - counter saturated, the consumer is woken anyway
+        }
+    }
+
+    // false on timeout or wakeup() - true does not guarantee an item (the caller pops and waits again)
+    bool wait_for_push(std::chrono::steady_clock::time_point deadline, bool forever) {
+
+        m_waiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        bool woken = true;
+        if (size() == 0) {
+            if (m_wakeup.exchange(false)) {
+                woken = false;
+            } else {
+                int timeout_ms = -1;
+                if (!forever) {
+                    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                    timeout_ms = (int)std::max<int64_t>(remaining.count(), 0);
+                }
+
+                if (timeout_ms == 0) {
+                    woken = false;
+                } else if (m_event_fd >= 0) {
+                    struct pollfd pfd = { m_event_fd, POLLIN, 0 };
+                    if (poll(&pfd, 1, timeout_ms) > 0)
+                        clear_event();
+                } else {
+                    usleep(IQQUEUE_FALLBACK_IDLE_US);
+                }
+
+                if (m_wakeup.exchange(false))
+                    woken = false;
+            }
+        }
+
+        m_waiting.store(false, std::memory_order_relaxed);
+
+        return woken;
+    }
+
+    int m_event_fd = -1;
+    std::atomic_bool m_waiting{false};
+    std::atomic_bool m_wakeup{false};
+    std::atomic_bool m_event_exported{false};
 
-class ThreadIQDataQueueBase {
 };
 
 typedef std::shared_ptr<ThreadIQDataQueueBase> ThreadIQDataQueueBasePtr;
@@ -90,22 +276,20 @@ typedef std::shared_ptr<ThreadIQDataQueueBase> ThreadIQDataQueueBasePtr;
 /**
  * RadioThreadIQDataQueue class
  *
- * @note for storing IQ sample blocks - currently more a quick hack to get IQ data to verify it
+ * @note for storing IQ sample blocks - std::deque guarded by a SpinMutex; can be used by several producers and
+ *       consumers and is kept as fallback for the RadioThreadIQDataRingQueue
  *
  */
 class RadioThreadIQDataQueue : public ThreadIQDataQueueBase {
 public:
 
-    typedef typename std::deque<RadioThreadIQDataPtr>::value_type value_type;
-    typedef typename std::deque<RadioThreadIQDataPtr>::size_type size_type;
-
     RadioThreadIQDataQueue() {
         // constructor
         LOG_RADIO_DEBUG("RadioThreadIQDataQueue() constructor");
 
     }
 
-    void set_max_items(unsigned int max_items) {
+    void set_max_items(unsigned int max_items) override {
         std::lock_guard < SpinMutex > lock(m_mutex);
 
         LOG_RADIO_DEBUG("set_max_items() {}", max_items);
@@ -115,21 +299,24 @@ public:
         }
     }
 
-    bool push(const value_type& item) {
+    bool push(const value_type& item) override {
         std::unique_lock < SpinMutex > lock(m_mutex);
 
         //LOG_RADIO_DEBUG("push() size queue {} - max {}", iq_queue.size(), m_max_items);
 
         if(m_iq_queue.size() >= m_max_items) {
+            m_overflow_count.fetch_add(1, std::memory_order_relaxed);
             return false;
-            LOG_RADIO_ERROR("push() queue full");
         }
 
         m_iq_queue.push_back(item);
+        lock.unlock();
+
+        notify();
         return true;
     }
 
-    bool pop(value_type& item) {
+    bool pop(value_type& item) override {
         std::unique_lock < SpinMutex > lock(m_mutex);
 
         if(m_iq_queue.size() > 0)  {
@@ -141,17 +328,17 @@ public:
         return false;
     }
 
-    void flush() {
+    void flush() override {
         std::lock_guard < SpinMutex > lock(m_mutex);
         m_iq_queue.clear();
     }
 
-    size_type size() const {
+    size_type size() const override {
         std::lock_guard < SpinMutex > lock(m_mutex);
         return m_iq_queue.size();
     }
 
-    void print_size() {
+    void print_size() override {
         LOG_RADIO_DEBUG("RadioThreadIQDataQueue() size queue {}", m_iq_queue.size());
     }
 
@@ -172,6 +359,160 @@ private:
 typedef std::shared_ptr<RadioThreadIQDataQueue> RadioThreadIQDataQueuePtr;
 
 
+#define IQQUEUE_CACHE_LINE_SIZE 64
+
+/**
+ * RadioThreadIQDataRingQueue class
+ *
+ * @note bounded wait-free single producer / single consumer ring for IQ sample blocks; the ring is preallocated
+ *       in set_max_items() which must be called before the producer and consumer threads are started
+ * @note head (consumer) and tail (producer) are kept on separate cache lines; each side caches the index of the
+ *       other side so that the shared line is only read when the ring looks full / empty
+ * @note flush() does pop() and therefore must only be called from the consumer thread (or once the consumer is joined)
+ *
+ */
+class RadioThreadIQDataRingQueue : public ThreadIQDataQueueBase {
+public:
+
+    RadioThreadIQDataRingQueue() {
+        LOG_RADIO_DEBUG("RadioThreadIQDataRingQueue() constructor");
+        m_ring.resize(m_max_items + 1);
+    }
+
+    void set_max_items(unsigned int max_items) override {
+
+        LOG_RADIO_DEBUG("RadioThreadIQDataRingQueue::set_max_items() {}", max_items);
+
+        if (max_items > m_max_items) {
+            m_max_items = max_items;
+
+            // one slot is kept free to distinguish between full and empty
+            m_ring.clear();
+            m_ring.resize(m_max_items + 1);
+
+            m_head.store(0, std::memory_order_relaxed);
+            m_tail.store(0, std::memory_order_relaxed);
+            m_head_cached = 0;
+            m_tail_cached = 0;
+        }
+    }
+
+    bool push(const value_type& item) override {
+
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t next = increment(tail);
+
+        if (next == m_head_cached) {
+            m_head_cached = m_head.load(std::memory_order_acquire);
+            if (next == m_head_cached) {
+                m_overflow_count.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+
+        m_ring[tail] = item;
+        m_tail.store(next, std::memory_order_release);
+
+        notify();
+        return true;
+    }
+
+    bool pop(value_type& item) override {
+
+        const size_t head = m_head.load(std::memory_order_relaxed);
+
+        if (head == m_tail_cached) {
+            m_tail_cached = m_tail.load(std::memory_order_acquire);
+            if (head == m_tail_cached) {
+                return false;
+            }
+        }
+
+        // move out so that the ring does not keep a reference to the block
+        item = std::move(m_ring[head]);
+        m_ring[head].reset();
+
+        m_head.store(increment(head), std::memory_order_release);
+
+        return true;
+    }
+
+    void flush() override {
+        value_type item;
+        while (pop(item)) {
+            item.reset();
+        }
+    }
+
+    size_type size() const override {
+        const size_t head = m_head.load(std::memory_order_acquire);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+
+        return (tail >= head) ? (tail - head) : (tail + m_ring.size() - head);
+    }
+
+    void print_size() override {
+        LOG_RADIO_DEBUG("RadioThreadIQDataRingQueue() size queue {} overflow {}", size(), overflow_count());
+    }
+
+    ~RadioThreadIQDataRingQueue() {
+        LOG_RADIO_DEBUG("RadioThreadIQDataRingQueue() de-constructor");
+    }
+
+private:
+
+    size_t increment(size_t idx) const {
+        return (idx + 1 == m_ring.size()) ? 0 : idx + 1;
+    }
+
+    std::vector<RadioThreadIQDataPtr> m_ring;
+
+    size_t m_max_items = 1; // default value for max items
+
+    // consumer side
+    alignas(IQQUEUE_CACHE_LINE_SIZE) std::atomic<size_t> m_head{0};
+    size_t m_tail_cached = 0;
+
+    // producer side
+    alignas(IQQUEUE_CACHE_LINE_SIZE) std::atomic<size_t> m_tail{0};
+    size_t m_head_cached = 0;
+
+    // keep anything else off the producer cache line
+    alignas(IQQUEUE_CACHE_LINE_SIZE) char m_padding[IQQUEUE_CACHE_LINE_SIZE] = {};
+
+};
+
+typedef std::shared_ptr<RadioThreadIQDataRingQueue> RadioThreadIQDataRingQueuePtr;
+
+
+/**
+ * @brief creates the IQ data queue selected by type
+ *
+ * @param type "ring" for the lock-free SPSC RadioThreadIQDataRingQueue (default), "spinlock" for the
+ *             RadioThreadIQDataQueue fallback
+ * @param max_items max number of IQ sample blocks the queue can hold
+ * @return ThreadIQDataQueueBasePtr
+ */
+inline ThreadIQDataQueueBasePtr createRadioThreadIQDataQueue(const std::string& type, unsigned int max_items) {
+
+    ThreadIQDataQueueBasePtr queue;
+
+    if (type == "spinlock") {
+        queue = std::make_shared<RadioThreadIQDataQueue>();
+    } else {
+        if (type != "ring") {
+            LOG_RADIO_WARN("createRadioThreadIQDataQueue() unknown queue type {} - using ring", type);
+        }
+        queue = std::make_shared<RadioThreadIQDataRingQueue>();
+    }
+
+    queue->set_max_items(max_items);
+
+    return queue;
+}
+
+
+
 class RadioThread {
 public:
     RadioThread();
@@ -198,9 +539,34 @@ public:
     void setRXQueue(const ThreadIQDataQueueBasePtr& threadQueue);
     ThreadIQDataQueueBasePtr getRXQueue();
 
+    /**
+     * @brief queue of the blocks of one RX channel (see setRXChannels()); channel 0 is the queue of setRXQueue(),
+     *        without queue the blocks of a channel are dropped
+     *
+     * @note has to be set before the thread is started
+     *
+     * @param channel RX channel 0 .. RADIO_MAX_RX_CHANNELS - 1
+     * @param threadQueue
+     */
+    void setRXQueue(size_t channel, const ThreadIQDataQueueBasePtr& threadQueue);
+    ThreadIQDataQueueBasePtr getRXQueue(size_t channel);
+
     void setTXQueue(const ThreadIQDataQueueBasePtr& threadQueue);
     ThreadIQDataQueueBasePtr getTXQueue();
 
+    /**
+     * @brief set the pool the RX blocks are taken from; has to be called before the thread is started
+     *
+     * @param pool IQBlockPoolPtr
+     */
+    void setBlockPool(const IQBlockPoolPtr& pool);
+
+    /**
+     * @brief pool of the RX blocks - without setBlockPool() a pool of DEFAULT_IQBLOCKPOOL_BLOCKS blocks of
+     *        m_sampleBufferCnt samples is created on the first call
+     */
+    IQBlockPoolPtr getBlockPool();
+
     // SDR Radio stuff as virutal functions which are then defined in the specifc radio class
 
     /**
@@ -213,6 +579,14 @@ public:
         return m_isRxTxRunning.load();
     }
 
+    /**
+     * @brief state of the RF frontend (GPIO RX/TX switch) - RX and TX streaming run at the same time regardless,
+     *        the frontend is switched by set_HW_RX() / set_HW_TX() along the TX timestamps
+     */
+    bool isRxOn() {
+        return m_isRX.load();
+    }
+
     void setRxOn() {
         m_isRX.store(true); // true = RX
     }
@@ -231,6 +605,24 @@ public:
      */
     virtual void setFrequency(float_t frequency);
 
+    /**
+     * @brief retune only if it needs no calibration (see Radio::tryFrequency()) - e.g. the retunes of a sensing
+     *        quiet period
+     *
+     * @param frequency RF center frequency in Hz
+     *
+     * @return false if the setting would need a calibration - the radio stays at the current frequency
+     */
+    virtual bool tryFrequency(float_t frequency);
+
+    /**
+     * @brief calibrate the settings at frequencies which are not cached yet and return to the current frequency (see
+     *        Radio::precalibrate())
+     *
+     * @param frequencies RF center frequencies in Hz
+     */
+    virtual void precalibrate(const std::vector<double>& frequencies);
+
     /**
      * @brief Set the Sampling_Rate and Oversampling
      *
@@ -239,6 +631,42 @@ public:
      */
     virtual void setSamplingRate(float_t sampling_rate, size_t oversampling);
 
+    /**
+     * @brief Set the host side sample format of the LMS stream (F32, I16, I12); streams are restarted
+     *
+     * @param format IQStreamFormat
+     */
+    virtual void setStreamFormat(IQStreamFormat format);
+
+    IQStreamFormat getStreamFormat() { return m_streamFormat; }
+
+    /**
+     * @brief number of RX channels streamed at once (1 .. RADIO_MAX_RX_CHANNELS); the blocks of the channels are
+     *        aligned on the timestamps and pushed to the queue of each channel - streams are restarted
+     *
+     * @param channels
+     */
+    virtual void setRXChannels(size_t channels);
+
+    size_t getRXChannels() { return m_rxChannels; }
+
+    /**
+     * @brief keep the LO and calibration settings per (frequency, sample rate, gains) in file - a retune to a cached
+     *        setting restores it instead of calibrating, a new setting is calibrated once and added to the cache
+     *
+     * @param file calibration cache (JSON)
+     */
+    virtual void setCalibrationCache(const std::string& file);
+
+    /**
+     * @brief block size and LMS stream parameters (FIFO size, throughputVsLatency), fixed or adapted to the latency
+     *        budget at runtime (see RadioStreamTuner); the block size is bounded by the IQBlockPool - set the pool
+     *        first; streams are restarted
+     *
+     * @param config RadioStreamConfig
+     */
+    virtual void setStreamConfig(const RadioStreamConfig& config);
+
     // done via queues now
     // virtual void getIQData();
     // virtual void setIQData();
@@ -265,6 +693,15 @@ public:
      */
     virtual void set_HW_TX(uint8_t m);
 
+    /**
+     * @brief TX mode (band filter) the frontend is switched to for a TX burst
+     *
+     * @param m mode based on RadioThread::TxMode enum
+     */
+    void set_HW_TX_mode(TxMode m) { m_TxMode = m; }
+
+    TxMode get_HW_TX_mode() { return m_TxMode; }
+
     /**
     * @brief set HW GPIO for LED SDR_ON
     *
@@ -282,22 +719,31 @@ public:
 
 protected:
     ThreadIQDataQueueBasePtr m_tx_queue;
-    ThreadIQDataQueueBasePtr m_rx_queue;
+    ThreadIQDataQueueBasePtr m_rx_queue[RADIO_MAX_RX_CHANNELS];
 
     std::mutex m_queue_bindings_mutex;
 
+    IQBlockPoolPtr m_block_pool;    // created by getBlockPool() if not set
+
+    // samples per block of the pool (m_sampleBufferCnt for the default pool) - does not create the pool
+    size_t blockCapacity();
+
     std::atomic_bool stopping;
 
     std::atomic_bool m_isRxTxRunning;
 
     /**
-     * @brief m_isRX is true when the RadioThread is in RX mode; if false the thread is running in TX
+     * @brief m_isRX is true when the RF frontend is switched to RX; if false it is in TX (streams are not affected)
      *
      */
     std::atomic_bool m_isRX;
 
     int m_sampleBufferCnt;
 
+    IQStreamFormat m_streamFormat = IQStreamFormat::F32;
+
+    size_t m_rxChannels = 1;
+
 private:
     //true when the thread has really ended, i.e run() from threadMain() has returned.
     std::atomic_bool terminated;
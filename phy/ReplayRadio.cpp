@@ -0,0 +1,303 @@
+#include "phy/ReplayRadio.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+
+#include <nlohmann/json.hpp>
+
+
+static bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+
+ReplayRadio::ReplayRadio(const std::string& filename, int sampleBufferCnt)
+    : Radio(sampleBufferCnt) {
+
+    LOG_RADIO_TRACE("ReplayRadio() constructor {}", filename);
+
+    std::memset(&m_rx_status, 0, sizeof(m_rx_status));
+
+    m_view_pool = IQBlockPool::create(REPLAY_VIEW_BLOCKS, 0);
+
+    bool ok;
+    if (ends_with(filename, ".sigmf-meta")) {
+        ok = open_sigmf(filename, filename.substr(0, filename.size() - 5) + "-data");
+    } else if (ends_with(filename, ".sigmf-data")) {
+        ok = open_sigmf(filename.substr(0, filename.size() - 5) + "-meta", filename);
+    } else if (ends_with(filename, ".txt") || ends_with(filename, ".csv")) {
+        ok = open_text(filename);
+    } else {
+        // raw cf32 without metadata
+        ok = map_file(filename);
+        if (ok) {
+            m_cf32 = static_cast<const liquid_float_complex *>(m_map);
+            m_num_samples = m_map_size / sizeof(liquid_float_complex);
+            m_captures.push_back({0, 0});
+        }
+    }
+
+    if (!ok || m_num_samples == 0) {
+        LOG_RADIO_ERROR("ReplayRadio() no samples in {}", filename);
+        m_num_samples = 0;
+        m_eof = true;
+        return;
+    }
+
+    m_timestamp = m_captures.front().timestamp;
+
+    LOG_RADIO_INFO("ReplayRadio() {} samples in {} capture segments from {} ({})", m_num_samples, m_captures.size(),
+                   filename, m_format == CI16 ? "ci16_le" : "cf32_le");
+}
+
+
+ReplayRadio::~ReplayRadio() {
+
+    LOG_RADIO_TRACE("ReplayRadio destructor");
+
+    // blocks still referenced by consumers point into the mapping - PhyThread deletes the radio after its threads
+    unmap_file();
+}
+
+
+bool ReplayRadio::map_file(const std::string& filename) {
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        LOG_RADIO_ERROR("ReplayRadio::map_file() cannot open {}: {}", filename, std::strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // private writable mapping - a consumer writing into a view only touches its copy-on-write page
+    m_map_size = st.st_size;
+    m_map = mmap(nullptr, m_map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (m_map == MAP_FAILED) {
+        LOG_RADIO_ERROR("ReplayRadio::map_file() mmap of {} failed: {}", filename, std::strerror(errno));
+        m_map = nullptr;
+        m_map_size = 0;
+        return false;
+    }
+
+    madvise(m_map, m_map_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+    return true;
+}
+
+
+void ReplayRadio::unmap_file() {
+    if (m_map != nullptr)
+        munmap(m_map, m_map_size);
+    m_map = nullptr;
+    m_map_size = 0;
+}
+
+
+bool ReplayRadio::open_sigmf(const std::string& metafile, const std::string& datafile) {
+
+    std::ifstream f(metafile);
+    if (!f.is_open()) {
+        LOG_RADIO_ERROR("ReplayRadio::open_sigmf() cannot open {}", metafile);
+        return false;
+    }
+
+    nlohmann::json meta;
+    try {
+        meta = nlohmann::json::parse(f);
+    } catch (const nlohmann::json::exception& e) {
+        LOG_RADIO_ERROR("ReplayRadio::open_sigmf() {}: {}", metafile, e.what());
+        return false;
+    }
+
+    const std::string datatype = meta["global"].value("core:datatype", "cf32_le");
+    if (datatype == "ci16_le") {
+        m_format = CI16;
+    } else if (datatype != "cf32_le") {
+        LOG_RADIO_ERROR("ReplayRadio::open_sigmf() datatype {} not supported", datatype);
+        return false;
+    }
+
+    if (meta["global"].contains("core:sample_rate")) {
+        m_sample_rate = meta["global"]["core:sample_rate"].get<double>();
+        m_file_sample_rate = true;
+    }
+
+    if (meta.contains("captures")) {
+        for (const auto& c : meta["captures"]) {
+            uint64_t start = c.value("core:sample_start", (uint64_t)0);
+            uint64_t ts = c.value("rpx:timestamp", start);
+            m_captures.push_back({start, ts});
+            if (c.contains("core:frequency") && !m_file_frequency) {
+                m_frequency = c["core:frequency"].get<double>();
+                m_file_frequency = true;
+            }
+        }
+    }
+
+    if (m_captures.empty() || m_captures.front().sample_start != 0)
+        m_captures.insert(m_captures.begin(), {0, 0});
+
+    if (!map_file(datafile))
+        return false;
+
+    if (m_format == CI16) {
+        m_ci16 = static_cast<const int16_t *>(m_map);
+        m_num_samples = m_map_size / (2 * sizeof(int16_t));
+    } else {
+        m_cf32 = static_cast<const liquid_float_complex *>(m_map);
+        m_num_samples = m_map_size / sizeof(liquid_float_complex);
+    }
+
+    return true;
+}
+
+
+bool ReplayRadio::open_text(const std::string& filename) {
+
+    if (!map_file(filename))
+        return false;
+
+    // "I, Q, timestamp" per line - parsed once into m_text_samples, a new capture on each timestamp jump
+    const char *p = static_cast<const char *>(m_map);
+    const char *end = p + m_map_size;
+    char line[128];
+    uint64_t next_ts = 0;
+
+    m_text_samples.reserve(m_map_size / 24);
+
+    while (p < end) {
+        const char *eol = static_cast<const char *>(std::memchr(p, '\n', end - p));
+        if (eol == nullptr)
+            eol = end;
+
+        size_t len = std::min((size_t)(eol - p), sizeof(line) - 1);
+        std::memcpy(line, p, len);
+        line[len] = '\0';
+        p = eol + 1;
+
+        char *c = line;
+        float i = std::strtof(c, &c);
+        if (*c == ',') c++;
+        float q = std::strtof(c, &c);
+        if (*c == ',') c++;
+        char *ts_end;
+        uint64_t ts = std::strtoull(c, &ts_end, 10);
+        if (ts_end == c)
+            continue;       // empty or broken line
+
+        if (m_captures.empty() || ts != next_ts)
+            m_captures.push_back({m_text_samples.size(), ts});
+        next_ts = ts + 1;
+
+        m_text_samples.push_back(liquid_float_complex(i, q));
+    }
+
+    unmap_file();
+
+    m_cf32 = m_text_samples.data();
+    m_num_samples = m_text_samples.size();
+    return true;
+}
+
+
+int ReplayRadio::receive_IQ_data() {
+
+    if (m_pos >= m_num_samples) {
+        if (!m_loop || m_num_samples == 0) {
+            if (!m_eof) {
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+                LOG_RADIO_INFO("ReplayRadio::receive_IQ_data() end of capture - {} samples in {:.3f} s ({:.3f} MSps)",
+                               m_samples_replayed, seconds, seconds > 0 ? m_samples_replayed / seconds / 1e6 : 0.0);
+            }
+            m_eof = true;
+            setRXBuffer(getBlockPool()->acquire());
+            return 0;
+        }
+
+        // continue the timestamps after the last sample
+        m_ts_offset = m_timestamp - m_captures.front().timestamp;
+        m_pos = 0;
+        m_capture = 0;
+    }
+
+    if (m_samples_replayed == 0)
+        m_start = std::chrono::steady_clock::now();
+
+    // blocks do not span capture segments so that the timestamp of the first sample is exact
+    size_t n = std::min((size_t)m_sampleBufferCnt, m_num_samples - m_pos);
+    while (m_capture + 1 < m_captures.size() && m_captures[m_capture + 1].sample_start <= m_pos)
+        m_capture++;
+    if (m_capture + 1 < m_captures.size())
+        n = std::min(n, (size_t)(m_captures[m_capture + 1].sample_start - m_pos));
+
+    const Capture& cap = m_captures[m_capture];
+    m_timestamp = cap.timestamp + (m_pos - cap.sample_start) + m_ts_offset;
+
+    RadioIQDataPtr block;
+    if (m_cf32 != nullptr) {
+        block = m_view_pool->acquire();
+        block->data.attach(const_cast<liquid_float_complex *>(m_cf32 + m_pos), n);
+    } else {
+        block = getBlockPool()->acquire();
+        block->data.resize(n);
+        iq_convert_i16_to_cf(m_ci16 + 2 * m_pos, block->data.data(), n, 1.0f / iqStreamFormatFullScale(IQStreamFormat::I16));
+    }
+
+    block->timestampFirstSample = m_timestamp;
+    block->sampleRate = (long long)m_sample_rate;
+    block->frequency = (long long)m_frequency;
+
+    m_pos += n;
+    m_timestamp += n;
+    m_samples_replayed += n;
+
+    // paced: deliver the block when the last sample would have been received
+    if (m_paced) {
+        auto due = m_start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(m_samples_replayed / m_sample_rate));
+        std::this_thread::sleep_until(due);
+    }
+
+    setRXBuffer(block);
+
+    return (int)n;
+}
+
+
+int ReplayRadio::send_IQ_data() {
+    // nothing to send to
+    return 0;
+}
+
+
+uint64_t ReplayRadio::get_rx_timestamp() {
+    return m_timestamp;
+}
+
+
+void ReplayRadio::setFrequency(float_t frequency) {
+    // the capture frequency is kept if the file has one
+    if (!m_file_frequency)
+        m_frequency = frequency;
+}
+
+
+void ReplayRadio::setSamplingRate(float_t sampling_rate, size_t oversampling) {
+    // pacing follows the sample rate of the capture if the file has one
+    if (!m_file_sample_rate)
+        m_sample_rate = sampling_rate;
+}
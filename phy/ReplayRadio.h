@@ -0,0 +1,123 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#include "liquid/liquid.h"
+
+#include "phy/Radio.h"
+#include "phy/IQBlock.h"
+#include "phy/IQConvert.h"
+
+#include "util/log.h"
+
+
+// number of zero-copy view blocks which can be in flight (pipeline queue + iq debug)
+#define REPLAY_VIEW_BLOCKS          1024
+
+
+/**
+ * ReplayRadio class
+ *
+ * @note Radio which replays a capture instead of receiving from hardware - for profiling and for reproducing
+ *       sync failures without a LimeSDR
+ * @note supported files:
+ *       - SigMF from IQRecorder / PhyIQDebug (<name>.sigmf-meta or <name>.sigmf-data); cf32_le or ci16_le,
+ *         timestamps from the rpx:timestamp of each capture segment (gaps are replayed as timestamp jumps)
+ *       - raw cf32 (any other extension), timestamps count from 0
+ *       - the text format "I, Q, timestamp" per line of the former IQData.txt debug dump (.txt / .csv)
+ * @note the data file is memory mapped; cf32 blocks are views into the mapping (no copy), ci16 is converted into
+ *       blocks of the pool and the text format is parsed once when the file is opened
+ * @note paced (default) replays at the sample rate of the capture, otherwise as fast as the consumer takes blocks
+ *       (isRealtime() is false, i.e. the PHY waits for a free queue slot instead of dropping blocks)
+ * @note TX is discarded
+ *
+ */
+class ReplayRadio : public Radio {
+public:
+
+    explicit ReplayRadio(const std::string& filename, int sampleBufferCnt = DEFAULT_SAMPLEBUFFERCNT);
+
+    ~ReplayRadio();
+
+    int receive_IQ_data() override;
+    int send_IQ_data() override;
+
+    uint64_t get_rx_timestamp() override;
+
+    void setFrequency(float_t frequency) override;
+    void setSamplingRate(float_t sampling_rate, size_t oversampling) override;
+
+    bool isRealtime() override { return false; }
+
+    bool isEndOfStream() override { return m_eof; }
+
+    /**
+     * @brief replay at the sample rate (true) or unthrottled (false)
+     */
+    void setPaced(bool paced) { m_paced = paced; }
+
+    /**
+     * @brief start over at the end of the file; timestamps keep counting up
+     */
+    void setLoop(bool loop) { m_loop = loop; }
+
+    bool isOpen() const { return m_num_samples > 0; }
+
+    uint64_t samplesReplayed() const { return m_samples_replayed; }
+
+private:
+
+    struct Capture {
+        uint64_t sample_start;
+        uint64_t timestamp;
+    };
+
+    bool open_sigmf(const std::string& metafile, const std::string& datafile);
+
+    bool open_text(const std::string& filename);
+
+    bool map_file(const std::string& filename);
+
+    void unmap_file();
+
+    typedef enum {
+        CF32,
+        CI16
+    } Format;
+
+    Format m_format = CF32;
+
+    void *m_map = nullptr;
+    size_t m_map_size = 0;
+
+    const liquid_float_complex *m_cf32 = nullptr;     // points into the mapping or into m_text_samples
+    const int16_t *m_ci16 = nullptr;
+    size_t m_num_samples = 0;
+
+    IQSampleBuffer m_text_samples;
+
+    std::vector<Capture> m_captures;
+    size_t m_capture = 0;           // current capture segment
+
+    size_t m_pos = 0;               // next sample to replay
+    uint64_t m_ts_offset = 0;       // added to the capture timestamps when looping
+    uint64_t m_timestamp = 0;       // timestamp of the next sample
+
+    IQBlockPoolPtr m_view_pool;     // blocks without own storage for the cf32 views
+
+    double m_sample_rate = DEFAULT_SAMPLE_RATE;
+    bool m_file_sample_rate = false;
+    double m_frequency = DEFAULT_CENTER_FREQ;
+    bool m_file_frequency = false;
+
+    bool m_paced = true;
+    bool m_loop = false;
+    bool m_eof = false;
+
+    uint64_t m_samples_replayed = 0;
+    std::chrono::steady_clock::time_point m_start;
+
+};
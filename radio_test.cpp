@@ -5,12 +5,13 @@
 #include <iostream>
 #include <fstream> 
 #include <complex>
+#include <vector>
 
 #include "lime/LimeSuite.h"
 #include "liquid/liquid.h"
 #include "util/log.h"
 #include "util/ws_spectrogram.h"
-#include "util/write_csv_file.h"
+#include "util/IQRecorder.h"
 
 #include <nlohmann/json.hpp>
 #include <cxxopts.hpp>
@@ -18,6 +19,9 @@
 #include "phy/RadioThread.h"
 #include "phy/LimeRadioThread.h"
 #include "phy/PhyThread.h"
+#include "phy/PhyChannelizerBank.h"
+#include "phy/IQBus.h"
+#include "phy/PhyDSPKernels.h"
 
 
 using json = nlohmann::json;
@@ -60,11 +64,16 @@ int main(int argc, const char* argv[])
       .add_options()
       ("h,help", "Print help")
       ("c,config", "Config file")
-      ("w", "write CSV file")
+      ("w,write", "record RX IQ to <file>_<n>.sigmf-data (with -s)", cxxopts::value<std::string>())
       ("s", "websocket for spectrogram")
       ("p", "phy testing")
       ("b", "phy basestation")
       ("l", "gpio test")
+      ("replay", "run the phy (-p) on a recorded capture (.sigmf-meta, .cf32 or IQData.txt) instead of the LimeSDR", cxxopts::value<std::string>())
+      ("replay-fast", "replay as fast as the phy can process instead of at the sample rate")
+      ("replay-loop", "restart the replay at the end of the capture")
+      ("t,trace", "record frame sync trace events to file", cxxopts::value<std::string>())
+      ("trace-decode", "decode a frame sync trace file to csv and exit", cxxopts::value<std::string>())
     ;
 
     auto result = options.parse(argc, argv);
@@ -74,6 +83,15 @@ int main(int argc, const char* argv[])
         exit(0);
     }
 
+    if(result.count("trace-decode")) {
+        long n = PhyTrace::decode(result["trace-decode"].as<std::string>(), std::cout);
+        if(n < 0) {
+            std::cerr << "not a frame sync trace file: " << result["trace-decode"].as<std::string>() << std::endl;
+            exit(1);
+        }
+        exit(0);
+    }
+
 
     LOG_TEST_INFO("SDR Radio test program");
 
@@ -82,15 +100,108 @@ int main(int argc, const char* argv[])
     json SystemConfig = json::parse(SystemConfigFile);
     SystemConfigFile.close();
 
+    // optional sections - a config without one (e.g. only "Info" and "Radio") gets the defaults of its values
+    auto cf_section = [&SystemConfig](const char *name) { return SystemConfig.value(name, json::object()); };
+
     float_t cf_samp_rate = SystemConfig["Radio"]["SAMPLING_RATE"];
     size_t cf_oversampling = SystemConfig["Radio"]["OVERSAMPLING"];
     float_t cf_center_freq = SystemConfig["Radio"]["CENTER_FREQ"];
+    std::string cf_iq_queue = SystemConfig["Radio"].value("IQ_QUEUE", "ring");
+    size_t cf_iq_pool_blocks = SystemConfig["Radio"].value("IQ_POOL_BLOCKS", DEFAULT_IQBLOCKPOOL_BLOCKS);
+    IQStreamFormat cf_stream_format = iqStreamFormatFromString(SystemConfig["Radio"].value("STREAM_FORMAT", "F32"));
+    size_t cf_rx_channels = SystemConfig["Radio"].value("RX_CHANNELS", DEFAULT_RX_CHANNELS);
+    std::string cf_calibration_cache = SystemConfig["Radio"].value("CALIBRATION_CACHE_FILE", "");
+    unsigned int cf_iq_bus_slots = SystemConfig["Radio"].value("IQ_BUS_SLOTS", IQBUS_DEFAULT_SLOTS);
+    const json cf_phy = cf_section("Phy");
+    std::string cf_sts_detector = cf_phy.value("STS_DETECTOR", "fft");
+    unsigned int cf_tx_lead_frames = cf_phy.value("TX_LEAD_FRAMES", PHY_TX_LEAD_FRAMES);
+    bool cf_diversity_mrc = cf_phy.value("DIVERSITY_MRC", false);
+    const json cf_metrics = cf_section("Metrics");
+    unsigned int cf_metrics_period = cf_metrics.value("PERIOD_MS", METRICS_DEFAULT_PERIOD_MS);
+    std::string cf_metrics_file = cf_metrics.value("PROMETHEUS_FILE", "");
+    bool cf_cpe_pipeline = cf_phy.value("CPE_PIPELINE", true);
+    unsigned int cf_pipeline_depth = cf_phy.value("PIPELINE_QUEUE_DEPTH", PHY_PIPELINE_QUEUE_DEPTH);
+    const json cf_recorder = cf_section("Recorder");
+    std::string cf_rec_format = cf_recorder.value("FORMAT", "cf32");
+    uint64_t cf_rec_rotate_mb = cf_recorder.value("ROTATE_MB", 1024);
+    unsigned int cf_rec_rotate_sec = cf_recorder.value("ROTATE_SEC", 0);
+    bool cf_rec_direct = cf_recorder.value("O_DIRECT", true);
+    const json cf_channelizer_section = cf_section("Channelizer");
+    unsigned int cf_channelizer_channels = cf_channelizer_section.value("CHANNELS", 1);
+    unsigned int cf_channelizer_spectrum = cf_channelizer_section.value("SPECTRUM_CHANNEL", 0);
+    std::vector<unsigned int> cf_channelizer_phys = cf_channelizer_section.value("PHY_CHANNELS", std::vector<unsigned int>());
+    bool cf_sensing = SystemConfig.contains("Sensing") && SystemConfig["Sensing"].value("ENABLED", false);
+    PhySensingConfig cf_sensing_config;
+    if(cf_sensing)
+        cf_sensing_config = SystemConfig["Sensing"].get<PhySensingConfig>();
+    const json cf_spectrum_section = cf_section("Spectrum");
+    unsigned int cf_spectrum_fps = cf_spectrum_section.value("FPS", SPECTRUM_DEFAULT_FPS);
+    SpectrumConfig cf_spectrum;
+    cf_spectrum.nfft = cf_spectrum_section.value("NFFT", SPECTRUM_DEFAULT_NFFT);
+    cf_spectrum.average_ms = cf_spectrum_section.value("AVERAGE_MS", SPECTRUM_DEFAULT_AVERAGE_MS);
+    const json cf_auth = cf_section("Auth");
+    unsigned int cf_auth_workers = cf_auth.value("WORKERS", AUTH_DEFAULT_WORKERS);
+    size_t cf_auth_max_pending = cf_auth.value("MAX_PENDING", AUTH_DEFAULT_MAX_PENDING);
+    uint32_t cf_auth_token_lifetime = cf_auth.value("TOKEN_LIFETIME_S", SESSION_TOKEN_DEFAULT_LIFETIME);
+
+    // cpu affinity / SCHED_FIFO priority of the worker threads
+    auto cf_thread_sched = [&SystemConfig](const char *name) {
+        ThreadSched sched;
+        if(SystemConfig.contains("Threads") && SystemConfig["Threads"].contains(name)) {
+            sched.cpu = SystemConfig["Threads"][name].value("CPU", -1);
+            sched.fifo_priority = SystemConfig["Threads"][name].value("FIFO_PRIORITY", 0);
+        }
+        return sched;
+    };
+    // RX block size / LMS stream tuning per use ("PHY", "CAPTURE") - the profile gives the defaults, single values
+    // override them
+    bool cf_stream_tuning = SystemConfig.contains("Stream");
+    auto cf_stream = [&SystemConfig](const char *use, const char *profile) {
+        RadioStreamConfig config = RadioStreamConfig::profile(profile);
+        if(!SystemConfig.contains("Stream"))
+            return config;
+        const json& stream = SystemConfig["Stream"];
+        const json section = stream.contains(use) ? stream[use] : json::object();
+        config = RadioStreamConfig::profile(section.value("PROFILE", std::string(profile)));
+        config.adaptive = section.value("ADAPTIVE", stream.value("ADAPTIVE", false));
+        config.latency_budget_ms = section.value("LATENCY_BUDGET_MS", config.latency_budget_ms);
+        config.block_samples = section.value("BLOCK_SAMPLES", config.block_samples);
+        config.min_block_samples = section.value("MIN_BLOCK_SAMPLES", config.min_block_samples);
+        config.max_block_samples = section.value("MAX_BLOCK_SAMPLES", config.max_block_samples);
+        config.fifo_size = section.value("FIFO_SIZE", config.fifo_size);
+        config.throughput_vs_latency = section.value("THROUGHPUT_VS_LATENCY", config.throughput_vs_latency);
+        config.min_throughput_vs_latency = section.value("MIN_THROUGHPUT_VS_LATENCY", config.min_throughput_vs_latency);
+        config.max_throughput_vs_latency = section.value("MAX_THROUGHPUT_VS_LATENCY", config.max_throughput_vs_latency);
+        return config;
+    };
+    std::string cf_fft_planner = cf_phy.value("FFT_PLANNER", "estimate");
+    std::string cf_fft_wisdom = cf_phy.value("FFT_WISDOM_FILE", PHY_FFT_WISDOM_FILE);
+    std::string cf_dsp_kernels = cf_phy.value("DSP_KERNELS", "auto");
+
+    // async logging and the runtime levels of the subsystems - the loggers of Log::Init() are replaced before the
+    // worker threads start
+    LogConfig cf_log;
+    if(SystemConfig.contains("Log"))
+        cf_log = SystemConfig["Log"].get<LogConfig>();
+    Log::Configure(cf_log);
+
+    if(result.count("trace"))
+        PhyTrace::start(result["trace"].as<std::string>());
+
+    // FFT plans are shared process wide - load the wisdom of the last run before any plan gets created
+    PhyFFTPlanCache::instance().setPlanner(cf_fft_planner);
+    PhyFFTPlanCache::instance().importWisdom(cf_fft_wisdom);
+
+    // SIMD kernels of the PHY loops - the frame sync / gen keep the set of their construction
+    PhyDSPKernels::select(cf_dsp_kernels);
 
     LOG_TEST_DEBUG("SystemConfig samprate {}", cf_samp_rate);
     LOG_TEST_DEBUG("SystemConfig oversamp {}", cf_oversampling);
     LOG_TEST_DEBUG("SystemConfig freq {}", cf_center_freq);
 
 
+    Metrics::instance().start(cf_metrics_period, cf_metrics_file);
+
     // websocket spectrogram test stuff
     if(result.count("s")) {
 
@@ -98,19 +209,46 @@ int main(int argc, const char* argv[])
         RadioThread *sdr;
 
         // create RX and TX queues to communicate with the SDR object
-        RadioThreadIQDataQueuePtr iqpipe_rx = std::make_shared<RadioThreadIQDataQueue>();
-        iqpipe_rx->set_max_items(2000);
+        // RX goes to the IQ bus - spectrum, channelizer and recorder each subscribe with an own cursor
+        // TX: "ring" is the lock-free SPSC queue, "spinlock" the SpinMutex/std::deque fallback
+        IQBusPtr iqbus_rx = IQBus::create(cf_iq_bus_slots, (unsigned int)cf_iq_pool_blocks);
+        ThreadIQDataQueueBasePtr iqpipe_tx = createRadioThreadIQDataQueue(cf_iq_queue, 2000);
 
-        RadioThreadIQDataQueuePtr iqpipe_tx = std::make_shared<RadioThreadIQDataQueue>();
-        iqpipe_tx->set_max_items(2000);
+        // queue depths are sampled when the metrics are published
+        Metrics::instance().gauge("radio_iqpipe_rx_depth", "IQ blocks referenced by the RX bus").setCallback([iqbus_rx]() { return (int64_t)iqbus_rx->size(); });
+        Metrics::instance().gauge("radio_iqpipe_tx_depth", "IQ blocks in the TX queue").setCallback([iqpipe_tx]() { return (int64_t)iqpipe_tx->size(); });
 
         // init SDR
     //    sdr = new LimeRadioThread();  // default is defined via DEFAULT_SAMPLEBUFFERCNT
         sdr = new LimeRadioThread(3200);  // set to a specifc sampleCnt (# samples RX , # samples TX max)
-        sdr->setRXQueue(iqpipe_rx);
+        // the blocks of the pool bound the block size of the stream tuner
+        RadioStreamConfig cf_stream_capture = cf_stream("CAPTURE", "throughput");
+        sdr->setBlockPool(IQBlockPool::create(cf_iq_pool_blocks, std::max(3200u, cf_stream_capture.max_block_samples)));
+        sdr->setRXQueue(iqbus_rx);
         sdr->setTXQueue(iqpipe_tx);
         sdr->setFrequency(cf_center_freq);
-        sdr->setSamplingRate(cf_samp_rate, cf_oversampling);
+        sdr->setSamplingRate(PhyChannelizerBank::captureRate(cf_channelizer_channels, cf_samp_rate), cf_oversampling);     // capture covers all sub-channels
+        sdr->setStreamFormat(cf_stream_format);
+        sdr->setRXChannels(cf_rx_channels);     // blocks of channel 1 go to setRXQueue(1, ...) if set
+        if (cf_stream_tuning)
+            sdr->setStreamConfig(cf_stream_capture);   // small blocks for the phy, large ones for spectrum / recorder
+        // restores (or calibrates once) the setting above - later retunes to a cached setting take milliseconds
+        if (!cf_calibration_cache.empty())
+            sdr->setCalibrationCache(cf_calibration_cache);
+
+        // RX IQ recorder - subscriber of the RX bus, a slow disk only costs the recorder blocks
+        IQRecorder *recorder = nullptr;
+        std::thread *t_recorder = nullptr;
+        if(result.count("write")) {
+            ThreadIQDataQueueBasePtr iqpipe_rec = iqbus_rx->subscribe("recorder", IQBUS_DROP_OLDEST, IQRECORDER_QUEUE_DEPTH);
+            recorder = new IQRecorder(result["write"].as<std::string>());
+            recorder->setFormat(IQRecorder::formatFromString(cf_rec_format));
+            recorder->setRotate(cf_rec_rotate_mb * 1024 * 1024, cf_rec_rotate_sec);
+            recorder->setDirectIO(cf_rec_direct);
+            recorder->setQueue(iqpipe_rec);
+            Metrics::instance().gauge("recorder_queue_depth", "IQ blocks waiting for the recorder").setCallback([iqpipe_rec]() { return (int64_t)iqpipe_rec->size(); });
+            t_recorder = new std::thread(&IQRecorder::threadMain, recorder);
+        }
 
         // create SDR Thread
         std::thread *t_sdr = nullptr;
@@ -135,9 +273,27 @@ int main(int argc, const char* argv[])
             std::cout << ".";
         std::cout << std::endl;
 
+        // polyphase channelizer - the wide capture is split into sub-channels of cf_samp_rate, the spectrum shows
+        // one of them and a CPE PhyThread runs the frame sync on each of PHY_CHANNELS
+        PhyChannelizerBank *channelizer = nullptr;
+        ThreadIQDataQueueBasePtr iqpipe_spectrum;
+
+        if(cf_channelizer_channels > 1) {
+            channelizer = new PhyChannelizerBank(cf_channelizer_channels, cf_samp_rate, cf_center_freq, sdr->getBlockPool()->block_capacity());
+            iqpipe_spectrum = channelizer->start(iqbus_rx->subscribe("channelizer", IQBUS_DROP_OLDEST, 0), cf_channelizer_spectrum, cf_channelizer_phys, cf_iq_queue, cf_oversampling, [&](PhyThread *subPhy) {
+                subPhy->setSTSDetector(cf_sts_detector == "schmidl-cox" ? PhyFrameSync::STS_DETECTOR_SCHMIDL_COX : PhyFrameSync::STS_DETECTOR_FFT);
+                subPhy->setPipeline(cf_cpe_pipeline, cf_pipeline_depth);
+            });
+        } else {
+            // the spectrum only needs the newest blocks
+            iqpipe_spectrum = iqbus_rx->subscribe("spectrum", IQBUS_LATEST, WS_SPECTROGRAM_QUEUE_DEPTH);
+        }
+
         wsSpectrogram *wsspec;
         wsspec = new wsSpectrogram(9123);
-        wsspec->setQueue(iqpipe_rx);
+        wsspec->setSpectrum(cf_spectrum_fps, cf_spectrum);
+        wsspec->setAuth(cf_auth_workers, cf_auth_max_pending, cf_auth_token_lifetime);
+        wsspec->setQueue(iqpipe_spectrum);
 
         // create Thread
         std::thread *t_wsspec = nullptr;
@@ -152,44 +308,80 @@ int main(int argc, const char* argv[])
 
         // @todo stop command via WS 
     
-        // be nice and clean up
+        // be nice and clean up - all threads which log are joined before Log::Shutdown()
+        sdr->terminate();
+        t_sdr->join();
+        if(channelizer != nullptr) {
+            channelizer->stop();
+            delete(channelizer);
+        }
+        if(recorder != nullptr) {
+            recorder->terminate();
+            t_recorder->join();
+            delete(t_recorder);
+            delete(recorder);
+        }
+        wsspec->terminate();
+        t_wsspec->join();
+        delete(t_wsspec);
         delete(wsspec);
-        iqpipe_rx->flush();
+        iqbus_rx->flush();
         iqpipe_tx->flush();
         delete(t_sdr);
         
     } 
 
  
-    // write data for debug to ramdisk (cmdline -w option) - anyways  is even with ram very slow ...
-    // root@x:~# mkdir /tmp/ramdisk
-    // root@x:~# chmod 777 ramdisk/
-    // root@x:~# mount -t tmpfs -o size=200M myramdisk /tmp/ramdisk/
-
-    // bool stop = true;
-
-    // if(result.count("w")) {
-    //     write_csv_file(sdr, iqpipe_rx,"/tmp/ramdisk/IQData.csv");
-    //     stop = false;
-    // }
-    
     if(result.count("p")) {
+        // offline run on a capture - the radio is owned by the phy
+        ReplayRadio *replay = nullptr;
+        if(result.count("replay")) {
+            replay = new ReplayRadio(result["replay"].as<std::string>(), 1300);
+            replay->setPaced(!result.count("replay-fast"));
+            replay->setLoop(result.count("replay-loop") > 0);
+        }
+
         PhyThread *phy;
         if(result.count("b")) {
-            phy = new PhyThread(PhyThread::PhyMode::BASESTATION, cf_samp_rate, cf_oversampling, cf_center_freq);
+            phy = new PhyThread(PhyThread::PhyMode::BASESTATION, cf_samp_rate, cf_oversampling, cf_center_freq, replay);
         } else {
-            phy = new PhyThread(PhyThread::PhyMode::CPE, cf_samp_rate, cf_oversampling, cf_center_freq);
+            phy = new PhyThread(PhyThread::PhyMode::CPE, cf_samp_rate, cf_oversampling, cf_center_freq, replay);
         }
+        phy->setStreamFormat(cf_stream_format);
+        phy->setSTSDetector(cf_sts_detector == "schmidl-cox" ? PhyFrameSync::STS_DETECTOR_SCHMIDL_COX : PhyFrameSync::STS_DETECTOR_FFT);
+        phy->setTxLeadFrames(cf_tx_lead_frames);
+        phy->setRXChannels(cf_rx_channels);
+        if (cf_stream_tuning)
+            phy->setStreamConfig(cf_stream("PHY", "latency"));
+        phy->setDiversity(cf_diversity_mrc);
+        phy->setPipeline(cf_cpe_pipeline, cf_pipeline_depth);
+        phy->setThreadSched(PhyThread::STAGE_RX, cf_thread_sched("PHY_RX"));
+        phy->setThreadSched(PhyThread::STAGE_SYNC, cf_thread_sched("PHY_SYNC"));
+        phy->setThreadSched(PhyThread::STAGE_DEBUG, cf_thread_sched("PHY_DEBUG"));
+        if (!cf_calibration_cache.empty())
+            phy->setCalibrationCache(cf_calibration_cache);
+        if (cf_sensing)
+            phy->setSensing(cf_sensing_config);
 
         //wait for waitTime seconds and then stop the phy thread to limit the amount
         //of data collected for testing
+        // (a replay without loop stops by itself at the end of the capture)
         uint64_t waitTime = 20;
-        std::thread w1(warta,phy, waitTime);
+        std::thread w1;
+        if(replay == nullptr || result.count("replay-loop"))
+            w1 = std::thread(warta,phy, waitTime);
  
         phy->run(); // this is blocking for testing at the moment
  
         // join waiting thread so that it stops properly
-        w1.join();
+        if(w1.joinable())
+            w1.join();
+
+        if(phy->getSensing() != nullptr) {
+            for(const auto& c : phy->getSensing()->getOccupancy())
+                LOG_TEST_INFO("sensing {} Hz: {} - energy {:.1f} dBFS, feature {:.1f} dB, {} of {} dwells occupied", c.frequency,
+                              c.occupied ? "occupied" : "clear", c.energy_db, c.feature_db, c.detections, c.dwells);
+        }
 
         // be nice and clean up
         delete(phy);
@@ -229,5 +421,10 @@ int main(int argc, const char* argv[])
     // }
 
 
+    PhyFFTPlanCache::instance().exportWisdom(cf_fft_wisdom);
+    Metrics::instance().stop();
+    PhyTrace::stop();
+    Log::Shutdown();
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "util/AuthWorkerPool.h"
+
+#include <algorithm>
+
+
+AuthWorkerPool::AuthWorkerPool(unsigned int workers, size_t max_pending) : m_max_pending(max_pending) {
+
+    workers = std::max(1u, workers);
+    for (unsigned int i = 0; i < workers; i++)
+        m_workers.emplace_back(&AuthWorkerPool::worker, this);
+
+    LOG_TEST_DEBUG("AuthWorkerPool::AuthWorkerPool() {} workers, max {} pending", workers, max_pending);
+}
+
+
+AuthWorkerPool::~AuthWorkerPool() {
+
+    stop();
+}
+
+
+bool AuthWorkerPool::submit(std::function<void()> job) {
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping || m_jobs.size() >= m_max_pending)
+            return false;
+        m_jobs.push_back(std::move(job));
+    }
+    m_cv.notify_one();
+
+    return true;
+}
+
+
+void AuthWorkerPool::stop() {
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping)
+            return;
+        m_stopping = true;
+        m_jobs.clear();
+    }
+    m_cv.notify_all();
+
+    for (auto& t : m_workers)
+        t.join();
+    m_workers.clear();
+}
+
+
+size_t AuthWorkerPool::pending() {
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_jobs.size();
+}
+
+
+void AuthWorkerPool::worker() {
+
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+            if (m_stopping)
+                return;
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+
+        try {
+            job();
+        }
+        catch (std::exception& exception) {
+            LOG_TEST_ERROR("AuthWorkerPool::worker() job failed: {}", exception.what());
+        }
+    }
+}
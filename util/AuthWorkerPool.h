@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util/log.h"
+
+
+#define AUTH_DEFAULT_WORKERS        1
+#define AUTH_DEFAULT_MAX_PENDING    8
+
+
+/**
+ * AuthWorkerPool class
+ *
+ * @note runs the Argon2 verifications off the websocket service thread; the number of workers caps the concurrent
+ *       verifications and with it the memory (m_cost of the hash, 64 MiB for the Argon2Wrapper default, per worker)
+ * @note submit() refuses jobs when max_pending are already waiting - a login storm gets "busy" instead of growing
+ *       the queue
+ *
+ */
+class AuthWorkerPool {
+public:
+
+    explicit AuthWorkerPool(unsigned int workers = AUTH_DEFAULT_WORKERS, size_t max_pending = AUTH_DEFAULT_MAX_PENDING);
+
+    ~AuthWorkerPool();
+
+    AuthWorkerPool(const AuthWorkerPool&) = delete;
+
+    AuthWorkerPool& operator=(const AuthWorkerPool&) = delete;
+
+    /**
+     * @brief run job on a worker thread
+     *
+     * @return false if the queue is full or the pool is stopping
+     */
+    bool submit(std::function<void()> job);
+
+    /**
+     * @brief finish the running jobs, drop the waiting ones and join the workers
+     */
+    void stop();
+
+    size_t pending();
+
+private:
+
+    void worker();
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_jobs;
+    size_t m_max_pending;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stopping = false;
+
+};
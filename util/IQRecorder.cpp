@@ -0,0 +1,296 @@
+#include "util/IQRecorder.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <algorithm>
+
+#include <nlohmann/json.hpp>
+
+
+IQRecorder::IQRecorder(const std::string& basename) :
+        stopping(false), m_isRecording(false), m_basename(basename) {
+
+    LOG_TEST_DEBUG("IQRecorder::IQRecorder() constructor basename {}", basename);
+
+    m_buffer = static_cast<unsigned char *>(std::aligned_alloc(IQRECORDER_ALIGNMENT, IQRECORDER_WRITE_SIZE));
+    if (m_buffer == nullptr) {
+        throw std::bad_alloc();
+    }
+}
+
+IQRecorder::~IQRecorder() {
+
+    LOG_TEST_DEBUG("IQRecorder destructor");
+
+    close_file();
+    std::free(m_buffer);
+}
+
+
+void IQRecorder::threadMain() {
+    run();
+}
+
+
+void IQRecorder::terminate() {
+    LOG_TEST_DEBUG("IQRecorder::terminate()");
+    stopping.store(true);
+}
+
+
+void IQRecorder::setQueue(const ThreadIQDataQueueBasePtr &threadQueue) {
+    std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
+    m_IQdataQueue = threadQueue;
+}
+
+ThreadIQDataQueueBasePtr IQRecorder::getQueue() {
+    std::lock_guard < std::mutex > lock(m_queue_bindings_mutex);
+    return m_IQdataQueue;
+}
+
+
+IQRecorder::Format IQRecorder::formatFromString(const std::string& name) {
+    if (name == "ci16" || name == "CI16" || name == "ci16_le")
+        return CI16;
+    return CF32;
+}
+
+
+void IQRecorder::setFormat(Format format) {
+    m_format = format;
+    m_sample_size = (format == CI16) ? 2 * sizeof(int16_t) : sizeof(liquid_float_complex);
+}
+
+
+void IQRecorder::setRotate(uint64_t max_bytes, unsigned int max_seconds) {
+    m_rotate_bytes = max_bytes;
+    m_rotate_seconds = max_seconds;
+}
+
+
+void IQRecorder::run() {
+
+    ThreadIQDataQueueBasePtr queue = getQueue();
+    if (queue == nullptr) {
+        LOG_TEST_ERROR("IQRecorder::run() no queue set");
+        return;
+    }
+
+    LOG_TEST_INFO("IQRecorder::run() recording to {}_<n>.sigmf-data ({})", m_basename, m_format == CI16 ? "ci16_le" : "cf32_le");
+
+    m_isRecording.store(true);
+
+    RadioThreadIQDataPtr block;
+
+    while (!stopping) {
+        if (queue->wait_pop(block, IQRECORDER_WAIT_MS)) {
+            append_block(block);
+            block.reset();
+        }
+    }
+
+    // keep what is already queued
+    while (queue->pop(block)) {
+        append_block(block);
+    }
+    block.reset();
+
+    close_file();
+
+    m_isRecording.store(false);
+
+    LOG_TEST_INFO("IQRecorder::run() stopped after {} files", m_file_count);
+}
+
+
+bool IQRecorder::open_file() {
+
+    m_filename = m_basename + "_" + std::to_string(m_file_count++);
+    const std::string datafile = m_filename + ".sigmf-data";
+    const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+    m_fd_direct = false;
+    if (m_direct_io) {
+        m_fd = ::open(datafile.c_str(), flags | O_DIRECT, 0644);
+        if (m_fd >= 0)
+            m_fd_direct = true;
+        else if (errno == EINVAL)
+            LOG_TEST_DEBUG("IQRecorder::open_file() O_DIRECT not supported for {}", datafile);
+    }
+
+    if (m_fd < 0)
+        m_fd = ::open(datafile.c_str(), flags, 0644);
+
+    if (m_fd < 0) {
+        LOG_TEST_ERROR("IQRecorder::open_file() cannot open {}: {}", datafile, std::strerror(errno));
+        return false;
+    }
+
+    m_buffer_fill = 0;
+    m_file_bytes = 0;
+    m_file_samples = 0;
+    m_file_opened = std::chrono::steady_clock::now();
+    m_captures.clear();
+    m_gaps.clear();
+
+    LOG_TEST_INFO("IQRecorder::open_file() {} {}", datafile, m_fd_direct ? "O_DIRECT" : "buffered");
+    return true;
+}
+
+
+void IQRecorder::close_file() {
+
+    if (m_fd < 0)
+        return;
+
+    if (m_buffer_fill > 0) {
+        // the tail is usually not a multiple of the block size, which O_DIRECT does not allow
+        if (m_fd_direct && (m_buffer_fill % IQRECORDER_ALIGNMENT) != 0) {
+            int fl = fcntl(m_fd, F_GETFL);
+            if (fl != -1)
+                fcntl(m_fd, F_SETFL, fl & ~O_DIRECT);
+            m_fd_direct = false;
+        }
+        write_chunk(m_buffer_fill);
+        m_buffer_fill = 0;
+    }
+
+    ::close(m_fd);
+    m_fd = -1;
+
+    write_meta();
+    m_metric_files.add();
+
+    LOG_TEST_INFO("IQRecorder::close_file() {} samples in {} captures, {} gaps written to {}.sigmf-data", m_file_samples, m_captures.size(), m_gaps.size(), m_filename);
+}
+
+
+bool IQRecorder::write_chunk(size_t bytes) {
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    size_t done = 0;
+    while (done < bytes) {
+        ssize_t n = ::write(m_fd, m_buffer + done, bytes - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            LOG_TEST_ERROR("IQRecorder::write_chunk() write to {}.sigmf-data failed: {}", m_filename, std::strerror(errno));
+            return false;
+        }
+        done += n;
+    }
+
+    m_file_bytes += bytes;
+    m_metric_bytes.add(bytes);
+    m_metric_write_time.record(std::chrono::steady_clock::now() - t1);
+    return true;
+}
+
+
+void IQRecorder::append_block(const RadioThreadIQDataPtr& block) {
+
+    const size_t n = block->data.size();
+    if (n == 0)
+        return;
+
+    // rotate on block boundaries
+    if (m_fd >= 0 && m_file_samples > 0) {
+        const bool size_limit = m_rotate_bytes > 0 && (m_file_samples + n) * m_sample_size > m_rotate_bytes;
+        const bool time_limit = m_rotate_seconds > 0 && std::chrono::steady_clock::now() - m_file_opened >= std::chrono::seconds(m_rotate_seconds);
+        if (size_limit || time_limit)
+            close_file();
+    }
+
+    if (m_fd < 0 && !open_file())
+        return;
+
+    // new capture segment at the start of a file, after lost samples or when the radio was retuned
+    const uint64_t ts = block->timestampFirstSample;
+    const bool gap = m_have_ts && ts != m_next_ts;
+
+    if (gap) {
+        const int64_t lost = (int64_t)(ts - m_next_ts);
+        m_gaps.push_back({m_file_samples, lost});
+        m_metric_gaps.add();
+        LOG_TEST_DEBUG("IQRecorder::append_block() gap of {} samples at timestamp {}", lost, ts);
+    }
+
+    if (m_captures.empty() || gap || block->frequency != m_captures.back().frequency)
+        m_captures.push_back({m_file_samples, ts, block->frequency});
+
+    m_next_ts = ts + n;
+    m_have_ts = true;
+    m_sample_rate = block->sampleRate;
+
+    // IQRECORDER_WRITE_SIZE is a multiple of both sample sizes, i.e. a sample never straddles two chunks
+    const liquid_float_complex *in = block->data.data();
+    size_t left = n;
+
+    while (left > 0) {
+        const size_t k = std::min(left, (IQRECORDER_WRITE_SIZE - m_buffer_fill) / m_sample_size);
+
+        if (m_format == CI16)
+            iq_convert_cf_to_i16(in, reinterpret_cast<int16_t *>(m_buffer + m_buffer_fill), k, IQRECORDER_CI16_SCALE, IQRECORDER_CI16_SCALE);
+        else
+            std::memcpy(m_buffer + m_buffer_fill, in, k * sizeof(liquid_float_complex));
+
+        m_buffer_fill += k * m_sample_size;
+        in += k;
+        left -= k;
+
+        if (m_buffer_fill == IQRECORDER_WRITE_SIZE) {
+            write_chunk(IQRECORDER_WRITE_SIZE);
+            m_buffer_fill = 0;
+        }
+    }
+
+    m_file_samples += n;
+}
+
+
+bool IQRecorder::write_meta() {
+
+    const std::string metafile = m_filename + ".sigmf-meta";
+
+    nlohmann::json meta;
+
+    meta["global"] = {
+            {"core:datatype", m_format == CI16 ? "ci16_le" : "cf32_le"},
+            {"core:sample_rate", m_sample_rate},
+            {"core:version", "1.0.0"},
+            {"core:recorder", "RPX-100 IQRecorder"}
+    };
+
+    meta["captures"] = nlohmann::json::array();
+    for (const auto& c : m_captures) {
+        meta["captures"].push_back({
+                {"core:sample_start", c.sample_start},
+                {"core:frequency", c.frequency},
+                {"rpx:timestamp", c.timestamp}
+        });
+    }
+
+    meta["annotations"] = nlohmann::json::array();
+    for (const auto& g : m_gaps) {
+        meta["annotations"].push_back({
+                {"core:sample_start", g.sample_start},
+                {"core:sample_count", 0},
+                {"core:comment", "timestamp gap of " + std::to_string(g.samples) + " samples"},
+                {"rpx:gap_samples", g.samples}
+        });
+    }
+
+    std::ofstream f(metafile);
+    if (!f.is_open()) {
+        LOG_TEST_ERROR("IQRecorder::write_meta() cannot open {}", metafile);
+        return false;
+    }
+    f << meta.dump(2) << std::endl;
+
+    return true;
+}
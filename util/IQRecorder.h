@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+#include "liquid/liquid.h"
+
+#include "phy/RadioThread.h"
+#include "phy/IQConvert.h"
+#include "util/log.h"
+#include "util/Metrics.h"
+
+
+#define IQRECORDER_WRITE_SIZE       (4 * 1024 * 1024)   // bytes per write(), multiple of IQRECORDER_ALIGNMENT
+#define IQRECORDER_ALIGNMENT        4096                // O_DIRECT buffer / offset / size alignment
+#define IQRECORDER_WAIT_MS          100                 // max wait for a block (stop latency)
+#define IQRECORDER_QUEUE_DEPTH      2000
+#define IQRECORDER_CI16_SCALE       32767.0f            // ci16 value of 1.0 (and saturation limit)
+
+
+/**
+ * IQRecorder class
+ *
+ * @note streams the RX blocks of a queue (a subscriber of the RX IQBus) to <basename>_<n>.sigmf-data as cf32_le
+ *       or ci16_le with a SigMF <basename>_<n>.sigmf-meta per file
+ * @note samples are collected in an IQRECORDER_ALIGNMENT aligned buffer and written in IQRECORDER_WRITE_SIZE
+ *       chunks, with O_DIRECT if the filesystem supports it (tmpfs does not - the file is then opened without)
+ * @note a new capture segment is started in the metadata whenever timestampFirstSample of a block does not
+ *       follow the previous block (lost samples) or the center frequency changes; each gap is annotated
+ * @note files are rotated after setRotate() bytes / seconds, rotation happens on block boundaries
+ *
+ */
+class IQRecorder {
+public:
+
+    typedef enum {
+        CF32,
+        CI16
+    } Format;
+
+    explicit IQRecorder(const std::string& basename);
+
+    ~IQRecorder();
+
+    IQRecorder(const IQRecorder&) = delete;
+
+    IQRecorder& operator=(const IQRecorder&) = delete;
+
+    //the thread Main call back itself
+    void threadMain();
+
+    void run();
+
+    //Request for termination (asynchronous) - the queue is drained and the open file is closed by run()
+    void terminate();
+
+    void setQueue(const ThreadIQDataQueueBasePtr& threadQueue);
+    ThreadIQDataQueueBasePtr getQueue();
+
+    /**
+     * @brief sample format of the data file; CI16 is always written at the full scale of ci16 (1.0 = 32767) - the
+     *        blocks are normalized by the RX thread whatever the stream format (F32, I16, I12), i.e. an I12 stream
+     *        is written in the upper 12 bits and a SigMF reader (ReplayRadio) sees the same level as for I16
+     *
+     * @param format CF32 or CI16
+     */
+    void setFormat(Format format);
+
+    /**
+     * @brief "cf32" or "ci16", unknown strings fall back to CF32
+     */
+    static Format formatFromString(const std::string& name);
+
+    /**
+     * @brief rotate to the next file after max_bytes of sample data or max_seconds; 0 disables the limit
+     */
+    void setRotate(uint64_t max_bytes, unsigned int max_seconds);
+
+    void setDirectIO(bool direct) { m_direct_io = direct; }
+
+    bool isRecording() { return m_isRecording.load(); }
+
+private:
+
+    struct Capture {
+        uint64_t sample_start;      // sample index in the data file
+        uint64_t timestamp;         // timestampFirstSample of the segment
+        long long frequency;
+    };
+
+    struct Gap {
+        uint64_t sample_start;
+        int64_t samples;            // negative if the timestamp went backwards
+    };
+
+    bool open_file();
+
+    void close_file();
+
+    void append_block(const RadioThreadIQDataPtr& block);
+
+    bool write_chunk(size_t bytes);
+
+    bool write_meta();
+
+    ThreadIQDataQueueBasePtr m_IQdataQueue;
+
+    std::mutex m_queue_bindings_mutex;
+
+    std::atomic_bool stopping;
+
+    std::atomic_bool m_isRecording;
+
+    const std::string m_basename;
+    std::string m_filename;
+    unsigned int m_file_count = 0;
+
+    Format m_format = CF32;
+    size_t m_sample_size = sizeof(liquid_float_complex);
+
+    uint64_t m_rotate_bytes = 0;
+    unsigned int m_rotate_seconds = 0;
+    bool m_direct_io = true;
+
+    int m_fd = -1;
+    bool m_fd_direct = false;
+
+    unsigned char *m_buffer = nullptr;     // IQRECORDER_WRITE_SIZE, IQRECORDER_ALIGNMENT aligned
+    size_t m_buffer_fill = 0;
+
+    uint64_t m_file_bytes = 0;
+    uint64_t m_file_samples = 0;
+    std::chrono::steady_clock::time_point m_file_opened;
+
+    long long m_sample_rate = 0;
+    uint64_t m_next_ts = 0;                 // expected timestampFirstSample of the next block
+    bool m_have_ts = false;
+
+    std::vector<Capture> m_captures;
+    std::vector<Gap> m_gaps;
+
+    MetricCounter& m_metric_bytes = Metrics::instance().counter("recorder_bytes_total", "IQ bytes written by the recorder");
+    MetricCounter& m_metric_gaps = Metrics::instance().counter("recorder_gaps_total", "timestamp gaps in the recorded stream");
+    MetricCounter& m_metric_files = Metrics::instance().counter("recorder_files_total", "recording files written");
+    MetricHistogram& m_metric_write_time = Metrics::instance().histogram("recorder_write_seconds", "time per recorder write()");
+
+};
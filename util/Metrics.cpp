@@ -0,0 +1,215 @@
+#include "util/Metrics.h"
+
+#include <cstdio>
+#include <sstream>
+
+#include "util/WebSocketServer.h"
+
+
+unsigned int MetricHistogram::bucket(uint64_t v) {
+
+    if (v < METRICS_HIST_SUB_BUCKETS)
+        return (unsigned int)v;
+
+    // exponent of the highest bit and the next METRICS_HIST_SUB_BITS bits below it
+    const unsigned int e = 63 - __builtin_clzll(v);
+    const unsigned int sub = (unsigned int)(v >> (e - METRICS_HIST_SUB_BITS)) & (METRICS_HIST_SUB_BUCKETS - 1);
+
+    return (e - METRICS_HIST_SUB_BITS + 1) * METRICS_HIST_SUB_BUCKETS + sub;
+}
+
+
+uint64_t MetricHistogram::bucket_upper(unsigned int idx) {
+
+    if (idx < METRICS_HIST_SUB_BUCKETS)
+        return idx;
+
+    const unsigned int e = idx / METRICS_HIST_SUB_BUCKETS + METRICS_HIST_SUB_BITS - 1;
+    const uint64_t sub = idx % METRICS_HIST_SUB_BUCKETS;
+    const uint64_t low = ((uint64_t)METRICS_HIST_SUB_BUCKETS + sub) << (e - METRICS_HIST_SUB_BITS);
+
+    return low + ((uint64_t)1 << (e - METRICS_HIST_SUB_BITS)) - 1;
+}
+
+
+uint64_t MetricHistogram::quantile(double q) const {
+
+    const uint64_t n = count();
+    if (n == 0)
+        return 0;
+
+    const uint64_t rank = (uint64_t)(q * (double)n);
+    uint64_t seen = 0;
+
+    for (unsigned int i = 0; i < METRICS_HIST_BUCKETS; i++) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen > rank)
+            return std::min(bucket_upper(i), max());
+    }
+
+    return max();
+}
+
+
+Metrics& Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::~Metrics() {
+    stop();
+}
+
+
+MetricCounter& Metrics::counter(const std::string& name, const std::string& help) {
+    std::lock_guard < std::mutex > lock(m_metrics_mutex);
+
+    Entry& e = m_metrics[name];
+    if (!e.counter) {
+        e.help = help;
+        e.counter.reset(new MetricCounter());
+    }
+    return *e.counter;
+}
+
+MetricGauge& Metrics::gauge(const std::string& name, const std::string& help) {
+    std::lock_guard < std::mutex > lock(m_metrics_mutex);
+
+    Entry& e = m_metrics[name];
+    if (!e.gauge) {
+        e.help = help;
+        e.gauge.reset(new MetricGauge());
+    }
+    return *e.gauge;
+}
+
+MetricHistogram& Metrics::histogram(const std::string& name, const std::string& help) {
+    std::lock_guard < std::mutex > lock(m_metrics_mutex);
+
+    Entry& e = m_metrics[name];
+    if (!e.histogram) {
+        e.help = help;
+        e.histogram.reset(new MetricHistogram());
+    }
+    return *e.histogram;
+}
+
+
+std::string Metrics::prometheus_text() {
+
+    std::lock_guard < std::mutex > lock(m_metrics_mutex);
+    std::ostringstream out;
+
+    for (auto& m : m_metrics) {
+        const std::string& name = m.first;
+        const Entry& e = m.second;
+
+        out << "# HELP " << name << " " << e.help << "\n";
+
+        if (e.counter) {
+            out << "# TYPE " << name << " counter\n";
+            out << name << " " << e.counter->value() << "\n";
+        } else if (e.gauge) {
+            out << "# TYPE " << name << " gauge\n";
+            out << name << " " << e.gauge->value() << "\n";
+        } else if (e.histogram) {
+            const MetricHistogram& h = *e.histogram;
+            out << "# TYPE " << name << " summary\n";
+            for (double q : {0.5, 0.9, 0.99, 0.999})
+                out << name << "{quantile=\"" << q << "\"} " << (double)h.quantile(q) * 1e-9 << "\n";
+            out << name << "_sum " << (double)h.sum() * 1e-9 << "\n";
+            out << name << "_count " << h.count() << "\n";
+        }
+    }
+
+    return out.str();
+}
+
+
+std::string Metrics::json_text() {
+
+    std::lock_guard < std::mutex > lock(m_metrics_mutex);
+    std::ostringstream out;
+    bool first = true;
+
+    out << "{";
+    for (auto& m : m_metrics) {
+        const Entry& e = m.second;
+
+        out << (first ? "" : ",") << "\"" << m.first << "\":";
+        first = false;
+
+        if (e.counter) {
+            out << e.counter->value();
+        } else if (e.gauge) {
+            out << e.gauge->value();
+        } else if (e.histogram) {
+            const MetricHistogram& h = *e.histogram;
+            const uint64_t n = h.count();
+            out << "{\"count\":" << n
+                << ",\"mean_us\":" << (n ? (double)h.sum() / (double)n * 1e-3 : 0.0)
+                << ",\"p50_us\":" << (double)h.quantile(0.5) * 1e-3
+                << ",\"p99_us\":" << (double)h.quantile(0.99) * 1e-3
+                << ",\"p999_us\":" << (double)h.quantile(0.999) * 1e-3
+                << ",\"max_us\":" << (double)h.max() * 1e-3 << "}";
+        } else {
+            out << "null";
+        }
+    }
+    out << "}";
+
+    return out.str();
+}
+
+
+void Metrics::publish() {
+
+    if (!m_prometheus_file.empty()) {
+        // write and rename so that a scraper never reads a partial file
+        const std::string tmp = m_prometheus_file + ".tmp";
+        std::FILE *f = std::fopen(tmp.c_str(), "w");
+        if (f != nullptr) {
+            const std::string text = prometheus_text();
+            std::fwrite(text.data(), 1, text.size(), f);
+            std::fclose(f);
+            std::rename(tmp.c_str(), m_prometheus_file.c_str());
+        }
+    }
+
+    if (webSocketServer != nullptr)
+        webSocketServer->broadcast_metrics(json_text());
+}
+
+
+void Metrics::publisher_main() {
+
+    while (m_running.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(m_period_ms));
+        publish();
+    }
+}
+
+
+void Metrics::start(unsigned int period_ms, const std::string& prometheus_file) {
+
+    if (m_running.load())
+        return;
+
+    m_period_ms = period_ms > 0 ? period_ms : METRICS_DEFAULT_PERIOD_MS;
+    m_prometheus_file = prometheus_file;
+
+    m_running.store(true);
+    m_publisher = std::thread(&Metrics::publisher_main, this);
+
+    LOG_APP_INFO("Metrics::start() publishing every {} ms to '{}' and websocket", m_period_ms, m_prometheus_file);
+}
+
+
+void Metrics::stop() {
+
+    if (!m_running.load())
+        return;
+
+    m_running.store(false);
+    m_publisher.join();
+}
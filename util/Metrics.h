@@ -0,0 +1,177 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <map>
+#include <memory>
+#include <string>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+
+#include "util/log.h"
+
+
+// log-linear histogram: 2^METRICS_HIST_SUB_BITS sub buckets per power of two (~12% relative error)
+#define METRICS_HIST_SUB_BITS       3
+#define METRICS_HIST_SUB_BUCKETS    (1 << METRICS_HIST_SUB_BITS)
+#define METRICS_HIST_BUCKETS        ((64 - METRICS_HIST_SUB_BITS + 1) * METRICS_HIST_SUB_BUCKETS)
+
+#define METRICS_DEFAULT_PERIOD_MS   1000
+
+
+/**
+ * MetricCounter class
+ *
+ * @note monotonic counter, add() is one relaxed atomic add
+ *
+ */
+class MetricCounter {
+public:
+    void add(uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return m_value.load(std::memory_order_relaxed); }
+private:
+    std::atomic<uint64_t> m_value{0};
+};
+
+
+/**
+ * MetricGauge class
+ *
+ * @note last value gauge; optionally sampled from a callback at snapshot time (e.g. queue depth)
+ * @note setCallback() may be called while the publisher is running (e.g. a pipeline started after
+ *       Metrics::start()) - the callback is swapped under the lock of the gauge, set() / add() stay lock-free
+ *
+ */
+class MetricGauge {
+public:
+    void set(int64_t v) { m_value.store(v, std::memory_order_relaxed); }
+    void add(int64_t v) { m_value.fetch_add(v, std::memory_order_relaxed); }
+
+    int64_t value() const {
+        std::lock_guard<std::mutex> lock(m_fn_mutex);
+        return m_fn ? m_fn() : m_value.load(std::memory_order_relaxed);
+    }
+
+    void setCallback(std::function<int64_t()> fn) {
+        std::lock_guard<std::mutex> lock(m_fn_mutex);
+        m_fn = std::move(fn);
+    }
+private:
+    std::atomic<int64_t> m_value{0};
+    std::function<int64_t()> m_fn;
+    mutable std::mutex m_fn_mutex;
+};
+
+
+/**
+ * MetricHistogram class
+ *
+ * @note HDR style log-linear histogram of nanosecond values; record() is a few relaxed atomic adds and never
+ *       allocates, quantiles are read from the buckets at snapshot time
+ *
+ */
+class MetricHistogram {
+public:
+
+    void record(uint64_t value_ns) {
+        m_buckets[bucket(value_ns)].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_sum.fetch_add(value_ns, std::memory_order_relaxed);
+
+        uint64_t max = m_max.load(std::memory_order_relaxed);
+        while (value_ns > max && !m_max.compare_exchange_weak(max, value_ns, std::memory_order_relaxed));
+    }
+
+    template<class Rep, class Period>
+    void record(std::chrono::duration<Rep, Period> d) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        record(ns > 0 ? (uint64_t)ns : 0);
+    }
+
+    uint64_t count() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return m_sum.load(std::memory_order_relaxed); }
+    uint64_t max() const { return m_max.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief value below which q (0..1) of the recorded values are (upper bound of the bucket)
+     */
+    uint64_t quantile(double q) const;
+
+private:
+
+    static unsigned int bucket(uint64_t v);
+    static uint64_t bucket_upper(unsigned int idx);
+
+    std::atomic<uint64_t> m_buckets[METRICS_HIST_BUCKETS] = {};
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<uint64_t> m_sum{0};
+    std::atomic<uint64_t> m_max{0};
+};
+
+
+/**
+ * Metrics class
+ *
+ * @note process wide registry - counter()/gauge()/histogram() create the metric on first use and return a
+ *       reference which stays valid for the lifetime of the process; call them once at setup and keep the
+ *       reference for the hot path
+ * @note start() runs a publisher thread which writes a Prometheus text snapshot to a file (node exporter
+ *       textfile collector) and pushes a JSON snapshot to websocket users with the "read_metrics" permission
+ *
+ */
+class Metrics {
+public:
+
+    static Metrics& instance();
+
+    MetricCounter& counter(const std::string& name, const std::string& help);
+    MetricGauge& gauge(const std::string& name, const std::string& help);
+    MetricHistogram& histogram(const std::string& name, const std::string& help);
+
+    /**
+     * @brief snapshot in the Prometheus text exposition format; histograms are exported as summaries in seconds
+     */
+    std::string prometheus_text();
+
+    /**
+     * @brief snapshot as JSON object (histograms with count, mean, p50, p99, p999 and max in us)
+     */
+    std::string json_text();
+
+    /**
+     * @brief start the periodic publisher
+     *
+     * @param period_ms publish period
+     * @param prometheus_file file for the text snapshot, empty to disable
+     */
+    void start(unsigned int period_ms, const std::string& prometheus_file);
+
+    void stop();
+
+private:
+
+    Metrics() = default;
+    ~Metrics();
+
+    void publisher_main();
+
+    void publish();
+
+    struct Entry {
+        std::string help;
+        std::unique_ptr<MetricCounter> counter;
+        std::unique_ptr<MetricGauge> gauge;
+        std::unique_ptr<MetricHistogram> histogram;
+    };
+
+    std::map<std::string, Entry> m_metrics;
+    std::mutex m_metrics_mutex;
+
+    std::thread m_publisher;
+    std::atomic_bool m_running{false};
+    unsigned int m_period_ms = METRICS_DEFAULT_PERIOD_MS;
+    std::string m_prometheus_file;
+
+};
@@ -0,0 +1,121 @@
+#include "util/SessionToken.h"
+
+#include <chrono>
+#include <cstring>
+#include <random>
+
+#include "blake2/blake2.h"
+
+
+static std::string to_hex(const uint8_t *data, size_t n) {
+
+    static const char digits[] = "0123456789abcdef";
+    std::string s(2 * n, '0');
+    for (size_t i = 0; i < n; i++) {
+        s[2 * i] = digits[data[i] >> 4];
+        s[2 * i + 1] = digits[data[i] & 0x0f];
+    }
+    return s;
+}
+
+
+static bool from_hex(const std::string& s, std::string& out) {
+
+    if (s.size() % 2)
+        return false;
+
+    out.clear();
+    for (size_t i = 0; i < s.size(); i += 2) {
+        int v = 0;
+        for (int k = 0; k < 2; k++) {
+            const char c = s[i + k];
+            v <<= 4;
+            if (c >= '0' && c <= '9') v |= c - '0';
+            else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+            else return false;
+        }
+        out.push_back((char) v);
+    }
+    return true;
+}
+
+
+static uint64_t unix_time() {
+
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+SessionTokens::SessionTokens(uint32_t lifetime_s) : m_lifetime(lifetime_s) {
+
+    std::random_device random_dev;
+    for (auto& k : m_key)
+        k = random_dev();
+}
+
+
+SessionTokens::~SessionTokens() {
+
+    ::memset(m_key, 0, sizeof m_key);
+}
+
+
+std::string SessionTokens::mac(const std::string& user, uint64_t expiry, const std::string& password_hash) const {
+
+    const std::string msg = user + "." + std::to_string(expiry) + "." + password_hash;
+    uint8_t out[SESSION_TOKEN_MACLEN];
+    blake2b(out, sizeof out, msg.data(), msg.size(), m_key, sizeof m_key);
+    return to_hex(out, sizeof out);
+}
+
+
+std::string SessionTokens::issue(const std::string& user, const std::string& password_hash) const {
+
+    const uint64_t expiry = unix_time() + m_lifetime;
+    return to_hex((const uint8_t *) user.data(), user.size()) + "." + std::to_string(expiry) + "." +
+           mac(user, expiry, password_hash);
+}
+
+
+std::string SessionTokens::user(const std::string& token) {
+
+    const size_t p = token.find('.');
+    std::string u;
+    if (p == std::string::npos || !from_hex(token.substr(0, p), u))
+        return "";
+    return u;
+}
+
+
+bool SessionTokens::verify(const std::string& token, const std::string& password_hash) const {
+
+    const size_t p1 = token.find('.');
+    const size_t p2 = token.find('.', p1 == std::string::npos ? p1 : p1 + 1);
+    if (p1 == std::string::npos || p2 == std::string::npos)
+        return false;
+
+    std::string u;
+    if (!from_hex(token.substr(0, p1), u))
+        return false;
+
+    uint64_t expiry;
+    try {
+        expiry = std::stoull(token.substr(p1 + 1, p2 - p1 - 1));
+    } catch (std::exception&) {
+        return false;
+    }
+    if (expiry < unix_time())
+        return false;
+
+    const std::string expected = mac(u, expiry, password_hash);
+    const std::string given = token.substr(p2 + 1);
+    if (given.size() != expected.size())
+        return false;
+
+    // constant time compare
+    unsigned char diff = 0;
+    for (size_t i = 0; i < expected.size(); i++)
+        diff |= expected[i] ^ given[i];
+
+    return diff == 0;
+}
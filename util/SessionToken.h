@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+#define SESSION_TOKEN_KEYLEN            32
+#define SESSION_TOKEN_MACLEN            32
+#define SESSION_TOKEN_DEFAULT_LIFETIME  (12 * 3600)
+
+
+/**
+ * SessionTokens class
+ *
+ * @note signed session tokens for browsers which reconnect - checking one is a keyed BLAKE2b, no Argon2 run
+ * @note token: hex(user) "." expiry (unix time) "." hex(BLAKE2b-256(key, user "." expiry "." password_hash)); the
+ *       password hash is part of the MAC, so changing the password in users.json invalidates the open tokens
+ * @note the key is random per process - tokens do not survive a restart
+ *
+ */
+class SessionTokens {
+public:
+
+    explicit SessionTokens(uint32_t lifetime_s = SESSION_TOKEN_DEFAULT_LIFETIME);
+
+    ~SessionTokens();
+
+    void setLifetime(uint32_t lifetime_s) { m_lifetime = lifetime_s; }
+
+    uint32_t getLifetime() const { return m_lifetime; }
+
+    std::string issue(const std::string& user, const std::string& password_hash) const;
+
+    /**
+     * @brief user name of a token, empty if the token is malformed
+     *
+     * @note does not check the signature - use verify() with the password hash of that user
+     */
+    static std::string user(const std::string& token);
+
+    bool verify(const std::string& token, const std::string& password_hash) const;
+
+private:
+
+    std::string mac(const std::string& user, uint64_t expiry, const std::string& password_hash) const;
+
+    uint8_t m_key[SESSION_TOKEN_KEYLEN];
+    uint32_t m_lifetime;
+
+};
@@ -0,0 +1,187 @@
+#include "util/SpectrumEngine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+
+SpectrumEngine::SpectrumEngine(unsigned int fps) {
+
+    setFrameRate(fps);
+}
+
+
+SpectrumEngine::~SpectrumEngine() {
+
+    for (auto& c : m_channels)
+        spgramcf_destroy(c.second.q);
+    m_channels.clear();
+}
+
+
+void SpectrumEngine::setFrameRate(unsigned int fps) {
+
+    m_fps = std::max(1u, std::min(fps, 100u));
+    if (m_fps != fps)
+        LOG_TEST_WARN("SpectrumEngine::setFrameRate() {} fps not supported - using {} fps", fps, m_fps);
+
+    if (m_sample_rate > 0)
+        update_timing(m_sample_rate);
+}
+
+
+SpectrumConfig SpectrumEngine::normalize(const SpectrumConfig& config) {
+
+    SpectrumConfig c;
+
+    c.nfft = 64;
+    while (c.nfft < config.nfft && c.nfft < SPECTRUM_MAX_NFFT)
+        c.nfft <<= 1;
+
+    c.average_ms = std::max(1u, std::min(config.average_ms, 10'000u));
+
+    return c;
+}
+
+
+SpectrumConfig SpectrumEngine::addConsumer(const SpectrumConfig& config) {
+
+    const SpectrumConfig c = normalize(config);
+    Channel& ch = m_channels[c];
+
+    if (ch.q == nullptr) {
+        ch.q = spgramcf_create_default(c.nfft);
+        // accumulate all transforms until the next frame
+        spgramcf_set_alpha(ch.q, -1.0f);
+        ch.psd.assign(c.nfft, 0.0f);
+        ch.avg.assign(c.nfft, 0.0f);
+        LOG_TEST_DEBUG("SpectrumEngine::addConsumer() nfft {} average {} ms", c.nfft, c.average_ms);
+
+        if (m_sample_rate > 0)
+            update_timing(m_sample_rate);
+    }
+    ch.users++;
+
+    return c;
+}
+
+
+void SpectrumEngine::removeConsumer(const SpectrumConfig& config) {
+
+    auto it = m_channels.find(normalize(config));
+    if (it == m_channels.end())
+        return;
+
+    if (--it->second.users == 0) {
+        LOG_TEST_DEBUG("SpectrumEngine::removeConsumer() nfft {} average {} ms", it->first.nfft, it->first.average_ms);
+        spgramcf_destroy(it->second.q);
+        m_channels.erase(it);
+    }
+
+    // frames start over with the next consumer
+    if (m_channels.empty())
+        m_since_frame = 0;
+}
+
+
+void SpectrumEngine::update_timing(double sample_rate) {
+
+    m_sample_rate = sample_rate;
+    m_frame_samples = std::max<uint64_t>(1, std::llround(sample_rate / m_fps));
+    m_since_frame = std::min(m_since_frame, m_frame_samples - 1);
+
+    for (auto& c : m_channels) {
+        Channel& ch = c.second;
+        const uint64_t average_samples = std::llround(sample_rate * c.first.average_ms / 1000.0);
+
+        if (average_samples < m_frame_samples) {
+            ch.window = std::max<uint64_t>(average_samples, c.first.nfft);
+            ch.window = std::min(ch.window, m_frame_samples);
+            ch.alpha = 1.0f;
+        } else {
+            ch.window = m_frame_samples;
+            ch.alpha = (float) m_frame_samples / average_samples;
+        }
+        ch.have_avg = false;
+    }
+
+    LOG_TEST_DEBUG("SpectrumEngine::update_timing() sample rate {} - {} samples per frame", sample_rate, m_frame_samples);
+}
+
+
+void SpectrumEngine::push(const RadioThreadIQDataPtr& block) {
+
+    if (m_channels.empty() || !block || block->data.empty())
+        return;
+
+    const auto t0 = std::chrono::steady_clock::now();
+
+    if ((double) block->sampleRate != m_sample_rate)
+        update_timing(block->sampleRate);
+
+    liquid_float_complex *x = block->data.data();
+    size_t n = block->data.size();
+    uint64_t timestamp = block->timestampFirstSample;
+
+    while (n > 0) {
+        const size_t len = std::min<uint64_t>(n, m_frame_samples - m_since_frame);
+        const uint64_t end = m_since_frame + len;
+
+        // only the part of [m_since_frame, end) which lies in the averaging window before the frame
+        for (auto& c : m_channels) {
+            Channel& ch = c.second;
+            const uint64_t start = std::max(m_since_frame, m_frame_samples - ch.window);
+
+            if (start < end)
+                spgramcf_write(ch.q, x + (start - m_since_frame), end - start);
+        }
+
+        x += len;
+        n -= len;
+        timestamp += len;
+        m_since_frame = end;
+
+        if (m_since_frame >= m_frame_samples) {
+            publish(timestamp - 1);
+            m_since_frame = 0;
+        }
+    }
+
+    m_metric_push_time.record(std::chrono::steady_clock::now() - t0);
+}
+
+
+void SpectrumEngine::publish(uint64_t timestamp) {
+
+    const auto t0 = std::chrono::steady_clock::now();
+
+    for (auto& c : m_channels) {
+        Channel& ch = c.second;
+
+        if (spgramcf_get_num_transforms(ch.q) == 0)
+            continue;
+
+        spgramcf_get_psd(ch.q, ch.psd.data());
+
+        // a short window is not contiguous with the one of the next frame
+        if (ch.window < m_frame_samples)
+            spgramcf_reset(ch.q);
+        else
+            spgramcf_clear(ch.q);
+
+        if (ch.alpha < 1.0f) {
+            for (unsigned int i = 0; i < c.first.nfft; i++) {
+                const float p = std::pow(10.0f, ch.psd[i] / 10.0f);
+                ch.avg[i] = ch.have_avg ? ch.avg[i] + ch.alpha * (p - ch.avg[i]) : p;
+                ch.psd[i] = 10.0f * std::log10(ch.avg[i]);
+            }
+            ch.have_avg = true;
+        }
+
+        if (m_callback)
+            m_callback(c.first, ch.psd.data(), timestamp);
+        m_metric_frames.add();
+    }
+
+    m_metric_frame_time.record(std::chrono::steady_clock::now() - t0);
+}
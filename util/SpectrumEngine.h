@@ -0,0 +1,126 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+#include "liquid/liquid.h"
+
+#include "phy/RadioThread.h"
+#include "util/log.h"
+#include "util/Metrics.h"
+
+
+#define SPECTRUM_DEFAULT_FPS        25
+#define SPECTRUM_DEFAULT_NFFT       512
+#define SPECTRUM_DEFAULT_AVERAGE_MS 40
+#define SPECTRUM_MAX_NFFT           8192
+
+
+/**
+ * SpectrumConfig
+ *
+ * @note transform size and averaging interval of a spectrum - sessions with the same config share one spectrum
+ *
+ */
+struct SpectrumConfig {
+    unsigned int nfft = SPECTRUM_DEFAULT_NFFT;
+    unsigned int average_ms = SPECTRUM_DEFAULT_AVERAGE_MS;
+
+    bool operator<(const SpectrumConfig& o) const {
+        return nfft < o.nfft || (nfft == o.nfft && average_ms < o.average_ms);
+    }
+    bool operator==(const SpectrumConfig& o) const {
+        return nfft == o.nfft && average_ms == o.average_ms;
+    }
+};
+
+
+/**
+ * SpectrumEngine class
+ *
+ * @note computes the PSD for the spectrum displays at a fixed frame rate instead of per IQ block; one persistent
+ *       spgramcf (windowed, overlapping FFTs) per SpectrumConfig in use
+ * @note the frame clock runs on the sample count of the pushed blocks, i.e. a frame is due every
+ *       sample_rate / fps samples; per frame the PSD is read once and handed to the callback which sends it to
+ *       all sessions of that config
+ * @note average_ms up to the frame period: only the last average_ms of samples before a frame are written to the
+ *       spgram (the samples in between are not transformed at all); longer intervals keep the spgram averaging
+ *       over the whole frame and smooth the frames exponentially with a time constant of average_ms
+ * @note without consumers push() returns right away; all calls have to come from one thread and the callback
+ *       must not add or remove consumers
+ *
+ */
+class SpectrumEngine {
+public:
+
+    /**
+     * @param config spectrum config of this frame
+     * @param psd nfft values in dB, DC in the middle
+     * @param timestamp timestamp of the last sample of the frame
+     */
+    typedef std::function<void(const SpectrumConfig& config, const float *psd, uint64_t timestamp)> FrameCallback;
+
+    explicit SpectrumEngine(unsigned int fps = SPECTRUM_DEFAULT_FPS);
+
+    ~SpectrumEngine();
+
+    SpectrumEngine(const SpectrumEngine&) = delete;
+
+    SpectrumEngine& operator=(const SpectrumEngine&) = delete;
+
+    void setFrameRate(unsigned int fps);
+
+    unsigned int getFrameRate() const { return m_fps; }
+
+    void setCallback(FrameCallback cb) { m_callback = std::move(cb); }
+
+    /**
+     * @brief a session uses config - reference counted, the spgram is created with the first user
+     *
+     * @return the config actually used (nfft is limited to a power of 2 up to SPECTRUM_MAX_NFFT)
+     */
+    SpectrumConfig addConsumer(const SpectrumConfig& config);
+
+    void removeConsumer(const SpectrumConfig& config);
+
+    bool hasConsumers() const { return !m_channels.empty(); }
+
+    /**
+     * @brief feed one received block
+     */
+    void push(const RadioThreadIQDataPtr& block);
+
+    static SpectrumConfig normalize(const SpectrumConfig& config);
+
+private:
+
+    struct Channel {
+        spgramcf q = nullptr;
+        unsigned int users = 0;
+        uint64_t window = 0;            // samples per frame which are written into the spgram
+        float alpha = 1.0f;             // exponential smoothing of the frames (1 = none)
+        bool have_avg = false;
+        std::vector<float> psd;         // dB
+        std::vector<float> avg;         // linear power
+    };
+
+    void update_timing(double sample_rate);
+
+    void publish(uint64_t timestamp);
+
+    std::map<SpectrumConfig, Channel> m_channels;
+
+    FrameCallback m_callback;
+
+    unsigned int m_fps;
+    double m_sample_rate = 0;
+    uint64_t m_frame_samples = 0;       // samples per frame
+    uint64_t m_since_frame = 0;         // samples since the last frame
+
+    MetricCounter& m_metric_frames = Metrics::instance().counter("spectrum_frames_total", "spectrum frames published");
+    MetricHistogram& m_metric_push_time = Metrics::instance().histogram("spectrum_push_seconds", "spectrum time per IQ block");
+    MetricHistogram& m_metric_frame_time = Metrics::instance().histogram("spectrum_frame_seconds", "PSD and publish time per frame");
+
+};
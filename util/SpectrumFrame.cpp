@@ -0,0 +1,159 @@
+#include "util/SpectrumFrame.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+
+SpectrumEncoding spectrumEncodingFromString(const std::string& s) {
+
+    if (s == "u8" || s == "U8")
+        return SpectrumEncoding::U8;
+    if (s == "i16" || s == "I16")
+        return SpectrumEncoding::I16;
+    return SpectrumEncoding::JSON;
+}
+
+
+const char *spectrumEncodingToString(SpectrumEncoding encoding) {
+
+    switch (encoding) {
+        case SpectrumEncoding::U8:
+            return "u8";
+        case SpectrumEncoding::I16:
+            return "i16";
+        default:
+            return "json";
+    }
+}
+
+
+void spectrum_quantize(SpectrumEncoding encoding, const float *psd, unsigned int nfft, std::vector<uint8_t>& bins) {
+
+    if (encoding == SpectrumEncoding::I16) {
+        bins.resize(2 * nfft);
+        for (unsigned int i = 0; i < nfft; i++) {
+            float v = std::round(psd[i] / SPECTRUM_I16_DB_STEP);
+            v = std::max(-32768.0f, std::min(v, 32767.0f));     // also maps -inf of an empty bin to the minimum
+            const uint16_t q = (uint16_t) (int16_t) v;
+            bins[2 * i] = q & 0xff;
+            bins[2 * i + 1] = q >> 8;
+        }
+    } else {
+        bins.resize(nfft);
+        for (unsigned int i = 0; i < nfft; i++) {
+            float v = std::round((psd[i] - SPECTRUM_U8_DB_MIN) / SPECTRUM_U8_DB_STEP);
+            bins[i] = (uint8_t) std::max(0.0f, std::min(v, 255.0f));
+        }
+    }
+}
+
+
+SpectrumFrameEncoder::SpectrumFrameEncoder(SpectrumEncoding encoding, bool delta) :
+        m_encoding(encoding == SpectrumEncoding::I16 ? SpectrumEncoding::I16 : SpectrumEncoding::U8),
+        m_delta(delta) {
+}
+
+
+void SpectrumFrameEncoder::reset() {
+
+    m_since_key = 0;
+    m_prev.clear();
+}
+
+
+size_t SpectrumFrameEncoder::packbits(const uint8_t *in, size_t n, uint8_t *out) {
+
+    size_t o = 0;
+    size_t i = 0;
+
+    while (i < n) {
+        size_t run = 1;
+        while (i + run < n && run < 128 && in[i + run] == in[i])
+            run++;
+
+        if (run >= 2) {
+            out[o++] = (uint8_t) (257 - run);
+            out[o++] = in[i];
+            i += run;
+            continue;
+        }
+
+        // literals up to the next run of at least 3 equal bytes
+        size_t lit = 1;
+        while (i + lit < n && lit < 128 &&
+               !(i + lit + 2 < n && in[i + lit] == in[i + lit + 1] && in[i + lit] == in[i + lit + 2]))
+            lit++;
+
+        out[o++] = (uint8_t) (lit - 1);
+        std::memcpy(out + o, in + i, lit);
+        o += lit;
+        i += lit;
+    }
+
+    return o;
+}
+
+
+bool SpectrumFrameEncoder::encode(const std::vector<uint8_t>& bins, unsigned int nfft, double center, double span,
+                                  uint64_t timestamp, std::string& out) {
+
+    SpectrumFrameHeader h{};
+    std::memcpy(h.magic, SPECTRUM_FRAME_MAGIC, 4);
+    h.version = SPECTRUM_FRAME_VERSION;
+    h.encoding = (uint8_t) m_encoding;
+    h.nfft = nfft;
+    h.center = center;
+    h.span = span;
+    h.timestamp = timestamp;
+    if (m_encoding == SpectrumEncoding::I16) {
+        h.db_offset = 0.0f;
+        h.db_step = SPECTRUM_I16_DB_STEP;
+    } else {
+        h.db_offset = SPECTRUM_U8_DB_MIN;
+        h.db_step = SPECTRUM_U8_DB_STEP;
+    }
+
+    const uint8_t *payload = bins.data();
+    size_t len = bins.size();
+
+    if (m_delta) {
+        if (m_prev.size() != bins.size() || m_since_key >= SPECTRUM_KEYFRAME_INTERVAL)
+            m_since_key = 0;
+
+        if (m_since_key > 0) {
+            m_diff.resize(len);
+            if (m_encoding == SpectrumEncoding::I16) {
+                for (size_t i = 0; i < len; i += 2) {
+                    const uint16_t d = (uint16_t) ((bins[i] | bins[i + 1] << 8) - (m_prev[i] | m_prev[i + 1] << 8));
+                    m_diff[i] = d & 0xff;
+                    m_diff[i + 1] = d >> 8;
+                }
+            } else {
+                for (size_t i = 0; i < len; i++)
+                    m_diff[i] = (uint8_t) (bins[i] - m_prev[i]);
+            }
+            payload = m_diff.data();
+            h.flags |= SPECTRUM_FLAG_DELTA;
+        }
+
+        m_prev = bins;
+        m_since_key++;
+    }
+
+    m_rle.resize(len + len / 128 + 1);
+    const size_t rle_len = packbits(payload, len, m_rle.data());
+    if (rle_len < len) {
+        payload = m_rle.data();
+        len = rle_len;
+        h.flags |= SPECTRUM_FLAG_RLE;
+    }
+
+    h.payload_len = len;
+
+    out.resize(sizeof(h) + len);
+    std::memcpy(&out[0], &h, sizeof(h));
+    std::memcpy(&out[sizeof(h)], payload, len);
+
+    return (h.flags & SPECTRUM_FLAG_DELTA) != 0;
+}
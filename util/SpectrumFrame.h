@@ -0,0 +1,117 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+#define SPECTRUM_FRAME_MAGIC        "RPXS"
+#define SPECTRUM_FRAME_VERSION      1
+
+// uint8 bins: dB = SPECTRUM_U8_DB_MIN + value * SPECTRUM_U8_DB_STEP (-120 .. +7.5 dB)
+#define SPECTRUM_U8_DB_MIN          -120.0f
+#define SPECTRUM_U8_DB_STEP         0.5f
+// int16 bins: dB = value * SPECTRUM_I16_DB_STEP
+#define SPECTRUM_I16_DB_STEP        0.01f
+
+// a delta coded stream sends a key frame (absolute bins) every n frames
+#define SPECTRUM_KEYFRAME_INTERVAL  25
+
+
+/**
+ * @brief encoding of the spectrum messages of a session - JSON text (default, old clients) or binary frames
+ */
+enum class SpectrumEncoding : uint8_t {
+    JSON = 0,
+    U8 = 1,
+    I16 = 2
+};
+
+SpectrumEncoding spectrumEncodingFromString(const std::string& s);
+
+const char *spectrumEncodingToString(SpectrumEncoding encoding);
+
+
+#define SPECTRUM_FLAG_DELTA         0x01    // bins are the difference to the previous frame (modulo 2^8 / 2^16)
+#define SPECTRUM_FLAG_RLE           0x02    // payload is PackBits run length coded
+
+
+/**
+ * SpectrumFrameHeader
+ *
+ * @note header of a binary spectrum frame, all fields little endian, followed by payload_len bytes of bins
+ *       (nfft uint8 or nfft int16 values, DC in the middle) - after undoing RLE and delta if flagged
+ * @note PackBits: control byte c, c < 128: c + 1 literal bytes follow, c > 128: the next byte is repeated
+ *       257 - c times, c == 128 is skipped
+ *
+ */
+#pragma pack(push, 1)
+struct SpectrumFrameHeader {
+    char magic[4];              // "RPXS"
+    uint8_t version;            // SPECTRUM_FRAME_VERSION
+    uint8_t encoding;           // SpectrumEncoding::U8 / I16
+    uint8_t flags;              // SPECTRUM_FLAG_*
+    uint8_t reserved;
+    uint32_t nfft;
+    uint32_t payload_len;
+    double center;              // Hz
+    double span;                // Hz
+    uint64_t timestamp;         // sample timestamp of the last sample of the frame
+    float db_offset;            // dB = db_offset + bin * db_step
+    float db_step;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(SpectrumFrameHeader) == 48, "SpectrumFrameHeader layout");
+
+
+/**
+ * @brief quantize nfft dB values to the bins of encoding (little endian bytes)
+ *
+ * @note done once per frame and spectrum config, the per session SpectrumFrameEncoder works on these bytes
+ */
+void spectrum_quantize(SpectrumEncoding encoding, const float *psd, unsigned int nfft, std::vector<uint8_t>& bins);
+
+
+/**
+ * SpectrumFrameEncoder class
+ *
+ * @note builds the binary message of one session from the quantized bins; with delta coding the encoder keeps
+ *       the previous frame of the session and sends a key frame every SPECTRUM_KEYFRAME_INTERVAL frames and
+ *       whenever nfft changes
+ * @note RLE is applied when it makes the payload smaller (slowly changing bins give long zero runs in delta mode)
+ *
+ */
+class SpectrumFrameEncoder {
+public:
+
+    explicit SpectrumFrameEncoder(SpectrumEncoding encoding = SpectrumEncoding::U8, bool delta = false);
+
+    SpectrumEncoding getEncoding() const { return m_encoding; }
+
+    bool getDelta() const { return m_delta; }
+
+    /**
+     * @brief the next frame is a key frame
+     */
+    void reset();
+
+    /**
+     * @return true if the frame is delta coded (refers to the frame before)
+     */
+    bool encode(const std::vector<uint8_t>& bins, unsigned int nfft, double center, double span, uint64_t timestamp,
+                std::string& out);
+
+private:
+
+    static size_t packbits(const uint8_t *in, size_t n, uint8_t *out);
+
+    SpectrumEncoding m_encoding;
+    bool m_delta;
+
+    unsigned int m_since_key = 0;
+    std::vector<uint8_t> m_prev;
+    std::vector<uint8_t> m_diff;
+    std::vector<uint8_t> m_rle;
+
+};
@@ -16,6 +16,7 @@
 #include <stdexcept>
 #include <fstream>
 #include <queue>
+#include <algorithm>
 #include <nlohmann/json.hpp>
 #include "libwebsockets.h"
 #include "util/WebSocketServer.h"
@@ -34,18 +35,24 @@ using namespace std;
 WebSocketServer *webSocketServer;
 
 
-void read_users(const string & file_name, map<string, User> & users) {
+bool read_users(const string & file_name, map<string, User> & users) {
     std::filesystem::path file_name0{file_name};
     if (!std::filesystem::exists(file_name0)) {
         LOG_TEST_ERROR("User database {} is missing! Continuing without user support.", file_name);
-        return;
+        return false;
     }
     std::ifstream users_file(file_name);
-    nlohmann::json users_json = nlohmann::json::parse(users_file);
+    nlohmann::json users_json;
+    try {
+        users_json = nlohmann::json::parse(users_file);
+    } catch (std::exception & exception) {
+        LOG_TEST_ERROR("User database {} is not parsable: {}", file_name, exception.what());
+        return false;
+    }
     users_file.close();
     if(!users_json.is_array()) {
         LOG_TEST_ERROR("we got an invalid type - ignore the user file");
-        return;
+        return false;
     }
     for (auto & item: users_json) {
         // wrong type
@@ -68,6 +75,7 @@ void read_users(const string & file_name, map<string, User> & users) {
         }
         users[user.getUsername()] = user;
     }
+    return true;
 }
 
 static int callback_main(   struct lws *wsi,
@@ -76,38 +84,19 @@ static int callback_main(   struct lws *wsi,
                             void *in,
                             size_t len )
 {
-    int fd;
-
     switch( reason ) {
         case LWS_CALLBACK_ESTABLISHED:
-            webSocketServer->onConnectWrapper(lws_get_socket_fd(wsi ) );
-            lws_callback_on_writable( wsi );
+            webSocketServer->onConnectWrapper(lws_get_socket_fd(wsi ), wsi );
             break;
 
-        case LWS_CALLBACK_SERVER_WRITEABLE: {
-            fd = lws_get_socket_fd(wsi);
-
-            auto * buffer = webSocketServer->connections[fd]->getBuffer();
-            while (buffer != nullptr && !buffer->empty()) {
-                const auto message = buffer->front();
-                char buf[LWS_PRE + message.length()];
-                ::memset(buf, 0, LWS_PRE);
-                ::strcpy(buf + LWS_PRE, message.c_str());
-                int charsSent = lws_write(wsi, (unsigned char *) buf + LWS_PRE, message.length(), LWS_WRITE_TEXT);
-                //int charsSent = lws_write(wsi, (unsigned char *) "asdf", ::strlen("asdf"), LWS_WRITE_TEXT);
-                if (charsSent < message.length()) {
-                    std::cout << "check check " << fd << " " << buffer->size() << std::endl;
-                    webSocketServer->onErrorWrapper(fd, string("Error writing to socket"));
-                    break;  // added as there is a bug when the fd is remove on error and the while is still running
-                } else {
-                    // Only pop the message if it was sent successfully.
-                    buffer->pop();
-                }
-            }
+        case LWS_CALLBACK_SERVER_WRITEABLE:
+            webSocketServer->onWritable( wsi );
+            break;
 
-            lws_callback_on_writable( wsi );
+        // lws_cancel_service() from a producer thread
+        case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+            webSocketServer->onWakeup( wsi );
             break;
-        }
 
         case LWS_CALLBACK_RECEIVE:
             webSocketServer->onMessage(lws_get_socket_fd(wsi ), string((const char *)in, len ) );
@@ -179,25 +168,44 @@ WebSocketServer::WebSocketServer( int port, const string & certPath, const strin
     // allows us to call instance variables from the outside.  Unfortunately this
     // means some attributes must be public that otherwise would be private.
     webSocketServer = this;
-    read_users("users.json", users);
+    this->_auth_pool.reset( new AuthWorkerPool( ) );
+    this->reloadUsers( );
 }
 
 WebSocketServer::~WebSocketServer( )
 {
+    this->stopService( );
+    // running verifications report to the connections - finish them first
+    if( this->_auth_pool )
+        this->_auth_pool->stop( );
+
     // Free up some memory
-    for( auto it = this->connections.begin( ); it != this->connections.end( ); ++it )
-    {
-        Connection* c = it->second;
-        this->connections.erase( it->first );
-        delete c;
-    }
+    lock_guard<recursive_mutex> lock( this->_connections_mutex );
+    for( auto & connection : this->connections )
+        delete connection.second;
+    this->connections.clear( );
 }
 
-void WebSocketServer::onConnectWrapper( int socketID )
+// query arguments of the upgrade request which are kept as connection values, e.g. ws://host:port/?format=u8&delta=1
+static const char *connect_args[] = { "format", "delta", "nfft", "average_ms" };
+
+void WebSocketServer::onConnectWrapper( int socketID, struct lws *wsi )
 {
     auto* c = new Connection;
     c->setCreateTime(time(nullptr));
-    this->connections[ socketID ] = c;
+    c->setId(this->_next_connection_id++);
+    if( wsi != nullptr ) {
+        char value[64];
+        for( const char *arg : connect_args ) {
+            const string name = string(arg) + "=";
+            if( lws_get_urlarg_by_name( wsi, name.c_str( ), value, sizeof value ) != nullptr )
+                (*c)[arg] = value + name.length( );
+        }
+    }
+    {
+        lock_guard<recursive_mutex> lock( this->_connections_mutex );
+        this->connections[ socketID ] = c;
+    }
     this->onConnect( socketID );
 }
 
@@ -217,24 +225,111 @@ void WebSocketServer::onErrorWrapper( int socketID, const string& message )
 
 void WebSocketServer::send( int socketID, const string& data )
 {
-    // Push this onto the buffer. It will be written out when the socket is writable.
-    this->connections[socketID]->push_to_buffer( data );
+    this->send( socketID, make_shared<const string>( data ), false, ConnectionMessageKind::Control );
+}
+
+void WebSocketServer::send( int socketID, const ConnectionPayload& data, bool binary, ConnectionMessageKind kind )
+{
+    // Push this onto the buffer. It will be written out by the service thread when the socket is writable.
+    {
+        lock_guard<recursive_mutex> lock( this->_connections_mutex );
+        auto it = this->connections.find( socketID );
+        if( it == this->connections.end( ) )
+            return;
+        it->second->push_to_buffer( data, binary, kind );
+    }
+    this->_wakeup( );
+}
+
+void WebSocketServer::send_binary( int socketID, const string& data )
+{
+    this->send( socketID, make_shared<const string>( data ), true, ConnectionMessageKind::Control );
+}
+
+bool WebSocketServer::send_frame( int socketID, const ConnectionPayload& data, bool binary, bool delta, size_t& dropped )
+{
+    bool queued;
+    {
+        lock_guard<recursive_mutex> lock( this->_connections_mutex );
+        auto it = this->connections.find( socketID );
+        if( it == this->connections.end( ) )
+            return false;
+        queued = it->second->push_to_buffer( data, binary,
+                                             delta ? ConnectionMessageKind::FrameDelta : ConnectionMessageKind::Frame );
+        dropped += it->second->take_dropped( );
+    }
+    this->_wakeup( );
+    return queued;
 }
 
 void WebSocketServer::broadcast(const string& data )
 {
-    for(auto & connection : this->connections) {
-        this->send(connection.first, data);
+    // one payload for all connections
+    const ConnectionPayload payload = make_shared<const string>( data );
+    {
+        lock_guard<recursive_mutex> lock( this->_connections_mutex );
+        for(auto & connection : this->connections)
+            connection.second->push_to_buffer( payload, false, ConnectionMessageKind::Control );
     }
+    this->_wakeup( );
+}
+
+void WebSocketServer::_wakeup( )
+{
+    // one lws_cancel_service() until the service thread has handled it
+    if( !this->_wakeup_pending.exchange( true ) )
+        lws_cancel_service( this->_context );
+}
+
+void WebSocketServer::onWakeup( struct lws *wsi )
+{
+    this->_wakeup_pending.store( false );
+    lws_callback_on_writable_all_protocol( lws_get_context( wsi ), &protocols[0] );
+}
+
+void WebSocketServer::onWritable( struct lws *wsi )
+{
+    const int fd = lws_get_socket_fd( wsi );
+
+    // one message per writable callback - lws buffers partial writes, a slow client only backs up its own queue
+    if( lws_send_pipe_choked( wsi ) ) {
+        lws_callback_on_writable( wsi );
+        return;
+    }
+
+    ConnectionMessage message;
+    bool more;
+    {
+        lock_guard<recursive_mutex> lock( this->_connections_mutex );
+        auto it = this->connections.find( fd );
+        if( it == this->connections.end( ) || !it->second->pop_from_buffer( message ) )
+            return;
+        more = it->second->has_pending( );
+    }
+
+    const string & data = *message.data;
+    this->_write_buffer.resize( LWS_PRE + data.length( ) );
+    ::memcpy( this->_write_buffer.data( ) + LWS_PRE, data.data( ), data.length( ) );
+    int charsSent = lws_write( wsi, this->_write_buffer.data( ) + LWS_PRE, data.length( ),
+                               message.binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT );
+    if( charsSent < (int) data.length( ) ) {
+        this->onErrorWrapper( fd, string( "Error writing to socket" ) );
+        return;
+    }
+
+    if( more )
+        lws_callback_on_writable( wsi );
 }
 
 void WebSocketServer::setValue( int socketID, const string& name, const string& value )
 {
+    lock_guard<recursive_mutex> lock( this->_connections_mutex );
     (*this->connections[socketID])[name] = value;
 }
 
 string WebSocketServer::getValue( int socketID, const string& name )
 {
+    lock_guard<recursive_mutex> lock( this->_connections_mutex );
     return (*this->connections[socketID])[name];
 }
 int WebSocketServer::getNumberOfConnections( )
@@ -244,12 +339,38 @@ int WebSocketServer::getNumberOfConnections( )
 
 void WebSocketServer::run( uint64_t timeout )
 {
-    while( true )
+    while( !this->_service_stop.load( ) )
     {
         this->wait( timeout );
     }
 }
 
+void WebSocketServer::startService( uint64_t timeout )
+{
+    if( this->_service_thread != nullptr )
+        return;
+    this->_service_stop.store( false );
+    this->_service_thread = new thread( [this, timeout]( ) {
+        try {
+            this->run( timeout );
+        }
+        catch( std::exception & exception ) {
+            LOG_TEST_ERROR("WebSocketServer service thread: {}", exception.what( ) );
+        }
+    } );
+}
+
+void WebSocketServer::stopService( )
+{
+    if( this->_service_thread == nullptr )
+        return;
+    this->_service_stop.store( true );
+    lws_cancel_service( this->_context );
+    this->_service_thread->join( );
+    delete this->_service_thread;
+    this->_service_thread = nullptr;
+}
+
 void WebSocketServer::wait( uint64_t timeout )
 {
     if( lws_service( this->_context, timeout ) < 0 ) {
@@ -259,62 +380,190 @@ void WebSocketServer::wait( uint64_t timeout )
 
 void WebSocketServer::_removeConnection( int socketID )
 {
-    Connection* c = this->connections[ socketID ];
+    lock_guard<recursive_mutex> lock( this->_connections_mutex );
+    auto it = this->connections.find( socketID );
+    if( it == this->connections.end( ) )
+        return;
+    Connection* c = it->second;
     this->connections.erase( socketID );
     delete c;
 }
 
 void WebSocketServer::broadcast_log(const string &data) {
+    lock_guard<recursive_mutex> lock(this->_connections_mutex);
     if (this->connections.empty()) return;
 
+    ConnectionPayload payload;
     for(auto & id_and_connection: this->connections) {
         auto & user = users[id_and_connection.second->getUser()];
         if (user.hasPermission("read_log")) {
-            nlohmann::json j = {
-                    {"log", {{"message", data}}}
-            };
-            id_and_connection.second->push_to_buffer(j.dump());
+            if (!payload) {
+                nlohmann::json j = {
+                        {"log", {{"message", data}}}
+                };
+                payload = make_shared<const string>(j.dump());
+            }
+            id_and_connection.second->push_to_buffer(payload, false, ConnectionMessageKind::Control);
         }
     }
+    if (payload)
+        this->_wakeup();
 }
 
-bool WebSocketServer::authenticate(int socketId, const std::string & user, const std::string & pass) {
-    if (users.count(user) <= 0) {
-        LOG_TEST_INFO("Error: User {} does not exist", user);
-        if (socketId > 0) {
-            connections[socketId]->push_to_buffer(R"({"auth": {"message": "Password Wrong"}})");
+void WebSocketServer::broadcast_metrics(const string &json_data) {
+    lock_guard<recursive_mutex> lock(this->_connections_mutex);
+    if (this->connections.empty()) return;
+
+    // json_data is already a JSON object (Metrics::json_text())
+    const ConnectionPayload msg = make_shared<const string>("{\"metrics\":" + json_data + "}");
+
+    for(auto & id_and_connection: this->connections) {
+        auto & user = users[id_and_connection.second->getUser()];
+        if (user.hasPermission("read_metrics")) {
+            id_and_connection.second->push_to_buffer(msg, false, ConnectionMessageKind::Control);
         }
+    }
+    this->_wakeup();
+}
+
+void WebSocketServer::setAuth(unsigned int workers, size_t max_pending, uint32_t token_lifetime_s) {
+    if (this->_auth_pool)
+        this->_auth_pool->stop();
+    this->_auth_pool.reset(new AuthWorkerPool(workers, max_pending));
+    this->_tokens.setLifetime(token_lifetime_s);
+}
+
+bool WebSocketServer::reloadUsers() {
+    std::error_code ec;
+    const auto mtime = std::filesystem::last_write_time(this->_users_file, ec);
+
+    // the lookups keep working on the old map while the file is parsed
+    map<string, User> fresh;
+    if (!read_users(this->_users_file, fresh))
         return false;
+
+    size_t n;
+    {
+        lock_guard<recursive_mutex> lock(this->_connections_mutex);
+        this->users.swap(fresh);
+        this->_users_mtime = mtime;
+        n = this->users.size();
     }
-    auto & user0 = users[user];
-    Argon2Wrapper argon2;
-    if (argon2.verifyHash(pass, user0.getPasswordHash())) {
-        if (socketId > 0) { // if we have a socket - send a notification
-            connections[socketId]->setUser(user);
-            nlohmann::json j = {
-                {"auth", {
-                    {"message", "Authenticated Successfully"},
-                    {"userdata", {
-                        {"username", user0.getUsername()},
-                        {"permissions", user0.getPermissions()}
-                    }}
-                }}
-            };
-            connections[socketId]->push_to_buffer(j.dump());
+    LOG_TEST_INFO("User database {} loaded - {} users", this->_users_file, n);
+    return true;
+}
+
+void WebSocketServer::_reloadUsersIfChanged() {
+    std::error_code ec;
+    const auto mtime = std::filesystem::last_write_time(this->_users_file, ec);
+    if (!ec && mtime != this->_users_mtime)
+        this->reloadUsers();
+}
+
+bool WebSocketServer::authenticate(int socketId, const std::string & user, const std::string & pass) {
+    this->_reloadUsersIfChanged();
+
+    string hash;
+    uint64_t connectionId = 0;
+    {
+        lock_guard<recursive_mutex> lock(this->_connections_mutex);
+        if (users.count(user) <= 0) {
+            LOG_TEST_INFO("Error: User {} does not exist", user);
+            if (socketId > 0) {
+                this->send(socketId, R"({"auth": {"message": "Password Wrong"}})");
+            }
+            return false;
         }
-        return true;
-    } else {
-        if (socketId> 0) { // if we have a socket - send a notification
-            connections[socketId]->push_to_buffer(R"({"auth": {"message": "Password Wrong"}})");
+        hash = users[user].getPasswordHash();
+        auto it = this->connections.find(socketId);
+        if (it != this->connections.end())
+            connectionId = it->second->getId();
+    }
+
+    // Argon2 needs m_cost KiB and ~100 ms - not on the service thread
+    const bool queued = this->_auth_pool->submit([this, socketId, connectionId, user, password = string(pass), hash]() mutable {
+        Argon2Wrapper argon2;
+        const bool ok = argon2.verifyHash(password, hash);
+        ::memset(&password[0], 0, password.size());
+        this->_authResult(socketId, connectionId, user, hash, ok);
+    });
+
+    if (!queued) {
+        LOG_TEST_INFO("Authentication of {} refused - {} verifications pending", user, this->_auth_pool->pending());
+        if (socketId > 0)
+            this->send(socketId, R"({"auth": {"message": "Busy - try again"}})");
+    }
+    return queued;
+}
+
+bool WebSocketServer::authenticate_token(int socketId, const std::string & token) {
+    this->_reloadUsersIfChanged();
+
+    const string user = SessionTokens::user(token);
+    {
+        lock_guard<recursive_mutex> lock(this->_connections_mutex);
+        if (!user.empty() && users.count(user) > 0 && this->_tokens.verify(token, users[user].getPasswordHash())) {
+            this->_authSuccess(socketId, user);
+            return true;
         }
-        return false;
     }
+    LOG_TEST_INFO("Session token of {} rejected", user);
+    if (socketId > 0)
+        this->send(socketId, R"({"auth": {"message": "Token Invalid"}})");
+    return false;
+}
+
+void WebSocketServer::_authResult(int socketId, uint64_t connectionId, const string & user, const string & hash, bool ok) {
+    {
+        lock_guard<recursive_mutex> lock(this->_connections_mutex);
+        auto it = this->connections.find(socketId);
+        if (socketId <= 0 || it == this->connections.end() || it->second->getId() != connectionId) {
+            // closed while the hash was verified (the fd may belong to a new connection by now)
+            return;
+        }
+        // the password may have changed in between
+        if (ok && users.count(user) > 0 && users[user].getPasswordHash() == hash) {
+            this->_authSuccess(socketId, user);
+        } else {
+            it->second->push_to_buffer(R"({"auth": {"message": "Password Wrong"}})");
+        }
+    }
+    this->_wakeup();
+}
+
+void WebSocketServer::_authSuccess(int socketId, const string & user) {
+    // called with the connections mutex held
+    auto it = this->connections.find(socketId);
+    if (it == this->connections.end())
+        return;
+    auto & user0 = users[user];
+    it->second->setUser(user);
+    nlohmann::json j = {
+        {"auth", {
+            {"message", "Authenticated Successfully"},
+            {"token", this->_tokens.issue(user, user0.getPasswordHash())},
+            {"userdata", {
+                {"username", user0.getUsername()},
+                {"permissions", user0.getPermissions()}
+            }}
+        }}
+    };
+    it->second->push_to_buffer(j.dump());
+    this->_wakeup();
 }
 
 time_t Connection::getCreateTime() const {
     return createTime;
 }
 
+uint64_t Connection::getId() const {
+    return id;
+}
+
+void Connection::setId(uint64_t id) {
+    Connection::id = id;
+}
+
 void Connection::setCreateTime(time_t createTime) {
     Connection::createTime = createTime;
 }
@@ -328,11 +577,53 @@ void Connection::setUser(const string &user) {
 }
 
 void Connection::push_to_buffer(const string &buffer) {
-    this->buffer.push(buffer);
+    this->push_to_buffer(make_shared<const string>(buffer), false, ConnectionMessageKind::Control);
+}
+
+bool Connection::push_to_buffer(const ConnectionPayload &data, bool binary, ConnectionMessageKind kind) {
+    if (this->buffer.size() >= CONNECTION_MAX_QUEUE) {
+        // drop the oldest frame and the delta frames which refer to it - control messages are always kept
+        auto it = std::find_if(this->buffer.begin(), this->buffer.end(), [](const ConnectionMessage &m) {
+            return m.kind != ConnectionMessageKind::Control;
+        });
+        if (it != this->buffer.end()) {
+            it = this->buffer.erase(it);
+            this->dropped++;
+            while (it != this->buffer.end() && it->kind != ConnectionMessageKind::Frame) {
+                if (it->kind == ConnectionMessageKind::FrameDelta) {
+                    it = this->buffer.erase(it);
+                    this->dropped++;
+                } else {
+                    ++it;
+                }
+            }
+            // the chain reached the new message - its reference frame is gone
+            if (it == this->buffer.end() && kind == ConnectionMessageKind::FrameDelta) {
+                this->dropped++;
+                return false;
+            }
+        }
+    }
+    this->buffer.push_back(ConnectionMessage{data, binary, kind});
+    return true;
+}
+
+bool Connection::pop_from_buffer(ConnectionMessage &message) {
+    if (this->buffer.empty())
+        return false;
+    message = std::move(this->buffer.front());
+    this->buffer.pop_front();
+    return true;
+}
+
+bool Connection::has_pending() const {
+    return !this->buffer.empty();
 }
 
-queue<string> *Connection::getBuffer() {
-    return &(this->buffer);
+size_t Connection::take_dropped() {
+    size_t n = this->dropped;
+    this->dropped = 0;
+    return n;
 }
 
 string &Connection::operator[](const string &key) { return keyValueMap[key]; }
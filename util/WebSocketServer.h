@@ -26,18 +26,49 @@
 #include <iostream>
 #include <sstream>
 #include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
 #include "libwebsockets.h"
+#include <filesystem>
 #include "User.h"
+#include "AuthWorkerPool.h"
+#include "SessionToken.h"
 
 using namespace std;
 
 
 
-// Represents a client connection
+// Messages per connection before spectrum frames are dropped (oldest first)
+#define CONNECTION_MAX_QUEUE 32
+
+// Payloads are shared between the connections a message is sent to
+typedef shared_ptr<const string> ConnectionPayload;
+
+enum class ConnectionMessageKind : uint8_t
+{
+    Control,        // never dropped
+    Frame,          // may be dropped when the queue is full
+    FrameDelta      // may be dropped, refers to the frame before - dropped together with it
+};
+
+// A pending message, sent as text or binary websocket frame
+struct ConnectionMessage
+{
+    ConnectionPayload     data;
+    bool                  binary;
+    ConnectionMessageKind kind;
+};
+
+// Represents a client connection - guarded by the connections mutex of WebSocketServer
 class Connection
 {
-    queue<string>       buffer;     // Ordered list of pending messages to flush out when socket is writable
+    deque<ConnectionMessage> buffer;     // Ordered list of pending messages to flush out when socket is writable
+    size_t             dropped{0};       // frames dropped since take_dropped()
     map<string,string> keyValueMap;
+    uint64_t           id{0};            // unique per connection - socket fds are reused
     time_t             createTime;
     string user{"anonymous"};
 
@@ -45,14 +76,21 @@ public:
 
     time_t getCreateTime() const;
 
+    uint64_t getId() const;
+
+    void setId(uint64_t id);
+
     void setCreateTime(time_t createTime);
 
     const string &getUser() const;
 
-    queue<string> * getBuffer();
-
     void setUser(const string &user);
     void push_to_buffer(const string & buffer);
+    // false if the message could not be queued (a delta frame whose reference frame was dropped)
+    bool push_to_buffer(const ConnectionPayload & data, bool binary, ConnectionMessageKind kind);
+    bool pop_from_buffer(ConnectionMessage & message);
+    bool has_pending() const;
+    size_t take_dropped();
     string& operator[](const string & key);
 };
 
@@ -72,9 +110,21 @@ public:
 
     void run(       uint64_t timeout = 50     );
     void wait(      uint64_t timeout = 50     );
+
+    // libwebsockets event loop on its own thread; all callbacks (onConnect, onMessage, ...) run on it
+    void startService( uint64_t timeout = 1000 );
+    void stopService( );
+
+    // send / broadcast may be called from any thread, the service thread is woken up to write
     void send(      int socketID, const string& data );
+    void send(      int socketID, const ConnectionPayload& data, bool binary, ConnectionMessageKind kind );
+    void send_binary( int socketID, const string& data );
     void broadcast( const string& data               );
     void broadcast_log(const string& data);
+    void broadcast_metrics(const string& json_data);
+
+    // true if the message was queued; frames dropped since the last call are added to dropped
+    bool send_frame(  int socketID, const ConnectionPayload& data, bool binary, bool delta, size_t& dropped );
 
     // Key => value storage for each connection
     string getValue( int socketID, const string& name );
@@ -89,30 +139,72 @@ public:
 
 
     // Wrappers, so we can take care of some maintenance
-    void onConnectWrapper(    int socketID );
+    void onConnectWrapper(    int socketID, struct lws *wsi = nullptr );
     void onDisconnectWrapper( int socketID );
     void onErrorWrapper( int socketID, const string& message );
+    void onWritable( struct lws *wsi );
+    void onWakeup( struct lws *wsi );
 
     /**
      * Try to authenticate the user against the user database.
+     * The Argon2 verification runs on the auth worker pool, the result (with a session token on success) is sent
+     * to the connection when it is done.
      * @param socketId socket id (if it is a positive integer, we will notify the user)
      * @param user user name
      * @param pass user password
-     * @return true on success
+     * @return true if the verification was started
      */
     bool authenticate(int socketId, const std::string & user, const std::string & pass);
 
+    /**
+     * Authenticate with a session token of an earlier login - no Argon2 run.
+     * @return true on success
+     */
+    bool authenticate_token(int socketId, const std::string & token);
+
+    /**
+     * Auth worker pool size, waiting verifications and session token lifetime - call before startService().
+     */
+    void setAuth(unsigned int workers, size_t max_pending, uint32_t token_lifetime_s);
+
+    /**
+     * Read the user database again (also done on the next login when the file has changed).
+     * @return true if the file was read
+     */
+    bool reloadUsers();
+
 protected:
     // Nothing, yet.
 
     map<string, User> users;
+
+    // connections map and the Connection objects; recursive as log messages are broadcast from inside
+    recursive_mutex      _connections_mutex;
+
 private:
     int                  _port;
     string               _keyPath;
     string               _certPath;
     struct lws_context  *_context;
 
+    thread              *_service_thread{nullptr};
+    atomic_bool          _service_stop{false};
+    atomic_bool          _wakeup_pending{false};
+    vector<unsigned char> _write_buffer;
+
+    uint64_t             _next_connection_id{1};
+
+    string               _users_file{"users.json"};
+    filesystem::file_time_type _users_mtime{};
+
+    unique_ptr<AuthWorkerPool> _auth_pool;
+    SessionTokens        _tokens;
+
+    void _wakeup( );
     void _removeConnection( int socketID );
+    void _reloadUsersIfChanged( );
+    void _authResult( int socketId, uint64_t connectionId, const string & user, const string & hash, bool ok );
+    void _authSuccess( int socketId, const string & user );
 };
 
 extern WebSocketServer *webSocketServer;
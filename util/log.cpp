@@ -2,13 +2,16 @@
 #include "spdlog/sinks/base_sink.h"
 #include "spdlog/sinks/rotating_file_sink.h"
 #include <mutex>
+#include <nlohmann/json.hpp>
 #include "WebSocketServer.h"
+#include "Metrics.h"
 
 std::shared_ptr<spdlog::logger> Log::s_RadioLogger;
 std::shared_ptr<spdlog::logger> Log::s_PhyLogger;
 std::shared_ptr<spdlog::logger> Log::s_TestLogger;
 std::shared_ptr<spdlog::logger> Log::s_WebLogger;
 std::shared_ptr<spdlog::logger> Log::s_AppLogger;
+std::shared_ptr<spdlog::details::thread_pool> Log::s_threadPool;
 
 /**
  * A sink for spdlog to allow sending log messages to the frontend via websockets.
@@ -49,6 +52,14 @@ void WebSocketSink<Mutex>::sink_it_(const spdlog::details::log_msg &msg)
     }
 }
 
+void from_json(const nlohmann::json& j, LogConfig& config)
+{
+    config.async = j.value("ASYNC", config.async);
+    config.queue_size = j.value("QUEUE_SIZE", config.queue_size);
+    config.overflow_block = j.value("OVERFLOW", config.overflow_block ? "block" : "overrun_oldest") == "block";
+    config.levels = j.value("LEVELS", config.levels);
+}
+
 void Log::Init()
 {
     Init(0);
@@ -149,3 +160,97 @@ void Log::Init(int level, spdlog::filename_t logfile_name)
             break;
     }
 }
+
+std::shared_ptr<spdlog::logger>* Log::logger(const std::string& name)
+{
+    if (name == "RADIO")
+        return &s_RadioLogger;
+    if (name == "PHY")
+        return &s_PhyLogger;
+    if (name == "TEST")
+        return &s_TestLogger;
+    if (name == "WEB")
+        return &s_WebLogger;
+    if (name == "APP")
+        return &s_AppLogger;
+    return nullptr;
+}
+
+/**
+ * @brief the logger of each subsystem is created again on the same sinks (and with the same level), async on
+ *        pool or sync without pool
+ */
+static void rebuildLoggers(const std::vector<std::shared_ptr<spdlog::logger>*>& loggers,
+                           const std::shared_ptr<spdlog::details::thread_pool>& pool, spdlog::async_overflow_policy policy)
+{
+    for (auto logger : loggers)
+    {
+        const auto& old = *logger;
+        std::shared_ptr<spdlog::logger> created;
+        if (pool != nullptr)
+            created = std::make_shared<spdlog::async_logger>(old->name(), old->sinks().begin(), old->sinks().end(), pool, policy);
+        else
+            created = std::make_shared<spdlog::logger>(old->name(), old->sinks().begin(), old->sinks().end());
+        created->set_level(old->level());
+        created->flush_on(old->flush_level());
+        old->flush();
+
+        // registered for flush_every() - the APP logger of Init() is registered already
+        spdlog::drop(old->name());
+        spdlog::register_logger(created);
+
+        *logger = created;
+    }
+}
+
+void Log::Configure(const LogConfig& config)
+{
+    const std::vector<std::shared_ptr<spdlog::logger>*> loggers = {&s_RadioLogger, &s_PhyLogger, &s_TestLogger, &s_WebLogger, &s_AppLogger};
+
+    if (config.async && s_threadPool == nullptr)
+    {
+        s_threadPool = std::make_shared<spdlog::details::thread_pool>(config.queue_size, 1);
+        rebuildLoggers(loggers, s_threadPool, config.overflow_block ? spdlog::async_overflow_policy::block : spdlog::async_overflow_policy::overrun_oldest);
+        spdlog::flush_every(std::chrono::seconds(LOG_ASYNC_FLUSH_S));
+
+        // weak - Shutdown() releases the pool
+        std::weak_ptr<spdlog::details::thread_pool> pool = s_threadPool;
+        Metrics::instance().gauge("log_async_overrun_total", "log messages dropped by the full async queue").setCallback([pool]() {
+            auto p = pool.lock();
+            return p != nullptr ? (int64_t)p->overrun_counter() : 0;
+        });
+        Metrics::instance().gauge("log_async_queue_size", "log messages waiting in the async queue").setCallback([pool]() {
+            auto p = pool.lock();
+            return p != nullptr ? (int64_t)p->queue_size() : 0;
+        });
+    }
+
+    for (const auto& level : config.levels)
+    {
+        if (!setLevel(level.first, level.second))
+            LOG_APP_WARN("Log::Configure() unknown subsystem {}", level.first);
+    }
+
+    LOG_APP_INFO("Logging {} (queue {} messages, {}), compile-time level {}", config.async ? "async" : "sync", config.queue_size,
+                 config.overflow_block ? "block" : "overrun oldest", SPDLOG_ACTIVE_LEVEL);
+}
+
+bool Log::setLevel(const std::string& name, const std::string& level)
+{
+    auto logger = Log::logger(name);
+    if (logger == nullptr || *logger == nullptr)
+        return false;
+
+    (*logger)->set_level(spdlog::level::from_str(level));
+    return true;
+}
+
+void Log::Shutdown()
+{
+    if (s_threadPool == nullptr)
+        return;
+
+    // back to sync loggers - the pool drains the queue and joins its thread when it is released
+    rebuildLoggers({&s_RadioLogger, &s_PhyLogger, &s_TestLogger, &s_WebLogger, &s_AppLogger}, nullptr, spdlog::async_overflow_policy::block);
+    s_threadPool.reset();
+}
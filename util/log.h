@@ -1,11 +1,41 @@
 #pragma once
 
+// compile-time minimum level of the LOG_* macros - calls below it compile to nothing (no argument evaluation, no
+// level check); set via CMake (RPX_LOG_ACTIVE_LEVEL), Release builds drop TRACE and DEBUG
+#ifndef SPDLOG_ACTIVE_LEVEL
+#define SPDLOG_ACTIVE_LEVEL SPDLOG_LEVEL_TRACE
+#endif
+
 #include <memory>
+#include <map>
+#include <string>
 #include "spdlog/spdlog.h"
+#include "spdlog/async.h"
 #include "spdlog/sinks/stdout_color_sinks.h"
 #include "spdlog/sinks/rotating_file_sink.h"
 
+#include <nlohmann/json_fwd.hpp>
+
 #define DEFAULT_RPX100_LOG_FILE "/var/log/RPX-100.log"
+#define LOG_ASYNC_QUEUE_SIZE    8192        // messages of the async queue
+#define LOG_ASYNC_FLUSH_S       1           // async loggers are flushed at least every LOG_ASYNC_FLUSH_S seconds
+
+
+/**
+ * LogConfig
+ *
+ * @note logging mode and per subsystem levels (SystemConfig "Log") - see Log::Configure()
+ *
+ */
+struct LogConfig {
+    bool async = false;                         // messages are formatted and written by a background thread
+    size_t queue_size = LOG_ASYNC_QUEUE_SIZE;
+    bool overflow_block = false;                // full queue: block the caller (true) or drop the oldest message
+    std::map<std::string, std::string> levels;  // "RADIO", "PHY", "WEB", "APP", "TEST" -> "trace" .. "off"
+};
+
+// SystemConfig "Log" - missing keys keep the defaults
+void from_json(const nlohmann::json& j, LogConfig& config);
 
 class Log {
 public:
@@ -14,6 +44,32 @@ public:
     static void Init(int level);
     static void Init(int level, spdlog::filename_t logfile_name);
 
+    /**
+     * @brief switch to async loggers and set the levels of the subsystems - call after Init(), before the worker
+     *        threads are started (the loggers are created again)
+     *
+     * @note async: a bounded queue of LogConfig::queue_size messages and one writer thread; with overflow_block false
+     *       a full queue drops the oldest message (log_async_overrun_total) - a hot path never waits for the console
+     * @note the loggers are replaced without synchronization (the LOG_* macros read them without a lock), i.e. no
+     *       other thread may log during Configure() and Shutdown()
+     */
+    static void Configure(const LogConfig& config);
+
+    /**
+     * @brief runtime level of a subsystem ("RADIO", "PHY", "WEB", "APP", "TEST")
+     *
+     * @param name subsystem
+     * @param level spdlog level name ("trace", "debug", "info", "warning", "error", "critical", "off")
+     * @return false for an unknown subsystem
+     */
+    static bool setLevel(const std::string& name, const std::string& level);
+
+    /**
+     * @brief drain the async queue and stop the writer thread - call before exit, after all threads which log are
+     *        joined (see Configure())
+     */
+    static void Shutdown();
+
     static inline std::shared_ptr<spdlog::logger>& getRadioLogger() { return s_RadioLogger; }
     static inline std::shared_ptr<spdlog::logger>& getPhyLogger() { return s_PhyLogger; }
     static inline std::shared_ptr<spdlog::logger>& getTestLogger() { return s_TestLogger; }
@@ -27,34 +83,70 @@ private:
     static std::shared_ptr<spdlog::logger> s_TestLogger;
     static std::shared_ptr<spdlog::logger> s_WebLogger;
     static std::shared_ptr<spdlog::logger> s_AppLogger;
+
+    static std::shared_ptr<spdlog::details::thread_pool> s_threadPool;
+
+    // logger of a subsystem name - nullptr if unknown
+    static std::shared_ptr<spdlog::logger>* logger(const std::string& name);
 };
 
-#define LOG_RADIO_WARN(...)    Log::getRadioLogger()->warn(__VA_ARGS__)
-#define LOG_RADIO_INFO(...)    Log::getRadioLogger()->info(__VA_ARGS__)
-#define LOG_RADIO_ERROR(...)   Log::getRadioLogger()->error(__VA_ARGS__)
-#define LOG_RADIO_TRACE(...)   Log::getRadioLogger()->trace(__VA_ARGS__)
-#define LOG_RADIO_DEBUG(...)   Log::getRadioLogger()->debug(__VA_ARGS__)
-
-#define LOG_PHY_WARN(...)      Log::getPhyLogger()->warn(__VA_ARGS__)
-#define LOG_PHY_INFO(...)      Log::getPhyLogger()->info(__VA_ARGS__)
-#define LOG_PHY_ERROR(...)     Log::getPhyLogger()->error(__VA_ARGS__)
-#define LOG_PHY_TRACE(...)     Log::getPhyLogger()->trace(__VA_ARGS__)
-#define LOG_PHY_DEBUG(...)     Log::getPhyLogger()->debug(__VA_ARGS__)
-
-#define LOG_TEST_WARN(...)      Log::getTestLogger()->warn(__VA_ARGS__)
-#define LOG_TEST_INFO(...)      Log::getTestLogger()->info(__VA_ARGS__)
-#define LOG_TEST_ERROR(...)     Log::getTestLogger()->error(__VA_ARGS__)
-#define LOG_TEST_TRACE(...)     Log::getTestLogger()->trace(__VA_ARGS__)
-#define LOG_TEST_DEBUG(...)     Log::getTestLogger()->debug(__VA_ARGS__)
-
-#define LOG_WEB_WARN(...)      Log::getWebLogger()->warn(__VA_ARGS__)
-#define LOG_WEB_INFO(...)      Log::getWebLogger()->info(__VA_ARGS__)
-#define LOG_WEB_ERROR(...)     Log::getWebLogger()->error(__VA_ARGS__)
-#define LOG_WEB_TRACE(...)     Log::getWebLogger()->trace(__VA_ARGS__)
-#define LOG_WEB_DEBUG(...)     Log::getWebLogger()->debug(__VA_ARGS__)
-
-#define LOG_APP_WARN(...)      Log::getAppLogger()->warn(__VA_ARGS__)
-#define LOG_APP_INFO(...)      Log::getAppLogger()->info(__VA_ARGS__)
-#define LOG_APP_ERROR(...)     Log::getAppLogger()->error(__VA_ARGS__)
-#define LOG_APP_TRACE(...)     Log::getAppLogger()->trace(__VA_ARGS__)
-#define LOG_APP_DEBUG(...)     Log::getAppLogger()->debug(__VA_ARGS__)
+// arguments of a compiled out call - referenced in an unevaluated sizeof only, i.e. no code and no unused warnings for
+// values which only go into a log call (e.g. TRACE timings in an INFO build)
+template <typename... Args> inline int rpx_log_unused(const Args&...) { return 0; }
+
+// one call per level - compiled out below SPDLOG_ACTIVE_LEVEL, filtered by the runtime level of the logger otherwise
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_TRACE
+#define RPX_LOG_TRACE(logger, ...)     (logger)->trace(__VA_ARGS__)
+#else
+#define RPX_LOG_TRACE(logger, ...)     (void)sizeof(rpx_log_unused(__VA_ARGS__))
+#endif
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+#define RPX_LOG_DEBUG(logger, ...)     (logger)->debug(__VA_ARGS__)
+#else
+#define RPX_LOG_DEBUG(logger, ...)     (void)sizeof(rpx_log_unused(__VA_ARGS__))
+#endif
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_INFO
+#define RPX_LOG_INFO(logger, ...)      (logger)->info(__VA_ARGS__)
+#else
+#define RPX_LOG_INFO(logger, ...)      (void)sizeof(rpx_log_unused(__VA_ARGS__))
+#endif
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_WARN
+#define RPX_LOG_WARN(logger, ...)      (logger)->warn(__VA_ARGS__)
+#else
+#define RPX_LOG_WARN(logger, ...)      (void)sizeof(rpx_log_unused(__VA_ARGS__))
+#endif
+#if SPDLOG_ACTIVE_LEVEL <= SPDLOG_LEVEL_ERROR
+#define RPX_LOG_ERROR(logger, ...)     (logger)->error(__VA_ARGS__)
+#else
+#define RPX_LOG_ERROR(logger, ...)     (void)sizeof(rpx_log_unused(__VA_ARGS__))
+#endif
+
+#define LOG_RADIO_WARN(...)    RPX_LOG_WARN(Log::getRadioLogger(), __VA_ARGS__)
+#define LOG_RADIO_INFO(...)    RPX_LOG_INFO(Log::getRadioLogger(), __VA_ARGS__)
+#define LOG_RADIO_ERROR(...)   RPX_LOG_ERROR(Log::getRadioLogger(), __VA_ARGS__)
+#define LOG_RADIO_TRACE(...)   RPX_LOG_TRACE(Log::getRadioLogger(), __VA_ARGS__)
+#define LOG_RADIO_DEBUG(...)   RPX_LOG_DEBUG(Log::getRadioLogger(), __VA_ARGS__)
+
+#define LOG_PHY_WARN(...)      RPX_LOG_WARN(Log::getPhyLogger(), __VA_ARGS__)
+#define LOG_PHY_INFO(...)      RPX_LOG_INFO(Log::getPhyLogger(), __VA_ARGS__)
+#define LOG_PHY_ERROR(...)     RPX_LOG_ERROR(Log::getPhyLogger(), __VA_ARGS__)
+#define LOG_PHY_TRACE(...)     RPX_LOG_TRACE(Log::getPhyLogger(), __VA_ARGS__)
+#define LOG_PHY_DEBUG(...)     RPX_LOG_DEBUG(Log::getPhyLogger(), __VA_ARGS__)
+
+#define LOG_TEST_WARN(...)      RPX_LOG_WARN(Log::getTestLogger(), __VA_ARGS__)
+#define LOG_TEST_INFO(...)      RPX_LOG_INFO(Log::getTestLogger(), __VA_ARGS__)
+#define LOG_TEST_ERROR(...)     RPX_LOG_ERROR(Log::getTestLogger(), __VA_ARGS__)
+#define LOG_TEST_TRACE(...)     RPX_LOG_TRACE(Log::getTestLogger(), __VA_ARGS__)
+#define LOG_TEST_DEBUG(...)     RPX_LOG_DEBUG(Log::getTestLogger(), __VA_ARGS__)
+
+#define LOG_WEB_WARN(...)      RPX_LOG_WARN(Log::getWebLogger(), __VA_ARGS__)
+#define LOG_WEB_INFO(...)      RPX_LOG_INFO(Log::getWebLogger(), __VA_ARGS__)
+#define LOG_WEB_ERROR(...)     RPX_LOG_ERROR(Log::getWebLogger(), __VA_ARGS__)
+#define LOG_WEB_TRACE(...)     RPX_LOG_TRACE(Log::getWebLogger(), __VA_ARGS__)
+#define LOG_WEB_DEBUG(...)     RPX_LOG_DEBUG(Log::getWebLogger(), __VA_ARGS__)
+
+#define LOG_APP_WARN(...)      RPX_LOG_WARN(Log::getAppLogger(), __VA_ARGS__)
+#define LOG_APP_INFO(...)      RPX_LOG_INFO(Log::getAppLogger(), __VA_ARGS__)
+#define LOG_APP_ERROR(...)     RPX_LOG_ERROR(Log::getAppLogger(), __VA_ARGS__)
+#define LOG_APP_TRACE(...)     RPX_LOG_TRACE(Log::getAppLogger(), __VA_ARGS__)
+#define LOG_APP_DEBUG(...)     RPX_LOG_DEBUG(Log::getAppLogger(), __VA_ARGS__)
@@ -0,0 +1,41 @@
+#include "util/thread_sched.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+
+bool thread_sched_apply(const std::string& name, const ThreadSched& sched) {
+
+    bool ok = true;
+    pthread_t self = pthread_self();
+
+    pthread_setname_np(self, name.substr(0, 15).c_str());
+
+    if (sched.cpu >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(sched.cpu, &cpuset);
+
+        int err = pthread_setaffinity_np(self, sizeof(cpu_set_t), &cpuset);
+        if (err != 0) {
+            LOG_APP_WARN("thread_sched_apply() {} cannot pin to cpu {}: {}", name, sched.cpu, strerror(err));
+            ok = false;
+        }
+    }
+
+    if (sched.fifo_priority > 0) {
+        struct sched_param param;
+        param.sched_priority = sched.fifo_priority;
+
+        int err = pthread_setschedparam(self, SCHED_FIFO, &param);
+        if (err != 0) {
+            LOG_APP_WARN("thread_sched_apply() {} cannot set SCHED_FIFO priority {}: {}", name, sched.fifo_priority, strerror(err));
+            ok = false;
+        }
+    }
+
+    LOG_APP_INFO("thread_sched_apply() {} cpu {} fifo priority {}", name, sched.cpu, sched.fifo_priority);
+
+    return ok;
+}
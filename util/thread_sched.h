@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+
+#include "util/log.h"
+
+
+/**
+ * ThreadSched
+ *
+ * @note CPU affinity and real time priority of a worker thread (SystemConfig "Threads" section)
+ *
+ */
+struct ThreadSched {
+    int cpu = -1;               // core the thread is pinned to, -1 keeps the default affinity
+    int fifo_priority = 0;      // SCHED_FIFO priority 1..99, 0 keeps SCHED_OTHER
+};
+
+
+/**
+ * @brief name the calling thread and apply affinity / SCHED_FIFO priority
+ *
+ * @note SCHED_FIFO needs CAP_SYS_NICE (or an rtprio limit) - a failure is logged and the thread keeps running
+ *       with the default policy
+ *
+ * @param name thread name (max 15 characters are shown by top/htop)
+ * @param sched
+ * @return true if all settings were applied
+ */
+bool thread_sched_apply(const std::string& name, const ThreadSched& sched);
@@ -42,6 +42,10 @@ wsSpectrogram::wsSpectrogram(int port) : WebSocketServer(port) {
 
     m_isWsRunning.store(false);
     m_socketsOn.store(false);
+
+    m_spectrum.setCallback([this](const SpectrumConfig& config, const float *psd, uint64_t timestamp) {
+        send_spectrum(config, psd, timestamp);
+    });
     // three blocks of mock data - delete in production
     { // shorten variable scope using the block - IPv4 Only
         neighborCacheEntry cacheEntry;
@@ -80,8 +84,6 @@ wsSpectrogram::wsSpectrogram(int port) : WebSocketServer(port) {
 
 wsSpectrogram::~wsSpectrogram() {
 
-    WebSocketServer::~WebSocketServer();
-
     terminated.store(false);
     stopping.store(false);
 
@@ -120,92 +122,151 @@ void wsSpectrogram::run() {
 
     LOG_TEST_DEBUG("wsSpectrogram::run()");
 
-    m_IQdataQueue = std::static_pointer_cast<RadioThreadIQDataQueue>(wsSpectrogram::getQueue());
+    m_IQdataQueue = wsSpectrogram::getQueue();
 
     LOG_TEST_DEBUG("wsSpectrogram::run() m_IQdataQueue use_cout {}", m_IQdataQueue.use_count());
 
-    // options
-    unsigned int nfft        =  512;    // transform size
+    // the websocket is serviced on its own thread, the frames are handed over through the connection queues
+    WebSocketServer::startService();
 
     while(!stopping)
     {
+        if(!m_IQdataQueue->wait_pop(m_IQdataOut, WS_SPECTROGRAM_WAIT_MS))
+            continue;
+
+        // the engine drops the blocks right away while no session is connected and computes the PSD once per
+        // frame for all sessions otherwise; it is only used by this thread - the session changes of the service
+        // thread are applied here, m_onSockets_mutex is only held for them and for the send of a frame
+        apply_spectrum_changes();
+        do {
+            m_spectrum.push(m_IQdataOut);
+        } while(m_IQdataQueue->pop(m_IQdataOut));
+        m_IQdataOut.reset();
+    }
 
-        //poll the websocket .. this would normally be done by WebSocketServer::run()
-        WebSocketServer::wait(-1);  //hack ?? timeout = 0 does not work is blocking
+    WebSocketServer::stopService();
 
+    m_isWsRunning.store(false);
+    LOG_TEST_DEBUG("wsSpectrogram::run() done");
+}
 
-        m_IQdataOut = std::make_shared<RadioThreadIQData>();
 
-    //    LOG_TEST_DEBUG("wsSpectrogram::run() queue size {}", m_IQdataQueue->size());
+void wsSpectrogram::apply_spectrum_changes() {
 
-        if(m_IQdataQueue->size() > 5) {
+    std::vector<std::pair<bool, SpectrumConfig>> changes;
+    {
+        std::lock_guard < std::mutex > lock(m_onSockets_mutex);
+        changes.swap(m_spectrum_changes);
+    }
 
-            m_IQdataQueue->pop(m_IQdataOut);
+    for (const auto& change : changes) {
+        if (change.first)
+            m_spectrum.addConsumer(change.second);
+        else
+            m_spectrum.removeConsumer(change.second);
+    }
+}
 
-            liquid_float_complex x[m_IQdataOut->data.size()];
 
+SpectrumConfig wsSpectrogram::add_consumer(const SpectrumConfig& config) {
 
+    const SpectrumConfig c = SpectrumEngine::normalize(config);
+    m_spectrum_changes.emplace_back(true, c);
+    return c;
+}
 
-            unsigned int i = 0;
-            for(auto sample: m_IQdataOut->data)
-            {
-                // x[i].real(sample.real());
-                // x[i].imag(sample.imag());
-                x[i] = sample;
-                i++;
-            }
-            if(m_socketsOn) {
-    
-                std::lock_guard < std::mutex > lock(m_onSockets_mutex);           
-
-                float sp_psd[nfft];
-
-                // initialize objects
-                spgramcf q = spgramcf_create_default(nfft);
-
-
-                // write block of samples to the spectrogram object
-                spgramcf_write(q, x, m_IQdataOut->data.size());
-
-                // print result to screen
-                spgramcf_get_psd(q, sp_psd);
-
-                // Handle SDR FFT
-                m_msgSOCKET.clear();
-                m_msgSOCKET.str("");
-                m_msgSOCKET << "{\"center\":[";
-                m_msgSOCKET << m_rxFreq;
-                m_msgSOCKET << "],";
-                m_msgSOCKET << "\"span\":[";
-                m_msgSOCKET << m_span;
-                m_msgSOCKET << "],";
-                // m_msgSOCKET << "\"txFreq\":[";
-                // m_msgSOCKET << m_txFreq;
-                // m_msgSOCKET << "],";
-                m_msgSOCKET << "\"s\":[";
-
-                int j = 0;
-
-                while (j < nfft)
-                {
-                    m_msgSOCKET << std::to_string((int)sp_psd[i]);
-                    if (j < nfft - 1)
-                    {
-                        m_msgSOCKET << ",";
-                    }
-                    j++;
-                }
-                m_msgSOCKET << "]}";
-                // msgSOCKET.seekp(-1, std::ios_base::end);
-                broadcast(m_msgSOCKET.str());
 
-                spgramcf_destroy(q);
+void wsSpectrogram::remove_consumer(const SpectrumConfig& config) {
+
+    m_spectrum_changes.emplace_back(false, config);
+}
+
+
+void wsSpectrogram::send_spectrum(const SpectrumConfig& config, const float *psd, uint64_t timestamp) {
+
+    // callback of m_spectrum.push() - the sessions are changed by the service thread
+    std::lock_guard < std::mutex > lock(m_onSockets_mutex);
+
+    // the JSON text and the quantized bins are built once per frame and config for all sessions which use them
+    size_t dropped = 0;
+    bool json = false;
+    bool binary[3] = {false, false, false};
+    for (auto& session : m_spectrum_sessions) {
+        if (session.second.config == config) {
+            if (session.second.encoding == SpectrumEncoding::JSON)
+                json = true;
+            else
+                binary[(int) session.second.encoding] = true;
+        }
+    }
+
+    if (json) {
+        m_msgSOCKET.clear();
+        m_msgSOCKET.str("");
+        m_msgSOCKET << "{\"center\":[";
+        m_msgSOCKET << m_rxFreq;
+        m_msgSOCKET << "],";
+        m_msgSOCKET << "\"span\":[";
+        m_msgSOCKET << m_span;
+        m_msgSOCKET << "],";
+        // m_msgSOCKET << "\"txFreq\":[";
+        // m_msgSOCKET << m_txFreq;
+        // m_msgSOCKET << "],";
+        m_msgSOCKET << "\"s\":[";
+
+        for (unsigned int j = 0; j < config.nfft; j++) {
+            m_msgSOCKET << (int)psd[j];
+            if (j < config.nfft - 1)
+                m_msgSOCKET << ",";
+        }
+        m_msgSOCKET << "]}";
+
+        // one payload shared by all JSON sessions
+        const ConnectionPayload msg = std::make_shared<const std::string>(m_msgSOCKET.str());
+        for (auto& session : m_spectrum_sessions) {
+            if (session.second.config == config && session.second.encoding == SpectrumEncoding::JSON)
+                send_frame(session.first, msg, false, false, dropped);
+        }
+    }
+
+    for (SpectrumEncoding encoding : {SpectrumEncoding::U8, SpectrumEncoding::I16}) {
+        if (!binary[(int) encoding])
+            continue;
+
+        spectrum_quantize(encoding, psd, config.nfft, m_spectrum_bins);
+
+        // delta coding is per session, each has its own previous frame
+        for (auto& session : m_spectrum_sessions) {
+            if (session.second.config == config && session.second.encoding == encoding) {
+                std::string frame;
+                const bool delta = session.second.encoder.encode(m_spectrum_bins, config.nfft, m_rxFreq, m_span,
+                                                                 timestamp, frame);
+                // a slow client drops frames - after a broken delta chain the next frame is a key frame
+                if (!send_frame(session.first, std::make_shared<const std::string>(std::move(frame)), true, delta,
+                                dropped))
+                    session.second.encoder.reset();
             }
         }
     }
 
-    m_isWsRunning.store(false);
-    LOG_TEST_DEBUG("wsSpectrogram::run() done");
+    if (dropped > 0)
+        m_metric_dropped.add(dropped);
+}
+
+
+void wsSpectrogram::set_session_format(SpectrumSession& session, const std::string& format, bool delta) {
+
+    session.encoding = spectrumEncodingFromString(format);
+    session.encoder = SpectrumFrameEncoder(session.encoding, delta && session.encoding != SpectrumEncoding::JSON);
+}
+
+
+void wsSpectrogram::setSpectrum(unsigned int fps, const SpectrumConfig& config) {
+    std::lock_guard < std::mutex > lock(m_onSockets_mutex);
+    m_spectrum.setFrameRate(fps);
+    m_spectrum_default = SpectrumEngine::normalize(config);
+    LOG_TEST_INFO("wsSpectrogram::setSpectrum() {} fps nfft {} average {} ms", m_spectrum.getFrameRate(),
+                  m_spectrum_default.nfft, m_spectrum_default.average_ms);
 }
 
 
@@ -235,14 +296,31 @@ void wsSpectrogram::onConnect(int socketID) {
     std::lock_guard < std::mutex > lock(m_onSockets_mutex);
     LOG_TEST_INFO("wsSpectrogram::onConnect() socketID # {} ", socketID);
 
+    if (m_spectrum_sessions.count(socketID) == 0) {
+        // the query arguments of the connect request are kept as connection values by WebSocketServer
+        SpectrumSession& session = m_spectrum_sessions[socketID];
+        SpectrumConfig config = m_spectrum_default;
+        try {
+            if (!getValue(socketID, "nfft").empty())
+                config.nfft = std::stoul(getValue(socketID, "nfft"));
+            if (!getValue(socketID, "average_ms").empty())
+                config.average_ms = std::stoul(getValue(socketID, "average_ms"));
+        } catch (std::exception & exception) {
+            LOG_TEST_ERROR("wsSpectrogram::onConnect() socketID # {} invalid spectrum argument", socketID);
+        }
+        session.config = add_consumer(config);
+        set_session_format(session, getValue(socketID, "format"), getValue(socketID, "delta") == "1");
+
+        LOG_TEST_INFO("wsSpectrogram::onConnect() socketID # {} spectrum {} {}nfft {} average {} ms", socketID,
+                      spectrumEncodingToString(session.encoding), session.encoder.getDelta() ? "delta " : "",
+                      session.config.nfft, session.config.average_ms);
+    }
+
     m_socketsOn.store(true);
 }
 
 void wsSpectrogram::onMessage(int socketID, const string& data) {
 
-
-    LOG_TEST_INFO("User click: {} ", data);
-
     nlohmann::json json_data;
     try {
         json_data = nlohmann::json::parse(data);
@@ -256,8 +334,16 @@ void wsSpectrogram::onMessage(int socketID, const string& data) {
         return;
     }
     std::string cmd = json_data["cmd"];
+
+    // passwords and session tokens stay out of the log (it is broadcast to read_log users)
+    if (cmd != "authenticate")
+        LOG_TEST_INFO("User click: {} ", data);
+
     if (cmd == "authenticate") {
-        if (json_data.contains("user") && json_data["user"].is_string() &&
+        if (json_data.contains("token") && json_data["token"].is_string()) {
+            // reconnect with the token of an earlier login
+            authenticate_token(socketID, json_data["token"].get<std::string>());
+        } else if (json_data.contains("user") && json_data["user"].is_string() &&
             json_data.contains("password") && json_data["password"].is_string()) {
             std::string username{json_data["user"]};
             std::string password{json_data["password"]};
@@ -280,12 +366,50 @@ void wsSpectrogram::onMessage(int socketID, const string& data) {
             int arg = json_data["arg"].get<int>();
             LOG_TEST_INFO("arg value is {}", arg);
         }
+    } else if (cmd == "spectrum") {
+        // {"cmd": "spectrum", "nfft": 1024, "average_ms": 200, "format": "u8", "delta": true} - any field may be left out
+        std::lock_guard < std::mutex > lock(m_onSockets_mutex);
+        auto it = m_spectrum_sessions.find(socketID);
+        if (it != m_spectrum_sessions.end()) {
+            SpectrumSession& session = it->second;
+            SpectrumConfig config = session.config;
+            if (json_data.contains("nfft") && json_data["nfft"].is_number_unsigned())
+                config.nfft = json_data["nfft"].get<unsigned int>();
+            if (json_data.contains("average_ms") && json_data["average_ms"].is_number_unsigned())
+                config.average_ms = json_data["average_ms"].get<unsigned int>();
+
+            config = SpectrumEngine::normalize(config);
+            if (!(config == session.config)) {
+                remove_consumer(session.config);
+                session.config = add_consumer(config);
+            }
+
+            if ((json_data.contains("format") && json_data["format"].is_string()) ||
+                (json_data.contains("delta") && json_data["delta"].is_boolean())) {
+                std::string format = spectrumEncodingToString(session.encoding);
+                bool delta = session.encoder.getDelta();
+                if (json_data.contains("format") && json_data["format"].is_string())
+                    format = json_data["format"].get<std::string>();
+                if (json_data.contains("delta") && json_data["delta"].is_boolean())
+                    delta = json_data["delta"].get<bool>();
+                set_session_format(session, format, delta);
+            }
+
+            nlohmann::json j = {
+                {"spectrum", {{"nfft", session.config.nfft}, {"average_ms", session.config.average_ms},
+                              {"fps", m_spectrum.getFrameRate()},
+                              {"format", spectrumEncodingToString(session.encoding)},
+                              {"delta", session.encoder.getDelta()}}}
+            };
+            send(socketID, j.dump());
+        }
     } else if (cmd == "neighbor_cache") {
         if (json_data.contains("sub_cmd")) {
             if (json_data["sub_cmd"].is_string()) {
                 std::string sub_command{json_data["sub_cmd"]};
                 LOG_TEST_INFO("processing action {}", sub_command);
                 if (sub_command == "list") {
+                    std::lock_guard < std::recursive_mutex > lock(_connections_mutex);
                     auto & userName = this->connections[socketID]->getUser();
                     auto & user = this->users[userName];
                     if (user.hasPermission("read_neighbour_cache")) {
@@ -304,7 +428,13 @@ void wsSpectrogram::onDisconnect(int socketID) {
     std::lock_guard < std::mutex > lock(m_onSockets_mutex);
     LOG_TEST_INFO("wsSpectrogram::onDisconnect() socketID # {} ", socketID);
 
-    m_socketsOn.store(false);
+    auto session = m_spectrum_sessions.find(socketID);
+    if (session != m_spectrum_sessions.end()) {
+        remove_consumer(session->second.config);
+        m_spectrum_sessions.erase(session);
+    }
+
+    m_socketsOn.store(!m_spectrum_sessions.empty());
 
 }
 
@@ -14,11 +14,17 @@
 #include "phy/RadioThread.h"
 #include "util/log.h"
 #include "util/WebSocketServer.h"
+#include "util/SpectrumEngine.h"
+#include "util/SpectrumFrame.h"
 #include <nlohmann/json.hpp>
 
 
 #define SOCKET_TIMEOUT 50
 
+// max wait of the spectrum loop for an IQ block (stop latency)
+#define WS_SPECTROGRAM_WAIT_MS 100
+#define WS_SPECTROGRAM_QUEUE_DEPTH 64     // blocks the spectrum may lag behind the radio
+
 class neighborCacheEntry {
 public:
     unsigned char mac[6];
@@ -31,6 +37,16 @@ public:
     friend void from_json(const nlohmann::json& j, neighborCacheEntry& p);
 };
 
+/**
+ * @note spectrum settings of one websocket session; chosen with query arguments on connect
+ *       (ws://host:port/?format=u8&delta=1&nfft=1024&average_ms=200) or later with cmd "spectrum"
+ */
+struct SpectrumSession {
+    SpectrumConfig config;
+    SpectrumEncoding encoding = SpectrumEncoding::JSON;
+    SpectrumFrameEncoder encoder;
+};
+
 class wsSpectrogram : public WebSocketServer {
 public:
 
@@ -56,6 +72,13 @@ public:
     void setQueue(const ThreadIQDataQueueBasePtr& threadQueue);
     ThreadIQDataQueueBasePtr getQueue();
 
+    /**
+     * @brief frame rate of the spectrum and the config new sessions start with (cmd "spectrum" changes it per session)
+     *
+     * @note call before threadMain()
+     */
+    void setSpectrum(unsigned int fps, const SpectrumConfig& config);
+
     // Overridden by children
     void onConnect(    int socketID                        );
     void onMessage(    int socketID, const string& data    );
@@ -65,7 +88,7 @@ public:
 
 protected:
 
-    RadioThreadIQDataQueuePtr m_IQdataQueue;
+    ThreadIQDataQueueBasePtr m_IQdataQueue;
     ThreadIQDataQueueBasePtr m_IQdataQueueBase;
 
     RadioThreadIQDataPtr m_IQdataOut;
@@ -78,9 +101,26 @@ protected:
 
 private:
 
+    void send_spectrum(const SpectrumConfig& config, const float *psd, uint64_t timestamp);
+
+    void set_session_format(SpectrumSession& session, const std::string& format, bool delta);
+
+    // consumer changes of the sessions are queued (m_onSockets_mutex held) and applied to m_spectrum by run()
+    SpectrumConfig add_consumer(const SpectrumConfig& config);
+    void remove_consumer(const SpectrumConfig& config);
+    void apply_spectrum_changes();
+
 
     std::mutex m_onSockets_mutex;
 
+    SpectrumEngine m_spectrum;
+    SpectrumConfig m_spectrum_default;
+    std::map<int, SpectrumSession> m_spectrum_sessions;     // socketID -> spectrum settings of the session
+    std::vector<std::pair<bool, SpectrumConfig>> m_spectrum_changes;    // add (true) / remove of a consumer for run()
+    std::vector<uint8_t> m_spectrum_bins;
+
+    MetricCounter& m_metric_dropped = Metrics::instance().counter("spectrum_frames_dropped_total", "spectrum frames dropped for slow clients");
+
     std::atomic_bool terminated;
 
     int m_ConCurSocket;